@@ -3,6 +3,7 @@
 #include <magma_engine/Window.h>
 #include <magma_engine/ServiceLocater.h>
 #include <magma_engine/core/renderer/Renderer.h>
+#include <profiling/Profiler.h>
 
 #include "gui/GuiContext.h"
 #include "gui/GuiRenderer.h"
@@ -14,17 +15,22 @@
 int main()
 {
 	Magma::ServiceLocator::Register(std::make_shared<Magma::Window>());
-	Magma::ServiceLocator::Get<Magma::Window>()->OpenWindow({
+	Magma::ServiceLocator::Get<Magma::Window>().OpenWindow({
 		"Magma Editor",
 		1920,
 		1080
 	});
 
 	Magma::ServiceLocator::Register(std::make_shared<Magma::Renderer>());
-	Magma::ServiceLocator::Get<Magma::Renderer>()->Init();
+	Magma::ServiceLocator::Get<Magma::Renderer>().Init();
 
-	auto window = Magma::ServiceLocator::Get<Magma::Window>();
-	auto renderer = Magma::ServiceLocator::Get<Magma::Renderer>();
+	Magma::ServiceLocator::Freeze();
+
+	Magma::Window& window = Magma::ServiceLocator::Get<Magma::Window>();
+	Magma::Renderer& renderer = Magma::ServiceLocator::Get<Magma::Renderer>();
+
+	// The scene is only shown inside the viewport pane
+	renderer.SetCopyToSwapchain(false);
 
 	Magma::GuiContext guiContext(window, renderer);
 
@@ -34,22 +40,34 @@ int main()
 	guiRenderer.AddPane(std::make_unique<Magma::PropertiesPane>());
 	guiRenderer.AddPane(std::make_unique<Magma::SceneHierarchyPane>());
 
-	while (!window->ShouldClose())
+	MAGMA_PROFILE_THREAD("Main");
+
+	while (!window.ShouldClose())
 	{
-		window->Update();
+		MAGMA_PROFILE_ZONE("Editor frame");
+
+		window.Update();
 
-		renderer->BeginFrame();
-		renderer->RenderScene();
+		if (!renderer.BeginFrame())
+		{
+			// Nothing to present to while minimized, sleep until the window changes
+			if (window.IsMinimized())
+			{
+				window.WaitEvents();
+			}
+			continue;
+		}
+		renderer.RenderScene();
 
 		guiContext.BeginFrame();
 		guiRenderer.RenderAllPanes();
 		guiContext.EndFrame();
 
-		renderer->CopyToSwapchain();
-		renderer->BeginUIRenderPass();
-		guiContext.RenderToCommandBuffer(renderer->GetCurrentCommandBuffer());
-		renderer->EndFrame();
-		renderer->Present();
+		renderer.CopyToSwapchain();
+		renderer.BeginUIRenderPass();
+		guiContext.RenderToCommandBuffer(renderer.GetCurrentCommandBuffer());
+		renderer.EndFrame();
+		renderer.Present();
 	}
 
 	guiContext.Cleanup();
@@ -8,13 +8,14 @@
 #include <magma_engine/core/renderer/Renderer.h>
 #include <magma_engine/core/renderer/VkInitializers.h>
 #include <logging/Logger.h>
+#include <profiling/Profiler.h>
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
 namespace Magma
 {
-    GuiContext::GuiContext(std::shared_ptr<Window> window, std::shared_ptr<Renderer> renderer)
+    GuiContext::GuiContext(Window& window, Renderer& renderer)
         : m_window(window), m_renderer(renderer)
     {
         init_imgui();
@@ -52,7 +53,7 @@ namespace Magma
         pool_info.poolSizeCount = std::size(pool_sizes);
         pool_info.pPoolSizes = pool_sizes;
 
-        VK_CHECK(vkCreateDescriptorPool(m_renderer->GetDevice(), &pool_info, nullptr, &m_imguiDescriptorPool));
+        VK_CHECK(vkCreateDescriptorPool(m_renderer.GetDevice(), &pool_info, nullptr, &m_imguiDescriptorPool));
 
         IMGUI_CHECKVERSION();
         ImGui::CreateContext();
@@ -70,12 +71,12 @@ namespace Magma
             style.Colors[ImGuiCol_WindowBg].w = 1.0f;
         }
 
-        GLFWwindow* glfwWindow = ServiceLocator::Get<Window>()->GetGLFWWindow();
+        GLFWwindow* glfwWindow = m_window.GetGLFWWindow();
 
         ImGui_ImplGlfw_InitForVulkan(glfwWindow, true);
 
         // Configure dynamic rendering for ImGui
-        VkFormat colorFormat = m_renderer->GetSwapchainImageFormat();
+        VkFormat colorFormat = m_renderer.GetSwapchainImageFormat();
         VkPipelineRenderingCreateInfoKHR pipelineRenderingCreateInfo = {};
         pipelineRenderingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
         pipelineRenderingCreateInfo.colorAttachmentCount = 1;
@@ -83,11 +84,11 @@ namespace Magma
 
         // Initialize ImGui for Vulkan with dynamic rendering
         ImGui_ImplVulkan_InitInfo init_info = {};
-        init_info.Instance = m_renderer->GetInstance();
-        init_info.PhysicalDevice = m_renderer->GetPhysicalDevice();
-        init_info.Device = m_renderer->GetDevice();
-        init_info.QueueFamily = m_renderer->GetGraphicsQueueFamily();
-        init_info.Queue = m_renderer->GetGraphicsQueue();
+        init_info.Instance = m_renderer.GetInstance();
+        init_info.PhysicalDevice = m_renderer.GetPhysicalDevice();
+        init_info.Device = m_renderer.GetDevice();
+        init_info.QueueFamily = m_renderer.GetGraphicsQueueFamily();
+        init_info.Queue = m_renderer.GetGraphicsQueue();
         init_info.DescriptorPool = m_imguiDescriptorPool;
         init_info.MinImageCount = 3;
         init_info.ImageCount = 3;
@@ -98,11 +99,13 @@ namespace Magma
         ImGui_ImplVulkan_Init(&init_info);
 
         m_initialized = true;
-        Logger::Log(LogLevel::INFO, "ImGui initialized successfully");
+        MAGMA_LOG_INFO("ImGui initialized successfully");
     }
 
     void GuiContext::BeginFrame()
     {
+        MAGMA_PROFILE_ZONE("GuiContext::BeginFrame");
+
         ImGui_ImplVulkan_NewFrame();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
@@ -110,11 +113,15 @@ namespace Magma
 
     void GuiContext::EndFrame()
     {
+        MAGMA_PROFILE_ZONE("GuiContext::EndFrame");
+
         ImGui::Render();
     }
 
     void GuiContext::RenderToCommandBuffer(VkCommandBuffer cmd)
     {
+        MAGMA_PROFILE_ZONE("GuiContext::RenderToCommandBuffer");
+
         ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
 
         ImGuiIO& io = ImGui::GetIO();
@@ -129,16 +136,16 @@ namespace Magma
     {
         if (!m_initialized) return;
 
-        vkDeviceWaitIdle(m_renderer->GetDevice());
+        vkDeviceWaitIdle(m_renderer.GetDevice());
 
         ImGui_ImplVulkan_Shutdown();
         ImGui_ImplGlfw_Shutdown();
         ImGui::DestroyContext();
 
-        vkDestroyDescriptorPool(m_renderer->GetDevice(), m_imguiDescriptorPool, nullptr);
+        vkDestroyDescriptorPool(m_renderer.GetDevice(), m_imguiDescriptorPool, nullptr);
 
         m_initialized = false;
-        Logger::Log(LogLevel::INFO, "ImGui cleaned up");
+        MAGMA_LOG_INFO("ImGui cleaned up");
     }
 
     void GuiContext::shutdown_imgui()
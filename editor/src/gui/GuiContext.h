@@ -11,7 +11,7 @@ namespace Magma
     class GuiContext
     {
     public:
-        GuiContext(std::shared_ptr<Window> window, std::shared_ptr<Renderer> renderer);
+        GuiContext(Window& window, Renderer& renderer);
         ~GuiContext();
 
         void BeginFrame();
@@ -25,8 +25,8 @@ namespace Magma
         void shutdown_imgui();
 
     private:
-        std::shared_ptr<Window> m_window;
-        std::shared_ptr<Renderer> m_renderer;
+        Window& m_window;
+        Renderer& m_renderer;
         VkDescriptorPool m_imguiDescriptorPool;
         bool m_initialized = false;
     };
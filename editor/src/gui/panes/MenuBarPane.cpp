@@ -1,5 +1,6 @@
 #include "MenuBarPane.h"
 #include <imgui.h>
+#include <profiling/Profiler.h>
 
 namespace Magma
 {
@@ -30,6 +31,17 @@ namespace Magma
                 ImGui::EndMenu();
             }
 
+#if MAGMA_ENABLE_PROFILING
+            if (ImGui::BeginMenu("Tools"))
+            {
+                if (ImGui::MenuItem("Export Profiler Trace"))
+                {
+                    Profiler::ExportChromeTrace("magma_trace.json");
+                }
+                ImGui::EndMenu();
+            }
+#endif
+
             if (ImGui::BeginMenu("Help"))
             {
                 if (ImGui::MenuItem("About")) {}
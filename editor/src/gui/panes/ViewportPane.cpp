@@ -1,50 +1,89 @@
 #include "ViewportPane.h"
+#include <algorithm>
 #include <imgui.h>
 #include <backends/imgui_impl_vulkan.h>
 #include <magma_engine/core/renderer/Renderer.h>
 
 namespace Magma
 {
-    ViewportPane::ViewportPane(std::shared_ptr<Renderer> renderer)
+    ViewportPane::ViewportPane(Renderer& renderer)
         : m_renderer(renderer)
     {
     }
 
-    void ViewportPane::init_viewport_texture()
+    void ViewportPane::update_viewport_texture()
     {
-        if (m_textureInitialized) return;
+        m_viewportTextureID = VK_NULL_HANDLE;
 
-        // Create ImGui texture from the draw image
-        std::shared_ptr<AllocatedImage> drawImage = m_renderer->GetDrawImage();
+        std::shared_ptr<AllocatedImage> drawImage = m_renderer.GetDrawImage();
+        if (!drawImage)
+        {
+            return;
+        }
 
-        m_viewportTextureID = ImGui_ImplVulkan_AddTexture(
-            m_renderer->GetDrawImageSampler(),  // Use the proper sampler
-            drawImage->imageView,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-        );
+        auto it = m_textures.find(drawImage->imageView);
+        if (it == m_textures.end())
+        {
+            // Create ImGui texture from the draw image
+            VkDescriptorSet descriptorSet = ImGui_ImplVulkan_AddTexture(
+                m_renderer.GetDrawImageSampler(),  // Use the proper sampler
+                drawImage->imageView,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+            );
+            it = m_textures.emplace(drawImage->imageView, ViewportTexture{ descriptorSet, 0 }).first;
+        }
 
-        m_textureInitialized = true;
+        it->second.lastUsedFrame = m_renderer.GetFrameNumber();
+        m_viewportTextureID = it->second.descriptorSet;
+    }
+
+    void ViewportPane::release_unused_textures()
+    {
+        // A frame has completed once FRAME_OVERLAP newer frames have started recording. Per-frame
+        // versions come back every FRAME_OVERLAP frames, so they are kept.
+        uint32_t frameNumber = m_renderer.GetFrameNumber();
+        std::erase_if(m_textures, [frameNumber](const auto& entry) {
+            if (entry.second.lastUsedFrame + FRAME_OVERLAP < frameNumber)
+            {
+                ImGui_ImplVulkan_RemoveTexture(entry.second.descriptorSet);
+                return true;
+            }
+            return false;
+        });
     }
 
     void ViewportPane::Render()
     {
-        if (!m_textureInitialized)
-        {
-            init_viewport_texture();
-        }
+        release_unused_textures();
+        update_viewport_texture();
 
         ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0.0f, 0.0f));
         ImGui::Begin(GetName());
 
         ImVec2 viewportPanelSize = ImGui::GetContentRegionAvail();
 
-        if (m_viewportTextureID != VK_NULL_HANDLE)
+        // Render at the pane's pixel size, the image is resized before the next frame records
+        ImVec2 framebufferScale = ImGui::GetIO().DisplayFramebufferScale;
+        m_renderer.SetRenderExtent({
+            static_cast<uint32_t>(std::max(viewportPanelSize.x * framebufferScale.x, 0.0f)),
+            static_cast<uint32_t>(std::max(viewportPanelSize.y * framebufferScale.y, 0.0f))
+        });
+
+        std::shared_ptr<AllocatedImage> drawImage = m_renderer.GetDrawImage();
+        if (m_viewportTextureID != VK_NULL_HANDLE && drawImage)
         {
+            // Under dynamic resolution only the top-left region of the draw image holds the frame
+            VkExtent2D drawExtent = m_renderer.GetDrawExtent();
+            ImVec2 uvMax(
+                static_cast<float>(drawExtent.width) / static_cast<float>(drawImage->imageExtent.width),
+                static_cast<float>(drawExtent.height) / static_cast<float>(drawImage->imageExtent.height)
+            );
+
             ImGui::Image(
                 m_viewportTextureID,
                 viewportPanelSize,
                 ImVec2(0, 0),
-                ImVec2(1, 1)
+                uvMax
             );
         }
 
@@ -2,6 +2,7 @@
 
 #include "gui/panes/IPane.h"
 #include <memory>
+#include <types/Containers.h>
 #include <types/VkTypes.h>
 
 namespace Magma
@@ -11,18 +12,28 @@ namespace Magma
     class ViewportPane : public IPane
     {
     public:
-        explicit ViewportPane(std::shared_ptr<Renderer> renderer);
+        explicit ViewportPane(Renderer& renderer);
         ~ViewportPane() override = default;
 
         void Render() override;
         const char* GetName() const override { return "Viewport"; }
 
     private:
-        void init_viewport_texture();
+        void update_viewport_texture();
+        void release_unused_textures();
 
     private:
-        std::shared_ptr<Renderer> m_renderer;
+        struct ViewportTexture
+        {
+            VkDescriptorSet descriptorSet;
+            uint32_t lastUsedFrame;
+        };
+
+        Renderer& m_renderer;
         VkDescriptorSet m_viewportTextureID = VK_NULL_HANDLE;
-        bool m_textureInitialized = false;
+
+        // One texture per draw image view. The view changes every frame when the draw image has a
+        // version per frame in flight, and whenever the image is resized.
+        Map<VkImageView, ViewportTexture> m_textures;
     };
 }
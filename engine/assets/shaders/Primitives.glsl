@@ -0,0 +1,122 @@
+//Workgroup scans and reductions for the compute primitives, built from subgroup operations. Included
+//after the local size by shaders that enable GL_KHR_shader_subgroup_arithmetic and GL_KHR_shader_subgroup_ballot.
+//Workgroups are 1D with at most 256 invocations, a multiple of the subgroup size, see ComputePrimitiveSettings.
+//The pipelines are created with VK_PIPELINE_SHADER_STAGE_CREATE_REQUIRE_FULL_SUBGROUPS_BIT, so every subgroup is full.
+
+//256 invocations in subgroups of at least 4, must match k_MaxPrimitiveSubgroups
+#define MAX_SUBGROUPS 64
+
+//must match ReduceOperation
+#define REDUCE_SUM 0
+#define REDUCE_MIN 1
+#define REDUCE_MAX 2
+#define REDUCE_COUNT_NONZERO 3
+
+//the same block for every primitive, must match PrimitiveConstants in StageFactory.cpp
+layout(push_constant) uniform PrimitiveConstants
+{
+    uint elementCount;
+    //workgroups over the elements, one tile of elements each
+    uint blockCount;
+    //radix digit or histogram bin shift
+    uint shift;
+    //reduce operation, histogram bin count or the workgroup size of the dispatch over a scan total
+    uint parameter;
+    uint seed;
+    uint valueMask;
+} params;
+
+shared uint s_subgroupTotals[MAX_SUBGROUPS];
+
+//position of the invocation in the order the subgroup scans follow. Elements are assigned by it,
+//so scans and sorts keep the element order however the driver maps invocations to subgroups.
+//Only dense because every subgroup is full, see RenderStage::GetComputeSpecialization().
+uint tileIndex()
+{
+    return gl_SubgroupID * gl_SubgroupSize + gl_SubgroupInvocationID;
+}
+
+uint elementIndex()
+{
+    return gl_WorkGroupID.x * gl_WorkGroupSize.x + tileIndex();
+}
+
+uint reduceIdentity(uint operation)
+{
+    return operation == REDUCE_MIN ? 0xffffffffu : 0u;
+}
+
+uint reduceCombine(uint a, uint b, uint operation)
+{
+    if (operation == REDUCE_MIN)
+    {
+        return min(a, b);
+    }
+    if (operation == REDUCE_MAX)
+    {
+        return max(a, b);
+    }
+    return a + b;
+}
+
+//the operation comes from push constants, so every invocation takes the same branch
+uint subgroupReduce(uint value, uint operation)
+{
+    if (operation == REDUCE_MIN)
+    {
+        return subgroupMin(value);
+    }
+    if (operation == REDUCE_MAX)
+    {
+        return subgroupMax(value);
+    }
+    return subgroupAdd(value);
+}
+
+//every invocation of the workgroup must call these, they contain barriers
+uint workgroupReduce(uint value, uint operation)
+{
+    uint subgroupTotal = subgroupReduce(value, operation);
+    if (subgroupElect())
+    {
+        s_subgroupTotals[gl_SubgroupID] = subgroupTotal;
+    }
+    barrier();
+
+    //a handful of subgroups, cheaper to walk than to reduce again
+    uint total = reduceIdentity(operation);
+    for (uint i = 0; i < gl_NumSubgroups; i++)
+    {
+        total = reduceCombine(total, s_subgroupTotals[i], operation);
+    }
+
+    //the totals may be reused right after
+    barrier();
+    return total;
+}
+
+//sum of the values of the invocations before this one in tileIndex() order
+uint workgroupExclusiveAdd(uint value, out uint total)
+{
+    uint subgroupTotal = subgroupAdd(value);
+    uint subgroupPrefix = subgroupExclusiveAdd(value);
+    if (subgroupElect())
+    {
+        s_subgroupTotals[gl_SubgroupID] = subgroupTotal;
+    }
+    barrier();
+
+    uint subgroupOffset = 0;
+    total = 0;
+    for (uint i = 0; i < gl_NumSubgroups; i++)
+    {
+        if (i == gl_SubgroupID)
+        {
+            subgroupOffset = total;
+        }
+        total += s_subgroupTotals[i];
+    }
+
+    barrier();
+    return subgroupOffset + subgroupPrefix;
+}
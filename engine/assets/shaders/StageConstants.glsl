@@ -0,0 +1,17 @@
+//Per-frame values the orchestrator pushes to compute stages, must match StagePushConstants.
+//Stages with settings of their own define STAGE_CONSTANTS_EXTRA as the members that follow.
+
+#ifndef STAGE_CONSTANTS_EXTRA
+#define STAGE_CONSTANTS_EXTRA
+#endif
+
+layout(push_constant) uniform StageConstants
+{
+    uvec2 renderSize;
+    uvec2 imageSize;
+    float renderScale;
+    uint frameNumber;
+    uint historyFrames;
+    uint dispatchSwizzle;
+    STAGE_CONSTANTS_EXTRA
+} stage;
@@ -0,0 +1,73 @@
+//Remaps the workgroup of a 2D dispatch for cache locality, included by compute shaders through
+//GL_GOOGLE_include_directive. The swizzle comes from StageConstants.dispatchSwizzle: the mode
+//in the low 8 bits and the strip width or block size in workgroups above them.
+
+#define DISPATCH_SWIZZLE_NONE 0
+#define DISPATCH_SWIZZLE_TILE_STRIPS 1
+#define DISPATCH_SWIZZLE_MORTON 2
+
+//vertical strips of stripWidth workgroups, each walked row by row before the next one starts
+uvec2 swizzleTileStrips(uvec2 groupID, uvec2 groupCount, uint stripWidth)
+{
+    uint flatIndex = groupID.y * groupCount.x + groupID.x;
+    uint groupsPerStrip = stripWidth * groupCount.y;
+    uint strip = flatIndex / groupsPerStrip;
+    uint inStrip = flatIndex % groupsPerStrip;
+
+    //the last strip is narrower when the width is not a multiple of the strip width
+    uint width = strip < groupCount.x / stripWidth ? stripWidth : groupCount.x % stripWidth;
+    return uvec2(strip * stripWidth + inStrip % width, inStrip / width);
+}
+
+uint compactEvenBits(uint x)
+{
+    x &= 0x55555555u;
+    x = (x | (x >> 1)) & 0x33333333u;
+    x = (x | (x >> 2)) & 0x0f0f0f0fu;
+    x = (x | (x >> 4)) & 0x00ff00ffu;
+    x = (x | (x >> 8)) & 0x0000ffffu;
+    return x;
+}
+
+//Morton order inside square blocks, blocks in row-major order. Blocks cut by the grid edge fall
+//back to row-major order, a Morton curve has holes there.
+uvec2 swizzleMorton(uvec2 groupID, uvec2 groupCount, uint blockSize)
+{
+    uint flatIndex = groupID.y * groupCount.x + groupID.x;
+    uint blockRow = flatIndex / (blockSize * groupCount.x);
+    uint inRow = flatIndex % (blockSize * groupCount.x);
+
+    uint rowHeight = min(blockSize, groupCount.y - blockRow * blockSize);
+    uint groupsPerBlock = blockSize * rowHeight;
+    uint blockColumn = inRow / groupsPerBlock;
+    uint inBlock = inRow % groupsPerBlock;
+    uint blockWidth = blockColumn < groupCount.x / blockSize ? blockSize : groupCount.x % blockSize;
+
+    uvec2 local = blockWidth == blockSize && rowHeight == blockSize
+        ? uvec2(compactEvenBits(inBlock), compactEvenBits(inBlock >> 1))
+        : uvec2(inBlock % blockWidth, inBlock / blockWidth);
+
+    return uvec2(blockColumn, blockRow) * blockSize + local;
+}
+
+uvec2 swizzledWorkGroupID(uint dispatchSwizzle)
+{
+    uint mode = dispatchSwizzle & 0xffu;
+    uint size = max(dispatchSwizzle >> 8, 1u);
+
+    if(mode == DISPATCH_SWIZZLE_TILE_STRIPS)
+    {
+        return swizzleTileStrips(gl_WorkGroupID.xy, gl_NumWorkGroups.xy, size);
+    }
+    if(mode == DISPATCH_SWIZZLE_MORTON)
+    {
+        return swizzleMorton(gl_WorkGroupID.xy, gl_NumWorkGroups.xy, size);
+    }
+    return gl_WorkGroupID.xy;
+}
+
+//replaces gl_GlobalInvocationID.xy
+ivec2 swizzledTexelCoord(uint dispatchSwizzle)
+{
+    return ivec2(swizzledWorkGroupID(dispatchSwizzle) * gl_WorkGroupSize.xy + gl_LocalInvocationID.xy);
+}
@@ -10,7 +10,7 @@ namespace Magma
     public:
         MagmaRuntimeException(String msg)
         {
-           Logger::Log(LogLevel::ERROR, msg);
+           MAGMA_LOG_ERROR("{}", msg);
         }
 
         String& what() noexcept
@@ -1,11 +1,65 @@
 #pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <ctime>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <format>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <type_traits>
 #include <types/Containers.h>
 #include <unordered_map>
 
+// Statements below this level are compiled out entirely, arguments included.
+// 0 = DEBUG, 1 = INFO, 2 = WARNING, 3 = ERROR, 4 = OFF. Release builds log nothing by default.
+#ifndef MAGMA_LOG_LEVEL
+	#ifdef NDEBUG
+		#define MAGMA_LOG_LEVEL 4
+	#else
+		#define MAGMA_LOG_LEVEL 0
+	#endif
+#endif
+
+// Each enabled statement owns a static descriptor. Only the raw argument bytes are
+// queued, the writer thread formats them. The format string is still checked at compile time.
+#define MAGMA_LOG_IMPL(level, fmt, ...)                                                        \
+do                                                                                             \
+{                                                                                              \
+	static constexpr ::Magma::Logger::LogSite s_logSite {fmt, level, __FILE__, __LINE__};      \
+	::Magma::Logger::LogDeferred(s_logSite, fmt __VA_OPT__(,) __VA_ARGS__);                    \
+} while (0)
+
+#if MAGMA_LOG_LEVEL <= 0
+	#define MAGMA_LOG_DEBUG(fmt, ...) MAGMA_LOG_IMPL(::Magma::LogLevel::DEBUG, fmt __VA_OPT__(,) __VA_ARGS__)
+#else
+	#define MAGMA_LOG_DEBUG(fmt, ...) ((void)0)
+#endif
+
+#if MAGMA_LOG_LEVEL <= 1
+	#define MAGMA_LOG_INFO(fmt, ...) MAGMA_LOG_IMPL(::Magma::LogLevel::INFO, fmt __VA_OPT__(,) __VA_ARGS__)
+#else
+	#define MAGMA_LOG_INFO(fmt, ...) ((void)0)
+#endif
+
+#if MAGMA_LOG_LEVEL <= 2
+	#define MAGMA_LOG_WARNING(fmt, ...) MAGMA_LOG_IMPL(::Magma::LogLevel::WARNING, fmt __VA_OPT__(,) __VA_ARGS__)
+#else
+	#define MAGMA_LOG_WARNING(fmt, ...) ((void)0)
+#endif
+
+#if MAGMA_LOG_LEVEL <= 3
+	#define MAGMA_LOG_ERROR(fmt, ...) MAGMA_LOG_IMPL(::Magma::LogLevel::ERROR, fmt __VA_OPT__(,) __VA_ARGS__)
+#else
+	#define MAGMA_LOG_ERROR(fmt, ...) ((void)0)
+#endif
+
 namespace Magma
 {
 	enum class LogLevel {
@@ -18,66 +72,526 @@ namespace Magma
 
 namespace Magma::Logger
 {
-	static std::ofstream s_logFile;
-	static bool s_toFile = false;
-
 	#define RESET   "\033[0m"       // UNIMPORTANT DEBUG LOGS
 	#define RED     "\033[31m"      // Error
 	#define YELLOW  "\033[33m"      // Warning
 	#define GREEN   "\033[32m"      // Info
 
-	static const std::unordered_map<LogLevel, std::pair<std::string, std::string>> m_debugMap = {
+	inline const std::unordered_map<LogLevel, std::pair<std::string, std::string>> m_debugMap = {
 		{ LogLevel::INFO, {GREEN, "INFO"} },
 		{ LogLevel::WARNING, {YELLOW, "WARNING"} },
 		{ LogLevel::ERROR, {RED, "ERROR"} },
 		{ LogLevel::DEBUG, {RESET, "DEBUG"} }
 	};
 
-	static void SetLogfile(const String& filename)
+	// What a producer does when the queue is full. Errors always wait.
+	enum class OverflowPolicy {
+		DROP,   // Discard the message and report the count later
+		BLOCK,  // Wait for the writer thread to make room
+	};
+
+	// Static description of a log statement, one per MAGMA_LOG_* call site
+	struct LogSite
+	{
+		const char* format;
+		LogLevel level;
+		const char* file;
+		uint32_t line;
+	};
+
+	// Rebuilds the arguments from a record payload and appends the formatted message
+	using LogDecodeFunc = void (*)(const LogSite& site, const char* payload, String& out);
+
+	struct LogRecord
+	{
+		static constexpr size_t k_maxMessageSize = 480;
+
+		LogLevel level;
+		std::chrono::system_clock::time_point time;
+
+		// Null for pre-formatted text, otherwise text holds the encoded arguments
+		const LogSite* site;
+		LogDecodeFunc decode;
+
+		uint32_t length;
+		char text[k_maxMessageSize];
+	};
+
+	// Bounded lock-free multi-producer queue (Vyukov). The single consumer is the writer thread.
+	class LogQueue
+	{
+	public:
+		static constexpr uint64_t k_capacity = 4096;
+
+		LogQueue()
+		{
+			for (uint64_t i = 0; i < k_capacity; i++)
+			{
+				m_cells[i].sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		// Returns a slot to fill, or nullptr when the queue is full. Must be followed by Publish().
+		LogRecord* Reserve(uint64_t& ticket)
+		{
+			uint64_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+			while (true)
+			{
+				Cell& cell = m_cells[pos & (k_capacity - 1)];
+				uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+				int64_t diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(pos);
+
+				if (diff == 0)
+				{
+					if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					{
+						ticket = pos;
+						return &cell.record;
+					}
+				}
+				else if (diff < 0)
+				{
+					return nullptr;
+				}
+				else
+				{
+					pos = m_enqueuePos.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		void Publish(uint64_t ticket)
+		{
+			m_cells[ticket & (k_capacity - 1)].sequence.store(ticket + 1, std::memory_order_release);
+		}
+
+		const LogRecord* Peek()
+		{
+			Cell& cell = m_cells[m_dequeuePos & (k_capacity - 1)];
+			uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+			return sequence == m_dequeuePos + 1 ? &cell.record : nullptr;
+		}
+
+		void Pop()
+		{
+			m_cells[m_dequeuePos & (k_capacity - 1)].sequence.store(m_dequeuePos + k_capacity, std::memory_order_release);
+			m_dequeuePos++;
+		}
+
+		uint64_t GetDequeuePosition() const { return m_dequeuePos; }
+		uint64_t GetEnqueuePosition() const { return m_enqueuePos.load(std::memory_order_acquire); }
+
+	private:
+		struct Cell
+		{
+			std::atomic<uint64_t> sequence;
+			LogRecord record;
+		};
+
+		std::array<Cell, k_capacity> m_cells;
+		alignas(64) std::atomic<uint64_t> m_enqueuePos {0};
+		alignas(64) uint64_t m_dequeuePos = 0;
+	};
+
+	// Owns the queue and the background thread that formats timestamps and writes
+	// batches to the console and the log file. Producers never touch I/O.
+	class LogBackend
 	{
-		s_logFile.open(filename, std::ios::app);
-		if (!s_logFile.is_open())
+	public:
+		LogBackend()
+		{
+			m_writer = std::thread([this] { WriterLoop(); });
+		}
+
+		~LogBackend()
+		{
+			m_running.store(false, std::memory_order_release);
+			Wake();
+			if (m_writer.joinable())
+			{
+				m_writer.join();
+			}
+		}
+
+		LogBackend(const LogBackend&) = delete;
+		LogBackend& operator=(const LogBackend&) = delete;
+
+		LogRecord* Reserve(uint64_t& ticket, LogLevel level)
+		{
+			// Errors are what gets flushed before an abort, they are never dropped
+			bool mayDrop = level < LogLevel::ERROR && m_policy.load(std::memory_order_relaxed) == OverflowPolicy::DROP;
+			while (true)
+			{
+				LogRecord* record = m_queue.Reserve(ticket);
+				if (record || mayDrop)
+				{
+					if (!record)
+					{
+						m_dropped.fetch_add(1, std::memory_order_relaxed);
+					}
+					return record;
+				}
+
+				std::this_thread::yield();
+			}
+		}
+
+		void Publish(uint64_t ticket)
+		{
+			m_queue.Publish(ticket);
+			Wake();
+		}
+
+		// Blocks until everything enqueued before the call has been written out
+		void Flush()
+		{
+			uint64_t target = m_queue.GetEnqueuePosition();
+			uint64_t written = m_written.load(std::memory_order_acquire);
+			while (written < target && m_running.load(std::memory_order_acquire))
+			{
+				m_written.wait(written, std::memory_order_acquire);
+				written = m_written.load(std::memory_order_acquire);
+			}
+		}
+
+		bool SetLogfile(const String& filename)
+		{
+			std::lock_guard lock(m_fileMutex);
+			m_logFile.open(filename, std::ios::app);
+			m_toFile.store(m_logFile.is_open(), std::memory_order_release);
+			return m_logFile.is_open();
+		}
+
+		void SetOverflowPolicy(OverflowPolicy policy) { m_policy.store(policy, std::memory_order_relaxed); }
+
+		uint64_t GetDroppedCount() const { return m_totalDropped.load(std::memory_order_relaxed); }
+
+	private:
+		void Wake()
+		{
+			m_wakeups.fetch_add(1, std::memory_order_release);
+			m_wakeups.notify_one();
+		}
+
+		void WriterLoop()
+		{
+			String batch;
+			batch.reserve(64 * 1024);
+
+			while (true)
+			{
+				// Read before draining, so a record published after the drain changes it and the wait returns
+				uint32_t wakeups = m_wakeups.load(std::memory_order_acquire);
+				bool running = m_running.load(std::memory_order_acquire);
+
+				batch.clear();
+				uint64_t count = 0;
+
+				while (const LogRecord* record = m_queue.Peek())
+				{
+					// Records whose fill threw are published empty so the queue keeps moving
+					if (record->site || record->length > 0)
+					{
+						AppendRecord(batch, *record);
+					}
+					m_queue.Pop();
+					count++;
+				}
+
+				uint64_t dropped = m_dropped.exchange(0, std::memory_order_relaxed);
+				if (dropped > 0)
+				{
+					m_totalDropped.fetch_add(dropped, std::memory_order_relaxed);
+					std::format_to(std::back_inserter(batch), "{}[Logger] Dropped {} message(s), queue full{}\n", YELLOW, dropped, RESET);
+				}
+
+				if (!batch.empty())
+				{
+					std::fwrite(batch.data(), 1, batch.size(), stdout);
+					std::fflush(stdout);
+
+					if (m_toFile.load(std::memory_order_acquire))
+					{
+						std::lock_guard lock(m_fileMutex);
+						m_logFile.write(batch.data(), static_cast<std::streamsize>(batch.size()));
+						m_logFile.flush();
+					}
+				}
+
+				if (count > 0)
+				{
+					m_written.store(m_queue.GetDequeuePosition(), std::memory_order_release);
+					m_written.notify_all();
+				}
+
+				if (!running)
+				{
+					break;
+				}
+
+				if (count == 0)
+				{
+					m_wakeups.wait(wakeups, std::memory_order_acquire);
+				}
+			}
+
+			// Nothing is written after this, release every Flush() still waiting
+			m_written.store(UINT64_MAX, std::memory_order_release);
+			m_written.notify_all();
+		}
+
+		static void AppendRecord(String& batch, const LogRecord& record)
+		{
+			time_t now = std::chrono::system_clock::to_time_t(record.time);
+			tm timeinfo {};
+#ifdef _WIN32
+			localtime_s(&timeinfo, &now);
+#else
+			localtime_r(&now, &timeinfo);
+#endif
+			char timestamp[20];
+			strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &timeinfo);
+
+			auto it = m_debugMap.find(record.level);
+			const auto& [color, levelStr] = it->second;
+
+			std::format_to(std::back_inserter(batch), "{}[{}] {}: ", color, timestamp, levelStr);
+
+			if (record.site)
+			{
+				try
+				{
+					record.decode(*record.site, record.text, batch);
+				}
+				catch (const std::format_error&)
+				{
+					std::format_to(std::back_inserter(batch), "<bad format at {}:{}> {}",
+						record.site->file, record.site->line, record.site->format);
+				}
+			}
+			else
+			{
+				batch.append(record.text, record.length);
+			}
+
+			std::format_to(std::back_inserter(batch), "{}\n", RESET);
+		}
+
+	private:
+		LogQueue m_queue;
+		std::thread m_writer;
+		std::atomic<bool> m_running {true};
+		std::atomic<uint64_t> m_written {0};
+		std::atomic<uint32_t> m_wakeups {0};
+		std::atomic<uint64_t> m_dropped {0};
+		std::atomic<uint64_t> m_totalDropped {0};
+		std::atomic<OverflowPolicy> m_policy {OverflowPolicy::DROP};
+
+		std::mutex m_fileMutex;
+		std::ofstream m_logFile;
+		std::atomic<bool> m_toFile {false};
+	};
+
+	inline LogBackend& GetBackend()
+	{
+		static LogBackend s_backend;
+		return s_backend;
+	}
+
+	inline void SetLogfile(const String& filename)
+	{
+		if (!GetBackend().SetLogfile(filename))
 		{
 			std::cerr << "Error opening log file." << std::endl;
 		}
+	}
 
-		s_toFile = true;
+	inline void SetOverflowPolicy(OverflowPolicy policy)
+	{
+		GetBackend().SetOverflowPolicy(policy);
 	}
 
-	static void Log(const LogLevel& level, const String& message)
+	inline void Flush()
 	{
-#ifdef NDEBUG
-		return;
-#else
-		time_t now = time(nullptr);
-		tm* timeinfo = localtime(&now);
-		char timestamp[20];
-		strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", timeinfo);
+		GetBackend().Flush();
+	}
 
-		auto it = m_debugMap.find(level);
-		const auto& [color, levelStr] = it->second;
+	template<typename FillFunc>
+	inline void Enqueue(LogLevel level, FillFunc&& fill)
+	{
+		LogBackend& backend = GetBackend();
 
-		std::string logEntry = std::format("{}[{}] {}: {}{}\n",
-			color, timestamp, levelStr, message, RESET);
+		uint64_t ticket = 0;
+		LogRecord* record = backend.Reserve(ticket, level);
+		if (record)
+		{
+			record->level = level;
+			record->time = std::chrono::system_clock::now();
+			record->site = nullptr;
+			record->decode = nullptr;
+			record->length = 0;
 
-		std::cout << logEntry;
+			// The consumer waits on this ticket, it has to be published even if fill throws
+			try
+			{
+				fill(*record);
+			}
+			catch (...)
+			{
+				record->site = nullptr;
+				record->decode = nullptr;
+				record->length = 0;
+				backend.Publish(ticket);
+				throw;
+			}
+			backend.Publish(ticket);
+		}
 
-		if (s_toFile)
+		// Errors usually precede an abort, make sure they reach the console
+		if (level == LogLevel::ERROR)
 		{
-			s_logFile << logEntry;
-			s_logFile.flush();
+			backend.Flush();
 		}
+	}
+
+	inline void Log(const LogLevel& level, const String& message)
+	{
+#ifdef NDEBUG
+		return;
+#else
+		Enqueue(level, [&](LogRecord& record) {
+			size_t length = std::min(message.size(), LogRecord::k_maxMessageSize);
+			std::copy_n(message.data(), length, record.text);
+			record.length = static_cast<uint32_t>(length);
+		});
 #endif
 	}
 
 	template<typename... Args>
-	static void Log(const LogLevel& level, std::format_string<Args...> fmt, Args&&... args)
+	inline void Log(const LogLevel& level, std::format_string<Args...> fmt, Args&&... args)
 	{
 #ifdef NDEBUG
 		return;
 #else
-		std::string formatted = std::format(fmt, std::forward<Args>(args)...);
-		Log(level, formatted);
+		// Formats straight into the queue slot, long messages are truncated
+		Enqueue(level, [&](LogRecord& record) {
+			auto result = std::format_to_n(record.text, static_cast<std::ptrdiff_t>(LogRecord::k_maxMessageSize), fmt, std::forward<Args>(args)...);
+			record.length = static_cast<uint32_t>(std::min(static_cast<size_t>(result.size), LogRecord::k_maxMessageSize));
+		});
 #endif
 	}
+
+	// Strings are copied length-prefixed, other trivially copyable values byte for byte.
+	// A message with any other argument is formatted on the calling thread, since the writer
+	// could only apply the call site's format spec to a string of it.
+	struct DeferredString {};
+
+	template<typename T>
+	inline constexpr bool k_isDeferrable = std::is_convertible_v<const T&, std::string_view> || std::is_trivially_copyable_v<T>;
+
+	template<typename T>
+	using DeferredType = std::conditional_t<std::is_convertible_v<const T&, std::string_view>, DeferredString, T>;
+
+	inline bool EncodeString(char*& cursor, const char* end, std::string_view value)
+	{
+		uint32_t length = static_cast<uint32_t>(value.size());
+		if (static_cast<size_t>(end - cursor) < sizeof(length) + length)
+		{
+			return false;
+		}
+
+		std::memcpy(cursor, &length, sizeof(length));
+		std::memcpy(cursor + sizeof(length), value.data(), length);
+		cursor += sizeof(length) + length;
+		return true;
+	}
+
+	template<typename T>
+	inline bool EncodeArg(char*& cursor, const char* end, const T& arg)
+	{
+		if constexpr (std::is_convertible_v<const T&, std::string_view>)
+		{
+			if constexpr (std::is_pointer_v<T>)
+			{
+				return EncodeString(cursor, end, arg ? std::string_view(arg) : std::string_view("(null)"));
+			}
+			else
+			{
+				return EncodeString(cursor, end, std::string_view(arg));
+			}
+		}
+		else
+		{
+			if (static_cast<size_t>(end - cursor) < sizeof(T))
+			{
+				return false;
+			}
+
+			std::memcpy(cursor, &arg, sizeof(T));
+			cursor += sizeof(T);
+			return true;
+		}
+	}
+
+	template<typename Stored>
+	inline auto DecodeArg(const char*& cursor)
+	{
+		if constexpr (std::is_same_v<Stored, DeferredString>)
+		{
+			uint32_t length = 0;
+			std::memcpy(&length, cursor, sizeof(length));
+			std::string_view value(cursor + sizeof(length), length);
+			cursor += sizeof(length) + length;
+			return value;
+		}
+		else
+		{
+			Stored value;
+			std::memcpy(&value, cursor, sizeof(Stored));
+			cursor += sizeof(Stored);
+			return value;
+		}
+	}
+
+	template<typename... Stored>
+	inline void DecodeRecord(const LogSite& site, const char* payload, String& out)
+	{
+		const char* cursor = payload;
+
+		// Braced initialisation guarantees left-to-right evaluation
+		std::tuple<decltype(DecodeArg<Stored>(cursor))...> values {DecodeArg<Stored>(cursor)...};
+
+		std::apply([&](auto&... value) {
+			std::vformat_to(std::back_inserter(out), site.format, std::make_format_args(value...));
+		}, values);
+	}
+
+	// Backend of the MAGMA_LOG_* macros
+	template<typename... Args>
+	inline void LogDeferred(const LogSite& site, std::format_string<const Args&...> fmt, const Args&... args)
+	{
+		Enqueue(site.level, [&](LogRecord& record) {
+			char* cursor = record.text;
+			[[maybe_unused]] const char* end = record.text + LogRecord::k_maxMessageSize;
+
+			bool encoded = false;
+			if constexpr ((k_isDeferrable<Args> && ...))
+			{
+				encoded = (EncodeArg(cursor, end, args) && ...);
+			}
+
+			if (encoded)
+			{
+				record.site = &site;
+				record.decode = &DecodeRecord<DeferredType<Args>...>;
+				record.length = static_cast<uint32_t>(cursor - record.text);
+			}
+			else
+			{
+				// Arguments too large for a slot or not deferrable, fall back to truncated text
+				auto result = std::format_to_n(record.text, static_cast<std::ptrdiff_t>(LogRecord::k_maxMessageSize), fmt, args...);
+				record.length = static_cast<uint32_t>(std::min(static_cast<size_t>(result.size), LogRecord::k_maxMessageSize));
+			}
+		});
+	}
 }
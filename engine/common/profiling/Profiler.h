@@ -0,0 +1,256 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <types/Containers.h>
+
+// Zones are compiled in for debug builds. Release builds can opt in with -DMAGMA_ENABLE_PROFILING=1.
+#ifndef MAGMA_ENABLE_PROFILING
+	#ifdef NDEBUG
+		#define MAGMA_ENABLE_PROFILING 0
+	#else
+		#define MAGMA_ENABLE_PROFILING 1
+	#endif
+#endif
+
+#define MAGMA_PROFILE_CONCAT_IMPL(a, b) a##b
+#define MAGMA_PROFILE_CONCAT(a, b) MAGMA_PROFILE_CONCAT_IMPL(a, b)
+
+#if MAGMA_ENABLE_PROFILING
+	#define MAGMA_PROFILE_ZONE(name) ::Magma::Profiler::ScopedZone MAGMA_PROFILE_CONCAT(profileZone_, __LINE__)(name)
+	#define MAGMA_PROFILE_FUNCTION() MAGMA_PROFILE_ZONE(__func__)
+	#define MAGMA_PROFILE_THREAD(name) ::Magma::Profiler::SetThreadName(name)
+#else
+	#define MAGMA_PROFILE_ZONE(name) ((void)0)
+	#define MAGMA_PROFILE_FUNCTION() ((void)0)
+	#define MAGMA_PROFILE_THREAD(name) ((void)0)
+#endif
+
+namespace Magma::Profiler
+{
+	// Zone names must outlive the profiler: string literals, __func__ or Intern()ed strings.
+	struct ZoneRecord
+	{
+		std::atomic<const char*> name {nullptr};
+		std::atomic<uint64_t> startNs {0};
+		std::atomic<uint64_t> endNs {0};
+	};
+
+	// Single-producer ring owned by one thread. The exporter reads it concurrently and
+	// discards any record the producer may have overwritten while it was being copied.
+	class ZoneBuffer
+	{
+	public:
+		static constexpr uint64_t k_capacity = 1 << 14;
+
+		ZoneBuffer(uint32_t threadId, String threadName)
+			: m_threadId(threadId), m_threadName(std::move(threadName)) {}
+
+		void Push(const char* name, uint64_t startNs, uint64_t endNs)
+		{
+			uint64_t head = m_head.load(std::memory_order_relaxed);
+			ZoneRecord& record = m_records[head & (k_capacity - 1)];
+			record.name.store(name, std::memory_order_relaxed);
+			record.startNs.store(startNs, std::memory_order_relaxed);
+			record.endNs.store(endNs, std::memory_order_relaxed);
+			m_head.store(head + 1, std::memory_order_release);
+		}
+
+		template<typename Func>
+		void ForEach(Func&& func) const
+		{
+			uint64_t head = m_head.load(std::memory_order_acquire);
+			uint64_t first = head > k_capacity ? head - k_capacity : 0;
+
+			for (uint64_t i = first; i < head; i++)
+			{
+				const ZoneRecord& record = m_records[i & (k_capacity - 1)];
+				const char* name = record.name.load(std::memory_order_relaxed);
+				uint64_t startNs = record.startNs.load(std::memory_order_relaxed);
+				uint64_t endNs = record.endNs.load(std::memory_order_relaxed);
+
+				std::atomic_thread_fence(std::memory_order_acquire);
+				uint64_t latestHead = m_head.load(std::memory_order_relaxed);
+				// The writer fills slot i for record i + k_capacity before advancing the head past it
+				if (i + k_capacity <= latestHead)
+				{
+					continue;
+				}
+
+				func(name, startNs, endNs);
+			}
+		}
+
+		uint32_t GetThreadId() const { return m_threadId; }
+		const String& GetThreadName() const { return m_threadName; }
+		void SetThreadName(const String& name) { m_threadName = name; }
+
+	private:
+		std::array<ZoneRecord, k_capacity> m_records;
+		std::atomic<uint64_t> m_head {0};
+		uint32_t m_threadId;
+		String m_threadName;
+	};
+
+	struct ProfilerState
+	{
+		ProfilerState()
+		{
+			buffers.push_back(gpuBuffer);
+		}
+
+		std::mutex mutex;
+		Vector<std::shared_ptr<ZoneBuffer>> buffers;
+		Set<String> internedNames;
+		// Created up front, so the render thread can push to it without the lock
+		const std::shared_ptr<ZoneBuffer> gpuBuffer = std::make_shared<ZoneBuffer>(0, "GPU");
+		uint32_t nextThreadId = 1;
+		const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	};
+
+	inline ProfilerState& GetState()
+	{
+		static ProfilerState s_state;
+		return s_state;
+	}
+
+	inline uint64_t Now()
+	{
+		auto elapsed = std::chrono::steady_clock::now() - GetState().epoch;
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+	}
+
+	inline ZoneBuffer& GetThreadBuffer()
+	{
+		thread_local ZoneBuffer* t_buffer = nullptr;
+		if (!t_buffer)
+		{
+			ProfilerState& state = GetState();
+			std::lock_guard lock(state.mutex);
+			uint32_t threadId = state.nextThreadId++;
+			auto buffer = std::make_shared<ZoneBuffer>(threadId, "Thread " + std::to_string(threadId));
+			state.buffers.push_back(buffer);
+			t_buffer = buffer.get();
+		}
+		return *t_buffer;
+	}
+
+	inline void SetThreadName(const String& name)
+	{
+		ZoneBuffer& buffer = GetThreadBuffer();
+		std::lock_guard lock(GetState().mutex);
+		buffer.SetThreadName(name);
+	}
+
+	// Returns a pointer that stays valid for the lifetime of the process
+	inline const char* Intern(const String& name)
+	{
+		ProfilerState& state = GetState();
+		std::lock_guard lock(state.mutex);
+		return state.internedNames.insert(name).first->c_str();
+	}
+
+	// GPU work is reported by the render thread on a dedicated track
+	inline void RecordGpuZone(const char* name, uint64_t startNs, uint64_t endNs)
+	{
+		GetState().gpuBuffer->Push(name, startNs, endNs);
+	}
+
+	class ScopedZone
+	{
+	public:
+		explicit ScopedZone(const char* name)
+			: m_name(name), m_startNs(Now()) {}
+
+		~ScopedZone()
+		{
+			GetThreadBuffer().Push(m_name, m_startNs, Now());
+		}
+
+		ScopedZone(const ScopedZone&) = delete;
+		ScopedZone& operator=(const ScopedZone&) = delete;
+
+	private:
+		const char* m_name;
+		uint64_t m_startNs;
+	};
+
+	inline String EscapeJson(const char* text)
+	{
+		String escaped;
+		for (const char* c = text; c && *c; c++)
+		{
+			unsigned char character = static_cast<unsigned char>(*c);
+			switch (character)
+			{
+				case '"': escaped += "\\\""; break;
+				case '\\': escaped += "\\\\"; break;
+				case '\n': escaped += "\\n"; break;
+				case '\r': escaped += "\\r"; break;
+				case '\t': escaped += "\\t"; break;
+				default:
+					// JSON strings may not hold raw control characters
+					if (character < 0x20)
+					{
+						static constexpr char k_hexDigits[] = "0123456789abcdef";
+						escaped += "\\u00";
+						escaped += k_hexDigits[character >> 4];
+						escaped += k_hexDigits[character & 0xF];
+					}
+					else
+					{
+						escaped += *c;
+					}
+					break;
+			}
+		}
+		return escaped;
+	}
+
+	// Writes every buffered zone in Chrome trace-event format (chrome://tracing, Perfetto)
+	inline bool ExportChromeTrace(const String& filename)
+	{
+		std::ofstream file(filename, std::ios::trunc);
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		// Names are written under the lock by SetThreadName(), so they are copied with the buffers
+		Vector<std::shared_ptr<ZoneBuffer>> buffers;
+		Vector<String> threadNames;
+		{
+			std::lock_guard lock(GetState().mutex);
+			buffers = GetState().buffers;
+			for (const auto& buffer : buffers)
+			{
+				threadNames.push_back(buffer->GetThreadName());
+			}
+		}
+
+		file << std::fixed << std::setprecision(3);
+		file << "{\"traceEvents\":[";
+		bool first = true;
+
+		for (size_t i = 0; i < buffers.size(); i++)
+		{
+			const auto& buffer = buffers[i];
+			file << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->GetThreadId()
+				<< ",\"args\":{\"name\":\"" << EscapeJson(threadNames[i].c_str()) << "\"}}";
+			first = false;
+
+			buffer->ForEach([&](const char* name, uint64_t startNs, uint64_t endNs) {
+				file << ",\n{\"name\":\"" << EscapeJson(name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->GetThreadId()
+					<< ",\"ts\":" << startNs / 1000.0 << ",\"dur\":" << (endNs > startNs ? endNs - startNs : 0) / 1000.0 << "}";
+			});
+		}
+
+		file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+		return true;
+	}
+}
@@ -11,7 +11,7 @@ do                                                              \
 VkResult err = x;                                           \
 if (err)                                                    \
 {                                                           \
-Logger::Log(LogLevel::ERROR, "Detected Vulkan error: {}", static_cast<int>(err)); \
+MAGMA_LOG_ERROR("Detected Vulkan error: {}", static_cast<int>(err)); \
 abort();                                                \
 }                                                           \
 } while (0)
\ No newline at end of file
@@ -1,13 +1,14 @@
 #pragma once
 
-#include <map>
+#include <algorithm>
 #include <memory>
 #include <mutex>
 #include <stdexcept>
-#include <typeindex>
+#include <typeinfo>
 #include <type_traits>
 
 #include <logging/Logger.h>
+#include <types/Containers.h>
 
 namespace Magma
 {
@@ -19,6 +20,9 @@ namespace Magma
         virtual void Cleanup() = 0;
     };
 
+    // Every service type gets its own static slot, so Get<T>() is a single load with
+    // no lock, map lookup or refcount. Registration happens during startup under a
+    // mutex; after Freeze() the set of services is fixed until ShutdownServices().
     class ServiceLocator
     {
     public:
@@ -27,67 +31,113 @@ namespace Magma
         {
             static_assert(std::is_base_of<IService, T>::value, "T must inherit from IService");
             std::lock_guard lock(s_mutex);
-            auto typeIndex = std::type_index(typeid(T));
 
-            if (s_services.find(typeIndex) != s_services.end())
+            if (s_frozen)
             {
-                Logger::Log(LogLevel::WARNING, "{} Service already registered, skipping", typeIndex.name());
+                MAGMA_LOG_ERROR("Cannot register {} after the service locator is frozen", typeid(T).name());
                 return;
             }
 
-            Logger::Log(LogLevel::INFO, "Registering service: {}", typeIndex.name());
-            s_services[typeIndex] = service;
+            if (s_slot<T> != nullptr)
+            {
+                MAGMA_LOG_WARNING("{} Service already registered, skipping", typeid(T).name());
+                return;
+            }
+
+            MAGMA_LOG_INFO("Registering service: {}", typeid(T).name());
+            s_slot<T> = service.get();
+            s_services.push_back({ std::move(service), &ClearSlot<T> });
         }
 
         template<typename T>
         static void Unregister()
         {
             std::lock_guard lock(s_mutex);
-            auto typeIndex = std::type_index(typeid(T));
 
-            auto it = s_services.find(typeIndex);
+            if (s_frozen)
+            {
+                MAGMA_LOG_ERROR("Cannot unregister {} while the service locator is frozen", typeid(T).name());
+                return;
+            }
+
+            auto it = std::find_if(s_services.begin(), s_services.end(),
+                [](const ServiceEntry& entry) { return entry.clearSlot == &ClearSlot<T>; });
+
             if (it == s_services.end())
             {
-                Logger::Log(LogLevel::WARNING, "{} Service not registered", typeIndex.name());
+                MAGMA_LOG_WARNING("{} Service not registered", typeid(T).name());
                 return;
             }
 
-            Logger::Log(LogLevel::INFO, "Unregistering service: {}", typeIndex.name());
-            it->second->Cleanup();
+            MAGMA_LOG_INFO("Unregistering service: {}", typeid(T).name());
+            it->clearSlot();
+            it->service->Cleanup();
             s_services.erase(it);
         }
 
+        // The returned reference stays valid until the service is unregistered or shut down
         template<typename T>
-        static std::shared_ptr<T> Get()
+        static T& Get()
         {
-            std::lock_guard lock(s_mutex);
-            auto typeIndex = std::type_index(typeid(T));
-
-            auto it = s_services.find(typeIndex);
-            if (it == s_services.end())
+            T* service = s_slot<T>;
+            if (service == nullptr)
             {
                 throw std::runtime_error("Service not found");
             }
 
-            return std::static_pointer_cast<T>(it->second);
+            return *service;
         }
 
+        template<typename T>
+        static bool IsRegistered()
+        {
+            return s_slot<T> != nullptr;
+        }
+
+        // Ends the registration phase. Call once every service is registered and initialized.
+        static void Freeze()
+        {
+            std::lock_guard lock(s_mutex);
+            s_frozen = true;
+        }
+
+        // Services are cleaned up in reverse registration order, so a service can rely
+        // on everything registered before it during its own Cleanup()
         static void ShutdownServices()
         {
             std::lock_guard lock(s_mutex);
-            Logger::Log(LogLevel::INFO, "Shutting down all services");
+            MAGMA_LOG_INFO("Shutting down all services");
 
-            for (auto& [typeIndex, service] : s_services)
+            for (auto it = s_services.rbegin(); it != s_services.rend(); ++it)
             {
-                service->Cleanup();
+                it->clearSlot();
+                it->service->Cleanup();
             }
 
             s_services.clear();
+            s_frozen = false;
+        }
+
+    private:
+        struct ServiceEntry
+        {
+            std::shared_ptr<IService> service;
+            void (*clearSlot)();
+        };
+
+        template<typename T>
+        static void ClearSlot()
+        {
+            s_slot<T> = nullptr;
         }
 
     private:
-        static inline std::map<std::type_index, std::shared_ptr<IService>> s_services;
+        template<typename T>
+        static inline T* s_slot = nullptr;
+
+        static inline Vector<ServiceEntry> s_services;
         static inline std::mutex s_mutex;
+        static inline bool s_frozen = false;
 
     };
 }
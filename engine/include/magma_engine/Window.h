@@ -1,6 +1,7 @@
 #pragma once
 #include <types/Containers.h>
 #include <maths/Vec.h>
+#include <utility>
 #include <magma_engine/ServiceLocater.h>
 
 #define GLFW_INCLUDE_VULKAN
@@ -33,6 +34,13 @@ namespace Magma
 		bool ShouldClose() const { return glfwWindowShouldClose(m_window.get()); }
 		void GetDrawSurface(Map<SurfaceArgs, int*> surfaceArgs);
 		Maths::Vec2<uint32_t> GetExtent() { return {m_windowData.m_width, m_windowData.m_height}; }
+		bool IsMinimized() const { return m_windowData.m_width == 0 || m_windowData.m_height == 0; }
+
+		// True once after the framebuffer changed size, the extent is already updated
+		bool ConsumeResize() { return std::exchange(m_framebufferResized, false); }
+
+		// Blocks until an event arrives, for idling while minimized
+		void WaitEvents() { glfwWaitEvents(); }
 		GLFWwindow* GetGLFWWindow() const { return m_window.get(); }
 		const char** GetRequiredExtensions(uint32_t* count) const
 		{
@@ -41,10 +49,14 @@ namespace Magma
 		}
 		~Window() = default;
 
+	private:
+		static void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+
 	private:
 		WindowData m_windowData;
 		std::unique_ptr<GLFWwindow, decltype(&glfwDestroyWindow)> m_window;
 		const char** m_extensions;
 		uint32_t m_extensionCount = 0;
+		bool m_framebufferResized = false;
 	};
 }
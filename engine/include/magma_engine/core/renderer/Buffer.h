@@ -0,0 +1,11 @@
+#pragma once
+#include <types/VkTypes.h>
+
+struct AllocatedBuffer {
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VmaAllocation allocation = VK_NULL_HANDLE;
+	VkDeviceSize size = 0;
+
+	// Non-null for persistently mapped host-visible buffers
+	void* mappedData = nullptr;
+};
@@ -4,9 +4,12 @@
 #include <types/Containers.h>
 #include <types/VkTypes.h>
 #include <magma_engine/core/renderer/Image.h>
+#include <magma_engine/core/renderer/Buffer.h>
 
 namespace Magma
 {
+    // Maps graph buffer names to images. A buffer may have one version per frame in flight,
+    // frame slot i then uses version i % versionCount.
     class BufferRegistry
     {
     public:
@@ -14,12 +17,29 @@ namespace Magma
         ~BufferRegistry() = default;
 
         void RegisterBuffer(const String& name, std::shared_ptr<AllocatedImage> buffer);
+        void RegisterBufferVersions(const String& name, Vector<std::shared_ptr<AllocatedImage>> versions);
+
+        // The version of the frame slot set with SetCurrentVersion()
         std::shared_ptr<AllocatedImage> GetBuffer(const String& name) const;
+        std::shared_ptr<AllocatedImage> GetBuffer(const String& name, uint32_t version) const;
+        uint32_t GetVersionCount(const String& name) const;
+
+        // Graph storage buffers, versioned like the images. Owned by the RenderResourceAllocator.
+        void RegisterStorageBufferVersions(const String& name, Vector<AllocatedBuffer> versions);
+        const AllocatedBuffer* GetStorageBuffer(const String& name) const;
+        const AllocatedBuffer* GetStorageBuffer(const String& name, uint32_t version) const;
+        void ClearStorageBuffers();
+
+        // Selects the frame slot being recorded
+        void SetCurrentVersion(uint32_t version) { m_currentVersion = version; }
+
         bool HasBuffer(const String& name) const;
         Vector<String> GetAllBufferNames() const;
         void Clear();
 
     private:
-        Map<String, std::shared_ptr<AllocatedImage>> m_buffers;
+        Map<String, Vector<std::shared_ptr<AllocatedImage>>> m_buffers;
+        Map<String, Vector<AllocatedBuffer>> m_storageBuffers;
+        uint32_t m_currentVersion = 0;
     };
 }
@@ -4,6 +4,46 @@
 
 namespace Magma
 {
+    // Compute limits of the device, filled in by the renderer
+    struct ComputeDeviceInfo
+    {
+        // Guaranteed minimums until the renderer fills them in
+        uint32_t maxWorkgroupInvocations = 128;
+        uint32_t maxWorkgroupSize[3] = { 128, 128, 64 };
+
+        // VK_EXT_subgroup_size_control, lets pipelines pick a subgroup size in [min, max]
+        bool subgroupSizeControl = false;
+        uint32_t minSubgroupSize = 0;
+        uint32_t maxSubgroupSize = 0;
+        // Pipelines may require every subgroup of a workgroup to be full
+        bool computeFullSubgroups = false;
+
+        // Subgroup operations compute shaders may use, 0 while unknown
+        uint32_t subgroupSize = 0;
+        VkSubgroupFeatureFlags subgroupOperations = 0;
+
+        // Identifies the device and driver workgroup sizes were tuned on
+        uint32_t vendorID = 0;
+        uint32_t deviceID = 0;
+        uint32_t driverVersion = 0;
+        String deviceName;
+    };
+
+    // Values fixed at pipeline creation. Shaders take the workgroup size from specialization
+    // constants: layout(local_size_x_id = 0, local_size_y_id = 1, local_size_z_id = 2) in;
+    struct ComputeSpecialization
+    {
+        // 0 keeps the size declared in the shader
+        uint32_t workgroupSize[3] = { 0, 0, 0 };
+
+        // 0 lets the driver pick, needs subgroupSizeControl otherwise
+        uint32_t requiredSubgroupSize = 0;
+
+        // Every subgroup gets all its invocations, needs computeFullSubgroups and a workgroup
+        // width that is a multiple of the largest subgroup size
+        bool requireFullSubgroups = false;
+    };
+
     class ComputePipeline : public Pipeline
     {
     public:
@@ -12,12 +52,30 @@ namespace Magma
         bool Create(
             VkDevice device,
             const PipelineLayoutInfo& layoutInfo,
-            VkShaderModule computeShader
+            VkShaderModule computeShader,
+            const ComputeSpecialization& specialization = ComputeSpecialization{}
         );
 
+        // Uses the layout of another pipeline, which has to outlive this one
+        bool Create(
+            VkDevice device,
+            VkPipelineLayout sharedLayout,
+            VkShaderModule computeShader,
+            const ComputeSpecialization& specialization = ComputeSpecialization{}
+        );
+
+        // Exchanges the VkPipelines of two pipelines with the same layout, ownership of the layout stays put
+        void ExchangePipeline(ComputePipeline& other);
+
         void Bind(VkCommandBuffer cmd) const override;
 
         // Compute-specific functionality
         void Dispatch(VkCommandBuffer cmd, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) const;
+
+        // Group counts from a VkDispatchIndirectCommand at offset, which must be 4-byte aligned
+        void DispatchIndirect(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset) const;
+
+    private:
+        bool CreatePipelineObject(VkShaderModule computeShader, const ComputeSpecialization& specialization);
     };
 }
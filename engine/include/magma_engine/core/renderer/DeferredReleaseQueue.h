@@ -0,0 +1,85 @@
+#pragma once
+
+#include <types/Containers.h>
+#include <types/VkTypes.h>
+
+namespace Magma
+{
+    // Holds Vulkan objects that may still be referenced by in-flight command buffers.
+    // Every entry is tagged with the retire value current at the time it was released
+    // (the renderer's frame number) and destroyed once the GPU has completed that value.
+    // Handles live in plain per-type arrays, so releasing an object never allocates
+    // once the arrays have grown to their working size.
+    class DeferredReleaseQueue
+    {
+    public:
+        DeferredReleaseQueue() = default;
+        ~DeferredReleaseQueue() = default;
+
+        DeferredReleaseQueue(const DeferredReleaseQueue&) = delete;
+        DeferredReleaseQueue& operator=(const DeferredReleaseQueue&) = delete;
+
+        void Initialize(VkDevice device, VmaAllocator allocator);
+
+        // Objects released from now on are tagged with this value. Must not decrease.
+        void SetRetireValue(uint64_t retireValue) { m_retireValue = retireValue; }
+        uint64_t GetRetireValue() const { return m_retireValue; }
+
+        void ReleaseImage(VkImage image, VmaAllocation allocation);
+        void ReleaseImageView(VkImageView imageView);
+        // A swapchain retired through oldSwapchain, its views must be released alongside
+        void ReleaseSwapchain(VkSwapchainKHR swapchain);
+        void ReleaseBuffer(VkBuffer buffer, VmaAllocation allocation);
+        void ReleasePipeline(VkPipeline pipeline);
+        // The pool must be created with VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT
+        void ReleaseDescriptorSet(VkDescriptorPool pool, VkDescriptorSet descriptorSet);
+
+        // Destroys everything tagged with a value the GPU has completed
+        void Collect(uint64_t completedValue);
+
+        // Destroys everything. Only valid once the device is idle.
+        void Flush();
+
+        size_t GetPendingCount() const;
+
+    private:
+        template<typename Handle>
+        struct RetiredHandle
+        {
+            Handle handle;
+            uint64_t retireValue;
+        };
+
+        template<typename Handle>
+        struct RetiredAllocation
+        {
+            Handle handle;
+            VmaAllocation allocation;
+            uint64_t retireValue;
+        };
+
+        struct RetiredDescriptorSet
+        {
+            VkDescriptorPool pool;
+            VkDescriptorSet descriptorSet;
+            uint64_t retireValue;
+        };
+
+        // Entries are appended with non-decreasing retire values, so the completed
+        // ones always form a prefix that can be destroyed and erased in one go
+        template<typename Entry, typename DestroyFunc>
+        static void ReleaseCompleted(Vector<Entry>& entries, uint64_t completedValue, DestroyFunc&& destroy);
+
+    private:
+        VkDevice m_device = VK_NULL_HANDLE;
+        VmaAllocator m_allocator = VK_NULL_HANDLE;
+        uint64_t m_retireValue = 0;
+
+        Vector<RetiredAllocation<VkImage>> m_images;
+        Vector<RetiredHandle<VkImageView>> m_imageViews;
+        Vector<RetiredHandle<VkSwapchainKHR>> m_swapchains;
+        Vector<RetiredAllocation<VkBuffer>> m_buffers;
+        Vector<RetiredHandle<VkPipeline>> m_pipelines;
+        Vector<RetiredDescriptorSet> m_descriptorSets;
+    };
+}
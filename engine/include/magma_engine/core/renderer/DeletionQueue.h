@@ -8,7 +8,7 @@ struct DeletionQueue
 
 	void push_function(std::function<void()>&& function)
 	{
-		deletors.push_back(function);
+		deletors.push_back(std::move(function));
 	}
 
 	void flush()
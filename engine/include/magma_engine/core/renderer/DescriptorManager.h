@@ -1,4 +1,5 @@
 #pragma once
+#include <deque>
 #include <span>
 
 #include <types/VkTypes.h>
@@ -16,6 +17,8 @@ namespace Magma
         uint32_t descriptorCount = 1;
     };
 
+    // Starts with a pool of maxSets sets. When a pool runs out of sets or descriptors, allocate()
+    // moves on to a new one, each half again as large, so graphs of any size fit.
     struct DescriptorAllocator
     {
         struct PoolSizeRatio
@@ -24,13 +27,53 @@ namespace Magma
             float ratio;
         };
 
-        VkDescriptorPool pool = VK_NULL_HANDLE;
-
         void init_pool(VkDevice device, uint32_t maxSets, std::span<PoolSizeRatio> poolRatios);
         void clear_descriptors(VkDevice device);
         void destroy_pool(VkDevice device);
 
         VkDescriptorSet allocate(VkDevice device, VkDescriptorSetLayout layout);
+
+    private:
+        static constexpr uint32_t k_maxSetsPerPool = 4096;
+
+        VkDescriptorPool get_pool(VkDevice device);
+        VkDescriptorPool create_pool(VkDevice device, uint32_t setCount);
+
+        std::vector<PoolSizeRatio> ratios;
+        std::vector<VkDescriptorPool> fullPools;
+        std::vector<VkDescriptorPool> readyPools;
+        uint32_t setsPerPool = 0;
+    };
+
+    // Collects descriptor writes so they go to the driver in one vkUpdateDescriptorSets call
+    class DescriptorWriter
+    {
+    public:
+        void WriteImage(
+            VkDescriptorSet set,
+            uint32_t binding,
+            VkImageView imageView,
+            VkImageLayout layout,
+            VkDescriptorType type);
+
+        void WriteBuffer(
+            VkDescriptorSet set,
+            uint32_t binding,
+            VkBuffer buffer,
+            VkDeviceSize offset,
+            VkDeviceSize range,
+            VkDescriptorType type);
+
+        void Clear();
+
+        bool IsEmpty() const { return m_writes.empty(); }
+        const Vector<VkWriteDescriptorSet>& GetWrites() const { return m_writes; }
+
+    private:
+        // Deque keeps the infos in place while writes point at them
+        std::deque<VkDescriptorImageInfo> m_imageInfos;
+        std::deque<VkDescriptorBufferInfo> m_bufferInfos;
+        Vector<VkWriteDescriptorSet> m_writes;
     };
 
     class DescriptorManager
@@ -64,6 +107,8 @@ namespace Magma
             VkImageLayout layout,
             VkDescriptorType type);
 
+        // Submits and clears everything queued in writer
+        void UpdateDescriptorSets(DescriptorWriter& writer);
 
     private:
         VkDevice m_device = VK_NULL_HANDLE;
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <types/VkTypes.h>
+
+namespace Magma
+{
+    struct DynamicResolutionSettings
+    {
+        // When disabled the scale stays fixed at maxScale
+        bool enabled = false;
+
+        // GPU time of the render graph the controller aims for
+        double targetFrameTimeMs = 16.0;
+
+        float minScale = 0.5f;
+        float maxScale = 1.0f;
+
+        // Relative distance from the target that is accepted without rescaling
+        double deadband = 0.05;
+
+        // Largest scale change per adjustment, keeps the controller from oscillating
+        float maxStep = 0.05f;
+
+        // Weight of the newest sample in the smoothed GPU time
+        double smoothing = 0.2;
+
+        // Samples to wait after an adjustment. Timings lag by the frames in flight, so this
+        // has to be larger than that for the controller to see the effect of its last change.
+        uint32_t settleFrames = 4;
+    };
+
+    // Picks a render scale for resolution-dependent targets from measured GPU frame times.
+    // Shading cost is roughly proportional to pixel count, so the scale moves by the square
+    // root of the ratio between target and measured time.
+    class DynamicResolution
+    {
+    public:
+        DynamicResolution() = default;
+        ~DynamicResolution() = default;
+
+        void SetSettings(const DynamicResolutionSettings& settings);
+        const DynamicResolutionSettings& GetSettings() const { return m_settings; }
+
+        // Feeds the GPU time of a completed frame, returns the scale to render the next one at
+        float Update(double gpuTimeMs);
+
+        float GetScale() const { return m_scale; }
+        double GetSmoothedGpuTimeMs() const { return m_smoothedGpuTimeMs; }
+
+        void Reset();
+
+        // Rounds to whole pixels, never below 1x1
+        static VkExtent2D ScaleExtent(VkExtent2D extent, float scale);
+
+    private:
+        DynamicResolutionSettings m_settings;
+
+        float m_scale = 1.0f;
+        double m_smoothedGpuTimeMs = 0.0;
+        uint32_t m_framesSinceAdjustment = 0;
+    };
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <types/Containers.h>
+#include <types/VkTypes.h>
+
+namespace Magma
+{
+    class GpuSubmitter;
+
+    // Token for one submission, resolved once the submitter's timeline semaphore
+    // reaches its value. Can be polled, waited on, or co_awaited from a GpuTask.
+    class GpuFuture
+    {
+    public:
+        GpuFuture() = default;
+        GpuFuture(GpuSubmitter* submitter, uint64_t value)
+            : m_submitter(submitter), m_value(value) {}
+
+        uint64_t GetValue() const { return m_value; }
+        bool IsReady() const;
+
+        // Blocks the calling thread until the submission has completed
+        void Wait() const;
+
+        bool await_ready() const { return IsReady(); }
+        void await_suspend(std::coroutine_handle<> handle) const;
+        void await_resume() const {}
+
+    private:
+        GpuSubmitter* m_submitter = nullptr;
+        uint64_t m_value = 0;
+    };
+
+    // Fire-and-forget coroutine. Code after a co_await on a GpuFuture runs on the
+    // submitter's completion thread.
+    struct GpuTask
+    {
+        struct promise_type
+        {
+            GpuTask get_return_object() { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
+
+    // Asynchronous one-off submissions. Each submission records into its own transient
+    // command buffer from a recycled pool and signals a timeline semaphore, so callers
+    // never block unless they ask to. Any thread may submit.
+    class GpuSubmitter
+    {
+    public:
+        GpuSubmitter() = default;
+        ~GpuSubmitter() = default;
+
+        GpuSubmitter(const GpuSubmitter&) = delete;
+        GpuSubmitter& operator=(const GpuSubmitter&) = delete;
+
+        void Initialize(VkDevice device, VkQueue queue, uint32_t queueFamily);
+
+        // The device must be idle. Pending coroutines are resumed before returning.
+        void Cleanup();
+
+        GpuFuture Submit(std::function<void(VkCommandBuffer cmd)>&& function);
+
+        uint64_t GetCompletedValue() const;
+        void WaitForValue(uint64_t value) const;
+
+        // Every other user of the queue must hold this while calling vkQueueSubmit or vkQueuePresentKHR
+        std::mutex& GetQueueMutex() { return m_queueMutex; }
+
+        size_t GetCommandBufferCount() const { return m_commandBuffers.size(); }
+
+    private:
+        friend class GpuFuture;
+
+        struct TransientCommandBuffer
+        {
+            VkCommandPool pool = VK_NULL_HANDLE;
+            VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+            uint64_t lastValue = 0;
+            bool recording = false;
+        };
+
+        struct Waiter
+        {
+            uint64_t value;
+            std::coroutine_handle<> handle;
+        };
+
+        size_t AcquireCommandBuffer();
+        void AddWaiter(uint64_t value, std::coroutine_handle<> handle);
+        void CompletionLoop();
+        void ResumeCompleted(uint64_t completedValue);
+
+    private:
+        VkDevice m_device = VK_NULL_HANDLE;
+        VkQueue m_queue = VK_NULL_HANDLE;
+        uint32_t m_queueFamily = 0;
+        VkSemaphore m_timeline = VK_NULL_HANDLE;
+
+        std::mutex m_queueMutex;
+        uint64_t m_nextValue = 0;
+
+        // Slots are never erased while the submitter is alive, indices stay valid
+        std::mutex m_poolMutex;
+        Vector<TransientCommandBuffer> m_commandBuffers;
+
+        std::mutex m_waitMutex;
+        std::condition_variable m_waitCondition;
+        Vector<Waiter> m_waiters;
+
+        std::thread m_completionThread;
+        std::atomic<bool> m_running {false};
+    };
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <memory>
+#include <types/Containers.h>
+#include <types/VkTypes.h>
+#include <magma_engine/core/renderer/Image.h>
+#include <magma_engine/core/renderer/ResourcePools.h>
+
+namespace Magma
+{
+    struct DefragmentationSettings
+    {
+        // Upper bound on what a single frame copies
+        VkDeviceSize maxBytesPerPass = 8ull * 1024 * 1024;
+        uint32_t maxAllocationsPerPass = 4;
+
+        // How often fragmentation is measured, measuring walks every VMA block
+        uint32_t checkIntervalFrames = 600;
+
+        // Unused fraction of allocated blocks above which a run is started
+        float fragmentationThreshold = 0.25f;
+
+        // Smaller heaps are not worth compacting
+        VkDeviceSize minBlockBytes = 32ull * 1024 * 1024;
+    };
+
+    struct DefragmentationStats
+    {
+        uint64_t bytesMoved = 0;
+        uint64_t bytesFreed = 0;
+        uint32_t allocationsMoved = 0;
+        uint32_t deviceMemoryBlocksFreed = 0;
+
+        uint32_t passesCompleted = 0;
+        uint32_t runsCompleted = 0;
+
+        float lastFragmentation = 0.0f;
+        bool active = false;
+    };
+
+    // Incremental compaction on top of VMA's defragmentation API. At most one pass is
+    // in flight: RecordPass() recreates the moved images in their new place, records
+    // the copies into the frame's command buffer and swaps the handles inside the
+    // AllocatedImage. The pass is only ended, and the old images destroyed, once that
+    // frame has completed. Only registered images move, everything else is left in place.
+    // Dedicated allocations are never moved, so this only compacts pooled resources: graph
+    // images default to ResourceClass::RENDER_TARGET and have to opt in with PERSISTENT.
+    class MemoryDefragmenter
+    {
+    public:
+        MemoryDefragmenter() = default;
+        ~MemoryDefragmenter() = default;
+
+        MemoryDefragmenter(const MemoryDefragmenter&) = delete;
+        MemoryDefragmenter& operator=(const MemoryDefragmenter&) = delete;
+
+        // Compacts the default pools plus the custom pools that support it
+        void Initialize(VkDevice device, VmaAllocator allocator, ResourcePools* pools, const DefragmentationSettings& settings = {});
+
+        // The device must be idle
+        void Cleanup();
+
+        // Usage must match the image's create info, it is used to recreate the image
+        void RegisterImage(const std::shared_ptr<AllocatedImage>& image, VkImageUsageFlags usage);
+        void UnregisterImage(VmaAllocation allocation);
+
+        // Starts a run on the next frame regardless of the measured fragmentation
+        void RequestDefragmentation() { m_requested = true; }
+
+        // Ends the outstanding pass once its frame has completed. Call before
+        // deferred releases are collected.
+        void CompletePass(uint64_t completedFrame);
+
+        // Returns true when images moved, descriptors referencing them must be rewritten
+        bool RecordPass(VkCommandBuffer cmd, uint64_t frameNumber);
+
+        const DefragmentationStats& GetStats() const { return m_stats; }
+
+    private:
+        struct Registration
+        {
+            std::weak_ptr<AllocatedImage> image;
+            VkImageUsageFlags usage;
+        };
+
+        struct RetiredImage
+        {
+            VkImage image;
+            VkImageView imageView;
+        };
+
+        bool ShouldStart(uint64_t frameNumber);
+        float MeasureFragmentation() const;
+        bool BeginRun();
+        void EndRun();
+        bool MoveImage(VkCommandBuffer cmd, const VmaDefragmentationMove& move, AllocatedImage& image, VkImageUsageFlags usage);
+
+    private:
+        VkDevice m_device = VK_NULL_HANDLE;
+        VmaAllocator m_allocator = VK_NULL_HANDLE;
+        ResourcePools* m_pools = nullptr;
+        DefragmentationSettings m_settings;
+
+        Map<VmaAllocation, Registration> m_registrations;
+
+        // Pools compacted by the current run, one VMA context at a time. VK_NULL_HANDLE is the default pools.
+        Vector<VmaPool> m_runTargets;
+        size_t m_runTargetIndex = 0;
+        VmaDefragmentationContext m_context = VK_NULL_HANDLE;
+
+        VmaDefragmentationPassMoveInfo m_pass = {};
+        bool m_passOpen = false;
+        uint64_t m_passFrame = 0;
+        Vector<RetiredImage> m_retiredImages;
+
+        bool m_requested = false;
+        uint64_t m_lastCheckFrame = 0;
+
+        DefragmentationStats m_stats;
+    };
+}
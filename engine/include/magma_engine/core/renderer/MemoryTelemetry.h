@@ -0,0 +1,141 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <mutex>
+#include <types/Containers.h>
+#include <types/VkTypes.h>
+
+namespace Magma
+{
+    enum class MemoryCategory
+    {
+        RENDER_TARGET = 0,
+        BUFFER,
+        STAGING,
+        OTHER,
+        COUNT
+    };
+
+    const char* MemoryCategoryToString(MemoryCategory category);
+
+    struct MemoryBudgetSettings
+    {
+        // Soft budget as a fraction of the device-local heaps' budget
+        float softBudgetFraction = 0.9f;
+
+        // Absolute soft budget in bytes, overrides the fraction when non-zero
+        VkDeviceSize softBudgetBytes = 0;
+
+        // Frames to wait after eviction before asking for quality downscaling, so
+        // deferred releases have a chance to land
+        uint32_t downscaleDelayFrames = 8;
+    };
+
+    struct HeapBudget
+    {
+        uint32_t heapIndex = 0;
+        bool deviceLocal = false;
+
+        // From VK_EXT_memory_budget when available, otherwise estimated by VMA
+        VkDeviceSize budget = 0;
+        VkDeviceSize usage = 0;
+
+        // What this process has allocated through VMA
+        VkDeviceSize blockBytes = 0;
+        VkDeviceSize allocationBytes = 0;
+        uint32_t allocationCount = 0;
+    };
+
+    struct ResourceMemory
+    {
+        String name;
+        MemoryCategory category = MemoryCategory::OTHER;
+        VkDeviceSize size = 0;
+    };
+
+    struct MemoryReport
+    {
+        Vector<HeapBudget> heaps;
+        std::array<VkDeviceSize, static_cast<size_t>(MemoryCategory::COUNT)> categoryBytes {};
+        Vector<ResourceMemory> resources;
+
+        VkDeviceSize deviceLocalUsage = 0;
+        VkDeviceSize deviceLocalBudget = 0;
+        VkDeviceSize softBudget = 0;
+    };
+
+    struct MemoryPressure
+    {
+        VkDeviceSize usage = 0;
+        VkDeviceSize softBudget = 0;
+
+        // Bytes that need to be freed to get back under the soft budget
+        VkDeviceSize excess = 0;
+    };
+
+    using MemoryPressureCallback = std::function<void(const MemoryPressure& pressure)>;
+
+    // Per-process GPU memory accounting on top of VMA. Heap budgets are refreshed every
+    // frame; the per-resource list is built from allocations registered with Track().
+    // Crossing the soft budget first notifies eviction callbacks, and if usage stays
+    // above it, downscale callbacks.
+    class MemoryTelemetry
+    {
+    public:
+        MemoryTelemetry() = default;
+        ~MemoryTelemetry() = default;
+
+        MemoryTelemetry(const MemoryTelemetry&) = delete;
+        MemoryTelemetry& operator=(const MemoryTelemetry&) = delete;
+
+        void Initialize(VmaAllocator allocator, const MemoryBudgetSettings& settings = {});
+        void Cleanup();
+
+        void Track(VmaAllocation allocation, const String& name, MemoryCategory category);
+        void Untrack(VmaAllocation allocation);
+
+        // Refreshes heap budgets and evaluates the soft budget. Call once per frame.
+        void Update(uint32_t frameIndex);
+
+        // Full statistics including per-resource sizes. Walks every VMA block, so not per frame.
+        MemoryReport GenerateReport() const;
+
+        const Vector<HeapBudget>& GetHeapBudgets() const { return m_heaps; }
+        VkDeviceSize GetDeviceLocalUsage() const { return m_deviceLocalUsage; }
+        VkDeviceSize GetSoftBudget() const { return m_softBudget; }
+
+        void SetBudgetSettings(const MemoryBudgetSettings& settings) { m_settings = settings; }
+
+        void AddEvictionCallback(MemoryPressureCallback callback) { m_evictionCallbacks.push_back(std::move(callback)); }
+        void AddDownscaleCallback(MemoryPressureCallback callback) { m_downscaleCallbacks.push_back(std::move(callback)); }
+
+    private:
+        enum class PressureState
+        {
+            NONE,
+            EVICTING,
+            DOWNSCALED,
+        };
+
+        void EvaluatePressure();
+
+    private:
+        VmaAllocator m_allocator = VK_NULL_HANDLE;
+        MemoryBudgetSettings m_settings;
+
+        Vector<bool> m_heapIsDeviceLocal;
+        Vector<HeapBudget> m_heaps;
+        VkDeviceSize m_deviceLocalUsage = 0;
+        VkDeviceSize m_deviceLocalBudget = 0;
+        VkDeviceSize m_softBudget = 0;
+
+        mutable std::mutex m_trackMutex;
+        Map<VmaAllocation, ResourceMemory> m_tracked;
+
+        PressureState m_pressureState = PressureState::NONE;
+        uint32_t m_framesSinceEviction = 0;
+        Vector<MemoryPressureCallback> m_evictionCallbacks;
+        Vector<MemoryPressureCallback> m_downscaleCallbacks;
+    };
+}
@@ -34,6 +34,9 @@ namespace Magma
         VkPipeline m_pipeline = VK_NULL_HANDLE;
         VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
 
+        // False when the layout is borrowed from another pipeline, which destroys it
+        bool m_ownsLayout = true;
+
         bool CreatePipelineLayout(const PipelineLayoutInfo& layoutInfo);
 
         Pipeline() = default;
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <types/Containers.h>
+#include <magma_engine/core/renderer/RenderGraph.h>
+#include <magma_engine/core/renderer/StageProfiler.h>
+
+namespace Magma
+{
+    struct PrimitiveBenchmarkResult
+    {
+        String instanceName;
+        ComputePrimitive type = ComputePrimitive::REDUCE;
+        uint32_t elementCount = 0;
+
+        // Average GPU time of all the instance's stages in a frame
+        double gpuTimeMs = 0.0;
+        uint32_t samples = 0;
+
+        double GetElementsPerSecond() const { return gpuTimeMs > 0.0 ? elementCount / (gpuTimeMs * 1e-3) : 0.0; }
+    };
+
+    // Measures the throughput of the compute primitives in the graph. The profiled GPU times of the
+    // stages of each primitive instance are summed per frame and averaged over the samples, then
+    // logged as elements per second along with the device they were measured on.
+    class PrimitiveBenchmark
+    {
+    public:
+        PrimitiveBenchmark() = default;
+        ~PrimitiveBenchmark() = default;
+
+        // Frames still in flight or warming caches up are skipped before sampling starts
+        void Start(RenderGraph& graph, const String& deviceName, uint32_t warmupFrames, uint32_t samples);
+        void Stop() { m_running = false; }
+
+        // After the profiler's BeginFrame() for the slot
+        void Update(const StageProfiler& profiler, bool hasStats);
+
+        bool IsRunning() const { return m_running; }
+        const Vector<PrimitiveBenchmarkResult>& GetResults() const { return m_results; }
+
+    private:
+        void Finish();
+
+    private:
+        bool m_running = false;
+        String m_deviceName;
+        uint32_t m_warmupFrames = 0;
+        uint32_t m_samples = 0;
+        uint32_t m_frame = 0;
+
+        // Graph positions of each instance's stages, parallel to m_results
+        Vector<Vector<uint32_t>> m_stageIndices;
+        Vector<PrimitiveBenchmarkResult> m_results;
+    };
+}
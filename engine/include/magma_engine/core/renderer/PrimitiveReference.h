@@ -0,0 +1,29 @@
+#pragma once
+
+#include <types/Containers.h>
+#include <magma_engine/core/renderer/StageConfiguration.h>
+
+namespace Magma
+{
+    // CPU versions of the compute primitives of StageFactory, written for clarity rather than speed.
+    // Given the same input they produce the same values the GPU stages leave in their buffers.
+    class PrimitiveReference
+    {
+    public:
+        // What a random fill stage with the same seed and mask writes
+        static Vector<uint32_t> RandomFill(uint32_t elementCount, uint32_t seed, uint32_t valueMask = 0xFFFFFFFF);
+
+        // MIN of no values is 0xFFFFFFFF, every other operation gives 0
+        static uint32_t Reduce(const Vector<uint32_t>& values, ReduceOperation operation);
+
+        static Vector<uint32_t> ExclusiveScan(const Vector<uint32_t>& values);
+
+        // Only the kept values, the GPU leaves the rest of its output untouched
+        static Vector<uint32_t> Compact(const Vector<uint32_t>& values, const Vector<uint32_t>& flags);
+
+        static Vector<uint32_t> Histogram(const Vector<uint32_t>& values, uint32_t binCount, uint32_t binShift = 0);
+
+        // Stable sort of the pairs by the low keyBits bits of the keys, rounded up to whole bytes
+        static void RadixSort(Vector<uint32_t>& keys, Vector<uint32_t>& values, uint32_t keyBits = 32);
+    };
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <types/Containers.h>
+#include <types/VkTypes.h>
+#include <magma_engine/core/renderer/Buffer.h>
+#include <magma_engine/core/renderer/RenderGraph.h>
+
+// Primitives are checked once after initialization in debug builds. Release builds can opt in
+// with -DMAGMA_VALIDATE_PRIMITIVES=1 or call RenderOrchestrator::StartPrimitiveValidation().
+#ifndef MAGMA_VALIDATE_PRIMITIVES
+    #ifdef NDEBUG
+        #define MAGMA_VALIDATE_PRIMITIVES 0
+    #else
+        #define MAGMA_VALIDATE_PRIMITIVES 1
+    #endif
+#endif
+
+namespace Magma
+{
+    class BufferRegistry;
+    class RenderResourceAllocator;
+
+    // Checks the compute primitives in the graph against PrimitiveReference. The next frame copies
+    // the inputs of each instance before its first stage and its outputs after its last stage into
+    // mapped buffers, which are compared once the frame slot comes around again.
+    class PrimitiveValidator
+    {
+    public:
+        PrimitiveValidator() = default;
+        ~PrimitiveValidator() = default;
+
+        void Start(RenderGraph& graph, RenderResourceAllocator& allocator);
+        void Stop();
+
+        // At the start of the frame, after the slot's fence was waited for
+        void Update(uint32_t frameIndex);
+
+        // Around the stage at stageIndex, with the frame's buffer versions current
+        void BeforeStage(VkCommandBuffer cmd, uint32_t stageIndex, const BufferRegistry& bufferRegistry);
+        void AfterStage(VkCommandBuffer cmd, uint32_t stageIndex, const BufferRegistry& bufferRegistry);
+
+        bool IsRunning() const { return m_state != State::IDLE; }
+
+        // Instances that did not match their reference on the last run
+        uint32_t GetFailureCount() const { return m_failureCount; }
+
+    private:
+        enum class State
+        {
+            IDLE,
+            PENDING,
+            RECORDING,
+            WAITING
+        };
+
+        struct Readback
+        {
+            String bufferName;
+            AllocatedBuffer buffer;
+        };
+
+        struct Instance
+        {
+            ComputePrimitiveInfo info;
+            uint32_t firstStage = 0;
+            uint32_t lastStage = 0;
+
+            // Parallel to info.bufferNames, empty where the buffer is not read back
+            Vector<Readback> inputs;
+            Vector<Readback> outputs;
+        };
+
+        void CopyBuffers(VkCommandBuffer cmd, Vector<Readback>& readbacks, const BufferRegistry& bufferRegistry);
+        bool Check(const Instance& instance) const;
+        void DestroyReadbacks();
+
+    private:
+        State m_state = State::IDLE;
+        uint32_t m_frameIndex = 0;
+        uint32_t m_failureCount = 0;
+
+        RenderResourceAllocator* m_allocator = nullptr;
+        Vector<Instance> m_instances;
+    };
+}
@@ -30,11 +30,19 @@ namespace Magma
         Vector<String> GetExecutionOrder() const;
         size_t GetStageCount() const { return m_executionOrder.size(); }
 
+        // Merges consecutive pixel stages where the first one's output only feeds the second one.
+        // The intermediate buffer disappears from the graph. Must run before the stages are
+        // initialized, returns the number of stages removed.
+        size_t FusePixelStages();
+
         Vector<BufferRequirement> CollectAllBufferRequirements() const;
         Map<String, BufferRequirement> CollectUniqueBufferRequirements() const;
+        Map<String, StorageBufferRequirement> CollectUniqueStorageBufferRequirements() const;
 
         void Cleanup();
         void OnResolutionChanged(VkExtent2D newExtent);
+        void InvalidateDescriptors();
+        void InvalidateDescriptors(const String& bufferName);
 
         String GetFinalOutputBufferName() const;
 
@@ -75,10 +83,12 @@ namespace Magma
         StageIterator end() { return StageIterator(m_executionOrder.end(), &m_stages); }
 
     private:
-        void RebuildExecutionOrder();
+        bool CanFusePixelStages(const RenderStage& first, const RenderStage& second) const;
 
     private:
         Map<String, std::unique_ptr<RenderStage>> m_stages;
+
+        // Insertion order of the stages
         Vector<String> m_executionOrder;
         Vector<StageConnection> m_connections;
     };
@@ -6,6 +6,13 @@
 #include <magma_engine/core/renderer/RenderStage.h>
 #include <magma_engine/core/renderer/RenderGraph.h>
 #include <magma_engine/core/renderer/RenderResourceAllocator.h>
+#include <magma_engine/core/renderer/StageProfiler.h>
+#include <magma_engine/core/renderer/DynamicResolution.h>
+#include <magma_engine/core/renderer/StageSynchronizer.h>
+#include <magma_engine/core/renderer/SwizzleBenchmark.h>
+#include <magma_engine/core/renderer/PrimitiveBenchmark.h>
+#include <magma_engine/core/renderer/PrimitiveValidator.h>
+#include <magma_engine/core/renderer/WorkgroupTuner.h>
 #include <memory>
 
 namespace Magma
@@ -18,12 +25,28 @@ namespace Magma
 
         void AddStage(std::unique_ptr<RenderStage> stage);
 
-        void Initialize(
+        // Fuses consecutive pixel stages on Initialize(), see RenderGraph::FusePixelStages().
+        // Buffers between fused stages are not allocated, disable it to inspect them.
+        void SetStageFusion(bool enabled) { m_stageFusion = enabled; }
+
+        // Must be set before Initialize() for split barriers between stages
+        void SetSynchronizerSettings(const StageSynchronizerSettings& settings) { m_synchronizerSettings = settings; }
+
+        // Must be set before Initialize(). Compute stages are created against these limits and take
+        // their workgroup sizes from the tuning cache, untuned stages are tuned on the first frames.
+        void SetComputeDeviceInfo(const ComputeDeviceInfo& computeInfo) { m_computeDeviceInfo = computeInfo; }
+        void SetWorkgroupTunerSettings(const WorkgroupTunerSettings& settings) { m_workgroupTunerSettings = settings; }
+
+        // Fails when a stage cannot run on the device, nothing is left allocated then
+        bool Initialize(
             std::shared_ptr<RenderResourceAllocator> resourceAllocator,
-            VkExtent2D swapchainExtent
+            VkExtent2D swapchainExtent,
+            uint32_t framesInFlight,
+            const StageProfilerSettings& profilerSettings = StageProfilerSettings{}
         );
 
-        void Execute(VkCommandBuffer cmd);
+        // frameNumber counts every executed frame, stages receive it through their push constants
+        void Execute(VkCommandBuffer cmd, uint32_t frameIndex, uint32_t frameNumber);
 
         void Cleanup();
 
@@ -33,21 +56,90 @@ namespace Magma
 
         void OnResolutionChanged(VkExtent2D newExtent);
 
+        // Stages rewrite their descriptors from the buffer registry, e.g. after images moved in memory
+        void InvalidateDescriptors();
+
         // Access to the render graph for advanced configuration
         RenderGraph& GetRenderGraph() { return m_renderGraph; }
         const RenderGraph& GetRenderGraph() const { return m_renderGraph; }
 
+        const StageProfiler& GetProfiler() const { return m_profiler; }
+        const StageSynchronizer& GetSynchronizer() const { return m_synchronizer; }
+
+        // Times stages with a dispatch swizzle against row-major order over the next frames,
+        // needs timestamp queries. Lock the dynamic resolution scale while it runs.
+        void StartSwizzleBenchmark(uint32_t framesPerMode = 30, uint32_t samplesPerMode = 120);
+        const SwizzleBenchmark& GetSwizzleBenchmark() const { return m_swizzleBenchmark; }
+
+        const WorkgroupTuner& GetWorkgroupTuner() const { return m_workgroupTuner; }
+
+        // Throughput of the compute primitives in the graph over the next frames, needs timestamp queries
+        void StartPrimitiveBenchmark(uint32_t warmupFrames = 30, uint32_t samples = 120);
+        const PrimitiveBenchmark& GetPrimitiveBenchmark() const { return m_primitiveBenchmark; }
+
+        // Runs the compute primitives in the graph once on the next frame and compares what they
+        // leave in their buffers with PrimitiveReference. Debug builds do this after Initialize().
+        void StartPrimitiveValidation();
+        const PrimitiveValidator& GetPrimitiveValidator() const { return m_primitiveValidator; }
+
+        // Scales the rendered region of resolution-dependent images from the profiled GPU time.
+        // Needs timestamp queries, the scale stays put without them.
+        DynamicResolution& GetDynamicResolution() { return m_dynamicResolution; }
+
+        // Size resolution-dependent images are allocated at
+        VkExtent2D GetAllocatedExtent() const { return m_currentExtent; }
+
+        // Region of them the last Execute() rendered
+        VkExtent2D GetRenderExtent() const { return m_renderExtent; }
+
+        // Region of the final output holding the frame, the whole image after an upscaler
+        VkExtent2D GetOutputExtent() const { return m_outputExtent; }
+
     private:
         void CollectBufferRequirements();
+        void ResolveHistoryRequirements();
+        void SwapHistoryBuffers();
         void AllocateBuffers();
         void DeallocateBuffers();
+        void ResetStorageBuffers(VkCommandBuffer cmd, const BufferRegistry& bufferRegistry);
+        void ReportGpuZones(uint32_t frameIndex);
 
     private:
         RenderGraph m_renderGraph;
         std::weak_ptr<RenderResourceAllocator> m_resourceAllocator;
         Map<String, BufferRequirement> m_bufferRequirements;
+        Map<String, StorageBufferRequirement> m_storageBufferRequirements;
+
+        // Buffers whose previous frame is read through HistoryBufferName()
+        Vector<String> m_historyBuffers;
+        uint32_t m_historyFrames = 0;
+
+        // Set when a buffer is shared by consecutive frames, which then have to be ordered on the GPU.
+        // With only per-frame buffers a frame never waits for the previous one's stages.
+        bool m_needsFrameBarrier = true;
+        uint32_t m_framesInFlight = 1;
+        StageProfiler m_profiler;
+        StageSynchronizer m_synchronizer;
+        StageSynchronizerSettings m_synchronizerSettings;
+        SwizzleBenchmark m_swizzleBenchmark;
+        PrimitiveBenchmark m_primitiveBenchmark;
+        PrimitiveValidator m_primitiveValidator;
+        ComputeDeviceInfo m_computeDeviceInfo;
+        WorkgroupTunerSettings m_workgroupTunerSettings;
+        WorkgroupTuner m_workgroupTuner;
+
+        // Reused across frames to keep its storage
+        DescriptorWriter m_descriptorWriter;
+
+        // Interned stage names and the CPU time each frame slot was recorded at, for the trace export
+        Vector<const char*> m_stageZoneNames;
+        Vector<uint64_t> m_frameRecordTimeNs;
 
         VkExtent2D m_currentExtent = {0, 0};
+        VkExtent2D m_renderExtent = {0, 0};
+        VkExtent2D m_outputExtent = {0, 0};
+        DynamicResolution m_dynamicResolution;
+        bool m_stageFusion = true;
         bool m_initialized = false;
     };
 }
@@ -1,53 +1,169 @@
 #pragma once
 
+#include <deque>
+#include <list>
 #include <memory>
 #include <types/Containers.h>
 #include <types/VkTypes.h>
 #include <vk_mem_alloc.h>
 #include <vulkan/vulkan.h>
 #include <magma_engine/core/renderer/Image.h>
+#include <magma_engine/core/renderer/Buffer.h>
 #include <magma_engine/core/renderer/BufferRegistry.h>
+#include <magma_engine/core/renderer/DeferredReleaseQueue.h>
+#include <magma_engine/core/renderer/MemoryTelemetry.h>
+#include <magma_engine/core/renderer/ResourcePools.h>
+#include <magma_engine/core/renderer/MemoryDefragmenter.h>
 #include <magma_engine/core/renderer/DescriptorManager.h>
 #include <magma_engine/core/renderer/RenderStage.h>
 
 namespace Magma
 {
+    // Everything that makes two images interchangeable
+    struct ImagePoolKey
+    {
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkImageUsageFlags usage = 0;
+        VkExtent2D extent = {0, 0};
+        ResourceClass resourceClass = ResourceClass::RENDER_TARGET;
+
+        bool operator<(const ImagePoolKey& other) const;
+        bool operator==(const ImagePoolKey& other) const;
+    };
+
+    struct ImagePoolSettings
+    {
+        // Frames a released image stays available for reuse
+        uint64_t retentionFrames = 240;
+
+        // Pooled bytes above which the oldest images are destroyed early
+        VkDeviceSize maxPooledBytes = 256ull * 1024 * 1024;
+    };
+
+    struct ImagePoolStats
+    {
+        uint32_t pooledImages = 0;
+        VkDeviceSize pooledBytes = 0;
+        uint64_t reusedImages = 0;
+        uint64_t createdImages = 0;
+    };
+
     class RenderResourceAllocator
     {
     public:
         RenderResourceAllocator() = default;
         ~RenderResourceAllocator() = default;
 
-        void Initialize(VkDevice device, VmaAllocator allocator);
+        // Destroyed images are handed to releaseQueue, which must outlive the allocator.
+        // Allocations are reported to telemetry when one is given.
+        void Initialize(VkDevice device, VmaAllocator allocator, DeferredReleaseQueue& releaseQueue, MemoryTelemetry* telemetry = nullptr);
 
-        void AllocateImages(const Map<String, BufferRequirement>& requirements, VkExtent2D extent);
+        // Per-frame requirements get frameVersions images, registered as versions of one buffer.
+        // Internally each version is named "<buffer>#<version>".
+        void AllocateImages(const Map<String, BufferRequirement>& requirements, VkExtent2D extent, uint32_t frameVersions = 1);
+
+        // Only reallocates images whose extent follows the swapchain. Replaced images go back
+        // to the pool, so sizes that come back shortly after are served without allocating.
+        // Returns the names of the replaced images.
+        Vector<String> ResizeImages(const Map<String, BufferRequirement>& requirements, VkExtent2D extent);
+
+        // Destroys every image including the pooled ones
         void DeallocateImages();
 
+        // Graph storage buffers, frameVersions buffers each registered as versions of one name
+        void AllocateStorageBuffers(const Map<String, StorageBufferRequirement>& requirements, uint32_t frameVersions);
+        void DeallocateStorageBuffers();
+
+        // Pooled images become reusable once completedFrame has passed the frame they were
+        // released in, and are destroyed after the retention window
+        void UpdateImagePool(uint64_t currentFrame, uint64_t completedFrame);
+        void SetImagePoolSettings(const ImagePoolSettings& settings) { m_imagePoolSettings = settings; }
+        ImagePoolStats GetImagePoolStats() const;
+
         std::shared_ptr<AllocatedImage> GetImage(const String& name) const;
+
+        // Exchanges the images behind two names, e.g. a history resource and its previous frame.
+        // Both must have been allocated with the same key and neither may be per-frame.
+        void SwapImages(const String& first, const String& second);
+
+        // Keyed by internal name, so every version of a per-frame buffer is listed
         const Map<String, std::shared_ptr<AllocatedImage>>& GetAllImages() const;
 
         std::shared_ptr<DescriptorManager> GetDescriptorManager() const;
 
+        // Standalone buffers, e.g. upload destinations. Destruction is deferred until in-flight frames complete.
+        // READBACK buffers come back persistently mapped.
+        AllocatedBuffer CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, ResourceClass resourceClass = ResourceClass::PERSISTENT,
+            const String& debugName = "buffer");
+        void DestroyBuffer(AllocatedBuffer& buffer);
+
         VkDevice GetDevice() const;
         VmaAllocator GetAllocator() const;
 
+        // Moves allocated images to compact memory, see MemoryDefragmenter
+        MemoryDefragmenter& GetDefragmenter() { return m_defragmenter; }
+
         BufferRegistry& GetBufferRegistry();
         const BufferRegistry& GetBufferRegistry() const;
 
+        // Hands everything the allocator owns to the release queue. The pools stay alive
+        // until DestroyPools(), since the queued allocations still belong to them.
         void Cleanup();
 
+        // The release queue must have been flushed since Cleanup()
+        void DestroyPools();
+
         bool IsInitialized() const { return m_initialized; }
 
     private:
         bool m_initialized = false;
         VkDevice m_device = VK_NULL_HANDLE;
         VmaAllocator m_allocator = VK_NULL_HANDLE;
+        DeferredReleaseQueue* m_releaseQueue = nullptr;
+        MemoryTelemetry* m_telemetry = nullptr;
 
         std::shared_ptr<DescriptorManager> m_descriptorManager;
         BufferRegistry m_bufferRegistry;
+        ResourcePools m_pools;
+        MemoryDefragmenter m_defragmenter;
         Map<String, std::shared_ptr<AllocatedImage>> m_allocatedImages;
+        Map<String, ImagePoolKey> m_allocatedImageKeys;
+        Map<String, Vector<AllocatedBuffer>> m_storageBuffers;
+
+        struct PooledImage
+        {
+            ImagePoolKey key;
+            std::shared_ptr<AllocatedImage> image;
+            uint64_t releasedFrame;
+            VkDeviceSize size;
+        };
+
+        // Release order, oldest first, so trimming only ever looks at the front
+        std::list<PooledImage> m_imagePool;
+        // The same entries grouped by key, each group in release order
+        Map<ImagePoolKey, std::deque<std::list<PooledImage>::iterator>> m_imagePoolByKey;
+        ImagePoolSettings m_imagePoolSettings;
+        VkDeviceSize m_pooledBytes = 0;
+        uint64_t m_reusedImages = 0;
+        uint64_t m_createdImages = 0;
+
+        // Frames below this value have completed on the GPU
+        uint64_t m_completedFrameCount = 0;
+        uint64_t m_currentFrame = 0;
+
+        uint32_t m_frameVersions = 1;
+
+        static ImagePoolKey MakeImageKey(const BufferRequirement& requirement, VkExtent2D swapchainExtent);
+        static String VersionName(const String& name, uint32_t version, uint32_t versionCount);
+
+        uint32_t GetVersionCount(const BufferRequirement& requirement) const;
+        void AllocateVersions(const String& name, const BufferRequirement& requirement, const ImagePoolKey& key);
+
+        std::shared_ptr<AllocatedImage> AcquireImage(const ImagePoolKey& key, const String& name);
+        void ReleaseImage(const String& name);
+        void TrimImagePool();
 
-        AllocatedImage CreateImage(VkFormat format, VkImageUsageFlags usage, VkExtent2D extent);
+        AllocatedImage CreateImage(const ImagePoolKey& key);
         void DestroyImage(std::shared_ptr<AllocatedImage> image);
     };
 }
@@ -6,7 +6,9 @@
 #include <magma_engine/core/renderer/ShaderModule.h>
 #include <magma_engine/core/renderer/DescriptorManager.h>
 #include <magma_engine/core/renderer/BufferRegistry.h>
+#include <magma_engine/core/renderer/StageProfiler.h>
 #include <variant>
+#include <optional>
 #include <memory>
 
 namespace Magma
@@ -21,6 +23,20 @@ namespace Magma
         VkImageLayout expectedLayout;
         bool isInput;
         bool isOutput;
+        ResourceClass resourceClass = ResourceClass::RENDER_TARGET;
+        bool perFrame = false;
+    };
+
+    struct StorageBufferRequirement
+    {
+        String name;
+        VkDeviceSize size = 0;
+        VkBufferUsageFlags usage = 0;
+        bool clearEachFrame = false;
+        bool isOutput = false;
+
+        // Offsets of the VkDispatchIndirectCommands read from the buffer
+        Vector<VkDeviceSize> indirectArgsOffsets;
     };
 
     struct StageDebugInfo
@@ -29,6 +45,7 @@ namespace Magma
         Vector<String> inputBuffers;
         Vector<String> outputBuffers;
         Map<String, String> metadata;
+        StageGpuStats gpuStats;
     };
 
     class RenderStage
@@ -40,19 +57,64 @@ namespace Magma
         // IRenderStage interface implementation
         String GetStageName() const;
         Vector<BufferRequirement> GetBufferRequirements() const;
+        Vector<StorageBufferRequirement> GetStorageBufferRequirements() const;
 
-        void Initialize(
+        // One descriptor set is kept per frame in flight, so sets can be rewritten
+        // while earlier frames still use theirs. Fails when the device cannot run the stage
+        // or its pipeline cannot be created.
+        bool Initialize(
             VkDevice device,
             BufferRegistry& bufferRegistry,
-            std::shared_ptr<DescriptorManager> descriptorManager
+            std::shared_ptr<DescriptorManager> descriptorManager,
+            uint32_t framesInFlight,
+            const ComputeDeviceInfo& computeInfo = ComputeDeviceInfo{}
         );
 
-        void Execute(VkCommandBuffer cmd);
+        // Queues writes for the slot's stale bindings only. Must run before Execute() for the same slot.
+        void PrepareDescriptors(uint32_t frameIndex, DescriptorWriter& writer);
+
+        void Execute(VkCommandBuffer cmd, uint32_t frameIndex);
+
+        // Marks bindings stale in every frame slot, they are refreshed from the registry when the
+        // slot is next prepared. Call after registered images have been recreated or moved.
+        void InvalidateDescriptors();
+        void InvalidateDescriptors(const String& bufferName);
 
         void Cleanup();
         void OnResolutionChanged(VkExtent2D newExtent);
+
+        // Values for the next Execute(). The render size limits the dispatch to the active
+        // region of the resolution-dependent images.
+        void SetFrameConstants(const StagePushConstants& constants) { m_frameConstants = constants; }
+
+        // Stage specific push constant values, pushed at the configured offset on every Execute()
+        void SetPushConstantData(const void* data, uint32_t size);
+
+        // Disabled, the configured dispatch swizzle falls back to row-major order, e.g. for benchmarking
+        void SetDispatchSwizzleEnabled(bool enabled) { m_dispatchSwizzleEnabled = enabled; }
+        bool HasDispatchSwizzle() const { return m_config.IsCompute() && m_config.GetComputeConfig().swizzle != DispatchSwizzle::NONE; }
+
+        // Extra compute pipelines with other workgroup sizes, for the WorkgroupTuner. They share the
+        // stage's layout and descriptors, Execute() runs the selected one.
+        bool AddWorkgroupVariant(const ComputeConfig& computeConfig);
+        uint32_t GetWorkgroupVariantCount() const { return static_cast<uint32_t>(m_workgroupVariants.size()); }
+
+        // std::nullopt runs the configured pipeline
+        void SelectWorkgroupVariant(std::optional<uint32_t> variant);
+
+        // Makes the variant the configured pipeline and releases the variants
+        void CommitWorkgroupVariant(uint32_t variant);
+
+        // Drops all variants. Frames in flight may still use them, so their pipelines are destroyed
+        // once as many frames as there are frame slots have been executed.
+        void ReleaseWorkgroupVariants();
+
         StageDebugInfo GetDebugInfo() const;
 
+        // Takes the raw GPU counters for this stage and derives per-pixel metrics from its declared resources
+        void ApplyGpuStats(const StageGpuStats& stats);
+        const StageGpuStats& GetGpuStats() const { return m_gpuStats; }
+
         // Configuration access
         const StageConfiguration& GetConfiguration() const { return m_config; }
         void UpdateConfiguration(const StageConfiguration& config);
@@ -60,29 +122,60 @@ namespace Magma
     private:
         void LoadShaders(VkDevice device);
         void CreateDescriptorLayouts();
-        void CreatePipeline(VkDevice device);
-        void AllocateDescriptors();
-        void UpdateDescriptorSets(BufferRegistry& bufferRegistry);
+        bool CreatePipeline(VkDevice device);
+        void AllocateDescriptors(uint32_t framesInFlight);
+        uint32_t WriteDescriptorSet(uint32_t frameIndex, BufferRegistry& bufferRegistry, DescriptorWriter& writer, bool staleOnly);
 
         Vector<BufferRequirement> GenerateBufferRequirements() const;
 
-        void ExecuteCompute(VkCommandBuffer cmd);
-        void ExecuteGraphics(VkCommandBuffer cmd);
+        void ExecuteCompute(VkCommandBuffer cmd, VkDescriptorSet descriptorSet, uint32_t frameIndex);
+        void ExecuteGraphics(VkCommandBuffer cmd, VkDescriptorSet descriptorSet);
+
+        void PushStageConstants(VkCommandBuffer cmd, VkPipelineLayout layout) const;
+        const ComputeConfig& GetActiveComputeConfig() const;
+        ComputeSpecialization GetComputeSpecialization(const ComputeConfig& computeConfig) const;
+        VkExtent2D GetRenderExtent() const;
+        VkExtent3D GetDispatchGroupCount() const;
+        uint64_t EstimateResourceBytes(bool inputs) const;
 
     private:
+        struct WorkgroupVariant
+        {
+            ComputeConfig config;
+            ComputePipeline pipeline;
+        };
+
         StageConfiguration m_config;
+        VkDevice m_device = VK_NULL_HANDLE;
+        ComputeDeviceInfo m_computeInfo;
 
         std::shared_ptr<DescriptorManager> m_descriptorManager = nullptr;
         VkExtent2D m_currentExtent = {0, 0};
+        StagePushConstants m_frameConstants;
+        Vector<uint8_t> m_pushConstantData;
+        VkShaderStageFlags m_stagePushConstantStages = 0;
+        bool m_dispatchSwizzleEnabled = true;
 
         Vector<ShaderModule> m_shaderModules;
 
         std::variant<ComputePipeline, GraphicsPipeline> m_pipeline;
 
+        Vector<WorkgroupVariant> m_workgroupVariants;
+        std::optional<uint32_t> m_activeWorkgroupVariant;
+        Vector<ComputePipeline> m_retiredPipelines;
+        uint32_t m_retiredPipelineFrames = 0;
+        uint32_t m_framesInFlight = 1;
+
         VkDescriptorSetLayout m_descriptorLayout = VK_NULL_HANDLE;
-        VkDescriptorSet m_descriptorSet = VK_NULL_HANDLE;
+        Vector<VkDescriptorSet> m_descriptorSets;
+        // Per frame slot, the bindings whose image changed since the set was last written
+        Vector<Set<uint32_t>> m_staleBindings;
+        BufferRegistry* m_bufferRegistry = nullptr;
+
+        StageGpuStats m_gpuStats;
 
         bool m_initialized = false;
+        bool m_warnedGraphicsUnimplemented = false;
     };
 }
 
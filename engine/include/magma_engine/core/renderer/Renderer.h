@@ -5,6 +5,10 @@
 #include <magma_engine/ServiceLocater.h>
 #include <magma_engine/core/renderer/Image.h>
 #include <magma_engine/core/renderer/DeletionQueue.h>
+#include <magma_engine/core/renderer/DeferredReleaseQueue.h>
+#include <magma_engine/core/renderer/GpuSubmitter.h>
+#include <magma_engine/core/renderer/StagingUploader.h>
+#include <magma_engine/core/renderer/MemoryTelemetry.h>
 #include <magma_engine/core/renderer/ShaderModule.h>
 #include <magma_engine/core/renderer/RenderResourceAllocator.h>
 #include <magma_engine/core/renderer/RenderOrchestrator.h>
@@ -22,13 +26,6 @@ namespace Magma
         DeletionQueue m_deletionQueue;
     };
 
-    struct ImmRenderData
-    {
-        VkFence immFence;
-        VkCommandBuffer immCommandBuffer;
-        VkCommandPool immCommandPool;
-    };
-
     class Renderer : public IService
     {
     public:
@@ -36,15 +33,31 @@ namespace Magma
         void Cleanup() override;
         FrameData& get_current_frame() { return m_frames[m_frameNumber % FRAME_OVERLAP]; };
 
+        // Blocking wrapper around the GpuSubmitter, prefer Submit() and co_await the result
         void immediate_submit(std::function<void(VkCommandBuffer cmd)>&& function);
-
-        void BeginFrame();
+        GpuFuture Submit(std::function<void(VkCommandBuffer cmd)>&& function) { return m_gpuSubmitter.Submit(std::move(function)); }
+        GpuSubmitter& GetGpuSubmitter() { return m_gpuSubmitter; }
+        StagingUploader& GetStagingUploader() { return m_stagingUploader; }
+        MemoryTelemetry& GetMemoryTelemetry() { return m_memoryTelemetry; }
+
+        // Returns false when no swapchain image could be acquired (minimized window or a
+        // swapchain being recreated); the rest of the frame must then be skipped
+        bool BeginFrame();
         void RenderScene();
         void CopyToSwapchain();
         void BeginUIRenderPass();
         void EndFrame();
         void Present();
         VkCommandBuffer GetCurrentCommandBuffer() { return get_current_frame().m_mainCommandBuffer; }
+        uint32_t GetFrameNumber() const { return m_frameNumber; }
+
+        // Resolution the render graph draws at, applied by the next BeginFrame. Until called the
+        // render resolution follows the swapchain.
+        void SetRenderExtent(VkExtent2D extent);
+
+        // With the copy disabled CopyToSwapchain only prepares the swapchain image for the UI pass,
+        // which then clears it. For the editor, where the scene is only shown through the viewport.
+        void SetCopyToSwapchain(bool enabled) { m_copyToSwapchain = enabled; }
         uint32_t GetCurrentSwapchainIndex() const { return m_currentSwapchainImageIndex; }
 
         // ImGui / Editor Integration
@@ -54,21 +67,35 @@ namespace Magma
         VkQueue GetGraphicsQueue() const { return m_graphicsQueue; }
         uint32_t GetGraphicsQueueFamily() const { return m_graphicsQueueFamily; }
         VkFormat GetSwapchainImageFormat() const { return m_swapchainImageFormat; }
-        std::shared_ptr<AllocatedImage> GetDrawImage() { return m_renderOrchestrator.GetBuffer("drawImage"); }
+        // Output of the last render stage, what gets displayed
+        std::shared_ptr<AllocatedImage> GetDrawImage() { return m_renderOrchestrator.GetFinalOutputBuffer(); }
+        // Region of the draw image the last frame rendered, smaller than the image under dynamic resolution
         VkExtent2D GetDrawExtent() const { return m_drawExtent; }
         VkSampler GetDrawImageSampler() const { return m_drawImageSampler; }
 
+        const RenderOrchestrator& GetRenderOrchestrator() const { return m_renderOrchestrator; }
+        DynamicResolution& GetDynamicResolution() { return m_renderOrchestrator.GetDynamicResolution(); }
+        DeferredReleaseQueue& GetDeferredReleaseQueue() { return m_deferredRelease; }
+
     private:
         void init_vulkan();
         void init_swapchain();
         void init_commands();
         void init_sync_structures();
         void init_descriptors();
+        void init_staging();
         void init_render_stages();
 
         void create_swapchain(Maths::Vec2<uint32_t> size);
         void destroy_swapchain();
 
+        // Hands the current swapchain over as oldSwapchain and retires it through the deferred
+        // release queue. Returns false while the window has no area.
+        bool recreate_swapchain();
+
+        // Resizes resolution-dependent render targets when the requested extent changed
+        void apply_render_extent();
+
     private:
         VkInstance m_instance;
         VkDebugUtilsMessengerEXT m_debugMessenger;
@@ -76,27 +103,56 @@ namespace Magma
         VkDevice m_device;
         VkSurfaceKHR m_surface;
 
-        VkSwapchainKHR m_swapchain;
+        VkSwapchainKHR m_swapchain = VK_NULL_HANDLE;
         VkFormat m_swapchainImageFormat;
         Vector<VkImage> m_swapchainImages;
         Vector<VkImageView> m_swapchainImageViews;
         VkExtent2D m_swapchainExtent;
 
+        // Set by out-of-date/suboptimal results and window resizes, handled by the next BeginFrame
+        bool m_swapchainOutOfDate = false;
+
+        // Replaced swapchains. The presentation engine may still hold their images until an
+        // image of the current swapchain has been presented, so they are only released then.
+        struct RetiredSwapchain
+        {
+            VkSwapchainKHR swapchain;
+            Vector<VkImageView> imageViews;
+        };
+        Vector<RetiredSwapchain> m_retiredSwapchains;
+
         Vector<FrameData> m_frames;
         uint32_t m_frameNumber {0};
         VkQueue m_graphicsQueue;
         uint32_t m_graphicsQueueFamily;
 
+        // Same as the graphics queue when the device has no dedicated transfer family
+        VkQueue m_transferQueue;
+        uint32_t m_transferQueueFamily;
+        std::mutex m_transferQueueMutex;
+
         VkExtent2D m_drawExtent;
+        VkExtent2D m_requestedRenderExtent = {0, 0};
+        bool m_renderExtentFollowsSwapchain = true;
+        bool m_copyToSwapchain = true;
 
         VmaAllocator m_allocator;
 
         DeletionQueue m_mainDeletionQueue;
+        DeferredReleaseQueue m_deferredRelease;
+        MemoryTelemetry m_memoryTelemetry;
+
+        GpuSubmitter m_gpuSubmitter;
+        StagingUploader m_stagingUploader;
 
-        ImmRenderData m_immRenderData;
+        // Upload timeline value the frame being recorded has to wait on, 0 for none
+        uint64_t m_frameUploadWaitValue = 0;
 
         std::shared_ptr<RenderResourceAllocator> m_resourceAllocator;
         RenderOrchestrator m_renderOrchestrator;
+        StageProfilerSettings m_profilerSettings;
+        StageSynchronizerSettings m_synchronizerSettings;
+        ComputeDeviceInfo m_computeDeviceInfo;
 
         VkSampler m_drawImageSampler;
 
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <mutex>
+#include <types/Containers.h>
+#include <types/VkTypes.h>
+
+namespace Magma
+{
+    // Allocation hint for a resource. Each class gets its own VMA placement so
+    // resolution-sized targets do not fragment the blocks small resources live in.
+    enum class ResourceClass
+    {
+        // Full-screen render targets, one dedicated allocation each
+        RENDER_TARGET = 0,
+
+        // Small textures and buffers that outlive a frame, own pool compacted by the defragmenter
+        PERSISTENT,
+
+        // Per-frame data freed in allocation order, single-block ring pool
+        TRANSIENT,
+
+        // GPU to CPU copies, host-cached and persistently mapped
+        READBACK,
+
+        COUNT
+    };
+
+    const char* ResourceClassToString(ResourceClass resourceClass);
+
+    struct ResourcePoolSettings
+    {
+        VkDeviceSize persistentBlockSize = 64ull * 1024 * 1024;
+        VkDeviceSize transientRingSize = 32ull * 1024 * 1024;
+        VkDeviceSize readbackBlockSize = 16ull * 1024 * 1024;
+    };
+
+    // Picks VMA creation parameters per resource class. Custom pools are created lazily
+    // per memory type, since images and buffers with different usage can land in
+    // different types.
+    class ResourcePools
+    {
+    public:
+        ResourcePools() = default;
+        ~ResourcePools() = default;
+
+        ResourcePools(const ResourcePools&) = delete;
+        ResourcePools& operator=(const ResourcePools&) = delete;
+
+        void Initialize(VmaAllocator allocator, const ResourcePoolSettings& settings = {});
+
+        // Every allocation made from the pools must have been freed
+        void Cleanup();
+
+        VmaAllocationCreateInfo GetImageAllocationInfo(ResourceClass resourceClass, const VkImageCreateInfo& imageInfo);
+        VmaAllocationCreateInfo GetBufferAllocationInfo(ResourceClass resourceClass, const VkBufferCreateInfo& bufferInfo);
+
+        // Pools VMA can defragment, linear pools are excluded
+        Vector<VmaPool> GetDefragmentablePools();
+
+    private:
+        VmaAllocationCreateInfo GetBaseAllocationInfo(ResourceClass resourceClass) const;
+        VmaPool GetOrCreatePool(ResourceClass resourceClass, uint32_t memoryTypeIndex);
+
+    private:
+        VmaAllocator m_allocator = VK_NULL_HANDLE;
+        ResourcePoolSettings m_settings;
+
+        std::mutex m_mutex;
+
+        // Keyed by resource class in the high bits and memory type index in the low bits
+        Map<uint64_t, VmaPool> m_pools;
+    };
+}
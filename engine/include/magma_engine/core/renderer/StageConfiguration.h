@@ -2,6 +2,7 @@
 
 #include <types/Containers.h>
 #include <types/VkTypes.h>
+#include <magma_engine/core/renderer/ResourcePools.h>
 #include <variant>
 #include <optional>
 
@@ -32,13 +33,72 @@ namespace Magma
         uint32_t binding;
         VkDescriptorType descriptorType;
         VkShaderStageFlags shaderStages;
+
+        // Render targets get dedicated allocations that never move. Small fixed-size images
+        // belong in PERSISTENT, the pool the MemoryDefragmenter compacts.
+        ResourceClass resourceClass = ResourceClass::RENDER_TARGET;
+
+        // One image per frame in flight, so consecutive frames never touch the same one.
+        // Not supported for history resources, which are shared across frames by design.
+        bool perFrame = false;
     };
 
+    // Order workgroups of a 2D dispatch are mapped to the image in, see Swizzle.glsl. Row-major
+    // order walks whole rows, so neighbourhood filters on large images evict the rows above
+    // from L2 before they are read again.
+    enum class DispatchSwizzle : uint32_t
+    {
+        NONE = 0,
+        // Vertical strips swizzleSize workgroups wide, walked row by row
+        TILE_STRIPS = 1,
+        // Morton order inside square blocks of swizzleSize workgroups, a power of two
+        MORTON = 2
+    };
+
+    // The workgroup size reaches the shader through specialization constants 0-2, see ComputeSpecialization
     struct ComputeConfig
     {
         uint32_t workgroupSizeX = 16;
         uint32_t workgroupSizeY = 16;
         uint32_t workgroupSizeZ = 1;
+
+        // 0 lets the driver pick, ignored without subgroup size control
+        uint32_t requiredSubgroupSize = 0;
+
+        // Lets the WorkgroupTuner replace the size. Disable for shaders that depend on it, e.g. through shared memory.
+        bool tuneWorkgroupSize = true;
+
+        // Only applied by shaders that remap their workgroup through Swizzle.glsl
+        DispatchSwizzle swizzle = DispatchSwizzle::NONE;
+        uint32_t swizzleSize = 8;
+
+        // Graph storage buffer holding a VkDispatchIndirectCommand at indirectArgsOffset, written
+        // by an earlier stage. Set, the group count is read on the GPU instead of derived from the
+        // render extent. The graph resets the command to { 0, 1, 1 } at the start of every frame.
+        String indirectArgsBuffer;
+        VkDeviceSize indirectArgsOffset = 0;
+
+        bool IsIndirect() const { return !indirectArgsBuffer.empty(); }
+
+        // Set, enough workgroups along x for this many invocations are dispatched instead of
+        // covering the render extent, for stages working on storage buffers
+        uint32_t invocationCount = 0;
+    };
+
+    // A buffer of the graph rather than an image, e.g. a tile list or the arguments of an indirect
+    // dispatch. Bound as VK_DESCRIPTOR_TYPE_STORAGE_BUFFER with one buffer per frame in flight.
+    // Names share one namespace with the graph images.
+    struct StorageBufferBinding
+    {
+        String bufferName;
+        uint32_t binding;
+        VkShaderStageFlags shaderStages = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        // Bytes, the graph allocates the largest size declared for the buffer
+        VkDeviceSize size = 0;
+
+        // Zeroed at the start of every frame, e.g. for counters and lists appended to atomically
+        bool clearEachFrame = false;
     };
 
     struct GraphicsConfig
@@ -50,6 +110,112 @@ namespace Magma
         bool enableBlending = false;
     };
 
+    // Per-frame values pushed at offset 0 to stages with useStagePushConstants. Compute shaders
+    // declare the matching block by including StageConstants.glsl.
+    // Resolution-dependent images are allocated at imageSize, stages only cover renderSize of them.
+    struct StagePushConstants
+    {
+        uint32_t renderWidth = 0;
+        uint32_t renderHeight = 0;
+        uint32_t imageWidth = 0;
+        uint32_t imageHeight = 0;
+        float renderScale = 1.0f;
+        uint32_t frameNumber = 0;
+
+        // Consecutive frames the history resources have been written at the current render size,
+        // 0 when their previous-frame contents are undefined
+        uint32_t historyFrames = 0;
+
+        // Filled in per stage, the DispatchSwizzle in the low 8 bits and the swizzle size above them
+        uint32_t dispatchSwizzle = 0;
+    };
+
+    // Declaring "<name>.prev" as a stage input turns <name> into a history resource: two images
+    // the graph swaps every frame, so "<name>.prev" holds what was written to <name> last frame
+    inline constexpr const char* k_HistorySuffix = ".prev";
+
+    inline String HistoryBufferName(const String& bufferName)
+    {
+        return bufferName + k_HistorySuffix;
+    }
+
+    // Part of the resolution-dependent images a stage covers
+    enum class StageResolution
+    {
+        // The active region picked by the render scale
+        RENDER,
+        // The whole image, for upscalers and the stages after them
+        DISPLAY
+    };
+
+    // Per-pixel operations of PixelChain.comp. Each reads and writes only its own texel, so the
+    // graph can fuse consecutive pixel stages into one dispatch that keeps intermediates in registers.
+    enum class PixelOperationType : uint32_t
+    {
+        // params[0]: exposure in stops
+        EXPOSURE = 0,
+        // params[0]: white point, 0 for the plain curve
+        REINHARD_TONEMAP = 1,
+        ACES_TONEMAP = 2,
+        // params: saturation, contrast, brightness offset
+        COLOR_GRADE = 3,
+        // params[0]: gamma
+        GAMMA = 4
+    };
+
+    struct PixelOperation
+    {
+        PixelOperationType type;
+        float params[3] = { 0.0f, 0.0f, 0.0f };
+    };
+
+    // Operations one pixel stage, fused or not, can run. Bounded by the push constant space.
+    inline constexpr uint32_t k_MaxPixelOperations = 4;
+
+    // Data-parallel building blocks on graph storage buffers of 32-bit unsigned values, see the
+    // primitive helpers of StageFactory
+    enum class ComputePrimitive : uint32_t
+    {
+        RANDOM_FILL,
+        REDUCE,
+        EXCLUSIVE_SCAN,
+        COMPACT,
+        HISTOGRAM,
+        RADIX_SORT
+    };
+
+    enum class ReduceOperation : uint32_t
+    {
+        // Wraps around on overflow
+        SUM = 0,
+        MIN = 1,
+        MAX = 2,
+        // Number of non-zero values
+        COUNT_NONZERO = 3
+    };
+
+    // Set on every stage of a primitive, the stages of one instance share the instance name
+    struct ComputePrimitiveInfo
+    {
+        ComputePrimitive type = ComputePrimitive::REDUCE;
+        String instanceName;
+        uint32_t elementCount = 0;
+
+        // The rest is what PrimitiveReference needs to compute the same result. The buffers come in
+        // the order the StageFactory helper takes them, e.g. input, flags, output and count.
+        Vector<String> bufferNames;
+        // Reduce operation, histogram bin count or radix sort key bits
+        uint32_t parameter = 0;
+        // Histogram bin shift
+        uint32_t shift = 0;
+        uint32_t seed = 0;
+        uint32_t valueMask = 0xFFFFFFFF;
+    };
+
+    // Primitive workgroups keep one value per subgroup in shared memory, see Primitives.glsl
+    inline constexpr uint32_t k_MaxPrimitiveWorkgroupSize = 256;
+    inline constexpr uint32_t k_MaxPrimitiveSubgroups = 64;
+
     struct PushConstantConfig
     {
         VkShaderStageFlags stageFlags;
@@ -68,10 +234,25 @@ namespace Magma
         Vector<BufferBinding> inputBuffers;
         Vector<BufferBinding> outputBuffers;
 
+        Vector<StorageBufferBinding> inputStorageBuffers;
+        Vector<StorageBufferBinding> outputStorageBuffers;
+
         std::variant<ComputeConfig, GraphicsConfig> pipelineConfig;
 
+        // Stage specific push constants must start at sizeof(StagePushConstants) when combined
         std::optional<PushConstantConfig> pushConstants;
+        bool useStagePushConstants = false;
+
+        StageResolution resolution = StageResolution::RENDER;
+
+        // Set on stages from StageFactory::CreatePixelStage(), which read binding 0 and write binding 1
+        Vector<PixelOperation> pixelOperations;
+
+        // Set on stages from the StageFactory primitive helpers
+        std::optional<ComputePrimitiveInfo> primitive;
 
+        bool IsPixelStage() const { return !pixelOperations.empty(); }
+        bool IsPrimitive() const { return primitive.has_value(); }
         bool IsCompute() const { return type == PipelineType::COMPUTE; }
         bool IsGraphics() const { return type == PipelineType::GRAPHICS; }
 
@@ -6,6 +6,42 @@
 
 namespace Magma
 {
+    struct UpscalerSettings
+    {
+        // 0 leaves the upsampled image as is, 1 sharpens the most
+        float sharpness = 0.5f;
+
+        String upsampleShaderPath = "assets/shaders/EdgeUpsample.comp.spv";
+        String sharpenShaderPath = "assets/shaders/ContrastAdaptiveSharpen.comp.spv";
+    };
+
+    struct TemporalAccumulateSettings
+    {
+        // Weight of the new frame once the history has converged, lower accumulates over more frames
+        float currentFrameWeight = 0.1f;
+
+        // Clamps history to the new frame's 3x3 neighbourhood, trading some noise for less ghosting
+        bool clampHistory = true;
+
+        String shaderPath = "assets/shaders/TemporalAccumulate.comp.spv";
+    };
+
+    struct ComputePrimitiveSettings
+    {
+        // Invocations per workgroup and elements per tile, a multiple of the subgroup size up to k_MaxPrimitiveWorkgroupSize
+        uint32_t workgroupSize = 256;
+
+        // Workgroups of the strided reduce and histogram passes, each walks the elements beyond them
+        uint32_t maxStridedWorkgroups = 1024;
+
+        // Workgroup size the dispatch written by a compaction is counted in
+        uint32_t indirectWorkgroupSize = 64;
+
+        String shaderDirectory = "assets/shaders/";
+    };
+
+    // Buffers written by the stages created here are per-frame, see BufferBinding::perFrame.
+    // Advanced and configuration-based stages keep whatever their bindings ask for.
     class StageFactory
     {
     public:
@@ -23,6 +59,20 @@ namespace Magma
             const Vector<BufferBinding>& outputs,
             const ComputeConfig& computeConfig = ComputeConfig{});
 
+        // Dispatches as many groups as an earlier stage wrote to indirectArgsBuffer, e.g. one per tile
+        // that needs work. The producer declares the buffer as an output storage buffer and writes a
+        // VkDispatchIndirectCommand at indirectArgsOffset, the graph resets it every frame and orders
+        // the dispatch after the producer.
+        static std::unique_ptr<RenderStage> CreateIndirectComputeStage(
+            const String& stageName,
+            const String& shaderPath,
+            const Vector<BufferBinding>& inputs,
+            const Vector<BufferBinding>& outputs,
+            const Vector<StorageBufferBinding>& storageInputs,
+            const String& indirectArgsBuffer,
+            VkDeviceSize indirectArgsOffset = 0,
+            const ComputeConfig& computeConfig = ComputeConfig{});
+
         static std::unique_ptr<RenderStage> CreateGraphicsStage(
             const String& stageName,
             const String& vertexShaderPath,
@@ -30,6 +80,97 @@ namespace Magma
             const String& outputBufferName,
             VkFormat colorFormat = VK_FORMAT_R16G16B16A16_SFLOAT);
 
+        // Edge-adaptive upsample followed by contrast-adaptive sharpening. Reads the render-scaled
+        // region of the input and fills the whole output, so every stage added after these runs
+        // at display resolution. The two stages must be added in the returned order.
+        static Vector<std::unique_ptr<RenderStage>> CreateUpscaleStages(
+            const String& stageName,
+            const String& inputBufferName,
+            const String& outputBufferName,
+            const UpscalerSettings& settings = UpscalerSettings{});
+
+        // Blends the input with the stage's own history into the output. The history lives in the
+        // "<stageName>History" resource and is reset whenever the render size changes.
+        static std::unique_ptr<RenderStage> CreateTemporalAccumulateStage(
+            const String& stageName,
+            const String& inputBufferName,
+            const String& outputBufferName,
+            const TemporalAccumulateSettings& settings = TemporalAccumulateSettings{});
+
+        // Runs up to k_MaxPixelOperations per-pixel operations from input to output in one
+        // dispatch. Consecutive pixel stages are fused by RenderGraph::FusePixelStages().
+        static std::unique_ptr<RenderStage> CreatePixelStage(
+            const String& stageName,
+            const String& inputBufferName,
+            const String& outputBufferName,
+            const Vector<PixelOperation>& operations,
+            const String& shaderPath = "assets/shaders/PixelChain.comp.spv");
+
+        // The primitives below work on graph storage buffers of elementCount 32-bit unsigned values,
+        // declared at the size they need. Multi-stage primitives return their stages in the order
+        // they must be added, their intermediate buffers are named after stageName.
+        // PrimitiveReference computes the same results on the CPU.
+
+        // Deterministic pseudo-random values, e.g. input for benchmarking the other primitives
+        static std::unique_ptr<RenderStage> CreateRandomFillStage(
+            const String& stageName,
+            const String& outputBufferName,
+            uint32_t elementCount,
+            uint32_t seed,
+            uint32_t valueMask = 0xFFFFFFFF,
+            const ComputePrimitiveSettings& settings = ComputePrimitiveSettings{});
+
+        // Writes the reduction of the input to the first value of the output
+        static Vector<std::unique_ptr<RenderStage>> CreateReduceStages(
+            const String& stageName,
+            const String& inputBufferName,
+            const String& outputBufferName,
+            uint32_t elementCount,
+            ReduceOperation operation = ReduceOperation::SUM,
+            const ComputePrimitiveSettings& settings = ComputePrimitiveSettings{});
+
+        // output[i] is the sum of input[0] to input[i - 1], wrapping around on overflow. The total
+        // is left in the first value of "<stageName>Total".
+        static Vector<std::unique_ptr<RenderStage>> CreateExclusiveScanStages(
+            const String& stageName,
+            const String& inputBufferName,
+            const String& outputBufferName,
+            uint32_t elementCount,
+            const ComputePrimitiveSettings& settings = ComputePrimitiveSettings{});
+
+        // Moves the input values with a non-zero flag to the front of the output, in order. The
+        // count buffer receives the number kept followed by a VkDispatchIndirectCommand over them,
+        // so CreateIndirectComputeStage() with offset 4 processes exactly the kept values.
+        static Vector<std::unique_ptr<RenderStage>> CreateCompactStages(
+            const String& stageName,
+            const String& inputBufferName,
+            const String& flagBufferName,
+            const String& outputBufferName,
+            const String& countBufferName,
+            uint32_t elementCount,
+            const ComputePrimitiveSettings& settings = ComputePrimitiveSettings{});
+
+        // Counts the input values per bin, bin = min(value >> binShift, binCount - 1)
+        static std::unique_ptr<RenderStage> CreateHistogramStage(
+            const String& stageName,
+            const String& inputBufferName,
+            const String& outputBufferName,
+            uint32_t elementCount,
+            uint32_t binCount,
+            uint32_t binShift = 0,
+            const ComputePrimitiveSettings& settings = ComputePrimitiveSettings{});
+
+        // Stable least-significant-digit sort of the key-value pairs in place, by the low keyBits
+        // bits of the keys rounded up to whole bytes. Runs three stages per 4-bit digit, two digits
+        // per byte so the pairs end up back in the original buffers.
+        static Vector<std::unique_ptr<RenderStage>> CreateRadixSortStages(
+            const String& stageName,
+            const String& keyBufferName,
+            const String& valueBufferName,
+            uint32_t elementCount,
+            uint32_t keyBits = 32,
+            const ComputePrimitiveSettings& settings = ComputePrimitiveSettings{});
+
         static std::unique_ptr<RenderStage> CreateFromConfiguration(
             const StageConfiguration& config);
     };
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <types/Containers.h>
+#include <types/VkTypes.h>
+
+namespace Magma
+{
+    struct StageProfilerSettings
+    {
+        bool enableTimestamps = true;
+        bool enablePipelineStatistics = false;
+
+        // Nanoseconds per timestamp tick (VkPhysicalDeviceLimits::timestampPeriod)
+        float timestampPeriod = 1.0f;
+    };
+
+    struct StageGpuStats
+    {
+        bool valid = false;
+
+        double gpuTimeMs = 0.0;
+
+        // Start of the stage relative to the first profiled stage of the same frame
+        double gpuStartOffsetMs = 0.0;
+
+        // Time the stage ran concurrently with earlier stages, gained from split barriers
+        double gpuOverlapMs = 0.0;
+
+        // Raw VK_QUERY_TYPE_PIPELINE_STATISTICS counters
+        uint64_t inputAssemblyPrimitives = 0;
+        uint64_t clippingPrimitives = 0;
+        uint64_t fragmentShaderInvocations = 0;
+        uint64_t computeShaderInvocations = 0;
+
+        // Derived metrics, filled in by the stage from its declared resources
+        uint64_t pixelCount = 0;
+        uint64_t dispatchedInvocations = 0;
+        double pixelsPerInvocation = 0.0;
+        uint64_t estimatedBytesRead = 0;
+        uint64_t estimatedBytesWritten = 0;
+    };
+
+    // Records per-stage GPU timestamps and pipeline statistics into one query
+    // range per frame in flight. Results of a frame slot are read back the next
+    // time that slot is recorded, once its fence guarantees the queries are done.
+    class StageProfiler
+    {
+    public:
+        StageProfiler() = default;
+        ~StageProfiler() = default;
+
+        StageProfiler(const StageProfiler&) = delete;
+        StageProfiler& operator=(const StageProfiler&) = delete;
+
+        void Initialize(VkDevice device, uint32_t framesInFlight, uint32_t maxStages, const StageProfilerSettings& settings);
+        void Cleanup();
+
+        // Reads back the results of this slot's previous use and resets its queries.
+        // Returns true if fresh results are available through GetStageStats().
+        bool BeginFrame(VkCommandBuffer cmd, uint32_t frameIndex);
+
+        void BeginStage(VkCommandBuffer cmd, uint32_t stageIndex);
+        void EndStage(VkCommandBuffer cmd, uint32_t stageIndex);
+
+        const StageGpuStats& GetStageStats(uint32_t stageIndex) const { return m_stageStats[stageIndex]; }
+        // Sum of the stage times
+        double GetTotalGpuTimeMs() const { return m_totalGpuTimeMs; }
+
+        // From the first stage's start to the last stage's end, below the total when stages overlap
+        double GetFrameGpuTimeMs() const { return m_frameGpuTimeMs; }
+
+        bool IsEnabled() const { return m_settings.enableTimestamps || m_settings.enablePipelineStatistics; }
+        bool HasPipelineStatistics() const { return m_statisticsPool != VK_NULL_HANDLE; }
+
+    private:
+        void CollectResults(uint32_t frameIndex);
+
+    private:
+        VkDevice m_device = VK_NULL_HANDLE;
+        StageProfilerSettings m_settings;
+
+        VkQueryPool m_timestampPool = VK_NULL_HANDLE;
+        VkQueryPool m_statisticsPool = VK_NULL_HANDLE;
+
+        uint32_t m_framesInFlight = 0;
+        uint32_t m_maxStages = 0;
+        uint32_t m_currentFrameIndex = 0;
+
+        // Number of stages written into each slot the last time it was recorded
+        Vector<uint32_t> m_recordedStages;
+
+        Vector<StageGpuStats> m_stageStats;
+        double m_totalGpuTimeMs = 0.0;
+        double m_frameGpuTimeMs = 0.0;
+    };
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <types/Containers.h>
+#include <types/VkTypes.h>
+#include <optional>
+
+namespace Magma
+{
+    struct StageSynchronizerSettings
+    {
+        // Split barriers need VK_KHR_synchronization2, without these every dependency is a pipeline barrier
+        PFN_vkCmdSetEvent2KHR cmdSetEvent2 = nullptr;
+        PFN_vkCmdWaitEvents2KHR cmdWaitEvents2 = nullptr;
+
+        bool enableSplitBarriers = true;
+    };
+
+    // Graph buffers a stage reads and writes, in execution order
+    struct StageAccess
+    {
+        Vector<String> reads;
+        Vector<String> writes;
+
+        // One of the reads holds the arguments of the stage's indirect dispatch
+        bool readsIndirectArgs = false;
+    };
+
+    // Compiles the dependencies between stages into the fewest barriers. A stage that depends on
+    // the stage right before it gets a pipeline barrier. A stage whose producers ran earlier, with
+    // independent stages in between, waits on events the producers set instead, so the GPU can
+    // overlap the independent work with the producer. Events are pooled per frame in flight.
+    class StageSynchronizer
+    {
+    public:
+        StageSynchronizer() = default;
+        ~StageSynchronizer() = default;
+
+        StageSynchronizer(const StageSynchronizer&) = delete;
+        StageSynchronizer& operator=(const StageSynchronizer&) = delete;
+
+        // barrierBeforeFirstStage orders the first stage after the previous frame's stages
+        void Initialize(VkDevice device, uint32_t framesInFlight, const Vector<StageAccess>& stages,
+            bool barrierBeforeFirstStage, const StageSynchronizerSettings& settings);
+        void Cleanup();
+
+        // Resets the slot's events, its fence must have been waited on
+        void BeginFrame(uint32_t frameIndex);
+
+        void BeforeStage(VkCommandBuffer cmd, uint32_t stageIndex);
+        void AfterStage(VkCommandBuffer cmd, uint32_t stageIndex);
+
+        uint32_t GetPipelineBarrierCount() const { return m_pipelineBarrierCount; }
+        uint32_t GetSplitBarrierCount() const { return m_splitBarrierCount; }
+
+    private:
+        struct StageSync
+        {
+            bool pipelineBarrier = false;
+
+            // The barrier also covers the indirect command read of the dispatch
+            bool indirectArgs = false;
+
+            // Event to wait on before the stage. Events order everything recorded before them,
+            // so only the latest producer's event is needed.
+            std::optional<uint32_t> waitEvent;
+
+            // Event set after the stage, if a later stage waits on it
+            std::optional<uint32_t> signalEvent;
+        };
+
+        void CompileStages(const Vector<StageAccess>& stages, bool barrierBeforeFirstStage, bool useEvents);
+        VkDependencyInfo GetEventDependency() const;
+
+    private:
+        VkDevice m_device = VK_NULL_HANDLE;
+        StageSynchronizerSettings m_settings;
+
+        Vector<StageSync> m_stages;
+
+        // Per frame slot, one event per signalling stage
+        Vector<Vector<VkEvent>> m_events;
+        uint32_t m_eventCount = 0;
+        uint32_t m_currentFrameIndex = 0;
+
+        VkMemoryBarrier2 m_eventBarrier{};
+
+        uint32_t m_pipelineBarrierCount = 0;
+        uint32_t m_splitBarrierCount = 0;
+    };
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <types/Containers.h>
+#include <types/VkTypes.h>
+#include <magma_engine/core/renderer/Buffer.h>
+#include <magma_engine/core/renderer/Image.h>
+
+namespace Magma
+{
+    struct StagingUploaderSettings
+    {
+        VkDeviceSize ringSize = 64ull * 1024 * 1024;
+
+        VkQueue transferQueue = VK_NULL_HANDLE;
+        uint32_t transferQueueFamily = 0;
+        uint32_t graphicsQueueFamily = 0;
+
+        // Held around every submission to the transfer queue. Must be the graphics
+        // queue's mutex when no dedicated transfer queue exists.
+        std::mutex* transferQueueMutex = nullptr;
+    };
+
+    struct StagingStats
+    {
+        double throughputMBps = 0.0;
+        uint64_t totalBytes = 0;
+        uint64_t batchesSubmitted = 0;
+
+        // Uploads that had to wait for the GPU because the ring was full
+        uint64_t stallCount = 0;
+
+        size_t pendingUploads = 0;
+    };
+
+    // Persistently mapped staging ring. Upload calls copy into the ring right away and
+    // queue the GPU copy. Flush() turns everything queued into one submission on the
+    // transfer queue, so many small uploads cost a single submit per frame. With a
+    // dedicated transfer family, ownership of each resource is released there and
+    // acquired on the graphics queue in the command buffer given to Flush(). Uploads may be issued
+    // from any thread; destinations must not be in use by frames in flight.
+    class StagingUploader
+    {
+    public:
+        StagingUploader() = default;
+        ~StagingUploader() = default;
+
+        StagingUploader(const StagingUploader&) = delete;
+        StagingUploader& operator=(const StagingUploader&) = delete;
+
+        void Initialize(VkDevice device, VmaAllocator allocator, const StagingUploaderSettings& settings);
+
+        // The device must be idle
+        void Cleanup();
+
+        // The destination needs VK_BUFFER_USAGE_TRANSFER_DST_BIT
+        bool UploadBuffer(const AllocatedBuffer& destination, VkDeviceSize destinationOffset, const void* data, VkDeviceSize size);
+
+        // Uploads mip 0 of a color image created with VK_IMAGE_USAGE_TRANSFER_DST_BIT.
+        // The image ends up in finalLayout once the acquiring frame executes.
+        bool UploadImage(std::shared_ptr<AllocatedImage> destination, const void* data, VkDeviceSize size,
+            VkImageLayout finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+        // Submits all queued copies and records the queue family acquire side for them into cmd.
+        // Returns the timeline value that cmd's submission must wait on, or 0 if nothing was
+        // submitted since the last call. Both happen under one lock, so uploads queued from
+        // other threads meanwhile can't be acquired without being waited on.
+        uint64_t Flush(VkCommandBuffer cmd);
+
+        VkSemaphore GetTimelineSemaphore() const { return m_timeline; }
+        const AllocatedBuffer& GetRingBuffer() const { return m_ring; }
+        bool HasDedicatedTransferQueue() const { return m_settings.transferQueueFamily != m_settings.graphicsQueueFamily; }
+
+        const StagingStats& GetStats() const { return m_stats; }
+
+    private:
+        struct PendingBufferCopy
+        {
+            VkBuffer destination;
+            VkBufferCopy region;
+        };
+
+        struct PendingImageCopy
+        {
+            std::shared_ptr<AllocatedImage> destination;
+            VkBufferImageCopy region;
+            VkImageLayout finalLayout;
+        };
+
+        struct Batch
+        {
+            VkCommandPool pool = VK_NULL_HANDLE;
+            VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+            uint64_t timelineValue = 0;
+
+            // Ring position just past the last byte this batch reads
+            uint64_t ringEnd = 0;
+        };
+
+        bool Allocate(VkDeviceSize size, VkDeviceSize alignment, uint64_t& outOffset);
+        uint64_t FlushLocked();
+        void RecordAcquireBarriersLocked(VkCommandBuffer cmd);
+        void Reclaim(uint64_t completedValue);
+        uint64_t GetCompletedValue() const;
+        Batch& AcquireBatch();
+        void RecordCopies(VkCommandBuffer cmd);
+        void UpdateThroughput(VkDeviceSize bytes);
+
+    private:
+        VkDevice m_device = VK_NULL_HANDLE;
+        VmaAllocator m_allocator = VK_NULL_HANDLE;
+        StagingUploaderSettings m_settings;
+        std::mutex m_mutex;
+
+        AllocatedBuffer m_ring;
+        uint8_t* m_ringData = nullptr;
+
+        // Monotonic byte positions, the ring offset is position % ringSize
+        uint64_t m_head = 0;
+        uint64_t m_tail = 0;
+
+        VkSemaphore m_timeline = VK_NULL_HANDLE;
+        uint64_t m_nextValue = 0;
+        uint64_t m_lastReturnedValue = 0;
+
+        Vector<Batch> m_batches;
+        Vector<PendingBufferCopy> m_pendingBuffers;
+        Vector<PendingImageCopy> m_pendingImages;
+        VkDeviceSize m_pendingBytes = 0;
+
+        // Ownership transfers released by the last batch, acquired by the next frame
+        Vector<VkBufferMemoryBarrier> m_bufferAcquires;
+        Vector<VkImageMemoryBarrier> m_imageAcquires;
+        Vector<std::pair<std::shared_ptr<AllocatedImage>, VkImageLayout>> m_layoutUpdates;
+
+        StagingStats m_stats;
+        std::chrono::steady_clock::time_point m_windowStart;
+        VkDeviceSize m_windowBytes = 0;
+    };
+}
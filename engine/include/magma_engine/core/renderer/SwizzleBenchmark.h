@@ -0,0 +1,62 @@
+#pragma once
+
+#include <types/Containers.h>
+#include <magma_engine/core/renderer/RenderGraph.h>
+#include <magma_engine/core/renderer/StageProfiler.h>
+#include <optional>
+
+namespace Magma
+{
+    struct SwizzleBenchmarkResult
+    {
+        String stageName;
+        DispatchSwizzle swizzle = DispatchSwizzle::NONE;
+
+        // Average GPU time of the stage in each dispatch order
+        double rowMajorMs = 0.0;
+        double swizzledMs = 0.0;
+        uint32_t rowMajorSamples = 0;
+        uint32_t swizzledSamples = 0;
+
+        double GetSpeedup() const { return swizzledMs > 0.0 ? rowMajorMs / swizzledMs : 0.0; }
+    };
+
+    // Measures what the dispatch swizzle gains. Stages with a swizzle alternate between it and
+    // row-major order in blocks of frames, and their profiled GPU times are averaged per order.
+    // Results are only meaningful while the render resolution stays fixed.
+    class SwizzleBenchmark
+    {
+    public:
+        SwizzleBenchmark() = default;
+        ~SwizzleBenchmark() = default;
+
+        // Runs until both orders have samplesPerMode timings for every swizzled stage
+        void Start(RenderGraph& graph, uint32_t framesInFlight, uint32_t framesPerMode, uint32_t samplesPerMode);
+
+        // Puts the swizzle back on
+        void Stop(RenderGraph& graph);
+
+        // After the profiler's BeginFrame() for the slot and before the stages are recorded.
+        // The slot's stats belong to the order it was last recorded with.
+        void Update(RenderGraph& graph, uint32_t frameIndex, const StageProfiler& profiler, bool hasStats);
+
+        bool IsRunning() const { return m_running; }
+        const Vector<SwizzleBenchmarkResult>& GetResults() const { return m_results; }
+
+    private:
+        void Finish(RenderGraph& graph);
+
+    private:
+        bool m_running = false;
+        uint32_t m_framesPerMode = 0;
+        uint32_t m_samplesPerMode = 0;
+        uint32_t m_frame = 0;
+
+        // Graph positions of the swizzled stages, parallel to m_results
+        Vector<uint32_t> m_stageIndices;
+        Vector<SwizzleBenchmarkResult> m_results;
+
+        // Order each frame slot was last recorded with
+        Vector<std::optional<bool>> m_slotSwizzled;
+    };
+}
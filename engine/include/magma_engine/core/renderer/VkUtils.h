@@ -4,5 +4,17 @@
 namespace Magma::vkutil
 {
 	void transition_image(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout);
+	// Only waits for srcStageMask and blocks dstStageMask. A TOP_OF_PIPE source relies on an earlier
+	// fence or semaphore wait to order the transition after previous accesses.
+	void transition_image(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout,
+		VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask);
+	// Makes shader and attachment writes of earlier commands visible to later shaders and attachments,
+	// and to indirect dispatches and draws reading their arguments if indirectCommandRead is set
+	void shader_write_barrier(VkCommandBuffer cmd, bool indirectCommandRead = false);
+	// Makes transfer writes, e.g. buffer fills, visible to later shaders and indirect arguments
+	void transfer_write_barrier(VkCommandBuffer cmd);
 	void copy_image_to_image(VkCommandBuffer cmd, VkImage source, VkImage destination, VkExtent2D srcSize, VkExtent2D dstSize, PFN_vkCmdBlitImage2KHR vkCmdBlitImage2Func);
+
+	// Size of a single texel in bytes, or 0 for formats that are not handled
+	uint32_t format_texel_size(VkFormat format);
 }
\ No newline at end of file
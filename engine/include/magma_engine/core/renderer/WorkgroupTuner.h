@@ -0,0 +1,90 @@
+#pragma once
+
+#include <types/Containers.h>
+#include <magma_engine/core/renderer/RenderGraph.h>
+#include <magma_engine/core/renderer/StageProfiler.h>
+#include <optional>
+
+namespace Magma
+{
+    struct WorkgroupTunerSettings
+    {
+        // Benchmarks the candidates for stages without a cache entry once the graph is running
+        bool enableTuning = true;
+
+        // Winners per device, driver and stage. Empty keeps them in memory only.
+        String cachePath = "workgroup_tuning.cache";
+
+        // Frames after switching candidates that are not measured
+        uint32_t warmupFrames = 8;
+        uint32_t samplesPerCandidate = 32;
+    };
+
+    struct WorkgroupTuningEntry
+    {
+        uint32_t workgroupSizeX = 0;
+        uint32_t workgroupSizeY = 0;
+        uint32_t workgroupSizeZ = 1;
+        uint32_t requiredSubgroupSize = 0;
+        double gpuTimeMs = 0.0;
+    };
+
+    // Picks the workgroup size of compute stages per device. Stages missing from the tuning cache
+    // get a pipeline per candidate size, the candidates take turns on live frames and the one with
+    // the lowest profiled GPU time is committed and saved. Later runs load the winners before the
+    // stages create their pipelines.
+    class WorkgroupTuner
+    {
+    public:
+        WorkgroupTuner() = default;
+        ~WorkgroupTuner() = default;
+
+        // Loads the tuning cache
+        void Initialize(const ComputeDeviceInfo& computeInfo, const WorkgroupTunerSettings& settings);
+
+        // Before the stages are initialized, writes cached sizes into their configurations
+        void ApplyCachedSizes(RenderGraph& graph) const;
+
+        // After the stages are initialized, creates the candidates of untuned stages. Needs timestamps.
+        void Start(RenderGraph& graph, uint32_t framesInFlight);
+
+        // After the profiler's BeginFrame() for the slot and before the stages are recorded
+        void Update(RenderGraph& graph, uint32_t frameIndex, const StageProfiler& profiler, bool hasStats);
+
+        bool IsRunning() const { return m_running; }
+        bool SaveCache() const;
+
+        const Map<String, WorkgroupTuningEntry>& GetCache() const { return m_cache; }
+
+    private:
+        struct TuningStage
+        {
+            uint32_t stageIndex = 0;
+            String cacheKey;
+
+            // Per candidate, in the order the stage's variants were added
+            Vector<double> gpuTimeMs;
+            Vector<uint32_t> samples;
+        };
+
+        Vector<ComputeConfig> GetCandidates(const ComputeConfig& baseConfig) const;
+        String GetCacheKey(const RenderStage& stage) const;
+        bool IsTunable(const RenderStage& stage) const;
+        void SelectCandidate(RenderGraph& graph, std::optional<uint32_t> candidate);
+        void Finish(RenderGraph& graph);
+        void LoadCache();
+
+    private:
+        ComputeDeviceInfo m_computeInfo;
+        WorkgroupTunerSettings m_settings;
+        Map<String, WorkgroupTuningEntry> m_cache;
+
+        bool m_running = false;
+        uint32_t m_frame = 0;
+        uint32_t m_candidateCount = 0;
+        Vector<TuningStage> m_stages;
+
+        // Candidate each frame slot was last recorded with, std::nullopt while warming up
+        Vector<std::optional<uint32_t>> m_slotCandidate;
+    };
+}
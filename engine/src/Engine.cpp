@@ -2,25 +2,33 @@
 #include <magma_engine/ServiceLocater.h>
 #include <magma_engine/Window.h>
 #include <magma_engine/core/renderer/Renderer.h>
+#include <profiling/Profiler.h>
 
 void Magma::Engine::Init()
 {
 	ServiceLocator::Register(std::make_shared<Window>());
-	ServiceLocator::Get<Window>()->OpenWindow({
+	ServiceLocator::Get<Window>().OpenWindow({
 		"Magma",
 		1920,
 		1080
 	});
 
 	ServiceLocator::Register(std::make_shared<Renderer>());
-	ServiceLocator::Get<Renderer>()->Init();
+	ServiceLocator::Get<Renderer>().Init();
+
+	ServiceLocator::Freeze();
 }
 
 void Magma::Engine::Run()
 {
-	while(!ServiceLocator::Get<Window>()->ShouldClose())
+	MAGMA_PROFILE_THREAD("Main");
+
+	Window& window = ServiceLocator::Get<Window>();
+
+	while(!window.ShouldClose())
 	{
-		ServiceLocator::Get<Window>()->Update();
+		MAGMA_PROFILE_ZONE("Engine::Run frame");
+		window.Update();
 	}
 
 	// Gracefully Exit
@@ -29,5 +37,9 @@ void Magma::Engine::Run()
 
 void Magma::Engine::Cleanup()
 {
+#if MAGMA_ENABLE_PROFILING
+	Profiler::ExportChromeTrace("magma_trace.json");
+#endif
+
 	ServiceLocator::ShutdownServices();
 }
@@ -17,7 +17,21 @@ void Magma::Window::OpenWindow(WindowData&& data)
 	m_extensions = glfwGetRequiredInstanceExtensions(&m_extensionCount);
 
 	glfwSetWindowUserPointer(m_window.get(), this);
-	glfwSetFramebufferSizeCallback(m_window.get(), nullptr);
+	glfwSetFramebufferSizeCallback(m_window.get(), framebuffer_size_callback);
+
+	// The framebuffer can differ from the requested window size on high-DPI displays
+	int framebufferWidth = 0, framebufferHeight = 0;
+	glfwGetFramebufferSize(m_window.get(), &framebufferWidth, &framebufferHeight);
+	m_windowData.m_width = static_cast<uint32_t>(framebufferWidth);
+	m_windowData.m_height = static_cast<uint32_t>(framebufferHeight);
+}
+
+void Magma::Window::framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+	auto* self = static_cast<Window*>(glfwGetWindowUserPointer(window));
+	self->m_windowData.m_width = static_cast<uint32_t>(width);
+	self->m_windowData.m_height = static_cast<uint32_t>(height);
+	self->m_framebufferResized = true;
 }
 
 void Magma::Window::Cleanup()
@@ -4,19 +4,60 @@ namespace Magma
 {
     void BufferRegistry::RegisterBuffer(const String& name, std::shared_ptr<AllocatedImage> buffer)
     {
-        m_buffers[name] = buffer;
+        m_buffers[name] = { buffer };
+    }
+
+    void BufferRegistry::RegisterBufferVersions(const String& name, Vector<std::shared_ptr<AllocatedImage>> versions)
+    {
+        m_buffers[name] = std::move(versions);
     }
 
     std::shared_ptr<AllocatedImage> BufferRegistry::GetBuffer(const String& name) const
+    {
+        return GetBuffer(name, m_currentVersion);
+    }
+
+    std::shared_ptr<AllocatedImage> BufferRegistry::GetBuffer(const String& name, uint32_t version) const
     {
         auto it = m_buffers.find(name);
-        if (it != m_buffers.end())
+        if (it != m_buffers.end() && !it->second.empty())
         {
-            return it->second;
+            return it->second[version % it->second.size()];
         }
         return nullptr;
     }
 
+    uint32_t BufferRegistry::GetVersionCount(const String& name) const
+    {
+        auto it = m_buffers.find(name);
+        return it != m_buffers.end() ? static_cast<uint32_t>(it->second.size()) : 0;
+    }
+
+    void BufferRegistry::RegisterStorageBufferVersions(const String& name, Vector<AllocatedBuffer> versions)
+    {
+        m_storageBuffers[name] = std::move(versions);
+    }
+
+    const AllocatedBuffer* BufferRegistry::GetStorageBuffer(const String& name) const
+    {
+        return GetStorageBuffer(name, m_currentVersion);
+    }
+
+    const AllocatedBuffer* BufferRegistry::GetStorageBuffer(const String& name, uint32_t version) const
+    {
+        auto it = m_storageBuffers.find(name);
+        if (it != m_storageBuffers.end() && !it->second.empty())
+        {
+            return &it->second[version % it->second.size()];
+        }
+        return nullptr;
+    }
+
+    void BufferRegistry::ClearStorageBuffers()
+    {
+        m_storageBuffers.clear();
+    }
+
     bool BufferRegistry::HasBuffer(const String& name) const
     {
         return m_buffers.find(name) != m_buffers.end();
@@ -36,6 +77,7 @@ namespace Magma
     void BufferRegistry::Clear()
     {
         m_buffers.clear();
+        m_storageBuffers.clear();
     }
 }
 
@@ -1,12 +1,14 @@
 #include <magma_engine/core/renderer/ComputePipeline.h>
 #include <logging/Logger.h>
+#include <utility>
 
 namespace Magma
 {
     bool ComputePipeline::Create(
         VkDevice device,
         const PipelineLayoutInfo& layoutInfo,
-        VkShaderModule computeShader)
+        VkShaderModule computeShader,
+        const ComputeSpecialization& specialization)
     {
         m_device = device;
 
@@ -16,13 +18,59 @@ namespace Magma
             return false;
         }
 
+        return CreatePipelineObject(computeShader, specialization);
+    }
+
+    bool ComputePipeline::Create(
+        VkDevice device,
+        VkPipelineLayout sharedLayout,
+        VkShaderModule computeShader,
+        const ComputeSpecialization& specialization)
+    {
+        m_device = device;
+        m_pipelineLayout = sharedLayout;
+        m_ownsLayout = false;
+
+        return CreatePipelineObject(computeShader, specialization);
+    }
+
+    void ComputePipeline::ExchangePipeline(ComputePipeline& other)
+    {
+        std::swap(m_pipeline, other.m_pipeline);
+    }
+
+    bool ComputePipeline::CreatePipelineObject(VkShaderModule computeShader, const ComputeSpecialization& specialization)
+    {
+        // Workgroup size constant IDs 0-2, only the dimensions that were given
+        VkSpecializationMapEntry mapEntries[3];
+        uint32_t mapEntryCount = 0;
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            if (specialization.workgroupSize[i] != 0)
+            {
+                mapEntries[mapEntryCount++] = { i, static_cast<uint32_t>(i * sizeof(uint32_t)), sizeof(uint32_t) };
+            }
+        }
+
+        VkSpecializationInfo specializationInfo{};
+        specializationInfo.mapEntryCount = mapEntryCount;
+        specializationInfo.pMapEntries = mapEntries;
+        specializationInfo.dataSize = sizeof(specialization.workgroupSize);
+        specializationInfo.pData = specialization.workgroupSize;
+
+        VkPipelineShaderStageRequiredSubgroupSizeCreateInfo subgroupSizeInfo{};
+        subgroupSizeInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_REQUIRED_SUBGROUP_SIZE_CREATE_INFO;
+        subgroupSizeInfo.requiredSubgroupSize = specialization.requiredSubgroupSize;
+
         // Create compute pipeline
         VkPipelineShaderStageCreateInfo shaderStageInfo{};
         shaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        shaderStageInfo.pNext = nullptr;
+        shaderStageInfo.pNext = specialization.requiredSubgroupSize != 0 ? &subgroupSizeInfo : nullptr;
+        shaderStageInfo.flags = specialization.requireFullSubgroups ? VK_PIPELINE_SHADER_STAGE_CREATE_REQUIRE_FULL_SUBGROUPS_BIT : 0;
         shaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
         shaderStageInfo.module = computeShader;
         shaderStageInfo.pName = "main";
+        shaderStageInfo.pSpecializationInfo = mapEntryCount > 0 ? &specializationInfo : nullptr;
 
         VkComputePipelineCreateInfo pipelineInfo{};
         pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
@@ -32,8 +80,11 @@ namespace Magma
 
         if (vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipeline) != VK_SUCCESS)
         {
-            Logger::Log(LogLevel::ERROR, "Failed to create compute pipeline");
-            vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+            MAGMA_LOG_ERROR("Failed to create compute pipeline");
+            if (m_ownsLayout)
+            {
+                vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+            }
             m_pipelineLayout = VK_NULL_HANDLE;
             return false;
         }
@@ -50,4 +101,9 @@ namespace Magma
     {
         vkCmdDispatch(cmd, groupCountX, groupCountY, groupCountZ);
     }
+
+    void ComputePipeline::DispatchIndirect(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset) const
+    {
+        vkCmdDispatchIndirect(cmd, buffer, offset);
+    }
 }
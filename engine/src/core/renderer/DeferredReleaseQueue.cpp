@@ -0,0 +1,118 @@
+#include <magma_engine/core/renderer/DeferredReleaseQueue.h>
+#include <limits>
+#include <cassert>
+
+namespace Magma
+{
+    void DeferredReleaseQueue::Initialize(VkDevice device, VmaAllocator allocator)
+    {
+        assert(device != VK_NULL_HANDLE && "DeferredReleaseQueue::Initialize() - VkDevice is null!");
+        assert(allocator != VK_NULL_HANDLE && "DeferredReleaseQueue::Initialize() - VmaAllocator is null!");
+
+        m_device = device;
+        m_allocator = allocator;
+    }
+
+    void DeferredReleaseQueue::ReleaseImage(VkImage image, VmaAllocation allocation)
+    {
+        if (image != VK_NULL_HANDLE)
+        {
+            m_images.push_back({ image, allocation, m_retireValue });
+        }
+    }
+
+    void DeferredReleaseQueue::ReleaseImageView(VkImageView imageView)
+    {
+        if (imageView != VK_NULL_HANDLE)
+        {
+            m_imageViews.push_back({ imageView, m_retireValue });
+        }
+    }
+
+    void DeferredReleaseQueue::ReleaseSwapchain(VkSwapchainKHR swapchain)
+    {
+        if (swapchain != VK_NULL_HANDLE)
+        {
+            m_swapchains.push_back({ swapchain, m_retireValue });
+        }
+    }
+
+    void DeferredReleaseQueue::ReleaseBuffer(VkBuffer buffer, VmaAllocation allocation)
+    {
+        if (buffer != VK_NULL_HANDLE)
+        {
+            m_buffers.push_back({ buffer, allocation, m_retireValue });
+        }
+    }
+
+    void DeferredReleaseQueue::ReleasePipeline(VkPipeline pipeline)
+    {
+        if (pipeline != VK_NULL_HANDLE)
+        {
+            m_pipelines.push_back({ pipeline, m_retireValue });
+        }
+    }
+
+    void DeferredReleaseQueue::ReleaseDescriptorSet(VkDescriptorPool pool, VkDescriptorSet descriptorSet)
+    {
+        if (pool != VK_NULL_HANDLE && descriptorSet != VK_NULL_HANDLE)
+        {
+            m_descriptorSets.push_back({ pool, descriptorSet, m_retireValue });
+        }
+    }
+
+    void DeferredReleaseQueue::Collect(uint64_t completedValue)
+    {
+        // Views and sets reference images and buffers, so they go first
+        ReleaseCompleted(m_descriptorSets, completedValue, [this](const RetiredDescriptorSet& entry) {
+            vkFreeDescriptorSets(m_device, entry.pool, 1, &entry.descriptorSet);
+        });
+
+        ReleaseCompleted(m_pipelines, completedValue, [this](const RetiredHandle<VkPipeline>& entry) {
+            vkDestroyPipeline(m_device, entry.handle, nullptr);
+        });
+
+        ReleaseCompleted(m_imageViews, completedValue, [this](const RetiredHandle<VkImageView>& entry) {
+            vkDestroyImageView(m_device, entry.handle, nullptr);
+        });
+
+        // Owns its images, so it outlives their views
+        ReleaseCompleted(m_swapchains, completedValue, [this](const RetiredHandle<VkSwapchainKHR>& entry) {
+            vkDestroySwapchainKHR(m_device, entry.handle, nullptr);
+        });
+
+        ReleaseCompleted(m_images, completedValue, [this](const RetiredAllocation<VkImage>& entry) {
+            vmaDestroyImage(m_allocator, entry.handle, entry.allocation);
+        });
+
+        ReleaseCompleted(m_buffers, completedValue, [this](const RetiredAllocation<VkBuffer>& entry) {
+            vmaDestroyBuffer(m_allocator, entry.handle, entry.allocation);
+        });
+    }
+
+    void DeferredReleaseQueue::Flush()
+    {
+        Collect(std::numeric_limits<uint64_t>::max());
+    }
+
+    size_t DeferredReleaseQueue::GetPendingCount() const
+    {
+        return m_images.size() + m_imageViews.size() + m_swapchains.size() + m_buffers.size() + m_pipelines.size() + m_descriptorSets.size();
+    }
+
+    template<typename Entry, typename DestroyFunc>
+    void DeferredReleaseQueue::ReleaseCompleted(Vector<Entry>& entries, uint64_t completedValue, DestroyFunc&& destroy)
+    {
+        size_t count = 0;
+        while (count < entries.size() && entries[count].retireValue <= completedValue)
+        {
+            destroy(entries[count]);
+            count++;
+        }
+
+        if (count > 0)
+        {
+            entries.erase(entries.begin(), entries.begin() + count);
+        }
+    }
+}
@@ -1,5 +1,6 @@
 #include <magma_engine/core/renderer/DescriptorManager.h>
 #include <logging/Logger.h>
+#include <algorithm>
 
 namespace Magma
 {
@@ -21,8 +22,8 @@ namespace Magma
             { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f }
         };
 
-        // Initialize with 10 max sets (can be adjusted based on needs)
-        m_globalDescriptorAllocator.init_pool(device, 10, poolRatios);
+        // Stages allocate one set per frame in flight, further pools are added as the graph needs them
+        m_globalDescriptorAllocator.init_pool(device, 64, poolRatios);
     }
 
     void DescriptorManager::Cleanup()
@@ -47,7 +48,7 @@ namespace Magma
     {
     	if (m_device == VK_NULL_HANDLE)
 		{
-			Logger::Log(LogLevel::ERROR, "DescriptorManager not initialized");
+			MAGMA_LOG_ERROR("DescriptorManager not initialized");
 			return VK_NULL_HANDLE;
 		}
 
@@ -76,7 +77,7 @@ namespace Magma
         VkDescriptorSetLayout layout = VK_NULL_HANDLE;
         if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &layout) != VK_SUCCESS)
         {
-            Logger::Log(LogLevel::ERROR, "Failed to create descriptor set layout");
+            MAGMA_LOG_ERROR("Failed to create descriptor set layout");
             return VK_NULL_HANDLE;
         }
 
@@ -98,7 +99,7 @@ namespace Magma
     {
         if (m_device == VK_NULL_HANDLE)
         {
-            Logger::Log(LogLevel::ERROR, "DescriptorManager not initialized");
+            MAGMA_LOG_ERROR("DescriptorManager not initialized");
             return VK_NULL_HANDLE;
         }
 
@@ -126,7 +127,7 @@ namespace Magma
     {
         if (m_device == VK_NULL_HANDLE)
         {
-            Logger::Log(LogLevel::ERROR, "DescriptorManager not initialized");
+            MAGMA_LOG_ERROR("DescriptorManager not initialized");
             return;
         }
 
@@ -146,41 +147,120 @@ namespace Magma
         vkUpdateDescriptorSets(m_device, 1, &writeSet, 0, nullptr);
     }
 
-	void DescriptorAllocator::init_pool(VkDevice device, uint32_t maxSets, std::span<PoolSizeRatio> poolRatios)
+    void DescriptorManager::UpdateDescriptorSets(DescriptorWriter& writer)
     {
-    	std::vector<VkDescriptorPoolSize> poolSizes;
-    	for (PoolSizeRatio ratio : poolRatios) {
-    		poolSizes.push_back(VkDescriptorPoolSize{
-				.type = ratio.type,
-				.descriptorCount = uint32_t(ratio.ratio * maxSets)
-			});
-    	}
+        if (writer.IsEmpty())
+        {
+            return;
+        }
 
-    	VkDescriptorPoolCreateInfo pool_info = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
-    	pool_info.flags = 0;
-    	pool_info.maxSets = maxSets;
-    	pool_info.poolSizeCount = (uint32_t)poolSizes.size();
-    	pool_info.pPoolSizes = poolSizes.data();
+        if (m_device == VK_NULL_HANDLE)
+        {
+            MAGMA_LOG_ERROR("DescriptorManager not initialized");
+            return;
+        }
 
-    	VK_CHECK(vkCreateDescriptorPool(device, &pool_info, nullptr, &pool));
+        const Vector<VkWriteDescriptorSet>& writes = writer.GetWrites();
+        vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+        writer.Clear();
+    }
+
+    void DescriptorWriter::WriteImage(
+        VkDescriptorSet set,
+        uint32_t binding,
+        VkImageView imageView,
+        VkImageLayout layout,
+        VkDescriptorType type)
+    {
+        VkDescriptorImageInfo& imgInfo = m_imageInfos.emplace_back();
+        imgInfo.imageLayout = layout;
+        imgInfo.imageView = imageView;
+
+        VkWriteDescriptorSet writeSet = {};
+        writeSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeSet.pNext = nullptr;
+        writeSet.dstBinding = binding;
+        writeSet.dstSet = set;
+        writeSet.descriptorCount = 1;
+        writeSet.descriptorType = type;
+        writeSet.pImageInfo = &imgInfo;
+
+        m_writes.push_back(writeSet);
+    }
+
+    void DescriptorWriter::WriteBuffer(
+        VkDescriptorSet set,
+        uint32_t binding,
+        VkBuffer buffer,
+        VkDeviceSize offset,
+        VkDeviceSize range,
+        VkDescriptorType type)
+    {
+        VkDescriptorBufferInfo& bufferInfo = m_bufferInfos.emplace_back();
+        bufferInfo.buffer = buffer;
+        bufferInfo.offset = offset;
+        bufferInfo.range = range;
+
+        VkWriteDescriptorSet writeSet = {};
+        writeSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeSet.pNext = nullptr;
+        writeSet.dstBinding = binding;
+        writeSet.dstSet = set;
+        writeSet.descriptorCount = 1;
+        writeSet.descriptorType = type;
+        writeSet.pBufferInfo = &bufferInfo;
+
+        m_writes.push_back(writeSet);
+    }
+
+    void DescriptorWriter::Clear()
+    {
+        m_imageInfos.clear();
+        m_bufferInfos.clear();
+        m_writes.clear();
+    }
+
+	void DescriptorAllocator::init_pool(VkDevice device, uint32_t maxSets, std::span<PoolSizeRatio> poolRatios)
+    {
+    	ratios.assign(poolRatios.begin(), poolRatios.end());
+
+    	readyPools.push_back(create_pool(device, maxSets));
+    	setsPerPool = std::min(maxSets + maxSets / 2, k_maxSetsPerPool);
     }
 
 	void DescriptorAllocator::clear_descriptors(VkDevice device)
     {
-    	vkResetDescriptorPool(device, pool, 0);
+    	for (VkDescriptorPool pool : readyPools)
+    	{
+    		vkResetDescriptorPool(device, pool, 0);
+    	}
+    	for (VkDescriptorPool pool : fullPools)
+    	{
+    		vkResetDescriptorPool(device, pool, 0);
+    		readyPools.push_back(pool);
+    	}
+    	fullPools.clear();
     }
 
 	void DescriptorAllocator::destroy_pool(VkDevice device)
     {
-    	if (pool != VK_NULL_HANDLE)
+    	for (VkDescriptorPool pool : readyPools)
     	{
     		vkDestroyDescriptorPool(device, pool, nullptr);
-    		pool = VK_NULL_HANDLE;
     	}
+    	for (VkDescriptorPool pool : fullPools)
+    	{
+    		vkDestroyDescriptorPool(device, pool, nullptr);
+    	}
+    	readyPools.clear();
+    	fullPools.clear();
     }
 
 	VkDescriptorSet DescriptorAllocator::allocate(VkDevice device, VkDescriptorSetLayout layout)
     {
+    	VkDescriptorPool pool = get_pool(device);
+
     	VkDescriptorSetAllocateInfo allocInfo = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
     	allocInfo.pNext = nullptr;
     	allocInfo.descriptorPool = pool;
@@ -188,8 +268,55 @@ namespace Magma
     	allocInfo.pSetLayouts = &layout;
 
     	VkDescriptorSet ds;
-    	VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, &ds));
+    	VkResult result = vkAllocateDescriptorSets(device, &allocInfo, &ds);
+
+    	// Out of sets or of one descriptor type, retire the pool and retry on a fresh one
+    	if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+    	{
+    		fullPools.push_back(pool);
 
+    		pool = get_pool(device);
+    		allocInfo.descriptorPool = pool;
+    		result = vkAllocateDescriptorSets(device, &allocInfo, &ds);
+    	}
+    	VK_CHECK(result);
+
+    	readyPools.push_back(pool);
     	return ds;
     }
+
+	VkDescriptorPool DescriptorAllocator::get_pool(VkDevice device)
+    {
+    	if (!readyPools.empty())
+    	{
+    		VkDescriptorPool pool = readyPools.back();
+    		readyPools.pop_back();
+    		return pool;
+    	}
+
+    	VkDescriptorPool pool = create_pool(device, setsPerPool);
+    	setsPerPool = std::min(setsPerPool + setsPerPool / 2, k_maxSetsPerPool);
+    	return pool;
+    }
+
+	VkDescriptorPool DescriptorAllocator::create_pool(VkDevice device, uint32_t setCount)
+    {
+    	std::vector<VkDescriptorPoolSize> poolSizes;
+    	for (PoolSizeRatio ratio : ratios) {
+    		poolSizes.push_back(VkDescriptorPoolSize{
+				.type = ratio.type,
+				.descriptorCount = uint32_t(ratio.ratio * setCount)
+			});
+    	}
+
+    	VkDescriptorPoolCreateInfo pool_info = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+    	pool_info.flags = 0;
+    	pool_info.maxSets = setCount;
+    	pool_info.poolSizeCount = (uint32_t)poolSizes.size();
+    	pool_info.pPoolSizes = poolSizes.data();
+
+    	VkDescriptorPool pool = VK_NULL_HANDLE;
+    	VK_CHECK(vkCreateDescriptorPool(device, &pool_info, nullptr, &pool));
+    	return pool;
+    }
 }
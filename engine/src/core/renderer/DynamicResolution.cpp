@@ -0,0 +1,75 @@
+#include <magma_engine/core/renderer/DynamicResolution.h>
+#include <logging/Logger.h>
+#include <algorithm>
+#include <cmath>
+
+namespace Magma
+{
+    void DynamicResolution::SetSettings(const DynamicResolutionSettings& settings)
+    {
+        m_settings = settings;
+        m_settings.minScale = std::clamp(m_settings.minScale, 0.01f, 1.0f);
+        m_settings.maxScale = std::clamp(m_settings.maxScale, m_settings.minScale, 1.0f);
+
+        Reset();
+    }
+
+    float DynamicResolution::Update(double gpuTimeMs)
+    {
+        if (!m_settings.enabled)
+        {
+            m_scale = m_settings.maxScale;
+            return m_scale;
+        }
+
+        if (gpuTimeMs <= 0.0)
+        {
+            return m_scale;
+        }
+
+        m_smoothedGpuTimeMs = m_smoothedGpuTimeMs > 0.0
+            ? m_smoothedGpuTimeMs + (gpuTimeMs - m_smoothedGpuTimeMs) * m_settings.smoothing
+            : gpuTimeMs;
+
+        if (++m_framesSinceAdjustment < m_settings.settleFrames)
+        {
+            return m_scale;
+        }
+
+        double ratio = m_settings.targetFrameTimeMs / m_smoothedGpuTimeMs;
+        if (std::abs(1.0 - ratio) <= m_settings.deadband)
+        {
+            return m_scale;
+        }
+
+        float desired = m_scale * static_cast<float>(std::sqrt(ratio));
+        desired = std::clamp(desired, m_scale - m_settings.maxStep, m_scale + m_settings.maxStep);
+        desired = std::clamp(desired, m_settings.minScale, m_settings.maxScale);
+
+        if (desired != m_scale)
+        {
+            MAGMA_LOG_DEBUG("[DynamicResolution] GPU {:.2f} ms (target {:.2f} ms), scale {:.2f} -> {:.2f}",
+                m_smoothedGpuTimeMs, m_settings.targetFrameTimeMs, m_scale, desired);
+
+            m_scale = desired;
+            m_framesSinceAdjustment = 0;
+        }
+
+        return m_scale;
+    }
+
+    void DynamicResolution::Reset()
+    {
+        m_scale = m_settings.maxScale;
+        m_smoothedGpuTimeMs = 0.0;
+        m_framesSinceAdjustment = 0;
+    }
+
+    VkExtent2D DynamicResolution::ScaleExtent(VkExtent2D extent, float scale)
+    {
+        return {
+            std::max(1u, static_cast<uint32_t>(std::lround(extent.width * scale))),
+            std::max(1u, static_cast<uint32_t>(std::lround(extent.height * scale)))
+        };
+    }
+}
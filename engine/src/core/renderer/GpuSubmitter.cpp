@@ -0,0 +1,265 @@
+#include <magma_engine/core/renderer/GpuSubmitter.h>
+#include <magma_engine/core/renderer/VkInitializers.h>
+#include <logging/Logger.h>
+#include <profiling/Profiler.h>
+#include <algorithm>
+#include <cassert>
+
+namespace Magma
+{
+    namespace
+    {
+        // Upper bound on a single completion-thread wait, so waiters added for an
+        // earlier value than the one being waited on are not held up for long
+        constexpr uint64_t k_completionWaitTimeoutNs = 100000000;
+    }
+
+    bool GpuFuture::IsReady() const
+    {
+        return m_submitter == nullptr || m_submitter->GetCompletedValue() >= m_value;
+    }
+
+    void GpuFuture::Wait() const
+    {
+        if (m_submitter)
+        {
+            m_submitter->WaitForValue(m_value);
+        }
+    }
+
+    void GpuFuture::await_suspend(std::coroutine_handle<> handle) const
+    {
+        m_submitter->AddWaiter(m_value, handle);
+    }
+
+    void GpuSubmitter::Initialize(VkDevice device, VkQueue queue, uint32_t queueFamily)
+    {
+        assert(device != VK_NULL_HANDLE && "GpuSubmitter::Initialize() - VkDevice is null!");
+
+        m_device = device;
+        m_queue = queue;
+        m_queueFamily = queueFamily;
+        m_nextValue = 0;
+
+        VkSemaphoreTypeCreateInfo typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo = vkinit::semaphore_create_info();
+        semaphoreInfo.pNext = &typeInfo;
+        VK_CHECK(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_timeline));
+
+        m_running.store(true, std::memory_order_release);
+        m_completionThread = std::thread([this] { CompletionLoop(); });
+
+        MAGMA_LOG_INFO("[GpuSubmitter] Initialized on queue family {}", m_queueFamily);
+    }
+
+    void GpuSubmitter::Cleanup()
+    {
+        if (m_device == VK_NULL_HANDLE)
+        {
+            return;
+        }
+
+        {
+            std::lock_guard lock(m_waitMutex);
+            m_running.store(false, std::memory_order_release);
+        }
+        m_waitCondition.notify_all();
+
+        if (m_completionThread.joinable())
+        {
+            m_completionThread.join();
+        }
+
+        std::lock_guard lock(m_poolMutex);
+        for (TransientCommandBuffer& slot : m_commandBuffers)
+        {
+            vkDestroyCommandPool(m_device, slot.pool, nullptr);
+        }
+        m_commandBuffers.clear();
+
+        vkDestroySemaphore(m_device, m_timeline, nullptr);
+        m_timeline = VK_NULL_HANDLE;
+        m_device = VK_NULL_HANDLE;
+
+        MAGMA_LOG_INFO("[GpuSubmitter] Cleaned up");
+    }
+
+    GpuFuture GpuSubmitter::Submit(std::function<void(VkCommandBuffer cmd)>&& function)
+    {
+        MAGMA_PROFILE_FUNCTION();
+
+        size_t slot = AcquireCommandBuffer();
+
+        VkCommandBuffer cmd = VK_NULL_HANDLE;
+        {
+            std::lock_guard lock(m_poolMutex);
+            cmd = m_commandBuffers[slot].commandBuffer;
+        }
+
+        // Each slot has its own pool, so recording needs no lock
+        VkCommandBufferBeginInfo cmdBeginInfo = vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+        VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
+
+        function(cmd);
+
+        VK_CHECK(vkEndCommandBuffer(cmd));
+
+        uint64_t value = 0;
+        {
+            // Timeline signal values must increase in submission order
+            std::lock_guard lock(m_queueMutex);
+            value = ++m_nextValue;
+
+            // synchronization2 is optional, so the timeline value is chained to a core submit
+            VkTimelineSemaphoreSubmitInfo timelineInfo{};
+            timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+            timelineInfo.signalSemaphoreValueCount = 1;
+            timelineInfo.pSignalSemaphoreValues = &value;
+
+            VkSubmitInfo submit{};
+            submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submit.pNext = &timelineInfo;
+            submit.commandBufferCount = 1;
+            submit.pCommandBuffers = &cmd;
+            submit.signalSemaphoreCount = 1;
+            submit.pSignalSemaphores = &m_timeline;
+
+            VK_CHECK(vkQueueSubmit(m_queue, 1, &submit, VK_NULL_HANDLE));
+        }
+
+        {
+            std::lock_guard lock(m_poolMutex);
+            m_commandBuffers[slot].lastValue = value;
+            m_commandBuffers[slot].recording = false;
+        }
+
+        return GpuFuture(this, value);
+    }
+
+    uint64_t GpuSubmitter::GetCompletedValue() const
+    {
+        uint64_t value = 0;
+        VK_CHECK(vkGetSemaphoreCounterValue(m_device, m_timeline, &value));
+        return value;
+    }
+
+    void GpuSubmitter::WaitForValue(uint64_t value) const
+    {
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &m_timeline;
+        waitInfo.pValues = &value;
+
+        VK_CHECK(vkWaitSemaphores(m_device, &waitInfo, UINT64_MAX));
+    }
+
+    size_t GpuSubmitter::AcquireCommandBuffer()
+    {
+        std::lock_guard lock(m_poolMutex);
+        uint64_t completedValue = GetCompletedValue();
+
+        for (size_t i = 0; i < m_commandBuffers.size(); i++)
+        {
+            TransientCommandBuffer& slot = m_commandBuffers[i];
+            if (!slot.recording && slot.lastValue <= completedValue)
+            {
+                VK_CHECK(vkResetCommandPool(m_device, slot.pool, 0));
+                slot.recording = true;
+                return i;
+            }
+        }
+
+        TransientCommandBuffer slot;
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = m_queueFamily;
+        VK_CHECK(vkCreateCommandPool(m_device, &poolInfo, nullptr, &slot.pool));
+
+        VkCommandBufferAllocateInfo allocInfo = vkinit::command_buffer_allocate_info(slot.pool, 1);
+        VK_CHECK(vkAllocateCommandBuffers(m_device, &allocInfo, &slot.commandBuffer));
+
+        slot.recording = true;
+        m_commandBuffers.push_back(slot);
+
+        MAGMA_LOG_DEBUG("[GpuSubmitter] Grew command buffer pool to {}", m_commandBuffers.size());
+        return m_commandBuffers.size() - 1;
+    }
+
+    void GpuSubmitter::AddWaiter(uint64_t value, std::coroutine_handle<> handle)
+    {
+        {
+            std::lock_guard lock(m_waitMutex);
+            m_waiters.push_back({ value, handle });
+        }
+        m_waitCondition.notify_one();
+    }
+
+    void GpuSubmitter::CompletionLoop()
+    {
+        MAGMA_PROFILE_THREAD("GPU Completion");
+
+        while (true)
+        {
+            uint64_t target = 0;
+            {
+                std::unique_lock lock(m_waitMutex);
+                m_waitCondition.wait(lock, [this] {
+                    return !m_waiters.empty() || !m_running.load(std::memory_order_acquire);
+                });
+
+                // Shutdown only completes once every suspended coroutine has been resumed
+                if (m_waiters.empty())
+                {
+                    break;
+                }
+
+                target = std::min_element(m_waiters.begin(), m_waiters.end(),
+                    [](const Waiter& a, const Waiter& b) { return a.value < b.value; })->value;
+            }
+
+            VkSemaphoreWaitInfo waitInfo{};
+            waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+            waitInfo.semaphoreCount = 1;
+            waitInfo.pSemaphores = &m_timeline;
+            waitInfo.pValues = &target;
+
+            VkResult result = vkWaitSemaphores(m_device, &waitInfo, k_completionWaitTimeoutNs);
+            if (result != VK_SUCCESS && result != VK_TIMEOUT)
+            {
+                MAGMA_LOG_ERROR("[GpuSubmitter] Waiting on the timeline failed: {}", static_cast<int>(result));
+                break;
+            }
+
+            ResumeCompleted(GetCompletedValue());
+        }
+    }
+
+    void GpuSubmitter::ResumeCompleted(uint64_t completedValue)
+    {
+        Vector<std::coroutine_handle<>> ready;
+        {
+            std::lock_guard lock(m_waitMutex);
+            auto it = std::partition(m_waiters.begin(), m_waiters.end(),
+                [completedValue](const Waiter& waiter) { return waiter.value > completedValue; });
+
+            for (auto readyIt = it; readyIt != m_waiters.end(); ++readyIt)
+            {
+                ready.push_back(readyIt->handle);
+            }
+            m_waiters.erase(it, m_waiters.end());
+        }
+
+        // Resumed outside the lock, a coroutine may submit and await again
+        for (std::coroutine_handle<> handle : ready)
+        {
+            handle.resume();
+        }
+    }
+}
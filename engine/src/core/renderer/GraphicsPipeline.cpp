@@ -120,7 +120,7 @@ namespace Magma
 
         if (vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipeline) != VK_SUCCESS)
         {
-            Logger::Log(LogLevel::ERROR, "Failed to create graphics pipeline");
+            MAGMA_LOG_ERROR("Failed to create graphics pipeline");
             vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
             m_pipelineLayout = VK_NULL_HANDLE;
             return false;
@@ -0,0 +1,310 @@
+#include <magma_engine/core/renderer/MemoryDefragmenter.h>
+#include <magma_engine/core/renderer/VkInitializers.h>
+#include <magma_engine/core/renderer/VkUtils.h>
+#include <logging/Logger.h>
+#include <profiling/Profiler.h>
+#include <cassert>
+
+namespace Magma
+{
+    void MemoryDefragmenter::Initialize(VkDevice device, VmaAllocator allocator, ResourcePools* pools, const DefragmentationSettings& settings)
+    {
+        assert(device != VK_NULL_HANDLE && "MemoryDefragmenter::Initialize() - VkDevice is null!");
+        assert(allocator != VK_NULL_HANDLE && "MemoryDefragmenter::Initialize() - VmaAllocator is null!");
+
+        m_device = device;
+        m_allocator = allocator;
+        m_pools = pools;
+        m_settings = settings;
+    }
+
+    void MemoryDefragmenter::Cleanup()
+    {
+        if (m_allocator == VK_NULL_HANDLE)
+        {
+            return;
+        }
+
+        // With the device idle the outstanding pass can be finished right away
+        if (m_passOpen)
+        {
+            CompletePass(m_passFrame);
+        }
+
+        if (m_context != VK_NULL_HANDLE)
+        {
+            vmaEndDefragmentation(m_allocator, m_context, nullptr);
+            m_context = VK_NULL_HANDLE;
+        }
+
+        m_registrations.clear();
+        m_runTargets.clear();
+        m_allocator = VK_NULL_HANDLE;
+        m_device = VK_NULL_HANDLE;
+    }
+
+    void MemoryDefragmenter::RegisterImage(const std::shared_ptr<AllocatedImage>& image, VkImageUsageFlags usage)
+    {
+        if (image && image->allocation != VK_NULL_HANDLE)
+        {
+            m_registrations[image->allocation] = { image, usage };
+        }
+    }
+
+    void MemoryDefragmenter::UnregisterImage(VmaAllocation allocation)
+    {
+        m_registrations.erase(allocation);
+    }
+
+    void MemoryDefragmenter::CompletePass(uint64_t completedFrame)
+    {
+        if (!m_passOpen || completedFrame < m_passFrame)
+        {
+            return;
+        }
+
+        MAGMA_PROFILE_FUNCTION();
+
+        // The old images are still bound to the source memory VMA is about to free
+        for (const RetiredImage& retired : m_retiredImages)
+        {
+            vkDestroyImageView(m_device, retired.imageView, nullptr);
+            vkDestroyImage(m_device, retired.image, nullptr);
+        }
+        m_retiredImages.clear();
+
+        VkResult result = vmaEndDefragmentationPass(m_allocator, m_context, &m_pass);
+        m_passOpen = false;
+        m_stats.passesCompleted++;
+
+        if (result == VK_SUCCESS)
+        {
+            EndRun();
+        }
+    }
+
+    bool MemoryDefragmenter::RecordPass(VkCommandBuffer cmd, uint64_t frameNumber)
+    {
+        if (m_allocator == VK_NULL_HANDLE || m_passOpen)
+        {
+            return false;
+        }
+
+        if (m_context == VK_NULL_HANDLE && (!ShouldStart(frameNumber) || !BeginRun()))
+        {
+            return false;
+        }
+
+        MAGMA_PROFILE_FUNCTION();
+
+        VkResult result = vmaBeginDefragmentationPass(m_allocator, m_context, &m_pass);
+        if (result == VK_SUCCESS)
+        {
+            // Nothing left to move
+            EndRun();
+            return false;
+        }
+
+        if (result != VK_INCOMPLETE)
+        {
+            MAGMA_LOG_ERROR("[MemoryDefragmenter] Failed to begin a defragmentation pass: {}", static_cast<int>(result));
+            EndRun();
+            return false;
+        }
+
+        uint32_t movedCount = 0;
+        for (uint32_t i = 0; i < m_pass.moveCount; i++)
+        {
+            VmaDefragmentationMove& move = m_pass.pMoves[i];
+
+            auto it = m_registrations.find(move.srcAllocation);
+            std::shared_ptr<AllocatedImage> image = it != m_registrations.end() ? it->second.image.lock() : nullptr;
+
+            if (!image || !MoveImage(cmd, move, *image, it->second.usage))
+            {
+                move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+                continue;
+            }
+
+            movedCount++;
+        }
+
+        if (movedCount == 0)
+        {
+            // Only allocations that cannot be fixed up were picked, VMA would keep offering them
+            vmaEndDefragmentationPass(m_allocator, m_context, &m_pass);
+            EndRun();
+            return false;
+        }
+
+        m_passOpen = true;
+        m_passFrame = frameNumber;
+
+        MAGMA_LOG_DEBUG("[MemoryDefragmenter] Moving {} image(s) in frame {}", movedCount, frameNumber);
+        return true;
+    }
+
+    bool MemoryDefragmenter::ShouldStart(uint64_t frameNumber)
+    {
+        if (m_requested)
+        {
+            m_requested = false;
+            return true;
+        }
+
+        // Nothing could be moved, not worth walking the blocks
+        if (m_registrations.empty() || frameNumber - m_lastCheckFrame < m_settings.checkIntervalFrames)
+        {
+            return false;
+        }
+
+        m_lastCheckFrame = frameNumber;
+        m_stats.lastFragmentation = MeasureFragmentation();
+
+        return m_stats.lastFragmentation >= m_settings.fragmentationThreshold;
+    }
+
+    float MemoryDefragmenter::MeasureFragmentation() const
+    {
+        VmaTotalStatistics statistics{};
+        vmaCalculateStatistics(m_allocator, &statistics);
+
+        const VmaDetailedStatistics& total = statistics.total;
+        if (total.statistics.blockBytes < m_settings.minBlockBytes || total.unusedRangeCount <= 1)
+        {
+            return 0.0f;
+        }
+
+        VkDeviceSize unusedBytes = total.statistics.blockBytes - total.statistics.allocationBytes;
+        return static_cast<float>(static_cast<double>(unusedBytes) / static_cast<double>(total.statistics.blockBytes));
+    }
+
+    bool MemoryDefragmenter::BeginRun()
+    {
+        if (m_runTargets.empty())
+        {
+            m_runTargets.push_back(VK_NULL_HANDLE);
+            if (m_pools)
+            {
+                for (VmaPool pool : m_pools->GetDefragmentablePools())
+                {
+                    m_runTargets.push_back(pool);
+                }
+            }
+            m_runTargetIndex = 0;
+
+            MAGMA_LOG_INFO("[MemoryDefragmenter] Starting defragmentation, {:.1f}% of allocated blocks unused",
+                m_stats.lastFragmentation * 100.0f);
+        }
+
+        VmaDefragmentationInfo info = {};
+        info.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT;
+        info.pool = m_runTargets[m_runTargetIndex];
+        info.maxBytesPerPass = m_settings.maxBytesPerPass;
+        info.maxAllocationsPerPass = m_settings.maxAllocationsPerPass;
+
+        VkResult result = vmaBeginDefragmentation(m_allocator, &info, &m_context);
+        if (result != VK_SUCCESS)
+        {
+            MAGMA_LOG_WARNING("[MemoryDefragmenter] Failed to begin defragmentation: {}", static_cast<int>(result));
+            m_context = VK_NULL_HANDLE;
+            m_runTargets.clear();
+            return false;
+        }
+
+        m_stats.active = true;
+        return true;
+    }
+
+    void MemoryDefragmenter::EndRun()
+    {
+        VmaDefragmentationStats runStats{};
+        vmaEndDefragmentation(m_allocator, m_context, &runStats);
+        m_context = VK_NULL_HANDLE;
+
+        m_stats.bytesMoved += runStats.bytesMoved;
+        m_stats.bytesFreed += runStats.bytesFreed;
+        m_stats.allocationsMoved += runStats.allocationsMoved;
+        m_stats.deviceMemoryBlocksFreed += runStats.deviceMemoryBlocksFreed;
+
+        if (runStats.allocationsMoved > 0)
+        {
+            MAGMA_LOG_INFO("[MemoryDefragmenter] Moved {} allocation(s), {} KB, freed {} block(s), {} KB",
+                runStats.allocationsMoved, runStats.bytesMoved / 1024, runStats.deviceMemoryBlocksFreed, runStats.bytesFreed / 1024);
+        }
+
+        // Continue with the next pool in the same frame's RecordPass call or the next one
+        if (++m_runTargetIndex < m_runTargets.size())
+        {
+            if (BeginRun())
+            {
+                return;
+            }
+        }
+
+        m_runTargets.clear();
+        m_stats.active = false;
+        m_stats.runsCompleted++;
+    }
+
+    bool MemoryDefragmenter::MoveImage(VkCommandBuffer cmd, const VmaDefragmentationMove& move, AllocatedImage& image, VkImageUsageFlags usage)
+    {
+        bool hasContents = image.currentLayout != VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImageUsageFlags copyUsage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+        // Adding transfer usage could change the memory requirements the new place was chosen for
+        if (hasContents && (usage & copyUsage) != copyUsage)
+        {
+            return false;
+        }
+
+        VkImageCreateInfo imageInfo = vkinit::image_create_info(image.imageFormat, usage, image.imageExtent);
+
+        VkImage newImage = VK_NULL_HANDLE;
+        if (vkCreateImage(m_device, &imageInfo, nullptr, &newImage) != VK_SUCCESS)
+        {
+            return false;
+        }
+
+        if (vmaBindImageMemory(m_allocator, move.dstTmpAllocation, newImage) != VK_SUCCESS)
+        {
+            vkDestroyImage(m_device, newImage, nullptr);
+            return false;
+        }
+
+        VkImageViewCreateInfo viewInfo = vkinit::imageview_create_info(image.imageFormat, newImage, VK_IMAGE_ASPECT_COLOR_BIT);
+
+        VkImageView newView = VK_NULL_HANDLE;
+        if (vkCreateImageView(m_device, &viewInfo, nullptr, &newView) != VK_SUCCESS)
+        {
+            vkDestroyImage(m_device, newImage, nullptr);
+            return false;
+        }
+
+        if (hasContents)
+        {
+            vkutil::transition_image(cmd, image.image, image.currentLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+            vkutil::transition_image(cmd, newImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+            VkImageCopy region = {};
+            region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+            region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+            region.extent = image.imageExtent;
+
+            vkCmdCopyImage(cmd,
+                image.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                newImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                1, &region);
+
+            vkutil::transition_image(cmd, newImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, image.currentLayout);
+        }
+
+        m_retiredImages.push_back({ image.image, image.imageView });
+
+        // Everything recorded after this point, including this frame's stages, uses the new place
+        image.image = newImage;
+        image.imageView = newView;
+
+        return true;
+    }
+}
@@ -0,0 +1,213 @@
+#include <magma_engine/core/renderer/MemoryTelemetry.h>
+#include <logging/Logger.h>
+#include <algorithm>
+#include <cassert>
+
+namespace Magma
+{
+    namespace
+    {
+        // Pressure is considered resolved once usage drops this far below the soft budget
+        constexpr double k_pressureReleaseFraction = 0.95;
+    }
+
+    const char* MemoryCategoryToString(MemoryCategory category)
+    {
+        switch (category)
+        {
+            case MemoryCategory::RENDER_TARGET: return "Render targets";
+            case MemoryCategory::BUFFER: return "Buffers";
+            case MemoryCategory::STAGING: return "Staging";
+            case MemoryCategory::OTHER: return "Other";
+            default: return "Unknown";
+        }
+    }
+
+    void MemoryTelemetry::Initialize(VmaAllocator allocator, const MemoryBudgetSettings& settings)
+    {
+        assert(allocator != VK_NULL_HANDLE && "MemoryTelemetry::Initialize() - VmaAllocator is null!");
+
+        m_allocator = allocator;
+        m_settings = settings;
+
+        const VkPhysicalDeviceMemoryProperties* memoryProperties = nullptr;
+        vmaGetMemoryProperties(m_allocator, &memoryProperties);
+
+        m_heapIsDeviceLocal.resize(memoryProperties->memoryHeapCount);
+        m_heaps.resize(memoryProperties->memoryHeapCount);
+        for (uint32_t i = 0; i < memoryProperties->memoryHeapCount; i++)
+        {
+            m_heapIsDeviceLocal[i] = (memoryProperties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+        }
+
+        Update(0);
+
+        MAGMA_LOG_INFO("[MemoryTelemetry] {} heap(s), device-local budget {} MB, soft budget {} MB",
+            m_heaps.size(), m_deviceLocalBudget / (1024 * 1024), m_softBudget / (1024 * 1024));
+    }
+
+    void MemoryTelemetry::Cleanup()
+    {
+        std::lock_guard lock(m_trackMutex);
+        m_tracked.clear();
+        m_evictionCallbacks.clear();
+        m_downscaleCallbacks.clear();
+        m_allocator = VK_NULL_HANDLE;
+    }
+
+    void MemoryTelemetry::Track(VmaAllocation allocation, const String& name, MemoryCategory category)
+    {
+        if (allocation == VK_NULL_HANDLE)
+        {
+            return;
+        }
+
+        VmaAllocationInfo info{};
+        vmaGetAllocationInfo(m_allocator, allocation, &info);
+
+        std::lock_guard lock(m_trackMutex);
+        m_tracked[allocation] = { name, category, info.size };
+    }
+
+    void MemoryTelemetry::Untrack(VmaAllocation allocation)
+    {
+        std::lock_guard lock(m_trackMutex);
+        m_tracked.erase(allocation);
+    }
+
+    void MemoryTelemetry::Update(uint32_t frameIndex)
+    {
+        if (m_allocator == VK_NULL_HANDLE)
+        {
+            return;
+        }
+
+        // Lets VMA refresh its cached budget from VK_EXT_memory_budget
+        vmaSetCurrentFrameIndex(m_allocator, frameIndex);
+
+        VmaBudget budgets[VK_MAX_MEMORY_HEAPS] = {};
+        vmaGetHeapBudgets(m_allocator, budgets);
+
+        m_deviceLocalUsage = 0;
+        m_deviceLocalBudget = 0;
+
+        for (uint32_t i = 0; i < m_heaps.size(); i++)
+        {
+            HeapBudget& heap = m_heaps[i];
+            heap.heapIndex = i;
+            heap.deviceLocal = m_heapIsDeviceLocal[i];
+            heap.budget = budgets[i].budget;
+            heap.usage = budgets[i].usage;
+            heap.blockBytes = budgets[i].statistics.blockBytes;
+            heap.allocationBytes = budgets[i].statistics.allocationBytes;
+            heap.allocationCount = budgets[i].statistics.allocationCount;
+
+            if (heap.deviceLocal)
+            {
+                m_deviceLocalUsage += heap.usage;
+                m_deviceLocalBudget += heap.budget;
+            }
+        }
+
+        m_softBudget = m_settings.softBudgetBytes != 0
+            ? m_settings.softBudgetBytes
+            : static_cast<VkDeviceSize>(static_cast<double>(m_deviceLocalBudget) * m_settings.softBudgetFraction);
+
+        EvaluatePressure();
+    }
+
+    MemoryReport MemoryTelemetry::GenerateReport() const
+    {
+        MemoryReport report;
+        report.heaps = m_heaps;
+        report.deviceLocalUsage = m_deviceLocalUsage;
+        report.deviceLocalBudget = m_deviceLocalBudget;
+        report.softBudget = m_softBudget;
+
+        if (m_allocator != VK_NULL_HANDLE)
+        {
+            // Exact per-heap totals, the per-frame budget numbers are cached by VMA
+            VmaTotalStatistics statistics{};
+            vmaCalculateStatistics(m_allocator, &statistics);
+
+            for (HeapBudget& heap : report.heaps)
+            {
+                const VmaDetailedStatistics& heapStats = statistics.memoryHeap[heap.heapIndex];
+                heap.blockBytes = heapStats.statistics.blockBytes;
+                heap.allocationBytes = heapStats.statistics.allocationBytes;
+                heap.allocationCount = heapStats.statistics.allocationCount;
+            }
+        }
+
+        {
+            std::lock_guard lock(m_trackMutex);
+            report.resources.reserve(m_tracked.size());
+            for (const auto& [allocation, resource] : m_tracked)
+            {
+                report.resources.push_back(resource);
+                report.categoryBytes[static_cast<size_t>(resource.category)] += resource.size;
+            }
+        }
+
+        std::sort(report.resources.begin(), report.resources.end(),
+            [](const ResourceMemory& a, const ResourceMemory& b) { return a.size > b.size; });
+
+        return report;
+    }
+
+    void MemoryTelemetry::EvaluatePressure()
+    {
+        if (m_softBudget == 0)
+        {
+            return;
+        }
+
+        MemoryPressure pressure;
+        pressure.usage = m_deviceLocalUsage;
+        pressure.softBudget = m_softBudget;
+        pressure.excess = m_deviceLocalUsage > m_softBudget ? m_deviceLocalUsage - m_softBudget : 0;
+
+        bool released = static_cast<double>(m_deviceLocalUsage) <= static_cast<double>(m_softBudget) * k_pressureReleaseFraction;
+
+        switch (m_pressureState)
+        {
+            case PressureState::NONE:
+                if (pressure.excess > 0)
+                {
+                    MAGMA_LOG_WARNING("[MemoryTelemetry] Over soft budget by {} MB, requesting eviction", pressure.excess / (1024 * 1024));
+                    m_pressureState = PressureState::EVICTING;
+                    m_framesSinceEviction = 0;
+                    for (const MemoryPressureCallback& callback : m_evictionCallbacks)
+                    {
+                        callback(pressure);
+                    }
+                }
+                break;
+
+            case PressureState::EVICTING:
+                if (released)
+                {
+                    m_pressureState = PressureState::NONE;
+                }
+                else if (pressure.excess > 0 && ++m_framesSinceEviction >= m_settings.downscaleDelayFrames)
+                {
+                    MAGMA_LOG_WARNING("[MemoryTelemetry] Still over soft budget by {} MB after eviction, requesting downscale",
+                        pressure.excess / (1024 * 1024));
+                    m_pressureState = PressureState::DOWNSCALED;
+                    for (const MemoryPressureCallback& callback : m_downscaleCallbacks)
+                    {
+                        callback(pressure);
+                    }
+                }
+                break;
+
+            case PressureState::DOWNSCALED:
+                if (released)
+                {
+                    MAGMA_LOG_INFO("[MemoryTelemetry] Back under soft budget");
+                    m_pressureState = PressureState::NONE;
+                }
+                break;
+        }
+    }
+}
@@ -7,6 +7,7 @@ namespace Magma
         : m_device(other.m_device)
         , m_pipeline(other.m_pipeline)
         , m_pipelineLayout(other.m_pipelineLayout)
+        , m_ownsLayout(other.m_ownsLayout)
     {
         other.m_device = VK_NULL_HANDLE;
         other.m_pipeline = VK_NULL_HANDLE;
@@ -22,6 +23,7 @@ namespace Magma
             m_device = other.m_device;
             m_pipeline = other.m_pipeline;
             m_pipelineLayout = other.m_pipelineLayout;
+            m_ownsLayout = other.m_ownsLayout;
 
             other.m_device = VK_NULL_HANDLE;
             other.m_pipeline = VK_NULL_HANDLE;
@@ -32,6 +34,8 @@ namespace Magma
 
     bool Pipeline::CreatePipelineLayout(const PipelineLayoutInfo& layoutInfo)
     {
+        m_ownsLayout = true;
+
         VkPipelineLayoutCreateInfo layoutCreateInfo{};
         layoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
         layoutCreateInfo.pNext = nullptr;
@@ -42,7 +46,7 @@ namespace Magma
 
         if (vkCreatePipelineLayout(m_device, &layoutCreateInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS)
         {
-            Logger::Log(LogLevel::ERROR, "Failed to create pipeline layout");
+            MAGMA_LOG_ERROR("Failed to create pipeline layout");
             return false;
         }
 
@@ -59,11 +63,11 @@ namespace Magma
                 m_pipeline = VK_NULL_HANDLE;
             }
 
-            if (m_pipelineLayout != VK_NULL_HANDLE)
+            if (m_pipelineLayout != VK_NULL_HANDLE && m_ownsLayout)
             {
                 vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
-                m_pipelineLayout = VK_NULL_HANDLE;
             }
+            m_pipelineLayout = VK_NULL_HANDLE;
 
             m_device = VK_NULL_HANDLE;
         }
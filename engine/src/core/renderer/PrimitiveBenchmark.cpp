@@ -0,0 +1,123 @@
+#include <magma_engine/core/renderer/PrimitiveBenchmark.h>
+#include <logging/Logger.h>
+#include <algorithm>
+
+namespace Magma
+{
+    namespace
+    {
+        const char* ComputePrimitiveToString(ComputePrimitive primitive)
+        {
+            switch (primitive)
+            {
+                case ComputePrimitive::RANDOM_FILL: return "random fill";
+                case ComputePrimitive::REDUCE: return "reduce";
+                case ComputePrimitive::EXCLUSIVE_SCAN: return "exclusive scan";
+                case ComputePrimitive::COMPACT: return "compact";
+                case ComputePrimitive::HISTOGRAM: return "histogram";
+                case ComputePrimitive::RADIX_SORT: return "radix sort";
+                default: return "unknown";
+            }
+        }
+    }
+
+    void PrimitiveBenchmark::Start(RenderGraph& graph, const String& deviceName, uint32_t warmupFrames, uint32_t samples)
+    {
+        m_stageIndices.clear();
+        m_results.clear();
+
+        uint32_t stageIndex = 0;
+        for (auto* stage : graph)
+        {
+            const StageConfiguration& config = stage->GetConfiguration();
+            if (config.IsPrimitive())
+            {
+                auto result = std::find_if(m_results.begin(), m_results.end(), [&config](const PrimitiveBenchmarkResult& existing) {
+                    return existing.instanceName == config.primitive->instanceName;
+                });
+
+                if (result == m_results.end())
+                {
+                    m_results.push_back({ config.primitive->instanceName, config.primitive->type, config.primitive->elementCount });
+                    m_stageIndices.emplace_back();
+                    result = m_results.end() - 1;
+                }
+
+                m_stageIndices[result - m_results.begin()].push_back(stageIndex);
+            }
+            stageIndex++;
+        }
+
+        if (m_results.empty())
+        {
+            MAGMA_LOG_WARNING("[PrimitiveBenchmark] No compute primitive in the graph, nothing to measure");
+            return;
+        }
+
+        m_deviceName = deviceName;
+        m_warmupFrames = warmupFrames;
+        m_samples = std::max(samples, 1u);
+        m_frame = 0;
+        m_running = true;
+
+        MAGMA_LOG_INFO("[PrimitiveBenchmark] Measuring {} primitive(s) over {} frame(s)", m_results.size(), m_samples);
+    }
+
+    void PrimitiveBenchmark::Update(const StageProfiler& profiler, bool hasStats)
+    {
+        if (!m_running || !hasStats)
+        {
+            return;
+        }
+
+        if (m_frame++ < m_warmupFrames)
+        {
+            return;
+        }
+
+        for (size_t i = 0; i < m_results.size(); i++)
+        {
+            // A frame only counts if every stage of the instance was timed
+            double gpuTimeMs = 0.0;
+            bool valid = true;
+            for (uint32_t stageIndex : m_stageIndices[i])
+            {
+                const StageGpuStats& stats = profiler.GetStageStats(stageIndex);
+                valid = valid && stats.valid;
+                gpuTimeMs += stats.gpuTimeMs;
+            }
+
+            if (valid)
+            {
+                m_results[i].gpuTimeMs += gpuTimeMs;
+                m_results[i].samples++;
+            }
+        }
+
+        if (m_frame - m_warmupFrames >= m_samples)
+        {
+            Finish();
+        }
+    }
+
+    void PrimitiveBenchmark::Finish()
+    {
+        m_running = false;
+
+        MAGMA_LOG_INFO("[PrimitiveBenchmark] Results on {}", m_deviceName.empty() ? "an unknown device" : m_deviceName);
+        for (PrimitiveBenchmarkResult& result : m_results)
+        {
+            if (result.samples == 0)
+            {
+                MAGMA_LOG_WARNING("[PrimitiveBenchmark] {}: no timings", result.instanceName);
+                continue;
+            }
+
+            result.gpuTimeMs /= result.samples;
+
+            MAGMA_LOG_INFO("[PrimitiveBenchmark] {} ({}, {} elements): {:.3f} ms, {:.1f} M elements/s",
+                result.instanceName, ComputePrimitiveToString(result.type), result.elementCount,
+                result.gpuTimeMs, result.GetElementsPerSecond() * 1e-6);
+        }
+    }
+}
@@ -0,0 +1,106 @@
+#include <magma_engine/core/renderer/PrimitiveReference.h>
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+
+namespace Magma
+{
+    namespace
+    {
+        // Matches pcgHash() in RandomFill.comp
+        uint32_t PcgHash(uint32_t value)
+        {
+            uint32_t state = value * 747796405u + 2891336453u;
+            uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+            return (word >> 22u) ^ word;
+        }
+    }
+
+    Vector<uint32_t> PrimitiveReference::RandomFill(uint32_t elementCount, uint32_t seed, uint32_t valueMask)
+    {
+        Vector<uint32_t> values(elementCount);
+        uint32_t seedHash = PcgHash(seed);
+        for (uint32_t i = 0; i < elementCount; i++)
+        {
+            values[i] = PcgHash(i ^ seedHash) & valueMask;
+        }
+        return values;
+    }
+
+    uint32_t PrimitiveReference::Reduce(const Vector<uint32_t>& values, ReduceOperation operation)
+    {
+        switch (operation)
+        {
+            case ReduceOperation::MIN:
+                return values.empty() ? 0xFFFFFFFF : *std::min_element(values.begin(), values.end());
+            case ReduceOperation::MAX:
+                return values.empty() ? 0 : *std::max_element(values.begin(), values.end());
+            case ReduceOperation::COUNT_NONZERO:
+                return static_cast<uint32_t>(std::count_if(values.begin(), values.end(), [](uint32_t value) { return value != 0; }));
+            case ReduceOperation::SUM:
+            default:
+                // Unsigned arithmetic wraps like the shader's
+                return std::accumulate(values.begin(), values.end(), 0u);
+        }
+    }
+
+    Vector<uint32_t> PrimitiveReference::ExclusiveScan(const Vector<uint32_t>& values)
+    {
+        Vector<uint32_t> result(values.size());
+        std::exclusive_scan(values.begin(), values.end(), result.begin(), 0u);
+        return result;
+    }
+
+    Vector<uint32_t> PrimitiveReference::Compact(const Vector<uint32_t>& values, const Vector<uint32_t>& flags)
+    {
+        assert(values.size() == flags.size() && "PrimitiveReference::Compact() - Every value needs a flag");
+
+        Vector<uint32_t> result;
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            if (flags[i] != 0)
+            {
+                result.push_back(values[i]);
+            }
+        }
+        return result;
+    }
+
+    Vector<uint32_t> PrimitiveReference::Histogram(const Vector<uint32_t>& values, uint32_t binCount, uint32_t binShift)
+    {
+        assert(binCount > 0 && binShift < 32 && "PrimitiveReference::Histogram() - Invalid bins");
+
+        Vector<uint32_t> bins(binCount, 0);
+        for (uint32_t value : values)
+        {
+            bins[std::min(value >> binShift, binCount - 1)]++;
+        }
+        return bins;
+    }
+
+    void PrimitiveReference::RadixSort(Vector<uint32_t>& keys, Vector<uint32_t>& values, uint32_t keyBits)
+    {
+        assert(keys.size() == values.size() && "PrimitiveReference::RadixSort() - Every key needs a value");
+
+        // The GPU sorts two 4-bit digits per byte
+        uint32_t sortedBits = (std::clamp(keyBits, 1u, 32u) + 7) / 8 * 8;
+        uint32_t keyMask = sortedBits >= 32 ? 0xFFFFFFFF : (1u << sortedBits) - 1;
+
+        Vector<size_t> order(keys.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&keys, keyMask](size_t a, size_t b) {
+            return (keys[a] & keyMask) < (keys[b] & keyMask);
+        });
+
+        Vector<uint32_t> sortedKeys(keys.size());
+        Vector<uint32_t> sortedValues(values.size());
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            sortedKeys[i] = keys[order[i]];
+            sortedValues[i] = values[order[i]];
+        }
+
+        keys = std::move(sortedKeys);
+        values = std::move(sortedValues);
+    }
+}
@@ -0,0 +1,330 @@
+#include <magma_engine/core/renderer/PrimitiveValidator.h>
+#include <magma_engine/core/renderer/PrimitiveReference.h>
+#include <magma_engine/core/renderer/RenderResourceAllocator.h>
+#include <logging/Logger.h>
+#include <algorithm>
+
+namespace Magma
+{
+    namespace
+    {
+        // The leading buffers of ComputePrimitiveInfo::bufferNames the instance reads, the rest it writes
+        uint32_t GetInputCount(ComputePrimitive primitive)
+        {
+            switch (primitive)
+            {
+                case ComputePrimitive::RANDOM_FILL: return 0;
+                case ComputePrimitive::COMPACT: return 2;
+                case ComputePrimitive::RADIX_SORT: return 2;
+                default: return 1;
+            }
+        }
+
+        Vector<uint32_t> ReadValues(const AllocatedBuffer& buffer, uint32_t count)
+        {
+            const uint32_t* values = static_cast<const uint32_t*>(buffer.mappedData);
+            if (!values)
+            {
+                return {};
+            }
+
+            count = std::min(count, static_cast<uint32_t>(buffer.size / sizeof(uint32_t)));
+            return Vector<uint32_t>(values, values + count);
+        }
+
+        bool Matches(const String& instanceName, const String& bufferName, const Vector<uint32_t>& expected, const Vector<uint32_t>& actual)
+        {
+            if (actual.size() != expected.size())
+            {
+                MAGMA_LOG_ERROR("[PrimitiveValidator] {}: read {} values of '{}', expected {}",
+                    instanceName, actual.size(), bufferName, expected.size());
+                return false;
+            }
+
+            auto mismatch = std::mismatch(expected.begin(), expected.end(), actual.begin());
+            if (mismatch.first == expected.end())
+            {
+                return true;
+            }
+
+            MAGMA_LOG_ERROR("[PrimitiveValidator] {}: '{}'[{}] is {}, expected {}",
+                instanceName, bufferName, mismatch.first - expected.begin(), *mismatch.second, *mismatch.first);
+            return false;
+        }
+    }
+
+    void PrimitiveValidator::Start(RenderGraph& graph, RenderResourceAllocator& allocator)
+    {
+        Stop();
+        m_allocator = &allocator;
+        m_failureCount = 0;
+
+        uint32_t stageIndex = 0;
+        for (auto* stage : graph)
+        {
+            const StageConfiguration& config = stage->GetConfiguration();
+            if (config.IsPrimitive())
+            {
+                auto instance = std::find_if(m_instances.begin(), m_instances.end(), [&config](const Instance& existing) {
+                    return existing.info.instanceName == config.primitive->instanceName;
+                });
+
+                if (instance == m_instances.end())
+                {
+                    m_instances.push_back({ *config.primitive, stageIndex, stageIndex });
+                }
+                else
+                {
+                    instance->lastStage = stageIndex;
+                }
+            }
+            stageIndex++;
+        }
+
+        // Instances are only checked with all their buffers
+        const BufferRegistry& bufferRegistry = allocator.GetBufferRegistry();
+        std::erase_if(m_instances, [&bufferRegistry](const Instance& instance) {
+            for (const String& bufferName : instance.info.bufferNames)
+            {
+                if (!bufferRegistry.GetStorageBuffer(bufferName))
+                {
+                    MAGMA_LOG_WARNING("[PrimitiveValidator] {}: buffer '{}' was not allocated, skipping it", instance.info.instanceName, bufferName);
+                    return true;
+                }
+            }
+            return false;
+        });
+
+        // Every version of a buffer has the same size
+        auto createReadback = [&allocator, &bufferRegistry](Readback& readback, const String& bufferName) {
+            readback.bufferName = bufferName;
+            readback.buffer = allocator.CreateBuffer(bufferRegistry.GetStorageBuffer(bufferName)->size,
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT, ResourceClass::READBACK, "PrimitiveValidator " + bufferName);
+        };
+
+        for (Instance& instance : m_instances)
+        {
+            const Vector<String>& bufferNames = instance.info.bufferNames;
+            uint32_t inputCount = GetInputCount(instance.info.type);
+
+            // A radix sort leaves its result in the buffers it read
+            bool inPlace = instance.info.type == ComputePrimitive::RADIX_SORT;
+
+            instance.inputs.resize(bufferNames.size());
+            instance.outputs.resize(bufferNames.size());
+            for (size_t i = 0; i < bufferNames.size(); i++)
+            {
+                if (i < inputCount)
+                {
+                    createReadback(instance.inputs[i], bufferNames[i]);
+                }
+                if (i >= inputCount || inPlace)
+                {
+                    createReadback(instance.outputs[i], bufferNames[i]);
+                }
+            }
+        }
+
+        if (m_instances.empty())
+        {
+            MAGMA_LOG_DEBUG("[PrimitiveValidator] No compute primitive in the graph, nothing to check");
+            return;
+        }
+
+        m_state = State::PENDING;
+        MAGMA_LOG_INFO("[PrimitiveValidator] Checking {} primitive(s) on the next frame", m_instances.size());
+    }
+
+    void PrimitiveValidator::Stop()
+    {
+        DestroyReadbacks();
+        m_instances.clear();
+        m_state = State::IDLE;
+    }
+
+    void PrimitiveValidator::Update(uint32_t frameIndex)
+    {
+        if (m_state == State::PENDING)
+        {
+            m_frameIndex = frameIndex;
+            m_state = State::RECORDING;
+            return;
+        }
+
+        if (m_state == State::RECORDING)
+        {
+            m_state = State::WAITING;
+        }
+
+        // The copies are done once the slot they were recorded in is reused
+        if (m_state != State::WAITING || frameIndex != m_frameIndex)
+        {
+            return;
+        }
+
+        VmaAllocator vmaAllocator = m_allocator->GetAllocator();
+        for (Instance& instance : m_instances)
+        {
+            for (Vector<Readback>* readbacks : { &instance.inputs, &instance.outputs })
+            {
+                for (Readback& readback : *readbacks)
+                {
+                    if (readback.buffer.allocation != VK_NULL_HANDLE)
+                    {
+                        vmaInvalidateAllocation(vmaAllocator, readback.buffer.allocation, 0, VK_WHOLE_SIZE);
+                    }
+                }
+            }
+        }
+
+        m_failureCount = 0;
+        for (const Instance& instance : m_instances)
+        {
+            if (Check(instance))
+            {
+                MAGMA_LOG_INFO("[PrimitiveValidator] {}: matches the reference", instance.info.instanceName);
+            }
+            else
+            {
+                m_failureCount++;
+            }
+        }
+
+        if (m_failureCount > 0)
+        {
+            MAGMA_LOG_ERROR("[PrimitiveValidator] {} of {} primitive(s) differ from the reference", m_failureCount, m_instances.size());
+        }
+
+        Stop();
+    }
+
+    void PrimitiveValidator::BeforeStage(VkCommandBuffer cmd, uint32_t stageIndex, const BufferRegistry& bufferRegistry)
+    {
+        if (m_state != State::RECORDING)
+        {
+            return;
+        }
+
+        for (Instance& instance : m_instances)
+        {
+            if (instance.firstStage == stageIndex && GetInputCount(instance.info.type) > 0)
+            {
+                CopyBuffers(cmd, instance.inputs, bufferRegistry);
+            }
+        }
+    }
+
+    void PrimitiveValidator::AfterStage(VkCommandBuffer cmd, uint32_t stageIndex, const BufferRegistry& bufferRegistry)
+    {
+        if (m_state != State::RECORDING)
+        {
+            return;
+        }
+
+        for (Instance& instance : m_instances)
+        {
+            if (instance.lastStage == stageIndex)
+            {
+                CopyBuffers(cmd, instance.outputs, bufferRegistry);
+            }
+        }
+    }
+
+    void PrimitiveValidator::CopyBuffers(VkCommandBuffer cmd, Vector<Readback>& readbacks, const BufferRegistry& bufferRegistry)
+    {
+        // Shader writes and the per-frame clears before the copies
+        VkMemoryBarrier memoryBarrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+        memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(cmd,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+        for (Readback& readback : readbacks)
+        {
+            const AllocatedBuffer* source = readback.buffer.buffer != VK_NULL_HANDLE
+                ? bufferRegistry.GetStorageBuffer(readback.bufferName)
+                : nullptr;
+            if (source)
+            {
+                VkBufferCopy region{ 0, 0, std::min(source->size, readback.buffer.size) };
+                vkCmdCopyBuffer(cmd, source->buffer, readback.buffer.buffer, 1, &region);
+            }
+        }
+
+        // Later stages may overwrite the sources, the host reads the copies after the frame's fence
+        memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(cmd,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+            0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    bool PrimitiveValidator::Check(const Instance& instance) const
+    {
+        const ComputePrimitiveInfo& info = instance.info;
+        const Vector<String>& names = info.bufferNames;
+        uint32_t elementCount = info.elementCount;
+
+        auto input = [&](size_t index) { return ReadValues(instance.inputs[index].buffer, elementCount); };
+        auto output = [&](size_t index, uint32_t count) { return ReadValues(instance.outputs[index].buffer, count); };
+
+        switch (info.type)
+        {
+            case ComputePrimitive::RANDOM_FILL:
+                return Matches(info.instanceName, names[0],
+                    PrimitiveReference::RandomFill(elementCount, info.seed, info.valueMask), output(0, elementCount));
+
+            case ComputePrimitive::REDUCE:
+                return Matches(info.instanceName, names[1],
+                    { PrimitiveReference::Reduce(input(0), static_cast<ReduceOperation>(info.parameter)) }, output(1, 1));
+
+            case ComputePrimitive::EXCLUSIVE_SCAN:
+                return Matches(info.instanceName, names[1],
+                    PrimitiveReference::ExclusiveScan(input(0)), output(1, elementCount));
+
+            case ComputePrimitive::COMPACT:
+            {
+                Vector<uint32_t> kept = PrimitiveReference::Compact(input(0), input(1));
+                uint32_t keptCount = static_cast<uint32_t>(kept.size());
+                return Matches(info.instanceName, names[3], { keptCount }, output(3, 1)) &&
+                    Matches(info.instanceName, names[2], kept, output(2, keptCount));
+            }
+
+            case ComputePrimitive::HISTOGRAM:
+                return Matches(info.instanceName, names[1],
+                    PrimitiveReference::Histogram(input(0), info.parameter, info.shift), output(1, info.parameter));
+
+            case ComputePrimitive::RADIX_SORT:
+            {
+                Vector<uint32_t> keys = input(0);
+                Vector<uint32_t> values = input(1);
+                PrimitiveReference::RadixSort(keys, values, info.parameter);
+                return Matches(info.instanceName, names[0], keys, output(0, elementCount)) &&
+                    Matches(info.instanceName, names[1], values, output(1, elementCount));
+            }
+
+            default:
+                return true;
+        }
+    }
+
+    void PrimitiveValidator::DestroyReadbacks()
+    {
+        for (Instance& instance : m_instances)
+        {
+            for (Vector<Readback>* readbacks : { &instance.inputs, &instance.outputs })
+            {
+                for (Readback& readback : *readbacks)
+                {
+                    if (readback.buffer.buffer != VK_NULL_HANDLE)
+                    {
+                        m_allocator->DestroyBuffer(readback.buffer);
+                    }
+                }
+            }
+        }
+    }
+}
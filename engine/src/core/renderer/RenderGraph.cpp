@@ -1,18 +1,25 @@
 #include <magma_engine/core/renderer/RenderGraph.h>
+#include <magma_engine/core/renderer/StageFactory.h>
 #include <magma_engine/core/renderer/VkUtils.h>
 #include <logging/Logger.h>
+#include <algorithm>
 
 namespace Magma
 {
     void RenderGraph::AddStage(std::unique_ptr<RenderStage> stage)
     {
         String stageName = stage->GetStageName();
+        bool replaced = m_stages.contains(stageName);
         m_stages[stageName] = std::move(stage);
 
     	// TODO: In future have explicit ordering and DAG support.
-        RebuildExecutionOrder();
+        // Stages run in the order they were added, a replaced stage keeps its slot
+        if (!replaced)
+        {
+            m_executionOrder.push_back(stageName);
+        }
 
-        Logger::Log(LogLevel::INFO, "[RenderGraph] Added stage: {}", stageName);
+        MAGMA_LOG_INFO("[RenderGraph] Added stage: {}", stageName);
     }
 
     void RenderGraph::RemoveStage(const String& stageName)
@@ -21,8 +28,8 @@ namespace Magma
         if (it != m_stages.end())
         {
             m_stages.erase(it);
-            RebuildExecutionOrder();
-            Logger::Log(LogLevel::INFO, "[RenderGraph] Removed stage: {}", stageName);
+            std::erase(m_executionOrder, stageName);
+            MAGMA_LOG_INFO("[RenderGraph] Removed stage: {}", stageName);
         }
     }
 
@@ -31,7 +38,7 @@ namespace Magma
         m_stages.clear();
         m_executionOrder.clear();
         m_connections.clear();
-        Logger::Log(LogLevel::INFO, "[RenderGraph] Cleared all stages");
+        MAGMA_LOG_INFO("[RenderGraph] Cleared all stages");
     }
 
     void RenderGraph::ConnectStages(const String& fromStage, const String& toStage, const String& bufferName)
@@ -39,7 +46,7 @@ namespace Magma
         // For future DAG support
         StageConnection connection{fromStage, toStage, bufferName};
         m_connections.push_back(connection);
-        Logger::Log(LogLevel::DEBUG, "[RenderGraph] Connected stage '{}' to '{}' via buffer '{}'",
+        MAGMA_LOG_DEBUG("[RenderGraph] Connected stage '{}' to '{}' via buffer '{}'",
             fromStage, toStage, bufferName);
     }
 
@@ -53,6 +60,93 @@ namespace Magma
         return m_executionOrder;
     }
 
+    size_t RenderGraph::FusePixelStages()
+    {
+        size_t removed = 0;
+
+        for (size_t i = 0; i + 1 < m_executionOrder.size();)
+        {
+            const RenderStage& first = *m_stages.at(m_executionOrder[i]);
+            const RenderStage& second = *m_stages.at(m_executionOrder[i + 1]);
+            if (!CanFusePixelStages(first, second))
+            {
+                i++;
+                continue;
+            }
+
+            const StageConfiguration& firstConfig = first.GetConfiguration();
+            const StageConfiguration& secondConfig = second.GetConfiguration();
+
+            Vector<PixelOperation> operations = firstConfig.pixelOperations;
+            operations.insert(operations.end(), secondConfig.pixelOperations.begin(), secondConfig.pixelOperations.end());
+
+            auto fused = StageFactory::CreatePixelStage(
+                firstConfig.name + "+" + secondConfig.name,
+                firstConfig.inputBuffers[0].bufferName,
+                secondConfig.outputBuffers[0].bufferName,
+                operations,
+                firstConfig.shaders[0].path);
+
+            MAGMA_LOG_INFO("[RenderGraph] Fused '{}' and '{}', '{}' is no longer written",
+                firstConfig.name, secondConfig.name, firstConfig.outputBuffers[0].bufferName);
+
+            String fusedName = fused->GetStageName();
+            m_stages.erase(m_executionOrder[i]);
+            m_stages.erase(m_executionOrder[i + 1]);
+            m_stages[fusedName] = std::move(fused);
+
+            // The fused stage may fuse with the next one as well
+            m_executionOrder[i] = fusedName;
+            m_executionOrder.erase(m_executionOrder.begin() + static_cast<std::ptrdiff_t>(i + 1));
+            removed++;
+        }
+
+        return removed;
+    }
+
+    bool RenderGraph::CanFusePixelStages(const RenderStage& first, const RenderStage& second) const
+    {
+        const StageConfiguration& firstConfig = first.GetConfiguration();
+        const StageConfiguration& secondConfig = second.GetConfiguration();
+
+        if (!firstConfig.IsPixelStage() || !secondConfig.IsPixelStage() ||
+            firstConfig.shaders[0].path != secondConfig.shaders[0].path ||
+            firstConfig.resolution != secondConfig.resolution ||
+            firstConfig.pixelOperations.size() + secondConfig.pixelOperations.size() > k_MaxPixelOperations)
+        {
+            return false;
+        }
+
+        const String& intermediate = firstConfig.outputBuffers[0].bufferName;
+        if (secondConfig.inputBuffers[0].bufferName != intermediate)
+        {
+            return false;
+        }
+
+        // The intermediate is only dropped when nothing else reads or writes it
+        for (const auto& [name, stage] : m_stages)
+        {
+            if (name == firstConfig.name || name == secondConfig.name)
+            {
+                continue;
+            }
+
+            const StageConfiguration& config = stage->GetConfiguration();
+            for (const Vector<BufferBinding>* bindings : { &config.inputBuffers, &config.outputBuffers })
+            {
+                for (const BufferBinding& binding : *bindings)
+                {
+                    if (binding.bufferName == intermediate || binding.bufferName == HistoryBufferName(intermediate))
+                    {
+                        return false;
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+
     Vector<BufferRequirement> RenderGraph::CollectAllBufferRequirements() const
     {
         Vector<BufferRequirement> allRequirements;
@@ -86,7 +180,7 @@ namespace Magma
                 if (uniqueRequirements.find(req.name) == uniqueRequirements.end())
                 {
                     uniqueRequirements[req.name] = req;
-                    Logger::Log(LogLevel::DEBUG, "[RenderGraph] Stage '{}' requires buffer '{}'",
+                    MAGMA_LOG_DEBUG("[RenderGraph] Stage '{}' requires buffer '{}'",
                         stageName, req.name);
                 }
                 else
@@ -96,24 +190,82 @@ namespace Magma
 
                     if (existing.format != req.format)
                     {
-                        Logger::Log(LogLevel::WARNING,
+                        MAGMA_LOG_WARNING(
                             "[RenderGraph] Stage '{}' requires buffer '{}' with different format. Existing: {}, Requested: {}",
                             stageName, req.name, static_cast<uint32_t>(existing.format), static_cast<uint32_t>(req.format));
                     }
 
+                    if (existing.resourceClass != req.resourceClass)
+                    {
+                        MAGMA_LOG_WARNING(
+                            "[RenderGraph] Stage '{}' requires buffer '{}' as {}, keeping {}",
+                            stageName, req.name, ResourceClassToString(req.resourceClass), ResourceClassToString(existing.resourceClass));
+                    }
+
                     // Merge usage flags (allow aliasing with different uses)
                     uniqueRequirements[req.name].usage |= req.usage;
+
+                    // Versioned as soon as one stage asks for it
+                    uniqueRequirements[req.name].perFrame |= req.perFrame;
                 }
             }
         }
 
-        Logger::Log(LogLevel::DEBUG, "[RenderGraph] Collected {} unique buffer requirements", uniqueRequirements.size());
+        MAGMA_LOG_DEBUG("[RenderGraph] Collected {} unique buffer requirements", uniqueRequirements.size());
+        return uniqueRequirements;
+    }
+
+    Map<String, StorageBufferRequirement> RenderGraph::CollectUniqueStorageBufferRequirements() const
+    {
+        Map<String, StorageBufferRequirement> uniqueRequirements;
+
+        for (const auto& stageName : m_executionOrder)
+        {
+            auto it = m_stages.find(stageName);
+            if (it == m_stages.end()) continue;
+
+            for (const auto& req : it->second->GetStorageBufferRequirements())
+            {
+                auto existing = uniqueRequirements.find(req.name);
+                if (existing == uniqueRequirements.end())
+                {
+                    uniqueRequirements[req.name] = req;
+                    continue;
+                }
+
+                // Every stage gets the buffer it declared, readers may leave the size to the writer
+                StorageBufferRequirement& merged = existing->second;
+                merged.size = std::max(merged.size, req.size);
+                merged.usage |= req.usage;
+                merged.clearEachFrame |= req.clearEachFrame;
+                merged.isOutput |= req.isOutput;
+                for (VkDeviceSize offset : req.indirectArgsOffsets)
+                {
+                    if (std::find(merged.indirectArgsOffsets.begin(), merged.indirectArgsOffsets.end(), offset) == merged.indirectArgsOffsets.end())
+                    {
+                        merged.indirectArgsOffsets.push_back(offset);
+                    }
+                }
+            }
+        }
+
+        for (auto it = uniqueRequirements.begin(); it != uniqueRequirements.end();)
+        {
+            if (it->second.size == 0)
+            {
+                MAGMA_LOG_ERROR("[RenderGraph] No stage declares the size of storage buffer '{}'", it->first);
+                it = uniqueRequirements.erase(it);
+                continue;
+            }
+            ++it;
+        }
+
         return uniqueRequirements;
     }
 
     void RenderGraph::Cleanup()
     {
-        Logger::Log(LogLevel::INFO, "[RenderGraph] Cleaning up");
+        MAGMA_LOG_INFO("[RenderGraph] Cleaning up");
 
         for (auto& [name, stage] : m_stages)
         {
@@ -123,7 +275,7 @@ namespace Magma
 
     void RenderGraph::OnResolutionChanged(VkExtent2D newExtent)
     {
-        Logger::Log(LogLevel::INFO, "[RenderGraph] Resolution changed to {}x{}", newExtent.width, newExtent.height);
+        MAGMA_LOG_INFO("[RenderGraph] Resolution changed to {}x{}", newExtent.width, newExtent.height);
 
         for (auto& [name, stage] : m_stages)
         {
@@ -131,38 +283,42 @@ namespace Magma
         }
     }
 
-    String RenderGraph::GetFinalOutputBufferName() const
+    void RenderGraph::InvalidateDescriptors()
     {
-        const String& lastStageName = m_executionOrder.back();
-        auto it = m_stages.find(lastStageName);
-
-        if (it == m_stages.end())
+        for (auto& [name, stage] : m_stages)
         {
-            return "";
+            stage->InvalidateDescriptors();
         }
+    }
 
-        auto requirements = it->second->GetBufferRequirements();
-        for (const auto& req : requirements)
+    void RenderGraph::InvalidateDescriptors(const String& bufferName)
+    {
+        for (auto& [name, stage] : m_stages)
         {
-            if (req.isOutput)
-            {
-                return req.name;
-            }
+            stage->InvalidateDescriptors(bufferName);
         }
-
-        return "";
     }
 
-    void RenderGraph::RebuildExecutionOrder()
+    String RenderGraph::GetFinalOutputBufferName() const
     {
-        // For linear execution, maintain insertion order
-        m_executionOrder.clear();
-
-        for (const auto& [name, stage] : m_stages)
+        // Stages that only write storage buffers, like the compute primitives, have no image to present
+        for (auto stageName = m_executionOrder.rbegin(); stageName != m_executionOrder.rend(); ++stageName)
         {
-            m_executionOrder.push_back(name);
+            auto it = m_stages.find(*stageName);
+            if (it == m_stages.end())
+            {
+                continue;
+            }
+
+            for (const auto& req : it->second->GetBufferRequirements())
+            {
+                if (req.isOutput)
+                {
+                    return req.name;
+                }
+            }
         }
 
-        Logger::Log(LogLevel::DEBUG, "[RenderGraph] Rebuilt execution order with {} stages", m_executionOrder.size());
+        return "";
     }
 }
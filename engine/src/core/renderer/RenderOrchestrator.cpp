@@ -1,6 +1,8 @@
 #include <stdint.h>
 #include <magma_engine/core/renderer/RenderOrchestrator.h>
+#include <magma_engine/core/renderer/VkUtils.h>
 #include <logging/Logger.h>
+#include <profiling/Profiler.h>
 #include <cassert>
 
 namespace Magma
@@ -9,65 +11,247 @@ namespace Magma
     {
         if (m_initialized)
         {
-            Logger::Log(LogLevel::ERROR, "Cannot add stage '{}' after orchestrator is initialized", stage->GetStageName());
+            MAGMA_LOG_ERROR("Cannot add stage '{}' after orchestrator is initialized", stage->GetStageName());
             return;
         }
 
         m_renderGraph.AddStage(std::move(stage));
     }
 
-    void RenderOrchestrator::Initialize(
+    bool RenderOrchestrator::Initialize(
         std::shared_ptr<RenderResourceAllocator> resourceAllocator,
-        VkExtent2D swapchainExtent)
+        VkExtent2D swapchainExtent,
+        uint32_t framesInFlight,
+        const StageProfilerSettings& profilerSettings)
     {
         assert(resourceAllocator && "RenderOrchestrator::Initialize() - resourceAllocator is null!");
         assert(resourceAllocator->IsInitialized() && "RenderOrchestrator::Initialize() - RenderResourceAllocator not initialized! Call resourceAllocator->Initialize() first.");
 
         if (m_initialized)
         {
-            Logger::Log(LogLevel::WARNING, "RenderOrchestrator already initialized");
-            return;
+            MAGMA_LOG_WARNING("RenderOrchestrator already initialized");
+            return true;
         }
 
         m_resourceAllocator = resourceAllocator;
+        m_framesInFlight = framesInFlight;
         m_currentExtent = swapchainExtent;
+        m_renderExtent = swapchainExtent;
+        m_outputExtent = swapchainExtent;
 
-        Logger::Log(LogLevel::INFO, "Initializing RenderOrchestrator with {} stage(s)",
+        MAGMA_LOG_INFO("Initializing RenderOrchestrator with {} stage(s)",
             m_renderGraph.GetStageCount());
 
+        if (m_stageFusion)
+        {
+            size_t fusedStages = m_renderGraph.FusePixelStages();
+            if (fusedStages > 0)
+            {
+                MAGMA_LOG_INFO("Fused {} pixel stage(s), {} stage(s) remain", fusedStages, m_renderGraph.GetStageCount());
+            }
+        }
+
+        // Tuned workgroup sizes have to be in place before the stages create their pipelines
+        m_workgroupTuner.Initialize(m_computeDeviceInfo, m_workgroupTunerSettings);
+        m_workgroupTuner.ApplyCachedSizes(m_renderGraph);
+
         // Collect requirements and allocate through resource allocator
         CollectBufferRequirements();
         AllocateBuffers();
 
         // Initialize each stage - pass allocator directly
         for (auto* stage : m_renderGraph) {
-            stage->Initialize(
+            bool initialized = stage->Initialize(
                 resourceAllocator->GetDevice(),
                 resourceAllocator->GetBufferRegistry(),
-                resourceAllocator->GetDescriptorManager());
+                resourceAllocator->GetDescriptorManager(),
+                framesInFlight,
+                m_computeDeviceInfo);
+            if (!initialized)
+            {
+                MAGMA_LOG_ERROR("Stage '{}' cannot run on this device, RenderOrchestrator initialization failed", stage->GetStageName());
+                m_renderGraph.Cleanup();
+                DeallocateBuffers();
+                m_bufferRequirements.clear();
+                m_storageBufferRequirements.clear();
+                return false;
+            }
+        }
+
+        // Barriers follow the buffers each stage reads and writes
+        Vector<StageAccess> stageAccesses;
+        for (auto* stage : m_renderGraph)
+        {
+            StageAccess& access = stageAccesses.emplace_back();
+            for (const BufferRequirement& requirement : stage->GetBufferRequirements())
+            {
+                (requirement.isOutput ? access.writes : access.reads).push_back(requirement.name);
+            }
+            for (const StorageBufferRequirement& requirement : stage->GetStorageBufferRequirements())
+            {
+                (requirement.isOutput ? access.writes : access.reads).push_back(requirement.name);
+                access.readsIndirectArgs |= !requirement.indirectArgsOffsets.empty();
+            }
         }
+        m_synchronizer.Initialize(resourceAllocator->GetDevice(), framesInFlight, stageAccesses,
+            m_needsFrameBarrier, m_synchronizerSettings);
+
+        m_profiler.Initialize(
+            resourceAllocator->GetDevice(),
+            framesInFlight,
+            static_cast<uint32_t>(m_renderGraph.GetStageCount()),
+            profilerSettings);
+
+        m_frameRecordTimeNs.assign(framesInFlight, 0);
+        m_stageZoneNames.clear();
+        for (auto* stage : m_renderGraph)
+        {
+            m_stageZoneNames.push_back(Profiler::Intern("GPU " + stage->GetStageName()));
+        }
+
+        // Candidates are told apart by their stage timestamps
+        if (m_profiler.IsEnabled())
+        {
+            m_workgroupTuner.Start(m_renderGraph, framesInFlight);
+        }
+
+#if MAGMA_VALIDATE_PRIMITIVES
+        m_primitiveValidator.Start(m_renderGraph, *resourceAllocator);
+#endif
 
         m_initialized = true;
-        Logger::Log(LogLevel::INFO, "RenderOrchestrator initialization complete");
+        MAGMA_LOG_INFO("RenderOrchestrator initialization complete");
+        return true;
     }
 
-    void RenderOrchestrator::Execute(VkCommandBuffer cmd)
+    void RenderOrchestrator::Execute(VkCommandBuffer cmd, uint32_t frameIndex, uint32_t frameNumber)
     {
+        MAGMA_PROFILE_FUNCTION();
+
         assert(m_initialized && "RenderOrchestrator::Execute() - Not initialized! Call Initialize() first.");
 
         auto allocator = m_resourceAllocator.lock();
         if (!allocator)
         {
-            Logger::Log(LogLevel::ERROR, "Resource allocator no longer available");
+            MAGMA_LOG_ERROR("Resource allocator no longer available");
             return;
         }
 
         assert(allocator->IsInitialized() && "RenderOrchestrator::Execute() - RenderResourceAllocator no longer initialized!");
 
+        // Stages and GetBuffer() see this frame slot's version of per-frame buffers
+        allocator->GetBufferRegistry().SetCurrentVersion(frameIndex);
+
+        m_synchronizer.BeginFrame(frameIndex);
+
+        bool hasStats = m_profiler.BeginFrame(cmd, frameIndex);
+        if (hasStats)
+        {
+            ReportGpuZones(frameIndex);
+
+            // Overlapping stages make the sum of stage times overestimate the frame
+            m_dynamicResolution.Update(m_profiler.GetFrameGpuTimeMs());
+        }
+        m_swizzleBenchmark.Update(m_renderGraph, frameIndex, m_profiler, hasStats);
+        m_workgroupTuner.Update(m_renderGraph, frameIndex, m_profiler, hasStats);
+        m_primitiveBenchmark.Update(m_profiler, hasStats);
+        m_primitiveValidator.Update(frameIndex);
+        m_frameRecordTimeNs[frameIndex] = Profiler::Now();
+
+        // Images keep their allocation, stages render into the scaled region of them
+        VkExtent2D renderExtent = DynamicResolution::ScaleExtent(m_currentExtent, m_dynamicResolution.GetScale());
+        if (renderExtent.width != m_renderExtent.width || renderExtent.height != m_renderExtent.height)
+        {
+            // History was written for a different region of the images
+            m_historyFrames = 0;
+        }
+        m_renderExtent = renderExtent;
+
+        SwapHistoryBuffers();
+
+        StagePushConstants frameConstants;
+        frameConstants.renderWidth = m_renderExtent.width;
+        frameConstants.renderHeight = m_renderExtent.height;
+        frameConstants.imageWidth = m_currentExtent.width;
+        frameConstants.imageHeight = m_currentExtent.height;
+        frameConstants.renderScale = m_dynamicResolution.GetScale();
+        frameConstants.frameNumber = frameNumber;
+        frameConstants.historyFrames = m_historyFrames;
+        m_historyFrames++;
+
+        for (auto* stage : m_renderGraph)
+        {
+            stage->SetFrameConstants(frameConstants);
+        }
+
+        // An upscaler as the last stage writing an image fills the whole output image
+        RenderStage* finalStage = nullptr;
+        for (auto* stage : m_renderGraph)
+        {
+            if (!stage->GetConfiguration().outputBuffers.empty())
+            {
+                finalStage = stage;
+            }
+        }
+        m_outputExtent = finalStage && finalStage->GetConfiguration().resolution == StageResolution::DISPLAY
+            ? m_currentExtent
+            : m_renderExtent;
+
+        // Stages read and write graph images as storage images. New images start out undefined and
+        // the output may have been left for sampling by the previous frame.
+        for (const auto& [name, requirement] : m_bufferRequirements)
+        {
+            std::shared_ptr<AllocatedImage> image = allocator->GetImage(name);
+            if (!image || image->currentLayout == VK_IMAGE_LAYOUT_GENERAL)
+            {
+                continue;
+            }
+
+            if (requirement.perFrame)
+            {
+                // This version was last used by the frame the slot's fence waited for
+                vkutil::transition_image(cmd, image->image, image->currentLayout, VK_IMAGE_LAYOUT_GENERAL,
+                    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+            }
+            else
+            {
+                vkutil::transition_image(cmd, image->image, image->currentLayout, VK_IMAGE_LAYOUT_GENERAL);
+            }
+            image->currentLayout = VK_IMAGE_LAYOUT_GENERAL;
+        }
+
+        ResetStorageBuffers(cmd, allocator->GetBufferRegistry());
+
+        // Descriptor updates for every stage go out in one call
+        for (auto* stage : m_renderGraph)
+        {
+            stage->PrepareDescriptors(frameIndex, m_descriptorWriter);
+        }
+        allocator->GetDescriptorManager()->UpdateDescriptorSets(m_descriptorWriter);
+
         // Execute each stage
+        uint32_t stageIndex = 0;
         for (auto* stage : m_renderGraph)
         {
-            stage->Execute(cmd);
+            if (hasStats)
+            {
+                stage->ApplyGpuStats(m_profiler.GetStageStats(stageIndex));
+            }
+
+            // Waits for what the stage consumes, the first one also for what the previous frame
+            // wrote into shared buffers
+            m_synchronizer.BeforeStage(cmd, stageIndex);
+            m_primitiveValidator.BeforeStage(cmd, stageIndex, allocator->GetBufferRegistry());
+
+            m_profiler.BeginStage(cmd, stageIndex);
+            stage->Execute(cmd, frameIndex);
+            m_profiler.EndStage(cmd, stageIndex);
+
+            m_synchronizer.AfterStage(cmd, stageIndex);
+            m_primitiveValidator.AfterStage(cmd, stageIndex, allocator->GetBufferRegistry());
+
+            stageIndex++;
         }
     }
 
@@ -78,16 +262,22 @@ namespace Magma
             return;
         }
 
-        Logger::Log(LogLevel::INFO, "Cleaning up RenderOrchestrator");
+        MAGMA_LOG_INFO("Cleaning up RenderOrchestrator");
 
         auto allocator = m_resourceAllocator.lock();
         if (allocator)
         {
+            m_profiler.Cleanup();
+            m_synchronizer.Cleanup();
+            m_swizzleBenchmark.Stop(m_renderGraph);
+            m_primitiveBenchmark.Stop();
+            m_primitiveValidator.Stop();
             m_renderGraph.Cleanup();
             DeallocateBuffers();
         }
 
         m_bufferRequirements.clear();
+        m_storageBufferRequirements.clear();
         m_initialized = false;
     }
 
@@ -102,7 +292,7 @@ namespace Magma
         String finalBufferName = m_renderGraph.GetFinalOutputBufferName();
         if (finalBufferName.empty())
         {
-            Logger::Log(LogLevel::ERROR, "No final output buffer defined");
+            MAGMA_LOG_ERROR("No final output buffer defined");
             return nullptr;
         }
 
@@ -113,21 +303,177 @@ namespace Magma
     {
         assert(m_initialized && "RenderOrchestrator::OnResolutionChanged() - Not initialized!");
 
-        Logger::Log(LogLevel::INFO, "Resolution changed to {}x{}, recreating buffers", newExtent.width, newExtent.height);
+        MAGMA_LOG_INFO("Resolution changed to {}x{}, recreating resolution-dependent buffers", newExtent.width, newExtent.height);
 
         m_currentExtent = newExtent;
+        m_historyFrames = 0;
 
-        DeallocateBuffers();
-        AllocateBuffers();
+        // Pipelines and layouts stay, only descriptors of replaced images are rewritten. Frames in
+        // flight keep the old images until they retire back into the allocator's pool.
+        auto allocator = m_resourceAllocator.lock();
+        if (allocator)
+        {
+            for (const String& bufferName : allocator->ResizeImages(m_bufferRequirements, m_currentExtent))
+            {
+                m_renderGraph.InvalidateDescriptors(bufferName);
+            }
+        }
 
         m_renderGraph.OnResolutionChanged(newExtent);
     }
 
+    void RenderOrchestrator::InvalidateDescriptors()
+    {
+        m_renderGraph.InvalidateDescriptors();
+    }
+
+    void RenderOrchestrator::StartSwizzleBenchmark(uint32_t framesPerMode, uint32_t samplesPerMode)
+    {
+        if (!m_profiler.IsEnabled())
+        {
+            MAGMA_LOG_WARNING("[SwizzleBenchmark] Stage timestamps are disabled, nothing to measure");
+            return;
+        }
+
+        if (m_workgroupTuner.IsRunning())
+        {
+            MAGMA_LOG_WARNING("[SwizzleBenchmark] Workgroup sizes are still being tuned, try again later");
+            return;
+        }
+
+        m_swizzleBenchmark.Start(m_renderGraph, m_framesInFlight, framesPerMode, samplesPerMode);
+    }
+
+    void RenderOrchestrator::StartPrimitiveBenchmark(uint32_t warmupFrames, uint32_t samples)
+    {
+        if (!m_profiler.IsEnabled())
+        {
+            MAGMA_LOG_WARNING("[PrimitiveBenchmark] Stage timestamps are disabled, nothing to measure");
+            return;
+        }
+
+        if (m_workgroupTuner.IsRunning())
+        {
+            MAGMA_LOG_WARNING("[PrimitiveBenchmark] Workgroup sizes are still being tuned, try again later");
+            return;
+        }
+
+        m_primitiveBenchmark.Start(m_renderGraph, m_computeDeviceInfo.deviceName, warmupFrames, samples);
+    }
+
+    void RenderOrchestrator::StartPrimitiveValidation()
+    {
+        assert(m_initialized && "RenderOrchestrator::StartPrimitiveValidation() - Not initialized!");
+
+        auto allocator = m_resourceAllocator.lock();
+        if (!allocator)
+        {
+            MAGMA_LOG_ERROR("Resource allocator no longer available");
+            return;
+        }
+
+        m_primitiveValidator.Start(m_renderGraph, *allocator);
+    }
+
+    void RenderOrchestrator::ReportGpuZones(uint32_t frameIndex)
+    {
+#if MAGMA_ENABLE_PROFILING
+        // GPU and CPU clocks are not calibrated, so the GPU track is anchored at the
+        // moment the frame was recorded and laid out with the measured stage offsets.
+        uint64_t anchorNs = m_frameRecordTimeNs[frameIndex];
+
+        for (size_t i = 0; i < m_stageZoneNames.size(); i++)
+        {
+            const StageGpuStats& stats = m_profiler.GetStageStats(static_cast<uint32_t>(i));
+            if (!stats.valid)
+            {
+                continue;
+            }
+
+            uint64_t startNs = anchorNs + static_cast<uint64_t>(stats.gpuStartOffsetMs * 1000000.0);
+            uint64_t endNs = startNs + static_cast<uint64_t>(stats.gpuTimeMs * 1000000.0);
+            Profiler::RecordGpuZone(m_stageZoneNames[i], startNs, endNs);
+        }
+#endif
+    }
+
     void RenderOrchestrator::CollectBufferRequirements()
     {
-        Logger::Log(LogLevel::DEBUG, "Collecting buffer requirements from render graph");
+        MAGMA_LOG_DEBUG("Collecting buffer requirements from render graph");
         m_bufferRequirements = m_renderGraph.CollectUniqueBufferRequirements();
-        Logger::Log(LogLevel::DEBUG, "Collected {} unique buffer requirements", m_bufferRequirements.size());
+        m_storageBufferRequirements = m_renderGraph.CollectUniqueStorageBufferRequirements();
+        ResolveHistoryRequirements();
+
+        m_needsFrameBarrier = !m_historyBuffers.empty();
+        for (const auto& [name, requirement] : m_bufferRequirements)
+        {
+            m_needsFrameBarrier |= !requirement.perFrame;
+        }
+
+        MAGMA_LOG_DEBUG("Collected {} unique buffer requirements, frames {} serialised",
+            m_bufferRequirements.size(), m_needsFrameBarrier ? "are" : "are not");
+    }
+
+    void RenderOrchestrator::ResolveHistoryRequirements()
+    {
+        m_historyBuffers.clear();
+
+        const size_t suffixLength = std::char_traits<char>::length(k_HistorySuffix);
+
+        for (auto& [name, requirement] : m_bufferRequirements)
+        {
+            if (name.size() <= suffixLength || !name.ends_with(k_HistorySuffix))
+            {
+                continue;
+            }
+
+            String bufferName = name.substr(0, name.size() - suffixLength);
+            auto current = m_bufferRequirements.find(bufferName);
+            if (current == m_bufferRequirements.end())
+            {
+                MAGMA_LOG_ERROR("History buffer '{}' has no stage writing '{}'", name, bufferName);
+                continue;
+            }
+
+            // The swap exchanges single images, a per-frame version would be read by the wrong frame
+            if (current->second.perFrame)
+            {
+                MAGMA_LOG_WARNING("Buffer '{}' keeps a history and cannot be per-frame, allocating it once", bufferName);
+                current->second.perFrame = false;
+            }
+
+            // Both halves must be interchangeable for the per-frame swap
+            VkImageUsageFlags usage = current->second.usage | requirement.usage;
+            bool isInput = requirement.isInput;
+            requirement = current->second;
+            requirement.name = name;
+            requirement.usage = usage;
+            requirement.isInput = isInput;
+            requirement.isOutput = false;
+            current->second.usage = usage;
+
+            m_historyBuffers.push_back(bufferName);
+            MAGMA_LOG_DEBUG("Buffer '{}' keeps its previous frame as '{}'", bufferName, name);
+        }
+    }
+
+    void RenderOrchestrator::SwapHistoryBuffers()
+    {
+        auto allocator = m_resourceAllocator.lock();
+        if (!allocator)
+        {
+            return;
+        }
+
+        // Last frame's output becomes the history, its old history image is overwritten this frame.
+        // Frame slots pick the swap up when they next prepare their descriptors.
+        for (const String& bufferName : m_historyBuffers)
+        {
+            String historyName = HistoryBufferName(bufferName);
+            allocator->SwapImages(bufferName, historyName);
+            m_renderGraph.InvalidateDescriptors(bufferName);
+            m_renderGraph.InvalidateDescriptors(historyName);
+        }
     }
 
     void RenderOrchestrator::AllocateBuffers()
@@ -135,7 +481,10 @@ namespace Magma
         auto allocator = m_resourceAllocator.lock();
         if (allocator)
         {
-            allocator->AllocateImages(m_bufferRequirements, m_currentExtent);
+            allocator->AllocateImages(m_bufferRequirements, m_currentExtent, m_framesInFlight);
+
+            // Storage buffers are small, so every one is per-frame and frames never share them
+            allocator->AllocateStorageBuffers(m_storageBufferRequirements, m_framesInFlight);
         }
     }
 
@@ -144,7 +493,57 @@ namespace Magma
         auto allocator = m_resourceAllocator.lock();
         if (allocator)
         {
+            allocator->DeallocateStorageBuffers();
             allocator->DeallocateImages();
         }
     }
+
+    void RenderOrchestrator::ResetStorageBuffers(VkCommandBuffer cmd, const BufferRegistry& bufferRegistry)
+    {
+        // Nothing reads an indirect dispatch that no stage produced this frame
+        const VkDispatchIndirectCommand emptyDispatch = { 0, 1, 1 };
+
+        bool cleared = false;
+        bool clearedIndirectArgs = false;
+        for (const auto& [name, requirement] : m_storageBufferRequirements)
+        {
+            const AllocatedBuffer* buffer = bufferRegistry.GetStorageBuffer(name);
+            if (buffer && requirement.clearEachFrame)
+            {
+                vkCmdFillBuffer(cmd, buffer->buffer, 0, VK_WHOLE_SIZE, 0);
+                cleared = true;
+                clearedIndirectArgs |= !requirement.indirectArgsOffsets.empty();
+            }
+        }
+
+        // The arguments are written over the cleared buffer
+        if (clearedIndirectArgs)
+        {
+            VkMemoryBarrier transferBarrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+            transferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            transferBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                1, &transferBarrier, 0, nullptr, 0, nullptr);
+        }
+
+        bool resetIndirectArgs = false;
+        for (const auto& [name, requirement] : m_storageBufferRequirements)
+        {
+            const AllocatedBuffer* buffer = bufferRegistry.GetStorageBuffer(name);
+            for (VkDeviceSize offset : requirement.indirectArgsOffsets)
+            {
+                if (buffer)
+                {
+                    vkCmdUpdateBuffer(cmd, buffer->buffer, offset, sizeof(emptyDispatch), &emptyDispatch);
+                    resetIndirectArgs = true;
+                }
+            }
+        }
+
+        // The slot's previous use completed before its fence was signalled, only later reads need ordering
+        if (cleared || resetIndirectArgs)
+        {
+            vkutil::transfer_write_barrier(cmd);
+        }
+    }
 }
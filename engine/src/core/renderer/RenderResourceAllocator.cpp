@@ -2,55 +2,105 @@
 #include <magma_engine/core/renderer/VkInitializers.h>
 #include <magma_engine/core/renderer/VkUtils.h>
 #include <logging/Logger.h>
+#include <algorithm>
 #include <cassert>
+#include <tuple>
 
 namespace Magma
 {
-    void RenderResourceAllocator::Initialize(VkDevice device, VmaAllocator allocator)
+    void RenderResourceAllocator::Initialize(VkDevice device, VmaAllocator allocator, DeferredReleaseQueue& releaseQueue, MemoryTelemetry* telemetry)
     {
         assert(device != VK_NULL_HANDLE && "RenderResourceAllocator::Initialize() - VkDevice is null!");
         assert(allocator != VK_NULL_HANDLE && "RenderResourceAllocator::Initialize() - VmaAllocator is null!");
 
         m_device = device;
         m_allocator = allocator;
+        m_releaseQueue = &releaseQueue;
+        m_telemetry = telemetry;
+
+        m_pools.Initialize(m_allocator);
+        m_defragmenter.Initialize(m_device, m_allocator, &m_pools);
 
         m_descriptorManager = std::make_shared<DescriptorManager>();
         m_descriptorManager->Init(m_device);
 
         m_initialized = true;
-        Logger::Log(LogLevel::INFO, "RenderResourceAllocator initialized");
+        MAGMA_LOG_INFO("RenderResourceAllocator initialized");
+    }
+
+    bool ImagePoolKey::operator<(const ImagePoolKey& other) const
+    {
+        return std::tie(format, usage, extent.width, extent.height, resourceClass) <
+            std::tie(other.format, other.usage, other.extent.width, other.extent.height, other.resourceClass);
+    }
+
+    bool ImagePoolKey::operator==(const ImagePoolKey& other) const
+    {
+        return !(*this < other) && !(other < *this);
     }
 
     void RenderResourceAllocator::AllocateImages(
         const Map<String, BufferRequirement>& requirements,
-        VkExtent2D extent)
+        VkExtent2D extent,
+        uint32_t frameVersions)
     {
         assert(m_initialized && "RenderResourceAllocator::AllocateImages() - Not initialized! Call Initialize(device, allocator) first.");
+        assert(frameVersions > 0 && "RenderResourceAllocator::AllocateImages() - frameVersions must be at least 1!");
+
+        MAGMA_LOG_DEBUG("Allocating {} images", requirements.size());
 
-        Logger::Log(LogLevel::DEBUG, "Allocating {} images", requirements.size());
+        m_frameVersions = frameVersions;
 
         for (const auto& [name, req] : requirements)
         {
-            VkExtent2D imageExtent = req.matchSwapchainExtent ? extent : req.extent;
+            ImagePoolKey key = MakeImageKey(req, extent);
+            AllocateVersions(name, req, key);
 
-            AllocatedImage image = CreateImage(req.format, req.usage, imageExtent);
-            auto imagePtr = std::make_shared<AllocatedImage>(image);
+            MAGMA_LOG_DEBUG("  Allocated image '{}' ({}x{}, format: {}, class: {}, versions: {})",
+                name, key.extent.width, key.extent.height, static_cast<uint32_t>(req.format), ResourceClassToString(req.resourceClass),
+                GetVersionCount(req));
+        }
 
-            m_allocatedImages[name] = imagePtr;
-            m_bufferRegistry.RegisterBuffer(name, imagePtr);
+        MAGMA_LOG_DEBUG("Image allocation complete");
+    }
+
+    Vector<String> RenderResourceAllocator::ResizeImages(
+        const Map<String, BufferRequirement>& requirements,
+        VkExtent2D extent)
+    {
+        assert(m_initialized && "RenderResourceAllocator::ResizeImages() - Not initialized!");
+
+        Vector<String> resized;
+
+        for (const auto& [name, req] : requirements)
+        {
+            if (!req.matchSwapchainExtent)
+            {
+                continue;
+            }
 
-            Logger::Log(LogLevel::DEBUG, "  Allocated image '{}' ({}x{}, format: {})",
-                name, imageExtent.width, imageExtent.height, static_cast<uint32_t>(req.format));
+            ImagePoolKey key = MakeImageKey(req, extent);
+
+            auto keyIt = m_allocatedImageKeys.find(VersionName(name, 0, GetVersionCount(req)));
+            if (keyIt != m_allocatedImageKeys.end() && keyIt->second == key)
+            {
+                continue;
+            }
+
+            // In-flight frames may still use the old images, they are only reused once those have completed
+            AllocateVersions(name, req, key);
+            resized.push_back(name);
         }
 
-        Logger::Log(LogLevel::DEBUG, "Image allocation complete");
+        MAGMA_LOG_DEBUG("Resized {} image(s) to {}x{}, {} pooled", resized.size(), extent.width, extent.height, GetImagePoolStats().pooledImages);
+        return resized;
     }
 
     void RenderResourceAllocator::DeallocateImages()
     {
         assert(m_initialized && "RenderResourceAllocator::DeallocateImages() - Not initialized!");
 
-        Logger::Log(LogLevel::DEBUG, "Deallocating {} images", m_allocatedImages.size());
+        MAGMA_LOG_DEBUG("Deallocating {} images", m_allocatedImages.size());
 
         for (auto& [name, imagePtr] : m_allocatedImages)
         {
@@ -60,16 +110,246 @@ namespace Magma
             }
         }
 
+        for (PooledImage& entry : m_imagePool)
+        {
+            DestroyImage(std::move(entry.image));
+        }
+
         m_allocatedImages.clear();
+        m_allocatedImageKeys.clear();
+        m_imagePool.clear();
+        m_imagePoolByKey.clear();
+        m_pooledBytes = 0;
         m_bufferRegistry.Clear();
     }
 
+    void RenderResourceAllocator::AllocateStorageBuffers(const Map<String, StorageBufferRequirement>& requirements, uint32_t frameVersions)
+    {
+        assert(m_initialized && "RenderResourceAllocator::AllocateStorageBuffers() - Not initialized!");
+
+        DeallocateStorageBuffers();
+
+        for (const auto& [name, requirement] : requirements)
+        {
+            Vector<AllocatedBuffer> versions;
+            for (uint32_t version = 0; version < std::max(frameVersions, 1u); version++)
+            {
+                versions.push_back(CreateBuffer(requirement.size, requirement.usage, ResourceClass::PERSISTENT,
+                    VersionName(name, version, frameVersions)));
+            }
+
+            m_storageBuffers[name] = versions;
+            m_bufferRegistry.RegisterStorageBufferVersions(name, std::move(versions));
+        }
+
+        MAGMA_LOG_DEBUG("Allocated {} storage buffer(s)", m_storageBuffers.size());
+    }
+
+    void RenderResourceAllocator::DeallocateStorageBuffers()
+    {
+        for (auto& [name, versions] : m_storageBuffers)
+        {
+            for (AllocatedBuffer& buffer : versions)
+            {
+                DestroyBuffer(buffer);
+            }
+        }
+
+        m_storageBuffers.clear();
+        m_bufferRegistry.ClearStorageBuffers();
+    }
+
+    void RenderResourceAllocator::UpdateImagePool(uint64_t currentFrame, uint64_t completedFrame)
+    {
+        m_currentFrame = currentFrame;
+        m_completedFrameCount = completedFrame + 1;
+
+        TrimImagePool();
+    }
+
+    ImagePoolStats RenderResourceAllocator::GetImagePoolStats() const
+    {
+        ImagePoolStats stats;
+        stats.pooledBytes = m_pooledBytes;
+        stats.reusedImages = m_reusedImages;
+        stats.createdImages = m_createdImages;
+        stats.pooledImages = static_cast<uint32_t>(m_imagePool.size());
+
+        return stats;
+    }
+
+    ImagePoolKey RenderResourceAllocator::MakeImageKey(const BufferRequirement& requirement, VkExtent2D swapchainExtent)
+    {
+        ImagePoolKey key;
+        key.format = requirement.format;
+        key.usage = requirement.usage;
+        key.extent = requirement.matchSwapchainExtent ? swapchainExtent : requirement.extent;
+        key.resourceClass = requirement.resourceClass;
+        return key;
+    }
+
+    String RenderResourceAllocator::VersionName(const String& name, uint32_t version, uint32_t versionCount)
+    {
+        return versionCount > 1 ? name + "#" + std::to_string(version) : name;
+    }
+
+    uint32_t RenderResourceAllocator::GetVersionCount(const BufferRequirement& requirement) const
+    {
+        return requirement.perFrame ? m_frameVersions : 1;
+    }
+
+    void RenderResourceAllocator::AllocateVersions(const String& name, const BufferRequirement& requirement, const ImagePoolKey& key)
+    {
+        uint32_t versionCount = GetVersionCount(requirement);
+
+        Vector<std::shared_ptr<AllocatedImage>> versions;
+        versions.reserve(versionCount);
+
+        for (uint32_t version = 0; version < versionCount; version++)
+        {
+            String versionName = VersionName(name, version, versionCount);
+
+            ReleaseImage(versionName);
+            auto imagePtr = AcquireImage(key, versionName);
+
+            m_allocatedImages[versionName] = imagePtr;
+            m_allocatedImageKeys[versionName] = key;
+            versions.push_back(std::move(imagePtr));
+        }
+
+        m_bufferRegistry.RegisterBufferVersions(name, std::move(versions));
+    }
+
+    std::shared_ptr<AllocatedImage> RenderResourceAllocator::AcquireImage(const ImagePoolKey& key, const String& name)
+    {
+        std::shared_ptr<AllocatedImage> imagePtr;
+
+        auto poolIt = m_imagePoolByKey.find(key);
+        if (poolIt != m_imagePoolByKey.end())
+        {
+            auto& pooled = poolIt->second;
+
+            // Oldest first, it is the most likely to be out of use by the GPU
+            for (auto it = pooled.begin(); it != pooled.end(); ++it)
+            {
+                if ((*it)->releasedFrame < m_completedFrameCount)
+                {
+                    imagePtr = std::move((*it)->image);
+                    m_pooledBytes -= (*it)->size;
+                    m_imagePool.erase(*it);
+                    pooled.erase(it);
+                    m_reusedImages++;
+                    break;
+                }
+            }
+
+            if (pooled.empty())
+            {
+                m_imagePoolByKey.erase(poolIt);
+            }
+        }
+
+        if (!imagePtr)
+        {
+            imagePtr = std::make_shared<AllocatedImage>(CreateImage(key));
+
+            // Dedicated allocations never move, only pooled images can be compacted
+            if (key.resourceClass != ResourceClass::RENDER_TARGET)
+            {
+                m_defragmenter.RegisterImage(imagePtr, key.usage);
+            }
+            m_createdImages++;
+        }
+
+        if (m_telemetry)
+        {
+            m_telemetry->Track(imagePtr->allocation, name, MemoryCategory::RENDER_TARGET);
+        }
+
+        return imagePtr;
+    }
+
+    void RenderResourceAllocator::ReleaseImage(const String& name)
+    {
+        auto imageIt = m_allocatedImages.find(name);
+        auto keyIt = m_allocatedImageKeys.find(name);
+        if (imageIt == m_allocatedImages.end() || keyIt == m_allocatedImageKeys.end())
+        {
+            return;
+        }
+
+        VmaAllocationInfo allocationInfo{};
+        vmaGetAllocationInfo(m_allocator, imageIt->second->allocation, &allocationInfo);
+
+        if (m_telemetry)
+        {
+            m_telemetry->Track(imageIt->second->allocation, "Image pool", MemoryCategory::OTHER);
+        }
+
+        m_imagePool.push_back({ keyIt->second, std::move(imageIt->second), m_currentFrame, allocationInfo.size });
+        m_imagePoolByKey[keyIt->second].push_back(std::prev(m_imagePool.end()));
+        m_pooledBytes += allocationInfo.size;
+
+        m_allocatedImages.erase(imageIt);
+        m_allocatedImageKeys.erase(keyIt);
+
+        TrimImagePool();
+    }
+
+    void RenderResourceAllocator::TrimImagePool()
+    {
+        while (!m_imagePool.empty())
+        {
+            PooledImage& oldest = m_imagePool.front();
+            bool expired = m_currentFrame - oldest.releasedFrame > m_imagePoolSettings.retentionFrames;
+            bool overBudget = m_pooledBytes > m_imagePoolSettings.maxPooledBytes;
+            if (!expired && !overBudget)
+            {
+                break;
+            }
+
+            m_pooledBytes -= oldest.size;
+
+            // Goes through the deferred release queue, so frames still using it are safe
+            DestroyImage(std::move(oldest.image));
+
+            // The oldest entry overall is also the oldest of its key
+            auto keyIt = m_imagePoolByKey.find(oldest.key);
+            keyIt->second.pop_front();
+            if (keyIt->second.empty())
+            {
+                m_imagePoolByKey.erase(keyIt);
+            }
+
+            m_imagePool.pop_front();
+        }
+    }
+
     std::shared_ptr<AllocatedImage> RenderResourceAllocator::GetImage(const String& name) const
     {
         assert(m_initialized && "RenderResourceAllocator::GetImage() - Not initialized!");
         return m_bufferRegistry.GetBuffer(name);
     }
 
+    void RenderResourceAllocator::SwapImages(const String& first, const String& second)
+    {
+        assert(m_initialized && "RenderResourceAllocator::SwapImages() - Not initialized!");
+
+        auto firstIt = m_allocatedImages.find(first);
+        auto secondIt = m_allocatedImages.find(second);
+        if (firstIt == m_allocatedImages.end() || secondIt == m_allocatedImages.end())
+        {
+            MAGMA_LOG_ERROR("Cannot swap images '{}' and '{}', both must be allocated", first, second);
+            return;
+        }
+
+        std::swap(firstIt->second, secondIt->second);
+        std::swap(m_allocatedImageKeys[first], m_allocatedImageKeys[second]);
+
+        m_bufferRegistry.RegisterBuffer(first, firstIt->second);
+        m_bufferRegistry.RegisterBuffer(second, secondIt->second);
+    }
+
     const Map<String, std::shared_ptr<AllocatedImage>>&
     RenderResourceAllocator::GetAllImages() const
     {
@@ -83,6 +363,55 @@ namespace Magma
         return m_descriptorManager;
     }
 
+    AllocatedBuffer RenderResourceAllocator::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, ResourceClass resourceClass, const String& debugName)
+    {
+        assert(m_initialized && "RenderResourceAllocator::CreateBuffer() - Not initialized!");
+
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VmaAllocationCreateInfo allocInfo = m_pools.GetBufferAllocationInfo(resourceClass, bufferInfo);
+
+        AllocatedBuffer buffer{};
+        buffer.size = size;
+
+        VmaAllocationInfo allocationResult = {};
+        VkResult result = vmaCreateBuffer(m_allocator, &bufferInfo, &allocInfo, &buffer.buffer, &buffer.allocation, &allocationResult);
+        if (result != VK_SUCCESS && allocInfo.pool != VK_NULL_HANDLE)
+        {
+            MAGMA_LOG_WARNING("{} pool exhausted, allocating buffer '{}' outside it", ResourceClassToString(resourceClass), debugName);
+            allocInfo.pool = VK_NULL_HANDLE;
+            result = vmaCreateBuffer(m_allocator, &bufferInfo, &allocInfo, &buffer.buffer, &buffer.allocation, &allocationResult);
+        }
+        VK_CHECK(result);
+
+        buffer.mappedData = allocationResult.pMappedData;
+
+        if (m_telemetry)
+        {
+            m_telemetry->Track(buffer.allocation, debugName,
+                resourceClass == ResourceClass::READBACK ? MemoryCategory::STAGING : MemoryCategory::BUFFER);
+        }
+
+        return buffer;
+    }
+
+    void RenderResourceAllocator::DestroyBuffer(AllocatedBuffer& buffer)
+    {
+        assert(m_initialized && "RenderResourceAllocator::DestroyBuffer() - Not initialized!");
+
+        if (m_telemetry)
+        {
+            m_telemetry->Untrack(buffer.allocation);
+        }
+
+        m_releaseQueue->ReleaseBuffer(buffer.buffer, buffer.allocation);
+        buffer = AllocatedBuffer{};
+    }
+
     VkDevice RenderResourceAllocator::GetDevice() const
     {
         assert(m_initialized && "RenderResourceAllocator::GetDevice() - Not initialized!");
@@ -114,6 +443,10 @@ namespace Magma
             return;
         }
 
+        // Finishes a pass still holding old images before anything is freed
+        m_defragmenter.Cleanup();
+
+        DeallocateStorageBuffers();
         DeallocateImages();
 
         if (m_descriptorManager)
@@ -124,38 +457,49 @@ namespace Magma
 
         m_device = VK_NULL_HANDLE;
         m_allocator = VK_NULL_HANDLE;
+        m_releaseQueue = nullptr;
+        m_telemetry = nullptr;
         m_initialized = false;
 
-        Logger::Log(LogLevel::INFO, "RenderResourceAllocator cleaned up");
+        MAGMA_LOG_INFO("RenderResourceAllocator cleaned up");
     }
 
-    AllocatedImage RenderResourceAllocator::CreateImage(
-        VkFormat format,
-        VkImageUsageFlags usage,
-        VkExtent2D extent)
+    void RenderResourceAllocator::DestroyPools()
+    {
+        assert(!m_initialized && "RenderResourceAllocator::DestroyPools() - Cleanup() has not run!");
+        m_pools.Cleanup();
+    }
+
+    AllocatedImage RenderResourceAllocator::CreateImage(const ImagePoolKey& key)
     {
         assert(m_initialized && "RenderResourceAllocator::CreateImage() - Not initialized!");
 
         AllocatedImage image{};
 
         VkExtent3D imageExtent = {
-            extent.width,
-            extent.height,
+            key.extent.width,
+            key.extent.height,
             1
         };
 
-        image.imageFormat = format;
+        image.imageFormat = key.format;
         image.imageExtent = imageExtent;
 
-        VkImageCreateInfo imgInfo = vkinit::image_create_info(format, usage, imageExtent);
+        VkImageCreateInfo imgInfo = vkinit::image_create_info(key.format, key.usage, imageExtent);
 
-        VmaAllocationCreateInfo allocInfo = {};
-        allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-        allocInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        VmaAllocationCreateInfo allocInfo = m_pools.GetImageAllocationInfo(key.resourceClass, imgInfo);
 
-        VK_CHECK(vmaCreateImage(m_allocator, &imgInfo, &allocInfo, &image.image, &image.allocation, nullptr));
+        VkResult result = vmaCreateImage(m_allocator, &imgInfo, &allocInfo, &image.image, &image.allocation, nullptr);
+        if (result != VK_SUCCESS && allocInfo.pool != VK_NULL_HANDLE)
+        {
+            // A full transient ring or persistent pool should not take the frame down
+            MAGMA_LOG_WARNING("{} pool exhausted, allocating image outside it", ResourceClassToString(key.resourceClass));
+            allocInfo.pool = VK_NULL_HANDLE;
+            result = vmaCreateImage(m_allocator, &imgInfo, &allocInfo, &image.image, &image.allocation, nullptr);
+        }
+        VK_CHECK(result);
 
-        VkImageViewCreateInfo viewInfo = vkinit::imageview_create_info(format, image.image, VK_IMAGE_ASPECT_COLOR_BIT);
+        VkImageViewCreateInfo viewInfo = vkinit::imageview_create_info(key.format, image.image, VK_IMAGE_ASPECT_COLOR_BIT);
         VK_CHECK(vkCreateImageView(m_device, &viewInfo, nullptr, &image.imageView));
 
         return image;
@@ -165,18 +509,20 @@ namespace Magma
     {
         assert(m_initialized && "RenderResourceAllocator::DestroyImage() - Not initialized!");
 
-        if (image->imageView != VK_NULL_HANDLE)
+        if (m_telemetry)
         {
-            vkDestroyImageView(m_device, image->imageView, nullptr);
-            image->imageView = VK_NULL_HANDLE;
+            m_telemetry->Untrack(image->allocation);
         }
 
-        if (image->image != VK_NULL_HANDLE)
-        {
-            vmaDestroyImage(m_allocator, image->image, image->allocation);
-            image->image = VK_NULL_HANDLE;
-            image->allocation = VK_NULL_HANDLE;
-        }
+        m_defragmenter.UnregisterImage(image->allocation);
+
+        // Frames still in flight may reference the image, release it once they have completed
+        m_releaseQueue->ReleaseImageView(image->imageView);
+        m_releaseQueue->ReleaseImage(image->image, image->allocation);
+
+        image->imageView = VK_NULL_HANDLE;
+        image->image = VK_NULL_HANDLE;
+        image->allocation = VK_NULL_HANDLE;
 
         image.reset();
     }
@@ -1,13 +1,16 @@
 #include <magma_engine/core/renderer/RenderStage.h>
 #include <magma_engine/core/renderer/VkUtils.h>
 #include <logging/Logger.h>
+#include <algorithm>
+#include <bit>
+#include <cassert>
 
 namespace Magma
 {
     RenderStage::RenderStage(const StageConfiguration& config)
         : m_config(config)
     {
-        Logger::Log(LogLevel::DEBUG, "[RenderStage] Created stage: {}", m_config.name);
+        MAGMA_LOG_DEBUG("[RenderStage] Created stage: {}", m_config.name);
     }
 
     String RenderStage::GetStageName() const
@@ -20,22 +23,91 @@ namespace Magma
         return GenerateBufferRequirements();
     }
 
-    void RenderStage::Initialize(
+    Vector<StorageBufferRequirement> RenderStage::GetStorageBufferRequirements() const
+    {
+        Vector<StorageBufferRequirement> requirements;
+
+        for (const Vector<StorageBufferBinding>* bindings : { &m_config.inputStorageBuffers, &m_config.outputStorageBuffers })
+        {
+            for (const auto& binding : *bindings)
+            {
+                StorageBufferRequirement req{};
+                req.name = binding.bufferName;
+                req.size = binding.size;
+                // Copied out by PrimitiveValidator
+                req.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+                req.clearEachFrame = binding.clearEachFrame;
+                req.isOutput = bindings == &m_config.outputStorageBuffers;
+                requirements.push_back(req);
+            }
+        }
+
+        // Read by the dispatch itself, no binding needed
+        if (m_config.IsCompute() && m_config.GetComputeConfig().IsIndirect())
+        {
+            const ComputeConfig& computeConfig = m_config.GetComputeConfig();
+
+            StorageBufferRequirement req{};
+            req.name = computeConfig.indirectArgsBuffer;
+            req.size = computeConfig.indirectArgsOffset + sizeof(VkDispatchIndirectCommand);
+            req.usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+            req.indirectArgsOffsets.push_back(computeConfig.indirectArgsOffset);
+            requirements.push_back(req);
+        }
+
+        return requirements;
+    }
+
+    bool RenderStage::Initialize(
         VkDevice device,
         BufferRegistry& bufferRegistry,
-        std::shared_ptr<DescriptorManager> descriptorManager)
+        std::shared_ptr<DescriptorManager> descriptorManager,
+        uint32_t framesInFlight,
+        const ComputeDeviceInfo& computeInfo)
     {
         if (m_initialized)
         {
-            Logger::Log(LogLevel::WARNING, "[RenderStage:{}] Already initialized", m_config.name);
-            return;
+            MAGMA_LOG_WARNING("[RenderStage:{}] Already initialized", m_config.name);
+            return true;
         }
 
+        m_device = device;
+        m_framesInFlight = framesInFlight;
         m_descriptorManager = descriptorManager;
+        m_bufferRegistry = &bufferRegistry;
+        m_computeInfo = computeInfo;
 
-        Logger::Log(LogLevel::INFO, "[RenderStage:{}] Initializing {} pipeline",
+        MAGMA_LOG_INFO("[RenderStage:{}] Initializing {} pipeline",
             m_config.name, m_config.IsCompute() ? "compute" : "graphics");
 
+        // Primitives scan in subgroup order and keep a value per subgroup in shared memory
+        if (m_config.IsPrimitive())
+        {
+            constexpr VkSubgroupFeatureFlags requiredOperations = VK_SUBGROUP_FEATURE_BASIC_BIT |
+                VK_SUBGROUP_FEATURE_ARITHMETIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT;
+            if ((computeInfo.subgroupOperations & requiredOperations) != requiredOperations)
+            {
+                MAGMA_LOG_ERROR("[RenderStage:{}] Compute shaders lack the subgroup arithmetic and ballot operations", m_config.name);
+                return false;
+            }
+            if (!computeInfo.computeFullSubgroups)
+            {
+                MAGMA_LOG_ERROR("[RenderStage:{}] The device cannot guarantee full subgroups in compute shaders", m_config.name);
+                return false;
+            }
+
+            // Full subgroups need the width to be a multiple of any subgroup size the driver may pick
+            uint32_t workgroupSize = m_config.GetComputeConfig().workgroupSizeX;
+            uint32_t smallestSubgroup = computeInfo.minSubgroupSize != 0 ? computeInfo.minSubgroupSize : computeInfo.subgroupSize;
+            uint32_t largestSubgroup = computeInfo.maxSubgroupSize != 0 ? computeInfo.maxSubgroupSize : computeInfo.subgroupSize;
+            if (workgroupSize % largestSubgroup != 0 || workgroupSize / smallestSubgroup > k_MaxPrimitiveSubgroups)
+            {
+                MAGMA_LOG_ERROR("[RenderStage:{}] Workgroups of {} do not split into at most {} whole subgroups of {} to {}",
+                    m_config.name, workgroupSize, k_MaxPrimitiveSubgroups, smallestSubgroup, largestSubgroup);
+                return false;
+            }
+        }
+
         // Get extent from first output buffer
         if (!m_config.outputBuffers.empty())
         {
@@ -51,42 +123,126 @@ namespace Magma
 
         // Create descriptor resources
         CreateDescriptorLayouts();
-        AllocateDescriptors();
-        UpdateDescriptorSets(bufferRegistry);
+        AllocateDescriptors(framesInFlight);
+
+        DescriptorWriter writer;
+        for (uint32_t i = 0; i < m_descriptorSets.size(); i++)
+        {
+            WriteDescriptorSet(i, bufferRegistry, writer, false);
+        }
+        m_descriptorManager->UpdateDescriptorSets(writer);
 
         // Create pipeline
-        CreatePipeline(device);
+        if (!CreatePipeline(device))
+        {
+            return false;
+        }
 
         m_initialized = true;
-        Logger::Log(LogLevel::INFO, "[RenderStage:{}] Initialization complete", m_config.name);
+        MAGMA_LOG_INFO("[RenderStage:{}] Initialization complete", m_config.name);
+        return true;
     }
 
-    void RenderStage::Execute(VkCommandBuffer cmd)
+    void RenderStage::Execute(VkCommandBuffer cmd, uint32_t frameIndex)
     {
         if (!m_initialized)
         {
-            Logger::Log(LogLevel::ERROR, "[RenderStage:{}] Not initialized", m_config.name);
+            MAGMA_LOG_ERROR("[RenderStage:{}] Not initialized", m_config.name);
             return;
         }
 
+        // Every frame that could have used the released variants has completed once the slots came around
+        if (!m_retiredPipelines.empty() && --m_retiredPipelineFrames == 0)
+        {
+            for (auto& pipeline : m_retiredPipelines)
+            {
+                pipeline.Destroy();
+            }
+            m_retiredPipelines.clear();
+        }
+
+        VkDescriptorSet descriptorSet = frameIndex < m_descriptorSets.size() ? m_descriptorSets[frameIndex] : VK_NULL_HANDLE;
+
         if (m_config.IsCompute())
         {
-            ExecuteCompute(cmd);
+            ExecuteCompute(cmd, descriptorSet, frameIndex);
         }
         else
         {
-            ExecuteGraphics(cmd);
+            ExecuteGraphics(cmd, descriptorSet);
+        }
+    }
+
+    void RenderStage::PrepareDescriptors(uint32_t frameIndex, DescriptorWriter& writer)
+    {
+        // The frame that last used this slot has completed, so its set can be written
+        if (!m_initialized || frameIndex >= m_descriptorSets.size() || m_staleBindings[frameIndex].empty())
+        {
+            return;
+        }
+
+        uint32_t writeCount = WriteDescriptorSet(frameIndex, *m_bufferRegistry, writer, true);
+
+        if (writeCount > 0)
+        {
+            MAGMA_LOG_DEBUG("[RenderStage:{}] Rewrote {} descriptor(s) for frame slot {}", m_config.name, writeCount, frameIndex);
+        }
+    }
+
+    void RenderStage::InvalidateDescriptors()
+    {
+        for (const Vector<BufferBinding>* bindings : { &m_config.inputBuffers, &m_config.outputBuffers })
+        {
+            for (const auto& binding : *bindings)
+            {
+                for (Set<uint32_t>& staleBindings : m_staleBindings)
+                {
+                    staleBindings.insert(binding.binding);
+                }
+            }
+        }
+    }
+
+    void RenderStage::InvalidateDescriptors(const String& bufferName)
+    {
+        for (const Vector<BufferBinding>* bindings : { &m_config.inputBuffers, &m_config.outputBuffers })
+        {
+            for (const auto& binding : *bindings)
+            {
+                if (binding.bufferName != bufferName)
+                {
+                    continue;
+                }
+
+                for (Set<uint32_t>& staleBindings : m_staleBindings)
+                {
+                    staleBindings.insert(binding.binding);
+                }
+            }
         }
     }
 
     void RenderStage::Cleanup()
     {
-        Logger::Log(LogLevel::INFO, "[RenderStage:{}] Cleaning up", m_config.name);
+        MAGMA_LOG_INFO("[RenderStage:{}] Cleaning up", m_config.name);
 
         // Destroy pipeline
         if (m_config.IsCompute())
         {
             std::get<ComputePipeline>(m_pipeline).Destroy();
+
+            for (auto& variant : m_workgroupVariants)
+            {
+                variant.pipeline.Destroy();
+            }
+            m_workgroupVariants.clear();
+            m_activeWorkgroupVariant.reset();
+
+            for (auto& pipeline : m_retiredPipelines)
+            {
+                pipeline.Destroy();
+            }
+            m_retiredPipelines.clear();
         }
         else
         {
@@ -108,7 +264,7 @@ namespace Magma
     void RenderStage::OnResolutionChanged(VkExtent2D newExtent)
     {
         m_currentExtent = newExtent;
-        Logger::Log(LogLevel::INFO, "[RenderStage:{}] Resolution changed to {}x{}",
+        MAGMA_LOG_INFO("[RenderStage:{}] Resolution changed to {}x{}",
             m_config.name, newExtent.width, newExtent.height);
     }
 
@@ -127,22 +283,95 @@ namespace Magma
             info.outputBuffers.push_back(output.bufferName);
         }
 
+        for (const auto& input : m_config.inputStorageBuffers)
+        {
+            info.inputBuffers.push_back(input.bufferName);
+        }
+
+        for (const auto& output : m_config.outputStorageBuffers)
+        {
+            info.outputBuffers.push_back(output.bufferName);
+        }
+
         info.metadata["type"] = m_config.IsCompute() ? "compute" : "graphics";
         info.metadata["resolution"] = std::to_string(m_currentExtent.width) + "x" + std::to_string(m_currentExtent.height);
+        VkExtent2D renderExtent = GetRenderExtent();
+        info.metadata["renderResolution"] = std::to_string(renderExtent.width) + "x" + std::to_string(renderExtent.height);
+
+        info.gpuStats = m_gpuStats;
+        if (m_gpuStats.valid)
+        {
+            info.metadata["gpuTimeMs"] = std::to_string(m_gpuStats.gpuTimeMs);
+            info.metadata["gpuOverlapMs"] = std::to_string(m_gpuStats.gpuOverlapMs);
+            info.metadata["computeInvocations"] = std::to_string(m_gpuStats.computeShaderInvocations);
+            info.metadata["fragmentInvocations"] = std::to_string(m_gpuStats.fragmentShaderInvocations);
+            info.metadata["primitives"] = std::to_string(m_gpuStats.inputAssemblyPrimitives);
+            info.metadata["pixelsPerInvocation"] = std::to_string(m_gpuStats.pixelsPerInvocation);
+            info.metadata["estimatedBytesRead"] = std::to_string(m_gpuStats.estimatedBytesRead);
+            info.metadata["estimatedBytesWritten"] = std::to_string(m_gpuStats.estimatedBytesWritten);
+        }
+
+        if (m_config.IsCompute() && m_config.GetComputeConfig().IsIndirect())
+        {
+            info.metadata["indirectArgs"] = m_config.GetComputeConfig().indirectArgsBuffer;
+        }
+
+        if (m_config.IsPrimitive())
+        {
+            info.metadata["primitive"] = m_config.primitive->instanceName;
+            info.metadata["elements"] = std::to_string(m_config.primitive->elementCount);
+        }
+
+        if (m_config.IsCompute())
+        {
+            info.metadata["dispatchedInvocations"] = std::to_string(m_gpuStats.dispatchedInvocations);
+        }
 
         return info;
     }
 
+    void RenderStage::ApplyGpuStats(const StageGpuStats& stats)
+    {
+        m_gpuStats = stats;
+
+        VkExtent2D renderExtent = GetRenderExtent();
+        m_gpuStats.pixelCount = static_cast<uint64_t>(renderExtent.width) * renderExtent.height;
+        m_gpuStats.estimatedBytesRead = EstimateResourceBytes(true);
+        m_gpuStats.estimatedBytesWritten = EstimateResourceBytes(false);
+
+        uint64_t invocations = m_config.IsCompute() ? stats.computeShaderInvocations : stats.fragmentShaderInvocations;
+
+        // Indirect group counts are only known on the GPU
+        if (m_config.IsCompute() && !m_config.GetComputeConfig().IsIndirect())
+        {
+            // What the CPU asked for, independent of whether statistics queries are available
+            const auto& computeConfig = GetActiveComputeConfig();
+            VkExtent3D groups = GetDispatchGroupCount();
+            m_gpuStats.dispatchedInvocations = static_cast<uint64_t>(groups.width) * groups.height * groups.depth *
+                computeConfig.workgroupSizeX * computeConfig.workgroupSizeY * computeConfig.workgroupSizeZ;
+
+            if (invocations == 0)
+            {
+                invocations = m_gpuStats.dispatchedInvocations;
+            }
+        }
+
+        // Values well below 1.0 point at over-dispatch
+        m_gpuStats.pixelsPerInvocation = invocations > 0
+            ? static_cast<double>(m_gpuStats.pixelCount) / static_cast<double>(invocations)
+            : 0.0;
+    }
+
     void RenderStage::UpdateConfiguration(const StageConfiguration& config)
     {
         if (m_initialized)
         {
-            Logger::Log(LogLevel::WARNING, "[RenderStage:{}] Cannot update configuration while initialized", m_config.name);
+            MAGMA_LOG_WARNING("[RenderStage:{}] Cannot update configuration while initialized", m_config.name);
             return;
         }
 
         m_config = config;
-        Logger::Log(LogLevel::INFO, "[RenderStage:{}] Configuration updated", m_config.name);
+        MAGMA_LOG_INFO("[RenderStage:{}] Configuration updated", m_config.name);
     }
 
     void RenderStage::LoadShaders(VkDevice device)
@@ -155,13 +384,13 @@ namespace Magma
             ShaderModule shader;
             if (!shader.LoadFromFile(device, shaderBinding.path))
             {
-                Logger::Log(LogLevel::ERROR, "[RenderStage:{}] Failed to load shader: {}",
+                MAGMA_LOG_ERROR("[RenderStage:{}] Failed to load shader: {}",
                     m_config.name, shaderBinding.path);
                 continue;
             }
 
             m_shaderModules.push_back(std::move(shader));
-            Logger::Log(LogLevel::DEBUG, "[RenderStage:{}] Loaded shader: {}",
+            MAGMA_LOG_DEBUG("[RenderStage:{}] Loaded shader: {}",
                 m_config.name, shaderBinding.path);
         }
     }
@@ -189,76 +418,107 @@ namespace Magma
             });
         }
 
+        for (const Vector<StorageBufferBinding>* storageBindings : { &m_config.inputStorageBuffers, &m_config.outputStorageBuffers })
+        {
+            for (const auto& storageBinding : *storageBindings)
+            {
+                bindings.push_back({
+                    .binding = storageBinding.binding,
+                    .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    .stageFlags = storageBinding.shaderStages
+                });
+            }
+        }
+
         if (!bindings.empty())
         {
             m_descriptorLayout = m_descriptorManager->CreateLayout(bindings);
-            Logger::Log(LogLevel::DEBUG, "[RenderStage:{}] Created descriptor layout with {} bindings",
+            MAGMA_LOG_DEBUG("[RenderStage:{}] Created descriptor layout with {} bindings",
                 m_config.name, bindings.size());
         }
     }
 
-    void RenderStage::AllocateDescriptors()
+    void RenderStage::AllocateDescriptors(uint32_t framesInFlight)
     {
+        m_descriptorSets.clear();
+        m_staleBindings.clear();
+
         if (m_descriptorLayout != VK_NULL_HANDLE)
         {
-            m_descriptorSet = m_descriptorManager->AllocateDescriptorSet(m_descriptorLayout);
-            Logger::Log(LogLevel::DEBUG, "[RenderStage:{}] Allocated descriptor set", m_config.name);
+            for (uint32_t i = 0; i < framesInFlight; i++)
+            {
+                m_descriptorSets.push_back(m_descriptorManager->AllocateDescriptorSet(m_descriptorLayout));
+            }
+            m_staleBindings.resize(framesInFlight);
+
+            MAGMA_LOG_DEBUG("[RenderStage:{}] Allocated {} descriptor sets", m_config.name, framesInFlight);
         }
     }
 
-    void RenderStage::UpdateDescriptorSets(BufferRegistry& bufferRegistry)
+    uint32_t RenderStage::WriteDescriptorSet(uint32_t frameIndex, BufferRegistry& bufferRegistry, DescriptorWriter& writer, bool staleOnly)
     {
-        if (m_descriptorSet == VK_NULL_HANDLE)
-        {
-            return;
-        }
+        VkDescriptorSet descriptorSet = m_descriptorSets[frameIndex];
+        Set<uint32_t>& staleBindings = m_staleBindings[frameIndex];
+        uint32_t writeCount = 0;
 
-    	// TODO: Doesn't need to be two loops, can be combined.
-    	// TODO: Handle other descriptor types (e.g., uniform buffers) as needed.
-        // Update input buffers
-        for (const auto& input : m_config.inputBuffers)
+        // TODO: Handle other descriptor types (e.g., uniform buffers) as needed.
+        for (const Vector<BufferBinding>* bindings : { &m_config.inputBuffers, &m_config.outputBuffers })
         {
-            auto buffer = bufferRegistry.GetBuffer(input.bufferName);
-            if (!buffer)
+            for (const auto& binding : *bindings)
             {
-                Logger::Log(LogLevel::ERROR, "[RenderStage:{}] Input buffer '{}' not found",
-                    m_config.name, input.bufferName);
-                continue;
+                if (staleOnly && staleBindings.count(binding.binding) == 0)
+                {
+                    continue;
+                }
+
+                // Each frame slot's set permanently points at that slot's version
+                auto buffer = bufferRegistry.GetBuffer(binding.bufferName, frameIndex);
+                if (!buffer)
+                {
+                    MAGMA_LOG_ERROR("[RenderStage:{}] Buffer '{}' not found",
+                        m_config.name, binding.bufferName);
+                    continue;
+                }
+
+                writer.WriteImage(
+                    descriptorSet,
+                    binding.binding,
+                    buffer->imageView,
+                    VK_IMAGE_LAYOUT_GENERAL,
+                    binding.descriptorType
+                );
+
+                writeCount++;
             }
-
-            m_descriptorManager->WriteImageDescriptor(
-                m_descriptorSet,
-                input.binding,
-                buffer->imageView,
-                VK_IMAGE_LAYOUT_GENERAL,
-                input.descriptorType
-            );
         }
 
-        // Update output buffers
-        for (const auto& output : m_config.outputBuffers)
+        for (const Vector<StorageBufferBinding>* storageBindings : { &m_config.inputStorageBuffers, &m_config.outputStorageBuffers })
         {
-            auto buffer = bufferRegistry.GetBuffer(output.bufferName);
-            if (!buffer)
+            for (const auto& binding : *storageBindings)
             {
-                Logger::Log(LogLevel::ERROR, "[RenderStage:{}] Output buffer '{}' not found",
-                    m_config.name, output.bufferName);
-                continue;
+                if (staleOnly && staleBindings.count(binding.binding) == 0)
+                {
+                    continue;
+                }
+
+                const AllocatedBuffer* buffer = bufferRegistry.GetStorageBuffer(binding.bufferName, frameIndex);
+                if (!buffer)
+                {
+                    MAGMA_LOG_ERROR("[RenderStage:{}] Storage buffer '{}' not found",
+                        m_config.name, binding.bufferName);
+                    continue;
+                }
+
+                writer.WriteBuffer(descriptorSet, binding.binding, buffer->buffer, 0, VK_WHOLE_SIZE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+                writeCount++;
             }
-
-            m_descriptorManager->WriteImageDescriptor(
-                m_descriptorSet,
-                output.binding,
-                buffer->imageView,
-                VK_IMAGE_LAYOUT_GENERAL,
-                output.descriptorType
-            );
         }
 
-        Logger::Log(LogLevel::DEBUG, "[RenderStage:{}] Updated descriptor sets", m_config.name);
+        staleBindings.clear();
+        return writeCount;
     }
 
-    void RenderStage::CreatePipeline(VkDevice device)
+    bool RenderStage::CreatePipeline(VkDevice device)
     {
         PipelineLayoutInfo layoutInfo{};
 
@@ -267,7 +527,32 @@ namespace Magma
             layoutInfo.descriptorSetLayouts.push_back(m_descriptorLayout);
         }
 
-        if (m_config.pushConstants.has_value())
+        if (m_config.useStagePushConstants)
+        {
+            // A stage may only appear in one range, so stage specific constants extend this one
+            VkPushConstantRange range{};
+            range.stageFlags = m_config.IsCompute()
+                ? VK_SHADER_STAGE_COMPUTE_BIT
+                : VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+            range.offset = 0;
+            range.size = sizeof(StagePushConstants);
+
+            if (m_config.pushConstants.has_value())
+            {
+                if (m_config.pushConstants->offset < sizeof(StagePushConstants))
+                {
+                    MAGMA_LOG_ERROR("[RenderStage:{}] Push constants at offset {} overlap the stage constants",
+                        m_config.name, m_config.pushConstants->offset);
+                }
+
+                range.stageFlags |= m_config.pushConstants->stageFlags;
+                range.size = std::max(range.size, m_config.pushConstants->offset + m_config.pushConstants->size);
+            }
+
+            m_stagePushConstantStages = range.stageFlags;
+            layoutInfo.pushConstantRanges.push_back(range);
+        }
+        else if (m_config.pushConstants.has_value())
         {
             VkPushConstantRange range{};
             range.stageFlags = m_config.pushConstants->stageFlags;
@@ -280,28 +565,28 @@ namespace Magma
         {
             if (m_shaderModules.empty())
             {
-                Logger::Log(LogLevel::ERROR, "[RenderStage:{}] No compute shader loaded", m_config.name);
-                return;
+                MAGMA_LOG_ERROR("[RenderStage:{}] No compute shader loaded", m_config.name);
+                return false;
             }
 
             // Construct ComputePipeline directly in the variant
             m_pipeline.emplace<ComputePipeline>();
             auto& pipeline = std::get<ComputePipeline>(m_pipeline);
 
-            if (!pipeline.Create(device, layoutInfo, m_shaderModules[0].GetModule()))
+            if (!pipeline.Create(device, layoutInfo, m_shaderModules[0].GetModule(), GetComputeSpecialization(m_config.GetComputeConfig())))
             {
-                Logger::Log(LogLevel::ERROR, "[RenderStage:{}] Failed to create compute pipeline", m_config.name);
-                return;
+                MAGMA_LOG_ERROR("[RenderStage:{}] Failed to create compute pipeline", m_config.name);
+                return false;
             }
 
-            Logger::Log(LogLevel::DEBUG, "[RenderStage:{}] Created compute pipeline", m_config.name);
+            MAGMA_LOG_DEBUG("[RenderStage:{}] Created compute pipeline", m_config.name);
         }
         else
         {
             if (m_shaderModules.size() < 2)
             {
-                Logger::Log(LogLevel::ERROR, "[RenderStage:{}] Graphics pipeline requires vertex and fragment shaders", m_config.name);
-                return;
+                MAGMA_LOG_ERROR("[RenderStage:{}] Graphics pipeline requires vertex and fragment shaders", m_config.name);
+                return false;
             }
 
             const auto& graphicsConfig = m_config.GetGraphicsConfig();
@@ -318,12 +603,14 @@ namespace Magma
                 graphicsConfig.colorAttachmentFormat,
                 graphicsConfig.depthAttachmentFormat))
             {
-                Logger::Log(LogLevel::ERROR, "[RenderStage:{}] Failed to create graphics pipeline", m_config.name);
-                return;
+                MAGMA_LOG_ERROR("[RenderStage:{}] Failed to create graphics pipeline", m_config.name);
+                return false;
             }
 
-            Logger::Log(LogLevel::DEBUG, "[RenderStage:{}] Created graphics pipeline", m_config.name);
+            MAGMA_LOG_DEBUG("[RenderStage:{}] Created graphics pipeline", m_config.name);
         }
+
+        return true;
     }
 
     Vector<BufferRequirement> RenderStage::GenerateBufferRequirements() const
@@ -342,6 +629,8 @@ namespace Magma
             req.expectedLayout = VK_IMAGE_LAYOUT_GENERAL;
             req.isInput = true;
             req.isOutput = false;
+            req.resourceClass = input.resourceClass;
+            req.perFrame = input.perFrame;
 
             requirements.push_back(req);
         }
@@ -362,6 +651,8 @@ namespace Magma
             req.expectedLayout = VK_IMAGE_LAYOUT_GENERAL;
             req.isInput = false;
             req.isOutput = true;
+            req.resourceClass = output.resourceClass;
+            req.perFrame = output.perFrame;
 
             requirements.push_back(req);
         }
@@ -369,41 +660,255 @@ namespace Magma
         return requirements;
     }
 
-    void RenderStage::ExecuteCompute(VkCommandBuffer cmd)
+    void RenderStage::ExecuteCompute(VkCommandBuffer cmd, VkDescriptorSet descriptorSet, uint32_t frameIndex)
     {
-        auto& computePipeline = std::get<ComputePipeline>(m_pipeline);
+        auto& computePipeline = m_activeWorkgroupVariant
+            ? m_workgroupVariants[*m_activeWorkgroupVariant].pipeline
+            : std::get<ComputePipeline>(m_pipeline);
 
         computePipeline.Bind(cmd);
 
-        if (m_descriptorSet != VK_NULL_HANDLE)
+        if (descriptorSet != VK_NULL_HANDLE)
         {
-            std::vector<VkDescriptorSet> sets = { m_descriptorSet };
+            std::vector<VkDescriptorSet> sets = { descriptorSet };
             m_descriptorManager->BindDescriptor(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline, sets);
         }
 
-        // Calculate dispatch size based on workgroup configuration
-        const auto& computeConfig = m_config.GetComputeConfig();
-        uint32_t groupCountX = (m_currentExtent.width + computeConfig.workgroupSizeX - 1) / computeConfig.workgroupSizeX;
-        uint32_t groupCountY = (m_currentExtent.height + computeConfig.workgroupSizeY - 1) / computeConfig.workgroupSizeY;
-        uint32_t groupCountZ = computeConfig.workgroupSizeZ;
+        PushStageConstants(cmd, computePipeline.GetLayout());
+
+        const ComputeConfig& computeConfig = m_config.GetComputeConfig();
+        if (computeConfig.IsIndirect())
+        {
+            // Group count written by an earlier stage this frame
+            const AllocatedBuffer* args = m_bufferRegistry->GetStorageBuffer(computeConfig.indirectArgsBuffer, frameIndex);
+            if (!args)
+            {
+                MAGMA_LOG_ERROR("[RenderStage:{}] Indirect arguments buffer '{}' not found", m_config.name, computeConfig.indirectArgsBuffer);
+                return;
+            }
+
+            computePipeline.DispatchIndirect(cmd, args->buffer, computeConfig.indirectArgsOffset);
+            return;
+        }
+
+        VkExtent3D groupCount = GetDispatchGroupCount();
+        computePipeline.Dispatch(cmd, groupCount.width, groupCount.height, groupCount.depth);
+    }
+
+    void RenderStage::SetPushConstantData(const void* data, uint32_t size)
+    {
+        if (!m_config.pushConstants.has_value() || size > m_config.pushConstants->size)
+        {
+            MAGMA_LOG_ERROR("[RenderStage:{}] {} bytes of push constants do not fit the configured range", m_config.name, size);
+            return;
+        }
+
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        m_pushConstantData.assign(bytes, bytes + size);
+    }
+
+    void RenderStage::PushStageConstants(VkCommandBuffer cmd, VkPipelineLayout layout) const
+    {
+        if (m_config.useStagePushConstants)
+        {
+            StagePushConstants constants = m_frameConstants;
+            if (m_config.IsCompute() && m_dispatchSwizzleEnabled)
+            {
+                const ComputeConfig& computeConfig = m_config.GetComputeConfig();
+
+                // Morton blocks have to be a power of two on each side
+                uint32_t swizzleSize = std::max(computeConfig.swizzleSize, 1u);
+                if (computeConfig.swizzle == DispatchSwizzle::MORTON)
+                {
+                    swizzleSize = std::bit_floor(swizzleSize);
+                }
+                constants.dispatchSwizzle = static_cast<uint32_t>(computeConfig.swizzle) | (swizzleSize << 8);
+            }
+
+            vkCmdPushConstants(cmd, layout, m_stagePushConstantStages, 0, sizeof(StagePushConstants), &constants);
+        }
+
+        if (!m_pushConstantData.empty())
+        {
+            // Combined with the stage constants the whole range shares one set of stage flags
+            VkShaderStageFlags stageFlags = m_config.useStagePushConstants ? m_stagePushConstantStages : m_config.pushConstants->stageFlags;
+            vkCmdPushConstants(cmd, layout, stageFlags, m_config.pushConstants->offset,
+                static_cast<uint32_t>(m_pushConstantData.size()), m_pushConstantData.data());
+        }
+    }
+
+    VkExtent2D RenderStage::GetRenderExtent() const
+    {
+        // Without frame constants, or past an upscaler, the whole image is rendered
+        if (m_config.resolution == StageResolution::DISPLAY ||
+            m_frameConstants.renderWidth == 0 || m_frameConstants.renderHeight == 0)
+        {
+            return m_currentExtent;
+        }
+
+        return {
+            std::min(m_frameConstants.renderWidth, m_currentExtent.width),
+            std::min(m_frameConstants.renderHeight, m_currentExtent.height)
+        };
+    }
+
+    VkExtent3D RenderStage::GetDispatchGroupCount() const
+    {
+        // Calculate dispatch size based on workgroup configuration, covering only the active region
+        const auto& computeConfig = GetActiveComputeConfig();
+        if (computeConfig.invocationCount > 0)
+        {
+            uint32_t workgroupInvocations = computeConfig.workgroupSizeX * computeConfig.workgroupSizeY * computeConfig.workgroupSizeZ;
+            return {(computeConfig.invocationCount + workgroupInvocations - 1) / workgroupInvocations, 1, 1};
+        }
+
+        VkExtent2D renderExtent = GetRenderExtent();
+        uint32_t groupCountX = (renderExtent.width + computeConfig.workgroupSizeX - 1) / computeConfig.workgroupSizeX;
+        uint32_t groupCountY = (renderExtent.height + computeConfig.workgroupSizeY - 1) / computeConfig.workgroupSizeY;
+
+        // Images are 2D, a deeper workgroup already covers the single layer
+        uint32_t groupCountZ = 1;
+
+        return {groupCountX, groupCountY, groupCountZ};
+    }
+
+    bool RenderStage::AddWorkgroupVariant(const ComputeConfig& computeConfig)
+    {
+        if (!m_initialized || !m_config.IsCompute() || m_shaderModules.empty())
+        {
+            return false;
+        }
+
+        WorkgroupVariant variant;
+        variant.config = computeConfig;
+
+        // Variants only differ in specialization constants, the stage's layout fits them all
+        const auto& stagePipeline = std::get<ComputePipeline>(m_pipeline);
+        if (!variant.pipeline.Create(m_device, stagePipeline.GetLayout(), m_shaderModules[0].GetModule(), GetComputeSpecialization(computeConfig)))
+        {
+            MAGMA_LOG_ERROR("[RenderStage:{}] Failed to create pipeline for workgroup {}x{}x{}", m_config.name,
+                computeConfig.workgroupSizeX, computeConfig.workgroupSizeY, computeConfig.workgroupSizeZ);
+            return false;
+        }
+
+        m_workgroupVariants.push_back(std::move(variant));
+        return true;
+    }
+
+    void RenderStage::SelectWorkgroupVariant(std::optional<uint32_t> variant)
+    {
+        assert((!variant || *variant < m_workgroupVariants.size()) && "RenderStage::SelectWorkgroupVariant() - Variant out of range!");
+        m_activeWorkgroupVariant = variant;
+    }
+
+    void RenderStage::CommitWorkgroupVariant(uint32_t variant)
+    {
+        assert(variant < m_workgroupVariants.size() && "RenderStage::CommitWorkgroupVariant() - Variant out of range!");
+
+        // The replaced pipeline takes the variant's place and is released with the others.
+        // Only the VkPipelines change places, the stage's pipeline keeps owning the layout.
+        WorkgroupVariant& committed = m_workgroupVariants[variant];
+        std::get<ComputePipeline>(m_pipeline).ExchangePipeline(committed.pipeline);
+        m_config.pipelineConfig = committed.config;
+
+        const ComputeConfig& computeConfig = m_config.GetComputeConfig();
+        MAGMA_LOG_INFO("[RenderStage:{}] Workgroup size set to {}x{}x{}", m_config.name,
+            computeConfig.workgroupSizeX, computeConfig.workgroupSizeY, computeConfig.workgroupSizeZ);
+
+        ReleaseWorkgroupVariants();
+    }
+
+    void RenderStage::ReleaseWorkgroupVariants()
+    {
+        for (auto& variant : m_workgroupVariants)
+        {
+            m_retiredPipelines.push_back(std::move(variant.pipeline));
+        }
+        m_workgroupVariants.clear();
+        m_activeWorkgroupVariant.reset();
+
+        // Counts down in Execute(), which runs once per frame
+        m_retiredPipelineFrames = m_framesInFlight;
+    }
+
+    const ComputeConfig& RenderStage::GetActiveComputeConfig() const
+    {
+        return m_activeWorkgroupVariant
+            ? m_workgroupVariants[*m_activeWorkgroupVariant].config
+            : m_config.GetComputeConfig();
+    }
+
+    ComputeSpecialization RenderStage::GetComputeSpecialization(const ComputeConfig& computeConfig) const
+    {
+        ComputeSpecialization specialization;
+        specialization.workgroupSize[0] = computeConfig.workgroupSizeX;
+        specialization.workgroupSize[1] = computeConfig.workgroupSizeY;
+        specialization.workgroupSize[2] = computeConfig.workgroupSizeZ;
+
+        uint32_t invocations = computeConfig.workgroupSizeX * computeConfig.workgroupSizeY * computeConfig.workgroupSizeZ;
+        if (invocations > m_computeInfo.maxWorkgroupInvocations ||
+            computeConfig.workgroupSizeX > m_computeInfo.maxWorkgroupSize[0] ||
+            computeConfig.workgroupSizeY > m_computeInfo.maxWorkgroupSize[1] ||
+            computeConfig.workgroupSizeZ > m_computeInfo.maxWorkgroupSize[2])
+        {
+            MAGMA_LOG_ERROR("[RenderStage:{}] Workgroup {}x{}x{} exceeds the device limits", m_config.name,
+                computeConfig.workgroupSizeX, computeConfig.workgroupSizeY, computeConfig.workgroupSizeZ);
+        }
+
+        uint32_t subgroupSize = computeConfig.requiredSubgroupSize;
+        if (subgroupSize != 0)
+        {
+            if (!m_computeInfo.subgroupSizeControl || !std::has_single_bit(subgroupSize) ||
+                subgroupSize < m_computeInfo.minSubgroupSize || subgroupSize > m_computeInfo.maxSubgroupSize)
+            {
+                MAGMA_LOG_WARNING("[RenderStage:{}] Subgroup size {} is not supported, the driver picks one", m_config.name, subgroupSize);
+                subgroupSize = 0;
+            }
+        }
+        specialization.requiredSubgroupSize = subgroupSize;
+        specialization.requireFullSubgroups = m_config.IsPrimitive();
+
+        return specialization;
+    }
+
+    uint64_t RenderStage::EstimateResourceBytes(bool inputs) const
+    {
+        uint64_t bytes = 0;
+
+        for (const auto& req : GenerateBufferRequirements())
+        {
+            if (req.isInput != inputs)
+            {
+                continue;
+            }
+
+            VkExtent2D extent = req.matchSwapchainExtent ? GetRenderExtent() : req.extent;
+            bytes += static_cast<uint64_t>(extent.width) * extent.height * vkutil::format_texel_size(req.format);
+        }
 
-        computePipeline.Dispatch(cmd, groupCountX, groupCountY, groupCountZ);
+        return bytes;
     }
 
-    void RenderStage::ExecuteGraphics(VkCommandBuffer cmd)
+    void RenderStage::ExecuteGraphics(VkCommandBuffer cmd, VkDescriptorSet descriptorSet)
     {
         auto& graphicsPipeline = std::get<GraphicsPipeline>(m_pipeline);
 
         graphicsPipeline.Bind(cmd);
 
-        if (m_descriptorSet != VK_NULL_HANDLE)
+        if (descriptorSet != VK_NULL_HANDLE)
         {
-            std::vector<VkDescriptorSet> sets = { m_descriptorSet };
+            std::vector<VkDescriptorSet> sets = { descriptorSet };
             m_descriptorManager->BindDescriptor(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline, sets);
         }
 
+        PushStageConstants(cmd, graphicsPipeline.GetLayout());
+
         // TODO: Actual graphics commands (draw calls, etc.)
         // This will be expanded in later phases
-        Logger::Log(LogLevel::WARNING, "[RenderStage:{}] Graphics pipeline execution not yet fully implemented", m_config.name);
+        if (!m_warnedGraphicsUnimplemented)
+        {
+            MAGMA_LOG_WARNING("[RenderStage:{}] Graphics pipeline execution not yet fully implemented", m_config.name);
+            m_warnedGraphicsUnimplemented = true;
+        }
     }
 }
@@ -3,6 +3,7 @@
 
 #include <VkBootstrap.h>
 #include <types/Containers.h>
+#include <profiling/Profiler.h>
 
 #include <magma_engine/ServiceLocater.h>
 #include <magma_engine/Window.h>
@@ -12,6 +13,14 @@
 #include <magma_engine/core/renderer/StageFactory.h>
 
 constexpr bool b_UseValidationLayers = true;
+constexpr bool b_UsePipelineStatistics = true;
+
+// Renders the scene at k_UpscalerRenderScale and upscales it in compute before display
+constexpr bool b_UseSpatialUpscaler = false;
+constexpr float k_UpscalerRenderScale = 0.67f;
+
+// Grades the scene with a chain of pixel stages, which the orchestrator fuses into one dispatch
+constexpr bool b_UsePostProcessChain = false;
 
 
 void Magma::Renderer::Init()
@@ -23,6 +32,7 @@ void Magma::Renderer::Init()
 	init_commands();
 	init_sync_structures();
 	init_descriptors();
+	init_staging();
 	init_render_stages();
 }
 
@@ -59,7 +69,7 @@ void Magma::Renderer::init_vulkan()
 	vkEnumerateInstanceExtensionProperties(nullptr, &extCount, extensions.data());
 
 	uint32_t glfwExtensionCount = 0;
-	const char** glfwExtensions = ServiceLocator::Get<Window>()->GetRequiredExtensions(&glfwExtensionCount);
+	const char** glfwExtensions = ServiceLocator::Get<Window>().GetRequiredExtensions(&glfwExtensionCount);
 
 	vkb::InstanceBuilder builder = vkb::InstanceBuilder();
 
@@ -98,7 +108,7 @@ void Magma::Renderer::init_vulkan()
 
 	if (!instance_result)
 	{
-		Logger::Log(LogLevel::ERROR, "Failed to create Vulkan instance: {}", instance_result.error().message());
+		MAGMA_LOG_ERROR("Failed to create Vulkan instance: {}", instance_result.error().message());
 		std::exit(EXIT_FAILURE);
 	}
 
@@ -112,13 +122,14 @@ void Magma::Renderer::init_vulkan()
 						{SurfaceArgs ::OUT_SURFACE, (int*)&m_surface}
 	};
 
-	ServiceLocator::Get<Window>()->GetDrawSurface(surfaceArgs);
+	ServiceLocator::Get<Window>().GetDrawSurface(surfaceArgs);
 
 	// Enable Vulkan 1.2 features including bufferDeviceAddress
 	VkPhysicalDeviceVulkan12Features vulkan12Features{};
 	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
 	vulkan12Features.bufferDeviceAddress = VK_TRUE;
 	vulkan12Features.descriptorIndexing = VK_TRUE;
+	vulkan12Features.timelineSemaphore = VK_TRUE;
 
 	vkb::PhysicalDeviceSelector selector{ vkb_inst };
 	auto physicalDeviceResult = selector
@@ -131,24 +142,115 @@ void Magma::Renderer::init_vulkan()
 
 	if (!physicalDeviceResult)
 	{
-		Logger::Log(LogLevel::ERROR, "Failed to select physical device: ", physicalDeviceResult.error().message());
+		MAGMA_LOG_ERROR("Failed to select physical device: {}", physicalDeviceResult.error().message());
 		std::exit(EXIT_FAILURE);
 	}
 
 	vkb::PhysicalDevice physicalDevice = physicalDeviceResult.value();
 
+	// Optional features used for per-stage GPU profiling
+	VkPhysicalDeviceFeatures optionalFeatures{};
+	optionalFeatures.pipelineStatisticsQuery = VK_TRUE;
+	bool pipelineStatisticsSupported = physicalDevice.enable_features_if_present(optionalFeatures);
+
+	m_profilerSettings.timestampPeriod = physicalDevice.properties.limits.timestampPeriod;
+	m_profilerSettings.enableTimestamps = physicalDevice.properties.limits.timestampComputeAndGraphics == VK_TRUE;
+	m_profilerSettings.enablePipelineStatistics = b_UsePipelineStatistics && pipelineStatisticsSupported;
+
+	// Real per-process heap usage and budgets for the memory telemetry
+	bool memoryBudgetSupported = physicalDevice.enable_extension_if_present(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+	// Events for split barriers between render stages
+	VkPhysicalDeviceSynchronization2Features synchronization2Feature{};
+	synchronization2Feature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES;
+	bool synchronization2Supported = physicalDevice.enable_extension_if_present(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+	if (synchronization2Supported)
+	{
+		VkPhysicalDeviceFeatures2 features2{};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features2.pNext = &synchronization2Feature;
+		vkGetPhysicalDeviceFeatures2(physicalDevice.physical_device, &features2);
+		synchronization2Supported = synchronization2Feature.synchronization2 == VK_TRUE;
+		synchronization2Feature.pNext = nullptr;
+	}
+
+	// Workgroup sizes and limits for the compute stages, subgroup sizes if the driver lets pipelines pick one
+	const VkPhysicalDeviceLimits& limits = physicalDevice.properties.limits;
+	m_computeDeviceInfo.maxWorkgroupInvocations = limits.maxComputeWorkGroupInvocations;
+	for (int i = 0; i < 3; i++)
+	{
+		m_computeDeviceInfo.maxWorkgroupSize[i] = limits.maxComputeWorkGroupSize[i];
+	}
+	m_computeDeviceInfo.vendorID = physicalDevice.properties.vendorID;
+	m_computeDeviceInfo.deviceID = physicalDevice.properties.deviceID;
+	m_computeDeviceInfo.driverVersion = physicalDevice.properties.driverVersion;
+	m_computeDeviceInfo.deviceName = physicalDevice.properties.deviceName;
+
+	// Subgroup operations the compute primitives are built on, core since Vulkan 1.1
+	VkPhysicalDeviceSubgroupProperties subgroupProperties{};
+	subgroupProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+	VkPhysicalDeviceProperties2 subgroupProperties2{};
+	subgroupProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	subgroupProperties2.pNext = &subgroupProperties;
+	vkGetPhysicalDeviceProperties2(physicalDevice.physical_device, &subgroupProperties2);
+
+	m_computeDeviceInfo.subgroupSize = subgroupProperties.subgroupSize;
+	if (subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT)
+	{
+		m_computeDeviceInfo.subgroupOperations = subgroupProperties.supportedOperations;
+	}
+
+	VkPhysicalDeviceSubgroupSizeControlFeatures subgroupSizeControlFeature{};
+	subgroupSizeControlFeature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_SIZE_CONTROL_FEATURES;
+	bool subgroupSizeControlSupported = physicalDevice.enable_extension_if_present(VK_EXT_SUBGROUP_SIZE_CONTROL_EXTENSION_NAME);
+	bool computeFullSubgroupsSupported = false;
+	if (subgroupSizeControlSupported)
+	{
+		VkPhysicalDeviceFeatures2 features2{};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features2.pNext = &subgroupSizeControlFeature;
+		vkGetPhysicalDeviceFeatures2(physicalDevice.physical_device, &features2);
+		subgroupSizeControlFeature.pNext = nullptr;
+
+		VkPhysicalDeviceSubgroupSizeControlProperties subgroupSizeControlProperties{};
+		subgroupSizeControlProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_SIZE_CONTROL_PROPERTIES;
+		VkPhysicalDeviceProperties2 properties2{};
+		properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties2.pNext = &subgroupSizeControlProperties;
+		vkGetPhysicalDeviceProperties2(physicalDevice.physical_device, &properties2);
+
+		subgroupSizeControlSupported = subgroupSizeControlFeature.subgroupSizeControl == VK_TRUE &&
+			(subgroupSizeControlProperties.requiredSubgroupSizeStages & VK_SHADER_STAGE_COMPUTE_BIT) != 0;
+		// Compute primitives rely on every subgroup of a workgroup being full
+		computeFullSubgroupsSupported = subgroupSizeControlFeature.computeFullSubgroups == VK_TRUE;
+		subgroupSizeControlFeature.subgroupSizeControl = subgroupSizeControlSupported ? VK_TRUE : VK_FALSE;
+
+		m_computeDeviceInfo.subgroupSizeControl = subgroupSizeControlSupported;
+		m_computeDeviceInfo.computeFullSubgroups = computeFullSubgroupsSupported;
+		m_computeDeviceInfo.minSubgroupSize = subgroupSizeControlProperties.minSubgroupSize;
+		m_computeDeviceInfo.maxSubgroupSize = subgroupSizeControlProperties.maxSubgroupSize;
+	}
+
 	VkPhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeature{};
 	dynamicRenderingFeature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
 	dynamicRenderingFeature.dynamicRendering = VK_TRUE;
 
 	vkb::DeviceBuilder deviceBuilder{ physicalDevice };
 	deviceBuilder.add_pNext(&dynamicRenderingFeature);
+	if (synchronization2Supported)
+	{
+		deviceBuilder.add_pNext(&synchronization2Feature);
+	}
+	if (subgroupSizeControlSupported || computeFullSubgroupsSupported)
+	{
+		deviceBuilder.add_pNext(&subgroupSizeControlFeature);
+	}
 
 	auto vkbDeviceResult = deviceBuilder.build();
 
 	if (!vkbDeviceResult)
 	{
-		Logger::Log(LogLevel::ERROR, "Failed to create device: ", vkbDeviceResult.error().message());
+		MAGMA_LOG_ERROR("Failed to create device: {}", vkbDeviceResult.error().message());
 		std::exit(EXIT_FAILURE);
 	}
 
@@ -160,6 +262,19 @@ void Magma::Renderer::init_vulkan()
 	m_graphicsQueue = vkbDevice.get_queue(vkb::QueueType::graphics).value();
 	m_graphicsQueueFamily = vkbDevice.get_queue_index(vkb::QueueType::graphics).value();
 
+	// Uploads prefer a transfer-only family so copies overlap with rendering
+	auto transferQueue = vkbDevice.get_dedicated_queue(vkb::QueueType::transfer);
+	if (transferQueue)
+	{
+		m_transferQueue = transferQueue.value();
+		m_transferQueueFamily = vkbDevice.get_dedicated_queue_index(vkb::QueueType::transfer).value();
+	}
+	else
+	{
+		m_transferQueue = m_graphicsQueue;
+		m_transferQueueFamily = m_graphicsQueueFamily;
+	}
+
 	// For dynamic rendering and copy commands
 	m_vkCmdBeginRenderingKHR = (PFN_vkCmdBeginRenderingKHR)vkGetDeviceProcAddr(m_device, "vkCmdBeginRenderingKHR");
 	m_vkCmdEndRenderingKHR = (PFN_vkCmdEndRenderingKHR)vkGetDeviceProcAddr(m_device, "vkCmdEndRenderingKHR");
@@ -169,21 +284,41 @@ void Magma::Renderer::init_vulkan()
 	assert(m_vkCmdEndRenderingKHR && "Dynamic Rendering not available!");
 	assert(m_vkCmdBlitImage2 && "vkCmdBlitImage2KHR not available!");
 
+	if (synchronization2Supported)
+	{
+		m_synchronizerSettings.cmdSetEvent2 = (PFN_vkCmdSetEvent2KHR)vkGetDeviceProcAddr(m_device, "vkCmdSetEvent2KHR");
+		m_synchronizerSettings.cmdWaitEvents2 = (PFN_vkCmdWaitEvents2KHR)vkGetDeviceProcAddr(m_device, "vkCmdWaitEvents2KHR");
+	}
+
 	VmaAllocatorCreateInfo allocatorInfo = {};
 	allocatorInfo.physicalDevice = m_physicalDevice;
 	allocatorInfo.device = m_device;
 	allocatorInfo.instance = m_instance;
 	allocatorInfo.flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+	if (memoryBudgetSupported)
+	{
+		allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+	}
 	vmaCreateAllocator(&allocatorInfo, &m_allocator);
 
 	m_mainDeletionQueue.push_function([&]() {
 		vmaDestroyAllocator(m_allocator);
 	});
+
+	m_deferredRelease.Initialize(m_device, m_allocator);
+	m_mainDeletionQueue.push_function([this]() {
+		m_deferredRelease.Flush();
+	});
+
+	m_memoryTelemetry.Initialize(m_allocator);
+	m_mainDeletionQueue.push_function([this]() {
+		m_memoryTelemetry.Cleanup();
+	});
 }
 
 void Magma::Renderer::init_swapchain()
 {
-	create_swapchain(ServiceLocator::Get<Window>()->GetExtent());
+	create_swapchain(ServiceLocator::Get<Window>().GetExtent());
 }
 
 void Magma::Renderer::init_commands()
@@ -209,15 +344,12 @@ void Magma::Renderer::init_commands()
 		});
 	}
 
-	// Creating immediate sync and render objects
-	VK_CHECK(vkCreateCommandPool(m_device, &commandPoolInfo, nullptr, &m_immRenderData.immCommandPool));
-
-	VkCommandBufferAllocateInfo cmdAllocInfo = vkinit::command_buffer_allocate_info(m_immRenderData.immCommandPool, 1);
-	VK_CHECK(vkAllocateCommandBuffers(m_device, &cmdAllocInfo, &m_immRenderData.immCommandBuffer));
+	// One-off submissions get their own transient command buffers and timeline
+	m_gpuSubmitter.Initialize(m_device, m_graphicsQueue, m_graphicsQueueFamily);
 
 	m_mainDeletionQueue.push_function([this]
 	{
-		vkDestroyCommandPool(m_device, m_immRenderData.immCommandPool, nullptr);
+		m_gpuSubmitter.Cleanup();
 	});
 }
 
@@ -233,12 +365,6 @@ void Magma::Renderer::init_sync_structures()
 		VK_CHECK(vkCreateSemaphore(m_device, &semaphoreCreateInfo, nullptr, &m_frames[i].m_swapchainSemaphore));
 		VK_CHECK(vkCreateSemaphore(m_device, &semaphoreCreateInfo, nullptr, &m_frames[i].m_renderSemaphore));
 	}
-
-	VK_CHECK(vkCreateFence(m_device, &fenceCreateInfo, nullptr, &m_immRenderData.immFence));
-	m_mainDeletionQueue.push_function([this]()
-	{
-		vkDestroyFence(m_device, m_immRenderData.immFence, nullptr);
-	});
 }
 
 void Magma::Renderer::init_descriptors()
@@ -268,16 +394,36 @@ void Magma::Renderer::init_descriptors()
 		vkDestroySampler(m_device, m_drawImageSampler, nullptr);
 	});
 
-	Logger::Log(LogLevel::INFO, "Descriptor manager initialized successfully");
+	MAGMA_LOG_INFO("Descriptor manager initialized successfully");
+}
+
+void Magma::Renderer::init_staging()
+{
+	StagingUploaderSettings settings;
+	settings.transferQueue = m_transferQueue;
+	settings.transferQueueFamily = m_transferQueueFamily;
+	settings.graphicsQueueFamily = m_graphicsQueueFamily;
+	settings.transferQueueMutex = m_transferQueueFamily == m_graphicsQueueFamily
+		? &m_gpuSubmitter.GetQueueMutex()
+		: &m_transferQueueMutex;
+
+	m_stagingUploader.Initialize(m_device, m_allocator, settings);
+	m_memoryTelemetry.Track(m_stagingUploader.GetRingBuffer().allocation, "Staging ring", MemoryCategory::STAGING);
+
+	m_mainDeletionQueue.push_function([this]()
+	{
+		m_memoryTelemetry.Untrack(m_stagingUploader.GetRingBuffer().allocation);
+		m_stagingUploader.Cleanup();
+	});
 }
 
 void Magma::Renderer::init_render_stages()
 {
-	Logger::Log(LogLevel::INFO, "Initializing render stages");
+	MAGMA_LOG_INFO("Initializing render stages");
 
 	// Create and initialize resource allocator
 	m_resourceAllocator = std::make_shared<RenderResourceAllocator>();
-	m_resourceAllocator->Initialize(m_device, m_allocator);
+	m_resourceAllocator->Initialize(m_device, m_allocator, m_deferredRelease, &m_memoryTelemetry);
 
 	// Add render stages to orchestrator
 	m_renderOrchestrator.AddStage(StageFactory::CreateComputeStage(
@@ -288,19 +434,54 @@ void Magma::Renderer::init_render_stages()
 		16
 	));
 
+	String sceneImage = "drawImage";
+	if (b_UsePostProcessChain)
+	{
+		m_renderOrchestrator.AddStage(StageFactory::CreatePixelStage("Exposure", "drawImage", "exposedImage",
+			{ { PixelOperationType::EXPOSURE, { 0.5f } } }));
+		m_renderOrchestrator.AddStage(StageFactory::CreatePixelStage("Tonemap", "exposedImage", "tonemappedImage",
+			{ { PixelOperationType::ACES_TONEMAP } }));
+		m_renderOrchestrator.AddStage(StageFactory::CreatePixelStage("ColorGrade", "tonemappedImage", "gradedImage",
+			{ { PixelOperationType::COLOR_GRADE, { 1.1f, 1.05f, 0.0f } } }));
+		sceneImage = "gradedImage";
+	}
+
+	if (b_UseSpatialUpscaler)
+	{
+		for (auto& stage : StageFactory::CreateUpscaleStages("Upscaler", sceneImage, "upscaledImage"))
+		{
+			m_renderOrchestrator.AddStage(std::move(stage));
+		}
+
+		DynamicResolutionSettings resolutionSettings;
+		resolutionSettings.minScale = 0.5f;
+		resolutionSettings.maxScale = k_UpscalerRenderScale;
+		m_renderOrchestrator.GetDynamicResolution().SetSettings(resolutionSettings);
+	}
+
 	// Initialize orchestrator (will allocate buffers and initialize all stages)
-	m_renderOrchestrator.Initialize(
+	m_renderOrchestrator.SetSynchronizerSettings(m_synchronizerSettings);
+	m_renderOrchestrator.SetComputeDeviceInfo(m_computeDeviceInfo);
+	bool orchestratorInitialized = m_renderOrchestrator.Initialize(
 		m_resourceAllocator,
-		m_swapchainExtent
+		m_swapchainExtent,
+		FRAME_OVERLAP,
+		m_profilerSettings
 	);
+	if (!orchestratorInitialized)
+	{
+		MAGMA_LOG_ERROR("Failed to initialize the render graph");
+		std::exit(EXIT_FAILURE);
+	}
 
 	// Update draw extent from the allocated draw image
-	auto drawImage = m_renderOrchestrator.GetBuffer("drawImage");
+	auto drawImage = m_renderOrchestrator.GetFinalOutputBuffer();
 	if (drawImage)
 	{
 		m_drawExtent.width = drawImage->imageExtent.width;
 		m_drawExtent.height = drawImage->imageExtent.height;
 	}
+	m_requestedRenderExtent = m_swapchainExtent;
 
 	m_mainDeletionQueue.push_function([this]()
 	{
@@ -308,10 +489,14 @@ void Magma::Renderer::init_render_stages()
 		if (m_resourceAllocator)
 		{
 			m_resourceAllocator->Cleanup();
+
+			// The released graph resources were allocated from the allocator's pools
+			m_deferredRelease.Flush();
+			m_resourceAllocator->DestroyPools();
 		}
 	});
 
-	Logger::Log(LogLevel::INFO, "Render stages initialized successfully");
+	MAGMA_LOG_INFO("Render stages initialized successfully");
 }
 
 void Magma::Renderer::create_swapchain(Maths::Vec2<uint32_t> size)
@@ -325,6 +510,7 @@ void Magma::Renderer::create_swapchain(Maths::Vec2<uint32_t> size)
 		.set_desired_present_mode(VK_PRESENT_MODE_FIFO_KHR)
 		.set_desired_extent(size.x, size.y)
 		.add_image_usage_flags(VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+		.set_old_swapchain(m_swapchain)
 		.build()
 		.value();
 
@@ -342,98 +528,203 @@ void Magma::Renderer::destroy_swapchain()
 	{
 		vkDestroyImageView(m_device, m_swapchainImageViews[i], nullptr);
 	}
+
+	for (RetiredSwapchain& retired : m_retiredSwapchains)
+	{
+		for (VkImageView imageView : retired.imageViews)
+		{
+			vkDestroyImageView(m_device, imageView, nullptr);
+		}
+		vkDestroySwapchainKHR(m_device, retired.swapchain, nullptr);
+	}
+	m_retiredSwapchains.clear();
 }
 
-void Magma::Renderer::immediate_submit(std::function<void(VkCommandBuffer cmd)>&& function)
+bool Magma::Renderer::recreate_swapchain()
 {
-	VK_CHECK(vkResetFences(m_device, 1, &m_immRenderData.immFence));
-	VK_CHECK(vkResetCommandBuffer(m_immRenderData.immCommandBuffer, 0));
+	MAGMA_PROFILE_ZONE("Renderer::recreate_swapchain");
 
-	VkCommandBuffer cmd = m_immRenderData.immCommandBuffer;
+	Window& window = ServiceLocator::Get<Window>();
+	window.ConsumeResize();
 
-	VkCommandBufferBeginInfo cmdBeginInfo = vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	// A zero sized swapchain is invalid, keep the old one until the window is restored
+	if (window.IsMinimized())
+	{
+		m_swapchainOutOfDate = true;
+		return false;
+	}
 
-	VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
+	VkSwapchainKHR oldSwapchain = m_swapchain;
+	Vector<VkImageView> oldImageViews = std::move(m_swapchainImageViews);
 
-	function(cmd);
+	create_swapchain(window.GetExtent());
 
-	VK_CHECK(vkEndCommandBuffer(cmd));
+	// Released by Present() once the new swapchain has presented an image
+	m_retiredSwapchains.push_back({ oldSwapchain, std::move(oldImageViews) });
+
+	m_swapchainOutOfDate = false;
+
+	if (m_renderExtentFollowsSwapchain)
+	{
+		m_requestedRenderExtent = m_swapchainExtent;
+	}
+
+	MAGMA_LOG_INFO("Swapchain recreated at {}x{}", m_swapchainExtent.width, m_swapchainExtent.height);
+	return true;
+}
+
+void Magma::Renderer::SetRenderExtent(VkExtent2D extent)
+{
+	if (extent.width == 0 || extent.height == 0)
+	{
+		return;
+	}
+
+	m_requestedRenderExtent = extent;
+	m_renderExtentFollowsSwapchain = false;
+}
+
+void Magma::Renderer::apply_render_extent()
+{
+	VkExtent2D allocatedExtent = m_renderOrchestrator.GetAllocatedExtent();
+	if (m_requestedRenderExtent.width == allocatedExtent.width && m_requestedRenderExtent.height == allocatedExtent.height)
+	{
+		return;
+	}
 
-	VkCommandBufferSubmitInfo cmdinfo = vkinit::command_buffer_submit_info(cmd);
-	VkSubmitInfo2 submit = vkinit::submit_info(&cmdinfo, nullptr, nullptr);
+	// Replaced targets return to the image pool once the frames using them have completed
+	m_renderOrchestrator.OnResolutionChanged(m_requestedRenderExtent);
+}
 
-	// submit command buffer to the queue and execute it.
-	//  _renderFence will now block until the graphic commands finish execution
-	VK_CHECK(vkQueueSubmit2(m_graphicsQueue, 1, &submit, m_immRenderData.immFence));
+void Magma::Renderer::immediate_submit(std::function<void(VkCommandBuffer cmd)>&& function)
+{
+	MAGMA_PROFILE_ZONE("Renderer::immediate_submit");
 
-	VK_CHECK(vkWaitForFences(m_device, 1, &m_immRenderData.immFence, true, 9999999999));
+	m_gpuSubmitter.Submit(std::move(function)).Wait();
 }
 
-void Magma::Renderer::BeginFrame()
+bool Magma::Renderer::BeginFrame()
 {
+	MAGMA_PROFILE_ZONE("Renderer::BeginFrame");
+
+	// The fence is only reset once an image is acquired, so a skipped frame leaves the slot reusable
 	VK_CHECK(vkWaitForFences(m_device, 1, &get_current_frame().m_renderFence, true, 1000000000));
-	VK_CHECK(vkResetFences(m_device, 1, &get_current_frame().m_renderFence));
 
 	get_current_frame().m_deletionQueue.flush();
 
-	VK_CHECK(vkAcquireNextImageKHR(m_device, m_swapchain, 1000000000, get_current_frame().m_swapchainSemaphore, nullptr, &m_currentSwapchainImageIndex));
+	// Waiting on this slot's fence means every frame up to m_frameNumber - FRAME_OVERLAP has completed
+	m_deferredRelease.SetRetireValue(m_frameNumber);
+	if (m_frameNumber >= FRAME_OVERLAP)
+	{
+		// A finished defragmentation pass must end before the allocations it moved can be freed
+		m_resourceAllocator->GetDefragmenter().CompletePass(m_frameNumber - FRAME_OVERLAP);
+		m_deferredRelease.Collect(m_frameNumber - FRAME_OVERLAP);
+		m_resourceAllocator->UpdateImagePool(m_frameNumber, m_frameNumber - FRAME_OVERLAP);
+	}
+
+	m_memoryTelemetry.Update(m_frameNumber);
+
+	if (m_swapchainOutOfDate && !recreate_swapchain())
+	{
+		return false;
+	}
+
+	VkResult acquireResult = vkAcquireNextImageKHR(m_device, m_swapchain, 1000000000, get_current_frame().m_swapchainSemaphore, nullptr, &m_currentSwapchainImageIndex);
+	if (acquireResult == VK_ERROR_OUT_OF_DATE_KHR)
+	{
+		// Nothing was signaled, the next frame retries on the new swapchain
+		recreate_swapchain();
+		return false;
+	}
+	if (acquireResult == VK_SUBOPTIMAL_KHR)
+	{
+		// The image is still presentable, recreate once this frame is out
+		m_swapchainOutOfDate = true;
+	}
+	else
+	{
+		VK_CHECK(acquireResult);
+	}
+
+	VK_CHECK(vkResetFences(m_device, 1, &get_current_frame().m_renderFence));
+
+	apply_render_extent();
 
 	VkCommandBuffer cmd = get_current_frame().m_mainCommandBuffer;
 	VK_CHECK(vkResetCommandBuffer(cmd, 0));
 
 	VkCommandBufferBeginInfo cmdBeginInfo = vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 	VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
+
+	// Everything uploaded since the last frame goes out in one transfer submission
+	m_frameUploadWaitValue = m_stagingUploader.Flush(cmd);
+
+	// Copies moved images before any stage touches them, stages pick up the new views lazily
+	if (m_resourceAllocator->GetDefragmenter().RecordPass(cmd, m_frameNumber))
+	{
+		m_renderOrchestrator.InvalidateDescriptors();
+	}
+
+	return true;
 }
 
 void Magma::Renderer::RenderScene()
 {
-	VkCommandBuffer cmd = get_current_frame().m_mainCommandBuffer;
+	MAGMA_PROFILE_ZONE("Renderer::RenderScene");
 
-	std::shared_ptr<AllocatedImage> drawImage = m_renderOrchestrator.GetBuffer("drawImage");
-	if (drawImage)
-	{
-		m_drawExtent.width = drawImage->imageExtent.width;
-		m_drawExtent.height = drawImage->imageExtent.height;
+	VkCommandBuffer cmd = get_current_frame().m_mainCommandBuffer;
 
-		// Transition to GENERAL for compute shader
-		vkutil::transition_image(cmd, drawImage->image, drawImage->currentLayout, VK_IMAGE_LAYOUT_GENERAL);
-		drawImage->currentLayout = VK_IMAGE_LAYOUT_GENERAL;
-	}
+	// Execute render stages through orchestrator, it moves the graph images to GENERAL
+	m_renderOrchestrator.Execute(cmd, m_frameNumber % FRAME_OVERLAP, m_frameNumber);
 
-	// Execute render stages through orchestrator
-	m_renderOrchestrator.Execute(cmd);
+	// Only this region of the draw image holds the frame, the copy to the swapchain upscales it
+	m_drawExtent = m_renderOrchestrator.GetOutputExtent();
 
-	// Transition draw image to shader read for ImGui viewport
+	// Transition draw image to shader read for ImGui viewport, waiting only for the stage writes.
+	// Blocking the transfer stage as well orders CopyToSwapchain's transition after this one.
+	std::shared_ptr<AllocatedImage> drawImage = m_renderOrchestrator.GetFinalOutputBuffer();
 	if (drawImage)
 	{
-		vkutil::transition_image(cmd, drawImage->image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		vkutil::transition_image(cmd, drawImage->image, drawImage->currentLayout, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT);
 		drawImage->currentLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	}
 }
 
 void Magma::Renderer::CopyToSwapchain()
 {
+	MAGMA_PROFILE_ZONE("Renderer::CopyToSwapchain");
+
 	VkCommandBuffer cmd = get_current_frame().m_mainCommandBuffer;
 
-	auto drawImage = m_renderOrchestrator.GetBuffer("drawImage");
-	if (!drawImage)
+	auto drawImage = m_renderOrchestrator.GetFinalOutputBuffer();
+	if (!m_copyToSwapchain || !drawImage)
 	{
+		// The UI pass clears the image instead, so its old contents can be discarded. The acquire
+		// semaphore is waited on at color attachment output, the transition has to follow it.
+		vkutil::transition_image(cmd, m_swapchainImages[m_currentSwapchainImageIndex], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
 		return;
 	}
 
-	// Transition draw image for transfer
-	vkutil::transition_image(cmd, drawImage->image, drawImage->currentLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+	// Transition draw image for transfer, chained to the transfer stage RenderScene's transition blocks
+	vkutil::transition_image(cmd, drawImage->image, drawImage->currentLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
 	drawImage->currentLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-	vkutil::transition_image(cmd, m_swapchainImages[m_currentSwapchainImageIndex], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	vkutil::transition_image(cmd, m_swapchainImages[m_currentSwapchainImageIndex], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
 
 	vkutil::copy_image_to_image(cmd, drawImage->image, m_swapchainImages[m_currentSwapchainImageIndex], m_drawExtent, m_swapchainExtent, m_vkCmdBlitImage2);
 
 	// Transition draw image back to shader read for ImGui to sample it
-	vkutil::transition_image(cmd, drawImage->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	vkutil::transition_image(cmd, drawImage->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
 	drawImage->currentLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
 	// Transition to color attachment for ImGui rendering
-	vkutil::transition_image(cmd, m_swapchainImages[m_currentSwapchainImageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	vkutil::transition_image(cmd, m_swapchainImages[m_currentSwapchainImageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
 }
 
 void Magma::Renderer::BeginUIRenderPass()
@@ -446,6 +737,12 @@ void Magma::Renderer::BeginUIRenderPass()
 		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
 	);
 	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;  // Load existing content
+	if (!m_copyToSwapchain)
+	{
+		// Nothing was copied in, the UI draws over a cleared image
+		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		colorAttachment.clearValue = {};
+	}
 	VkRenderingInfo renderInfo = vkinit::rendering_info(m_swapchainExtent, &colorAttachment, nullptr);
 
 	if (m_vkCmdBeginRenderingKHR)
@@ -470,16 +767,28 @@ void Magma::Renderer::EndFrame()
 
 void Magma::Renderer::Present()
 {
+	MAGMA_PROFILE_ZONE("Renderer::Present");
+
 	VkCommandBuffer cmd = get_current_frame().m_mainCommandBuffer;
 	// Submit
 	VkSubmitInfo submit = {};
 	submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 	submit.pNext = nullptr;
 
-	submit.waitSemaphoreCount = 1;
-	submit.pWaitSemaphores = &get_current_frame().m_swapchainSemaphore;
-	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	submit.pWaitDstStageMask = &waitStage;
+	VkSemaphore waitSemaphores[] = { get_current_frame().m_swapchainSemaphore, m_stagingUploader.GetTimelineSemaphore() };
+	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT };
+	uint64_t waitValues[] = { 0, m_frameUploadWaitValue };
+
+	// Only frames that acquire fresh uploads wait on the transfer timeline
+	VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.waitSemaphoreValueCount = m_frameUploadWaitValue != 0 ? 2 : 1;
+	timelineInfo.pWaitSemaphoreValues = waitValues;
+	submit.pNext = &timelineInfo;
+
+	submit.waitSemaphoreCount = m_frameUploadWaitValue != 0 ? 2 : 1;
+	submit.pWaitSemaphores = waitSemaphores;
+	submit.pWaitDstStageMask = waitStages;
 
 	submit.signalSemaphoreCount = 1;
 	submit.pSignalSemaphores = &get_current_frame().m_renderSemaphore;
@@ -487,6 +796,9 @@ void Magma::Renderer::Present()
 	submit.commandBufferCount = 1;
 	submit.pCommandBuffers = &cmd;
 
+	// The GpuSubmitter may be submitting from another thread
+	std::lock_guard queueLock(m_gpuSubmitter.GetQueueMutex());
+
 	VK_CHECK(vkQueueSubmit(m_graphicsQueue, 1, &submit, get_current_frame().m_renderFence));
 
 	// Present
@@ -501,7 +813,35 @@ void Magma::Renderer::Present()
 
 	presentInfo.pImageIndices = &m_currentSwapchainImageIndex;
 
-	VK_CHECK(vkQueuePresentKHR(m_graphicsQueue, &presentInfo));
+	VkResult presentResult = vkQueuePresentKHR(m_graphicsQueue, &presentInfo);
+
+	// The presentation engine is done with replaced swapchains once the current one presents.
+	// Frames in flight may still reference their views, so they go once this frame completes.
+	if ((presentResult == VK_SUCCESS || presentResult == VK_SUBOPTIMAL_KHR) && !m_retiredSwapchains.empty())
+	{
+		for (RetiredSwapchain& retired : m_retiredSwapchains)
+		{
+			for (VkImageView imageView : retired.imageViews)
+			{
+				m_deferredRelease.ReleaseImageView(imageView);
+			}
+			m_deferredRelease.ReleaseSwapchain(retired.swapchain);
+		}
+		m_retiredSwapchains.clear();
+	}
+	if (presentResult == VK_ERROR_OUT_OF_DATE_KHR || presentResult == VK_SUBOPTIMAL_KHR)
+	{
+		m_swapchainOutOfDate = true;
+	}
+	else
+	{
+		VK_CHECK(presentResult);
+	}
+
+	if (ServiceLocator::Get<Window>().ConsumeResize())
+	{
+		m_swapchainOutOfDate = true;
+	}
 
 	m_frameNumber++;
 }
@@ -0,0 +1,181 @@
+#include <magma_engine/core/renderer/ResourcePools.h>
+#include <logging/Logger.h>
+#include <cassert>
+
+namespace Magma
+{
+    const char* ResourceClassToString(ResourceClass resourceClass)
+    {
+        switch (resourceClass)
+        {
+            case ResourceClass::RENDER_TARGET: return "Render target";
+            case ResourceClass::PERSISTENT: return "Persistent";
+            case ResourceClass::TRANSIENT: return "Transient";
+            case ResourceClass::READBACK: return "Readback";
+            default: return "Unknown";
+        }
+    }
+
+    void ResourcePools::Initialize(VmaAllocator allocator, const ResourcePoolSettings& settings)
+    {
+        assert(allocator != VK_NULL_HANDLE && "ResourcePools::Initialize() - VmaAllocator is null!");
+
+        m_allocator = allocator;
+        m_settings = settings;
+    }
+
+    void ResourcePools::Cleanup()
+    {
+        std::lock_guard lock(m_mutex);
+
+        for (auto& [key, pool] : m_pools)
+        {
+            vmaDestroyPool(m_allocator, pool);
+        }
+
+        m_pools.clear();
+        m_allocator = VK_NULL_HANDLE;
+    }
+
+    VmaAllocationCreateInfo ResourcePools::GetImageAllocationInfo(ResourceClass resourceClass, const VkImageCreateInfo& imageInfo)
+    {
+        VmaAllocationCreateInfo allocInfo = GetBaseAllocationInfo(resourceClass);
+
+        if (resourceClass == ResourceClass::RENDER_TARGET)
+        {
+            return allocInfo;
+        }
+
+        uint32_t memoryTypeIndex = 0;
+        if (vmaFindMemoryTypeIndexForImageInfo(m_allocator, &imageInfo, &allocInfo, &memoryTypeIndex) == VK_SUCCESS)
+        {
+            allocInfo.pool = GetOrCreatePool(resourceClass, memoryTypeIndex);
+        }
+
+        return allocInfo;
+    }
+
+    VmaAllocationCreateInfo ResourcePools::GetBufferAllocationInfo(ResourceClass resourceClass, const VkBufferCreateInfo& bufferInfo)
+    {
+        VmaAllocationCreateInfo allocInfo = GetBaseAllocationInfo(resourceClass);
+
+        if (resourceClass == ResourceClass::RENDER_TARGET)
+        {
+            return allocInfo;
+        }
+
+        uint32_t memoryTypeIndex = 0;
+        if (vmaFindMemoryTypeIndexForBufferInfo(m_allocator, &bufferInfo, &allocInfo, &memoryTypeIndex) == VK_SUCCESS)
+        {
+            allocInfo.pool = GetOrCreatePool(resourceClass, memoryTypeIndex);
+        }
+
+        return allocInfo;
+    }
+
+    Vector<VmaPool> ResourcePools::GetDefragmentablePools()
+    {
+        std::lock_guard lock(m_mutex);
+
+        Vector<VmaPool> pools;
+        for (const auto& [key, pool] : m_pools)
+        {
+            if (pool != VK_NULL_HANDLE && static_cast<ResourceClass>(key >> 32) == ResourceClass::PERSISTENT)
+            {
+                pools.push_back(pool);
+            }
+        }
+
+        return pools;
+    }
+
+    VmaAllocationCreateInfo ResourcePools::GetBaseAllocationInfo(ResourceClass resourceClass) const
+    {
+        VmaAllocationCreateInfo allocInfo = {};
+
+        switch (resourceClass)
+        {
+            case ResourceClass::RENDER_TARGET:
+                allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+                allocInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+                allocInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+                break;
+
+            case ResourceClass::PERSISTENT:
+            case ResourceClass::TRANSIENT:
+                allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+                allocInfo.flags = VMA_ALLOCATION_CREATE_STRATEGY_MIN_TIME_BIT;
+                allocInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+                break;
+
+            case ResourceClass::READBACK:
+                allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+                allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+                allocInfo.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+                allocInfo.preferredFlags = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+                break;
+
+            default:
+                allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+                break;
+        }
+
+        return allocInfo;
+    }
+
+    VmaPool ResourcePools::GetOrCreatePool(ResourceClass resourceClass, uint32_t memoryTypeIndex)
+    {
+        uint64_t key = (static_cast<uint64_t>(resourceClass) << 32) | memoryTypeIndex;
+
+        std::lock_guard lock(m_mutex);
+
+        auto it = m_pools.find(key);
+        if (it != m_pools.end())
+        {
+            return it->second;
+        }
+
+        VmaPoolCreateInfo poolInfo = {};
+        poolInfo.memoryTypeIndex = memoryTypeIndex;
+
+        switch (resourceClass)
+        {
+            case ResourceClass::PERSISTENT:
+                // Default algorithm, asset reloads free from the middle and the pool has to stay defragmentable
+                poolInfo.blockSize = m_settings.persistentBlockSize;
+                break;
+
+            case ResourceClass::TRANSIENT:
+                // A linear pool with a single block behaves as a ring buffer when freed in allocation order
+                poolInfo.flags = VMA_POOL_CREATE_LINEAR_ALGORITHM_BIT;
+                poolInfo.blockSize = m_settings.transientRingSize;
+                poolInfo.maxBlockCount = 1;
+                break;
+
+            case ResourceClass::READBACK:
+                poolInfo.blockSize = m_settings.readbackBlockSize;
+                break;
+
+            default:
+                break;
+        }
+
+        VmaPool pool = VK_NULL_HANDLE;
+        VkResult result = vmaCreatePool(m_allocator, &poolInfo, &pool);
+        if (result != VK_SUCCESS)
+        {
+            MAGMA_LOG_WARNING("[ResourcePools] Failed to create {} pool for memory type {}: {}, using the default pools",
+                ResourceClassToString(resourceClass), memoryTypeIndex, static_cast<int>(result));
+            pool = VK_NULL_HANDLE;
+        }
+        else
+        {
+            vmaSetPoolName(m_allocator, pool, ResourceClassToString(resourceClass));
+            MAGMA_LOG_DEBUG("[ResourcePools] Created {} pool for memory type {}", ResourceClassToString(resourceClass), memoryTypeIndex);
+        }
+
+        // Failures are cached too, so the fallback is not retried on every allocation
+        m_pools[key] = pool;
+        return pool;
+    }
+}
@@ -1,4 +1,5 @@
 #include <magma_engine/core/renderer/ShaderModule.h>
+#include <profiling/Profiler.h>
 #include <fstream>
 #include <iostream>
 
@@ -27,6 +28,8 @@ namespace Magma
 
     bool ShaderModule::LoadFromFile(VkDevice device, const std::string& filePath)
     {
+        MAGMA_PROFILE_ZONE("ShaderModule::LoadFromFile");
+
         m_device = device;
 
         std::ifstream file(filePath, std::ios::ate | std::ios::binary);
@@ -1,7 +1,137 @@
 #include <magma_engine/core/renderer/StageFactory.h>
+#include <logging/Logger.h>
+#include <algorithm>
+#include <bit>
+#include <cstddef>
 
 namespace Magma
 {
+    namespace
+    {
+        // Follows StagePushConstants, matches TemporalAccumulate.comp
+        struct TemporalAccumulateConstants
+        {
+            float currentFrameWeight;
+            uint32_t clampHistory;
+        };
+
+        // Follows StagePushConstants, matches PixelChain.comp. x of each operation holds its type.
+        struct PixelChainConstants
+        {
+            uint32_t operationCount;
+
+            // The operations array is 16-byte aligned in the shader
+            uint32_t padding[3];
+            float operations[k_MaxPixelOperations][4];
+        };
+
+        static_assert(sizeof(StagePushConstants) + sizeof(PixelChainConstants) <= 128,
+            "Pixel chain push constants exceed the guaranteed 128 bytes");
+        static_assert((sizeof(StagePushConstants) + offsetof(PixelChainConstants, operations)) % 16 == 0,
+            "Pixel chain operations must start 16-byte aligned");
+
+        // Matches Primitives.glsl, fields a primitive has no use for stay 0
+        struct PrimitiveConstants
+        {
+            uint32_t elementCount = 0;
+            uint32_t blockCount = 0;
+            uint32_t shift = 0;
+            uint32_t parameter = 0;
+            uint32_t seed = 0;
+            uint32_t valueMask = 0;
+        };
+
+        // Matches RadixCount.comp and RadixScatter.comp
+        constexpr uint32_t k_RadixBits = 4;
+        constexpr uint32_t k_RadixDigits = 1u << k_RadixBits;
+
+        // Matches Histogram.comp
+        constexpr uint32_t k_MaxHistogramBins = 256;
+
+        // Guaranteed maxComputeWorkGroupCount[0], the primitives dispatch along x only
+        constexpr uint32_t k_MaxWorkgroupCount = 65535;
+
+        // VkDispatchIndirectCommand after the total, see ScanBlocks.comp
+        constexpr VkDeviceSize k_ScanSummarySize = 4 * sizeof(uint32_t);
+
+        uint32_t GetPrimitiveWorkgroupSize(const ComputePrimitiveSettings& settings)
+        {
+            // A power of two splits into whole subgroups
+            return std::bit_floor(std::clamp(settings.workgroupSize, k_RadixDigits, k_MaxPrimitiveWorkgroupSize));
+        }
+
+        uint32_t ClampElementCount(const String& stageName, uint32_t elementCount, uint32_t workgroupSize)
+        {
+            uint32_t maxElements = k_MaxWorkgroupCount * workgroupSize;
+            if (elementCount == 0 || elementCount > maxElements)
+            {
+                MAGMA_LOG_ERROR("[StageFactory] Primitive '{}' covers 1 to {} elements, not {}", stageName, maxElements, elementCount);
+            }
+            return std::clamp(elementCount, 1u, maxElements);
+        }
+
+        StorageBufferBinding MakePrimitiveBinding(const String& bufferName, uint32_t binding, VkDeviceSize size, bool clearEachFrame = false)
+        {
+            return StorageBufferBinding{
+                .bufferName = bufferName,
+                .binding = binding,
+                .shaderStages = VK_SHADER_STAGE_COMPUTE_BIT,
+                .size = size,
+                .clearEachFrame = clearEachFrame
+            };
+        }
+
+        VkDeviceSize GetElementBytes(uint32_t elementCount)
+        {
+            return static_cast<VkDeviceSize>(elementCount) * sizeof(uint32_t);
+        }
+
+        std::unique_ptr<RenderStage> CreatePrimitiveStage(
+            const String& stageName,
+            const String& shaderName,
+            const ComputePrimitiveInfo& primitive,
+            const Vector<StorageBufferBinding>& inputs,
+            const Vector<StorageBufferBinding>& outputs,
+            uint32_t workgroupSize,
+            uint32_t invocationCount,
+            const PrimitiveConstants& constants,
+            const ComputePrimitiveSettings& settings)
+        {
+            StageConfiguration config;
+            config.name = stageName;
+            config.type = PipelineType::COMPUTE;
+            config.shaders.push_back({
+                .stage = ShaderStage::COMPUTE,
+                .path = settings.shaderDirectory + shaderName
+            });
+
+            config.inputStorageBuffers = inputs;
+            config.outputStorageBuffers = outputs;
+
+            ComputeConfig computeConfig;
+            computeConfig.workgroupSizeX = workgroupSize;
+            computeConfig.workgroupSizeY = 1;
+            computeConfig.workgroupSizeZ = 1;
+            computeConfig.invocationCount = invocationCount;
+
+            // Tiles and the shared memory of the shaders follow the workgroup size
+            computeConfig.tuneWorkgroupSize = false;
+            config.pipelineConfig = computeConfig;
+
+            // Nothing here depends on the render size, so the stage constants are left out
+            config.pushConstants = PushConstantConfig{
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                .offset = 0,
+                .size = sizeof(PrimitiveConstants)
+            };
+            config.primitive = primitive;
+
+            auto stage = std::make_unique<RenderStage>(config);
+            stage->SetPushConstantData(&constants, sizeof(constants));
+            return stage;
+        }
+    }
+
     std::unique_ptr<RenderStage> StageFactory::CreateComputeStage(
         const String& stageName,
         const String& shaderPath,
@@ -24,7 +154,8 @@ namespace Magma
             .bufferName = outputBufferName,
             .binding = 0,
             .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-            .shaderStages = VK_SHADER_STAGE_COMPUTE_BIT
+            .shaderStages = VK_SHADER_STAGE_COMPUTE_BIT,
+            .perFrame = true
         });
 
         // Set compute configuration
@@ -33,6 +164,7 @@ namespace Magma
         computeConfig.workgroupSizeY = workgroupSizeY;
         computeConfig.workgroupSizeZ = 1;
         config.pipelineConfig = computeConfig;
+        config.useStagePushConstants = true;
 
         return std::make_unique<RenderStage>(config);
     }
@@ -57,6 +189,39 @@ namespace Magma
         config.inputBuffers = inputs;
         config.outputBuffers = outputs;
         config.pipelineConfig = computeConfig;
+        config.useStagePushConstants = true;
+
+        return std::make_unique<RenderStage>(config);
+    }
+
+    std::unique_ptr<RenderStage> StageFactory::CreateIndirectComputeStage(
+        const String& stageName,
+        const String& shaderPath,
+        const Vector<BufferBinding>& inputs,
+        const Vector<BufferBinding>& outputs,
+        const Vector<StorageBufferBinding>& storageInputs,
+        const String& indirectArgsBuffer,
+        VkDeviceSize indirectArgsOffset,
+        const ComputeConfig& computeConfig)
+    {
+        StageConfiguration config;
+        config.name = stageName;
+        config.type = PipelineType::COMPUTE;
+
+        config.shaders.push_back({
+            .stage = ShaderStage::COMPUTE,
+            .path = shaderPath
+        });
+
+        config.inputBuffers = inputs;
+        config.outputBuffers = outputs;
+        config.inputStorageBuffers = storageInputs;
+
+        ComputeConfig indirectConfig = computeConfig;
+        indirectConfig.indirectArgsBuffer = indirectArgsBuffer;
+        indirectConfig.indirectArgsOffset = indirectArgsOffset;
+        config.pipelineConfig = indirectConfig;
+        config.useStagePushConstants = true;
 
         return std::make_unique<RenderStage>(config);
     }
@@ -88,17 +253,500 @@ namespace Magma
             .bufferName = outputBufferName,
             .binding = 0,
             .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-            .shaderStages = VK_SHADER_STAGE_FRAGMENT_BIT
+            .shaderStages = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .perFrame = true
         });
 
         // Set graphics configuration
         GraphicsConfig graphicsConfig;
         graphicsConfig.colorAttachmentFormat = colorFormat;
         config.pipelineConfig = graphicsConfig;
+        config.useStagePushConstants = true;
 
         return std::make_unique<RenderStage>(config);
     }
 
+    Vector<std::unique_ptr<RenderStage>> StageFactory::CreateUpscaleStages(
+        const String& stageName,
+        const String& inputBufferName,
+        const String& outputBufferName,
+        const UpscalerSettings& settings)
+    {
+        String upsampledBufferName = stageName + "Upsampled";
+
+        auto makeBinding = [](const String& bufferName, uint32_t binding, bool perFrame = false) {
+            return BufferBinding{
+                .bufferName = bufferName,
+                .binding = binding,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                .shaderStages = VK_SHADER_STAGE_COMPUTE_BIT,
+                .perFrame = perFrame
+            };
+        };
+
+        ComputeConfig computeConfig;
+        computeConfig.workgroupSizeX = 16;
+        computeConfig.workgroupSizeY = 16;
+        computeConfig.workgroupSizeZ = 1;
+
+        // Neighbourhood reads, keep nearby workgroups in flight together
+        computeConfig.swizzle = DispatchSwizzle::TILE_STRIPS;
+
+        StageConfiguration upsampleConfig;
+        upsampleConfig.name = stageName + "Upsample";
+        upsampleConfig.type = PipelineType::COMPUTE;
+        upsampleConfig.shaders.push_back({
+            .stage = ShaderStage::COMPUTE,
+            .path = settings.upsampleShaderPath
+        });
+        upsampleConfig.inputBuffers.push_back(makeBinding(inputBufferName, 0));
+        upsampleConfig.outputBuffers.push_back(makeBinding(upsampledBufferName, 1, true));
+        upsampleConfig.pipelineConfig = computeConfig;
+        upsampleConfig.useStagePushConstants = true;
+        upsampleConfig.resolution = StageResolution::DISPLAY;
+
+        StageConfiguration sharpenConfig;
+        sharpenConfig.name = stageName + "Sharpen";
+        sharpenConfig.type = PipelineType::COMPUTE;
+        sharpenConfig.shaders.push_back({
+            .stage = ShaderStage::COMPUTE,
+            .path = settings.sharpenShaderPath
+        });
+        sharpenConfig.inputBuffers.push_back(makeBinding(upsampledBufferName, 0));
+        sharpenConfig.outputBuffers.push_back(makeBinding(outputBufferName, 1, true));
+        sharpenConfig.pipelineConfig = computeConfig;
+        sharpenConfig.useStagePushConstants = true;
+        sharpenConfig.resolution = StageResolution::DISPLAY;
+
+        // The sharpness follows the stage constants
+        sharpenConfig.pushConstants = PushConstantConfig{
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .offset = sizeof(StagePushConstants),
+            .size = sizeof(float)
+        };
+
+        auto sharpenStage = std::make_unique<RenderStage>(sharpenConfig);
+        float sharpness = std::clamp(settings.sharpness, 0.0f, 1.0f);
+        sharpenStage->SetPushConstantData(&sharpness, sizeof(sharpness));
+
+        Vector<std::unique_ptr<RenderStage>> stages;
+        stages.push_back(std::make_unique<RenderStage>(upsampleConfig));
+        stages.push_back(std::move(sharpenStage));
+        return stages;
+    }
+
+    std::unique_ptr<RenderStage> StageFactory::CreateTemporalAccumulateStage(
+        const String& stageName,
+        const String& inputBufferName,
+        const String& outputBufferName,
+        const TemporalAccumulateSettings& settings)
+    {
+        String historyBufferName = stageName + "History";
+
+        auto makeBinding = [](const String& bufferName, uint32_t binding, bool perFrame = false) {
+            return BufferBinding{
+                .bufferName = bufferName,
+                .binding = binding,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                .shaderStages = VK_SHADER_STAGE_COMPUTE_BIT,
+                .perFrame = perFrame
+            };
+        };
+
+        StageConfiguration config;
+        config.name = stageName;
+        config.type = PipelineType::COMPUTE;
+        config.shaders.push_back({
+            .stage = ShaderStage::COMPUTE,
+            .path = settings.shaderPath
+        });
+
+        // The history is kept apart from the output, so later stages can modify the output freely
+        config.inputBuffers.push_back(makeBinding(inputBufferName, 0));
+        config.inputBuffers.push_back(makeBinding(HistoryBufferName(historyBufferName), 1));
+        config.outputBuffers.push_back(makeBinding(outputBufferName, 2, true));
+        config.outputBuffers.push_back(makeBinding(historyBufferName, 3));
+
+        ComputeConfig computeConfig;
+        computeConfig.workgroupSizeX = 16;
+        computeConfig.workgroupSizeY = 16;
+        computeConfig.workgroupSizeZ = 1;
+
+        // Neighbourhood reads, keep nearby workgroups in flight together
+        computeConfig.swizzle = DispatchSwizzle::TILE_STRIPS;
+        config.pipelineConfig = computeConfig;
+        config.useStagePushConstants = true;
+
+        config.pushConstants = PushConstantConfig{
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .offset = sizeof(StagePushConstants),
+            .size = sizeof(TemporalAccumulateConstants)
+        };
+
+        TemporalAccumulateConstants constants{
+            .currentFrameWeight = std::clamp(settings.currentFrameWeight, 0.01f, 1.0f),
+            .clampHistory = settings.clampHistory ? 1u : 0u
+        };
+
+        auto stage = std::make_unique<RenderStage>(config);
+        stage->SetPushConstantData(&constants, sizeof(constants));
+        return stage;
+    }
+
+    std::unique_ptr<RenderStage> StageFactory::CreatePixelStage(
+        const String& stageName,
+        const String& inputBufferName,
+        const String& outputBufferName,
+        const Vector<PixelOperation>& operations,
+        const String& shaderPath)
+    {
+        StageConfiguration config;
+        config.name = stageName;
+        config.type = PipelineType::COMPUTE;
+        config.shaders.push_back({
+            .stage = ShaderStage::COMPUTE,
+            .path = shaderPath
+        });
+
+        config.inputBuffers.push_back({
+            .bufferName = inputBufferName,
+            .binding = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .shaderStages = VK_SHADER_STAGE_COMPUTE_BIT
+        });
+        config.outputBuffers.push_back({
+            .bufferName = outputBufferName,
+            .binding = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .shaderStages = VK_SHADER_STAGE_COMPUTE_BIT,
+            .perFrame = true
+        });
+
+        ComputeConfig computeConfig;
+        computeConfig.workgroupSizeX = 16;
+        computeConfig.workgroupSizeY = 16;
+        computeConfig.workgroupSizeZ = 1;
+        config.pipelineConfig = computeConfig;
+        config.useStagePushConstants = true;
+
+        config.pushConstants = PushConstantConfig{
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .offset = sizeof(StagePushConstants),
+            .size = sizeof(PixelChainConstants)
+        };
+
+        config.pixelOperations = operations;
+        if (config.pixelOperations.size() > k_MaxPixelOperations)
+        {
+            MAGMA_LOG_ERROR("[StageFactory] Pixel stage '{}' has {} operations, only the first {} run",
+                stageName, config.pixelOperations.size(), k_MaxPixelOperations);
+            config.pixelOperations.resize(k_MaxPixelOperations);
+        }
+
+        PixelChainConstants constants{};
+        constants.operationCount = static_cast<uint32_t>(config.pixelOperations.size());
+        for (uint32_t i = 0; i < constants.operationCount; i++)
+        {
+            const PixelOperation& operation = config.pixelOperations[i];
+            constants.operations[i][0] = static_cast<float>(operation.type);
+            constants.operations[i][1] = operation.params[0];
+            constants.operations[i][2] = operation.params[1];
+            constants.operations[i][3] = operation.params[2];
+        }
+
+        auto stage = std::make_unique<RenderStage>(config);
+        stage->SetPushConstantData(&constants, sizeof(constants));
+        return stage;
+    }
+
+    std::unique_ptr<RenderStage> StageFactory::CreateRandomFillStage(
+        const String& stageName,
+        const String& outputBufferName,
+        uint32_t elementCount,
+        uint32_t seed,
+        uint32_t valueMask,
+        const ComputePrimitiveSettings& settings)
+    {
+        uint32_t workgroupSize = GetPrimitiveWorkgroupSize(settings);
+        elementCount = ClampElementCount(stageName, elementCount, workgroupSize);
+
+        PrimitiveConstants constants;
+        constants.elementCount = elementCount;
+        constants.seed = seed;
+        constants.valueMask = valueMask;
+
+        ComputePrimitiveInfo primitive{ ComputePrimitive::RANDOM_FILL, stageName, elementCount };
+        primitive.bufferNames = { outputBufferName };
+        primitive.seed = seed;
+        primitive.valueMask = valueMask;
+
+        return CreatePrimitiveStage(stageName, "RandomFill.comp.spv", primitive,
+            {},
+            { MakePrimitiveBinding(outputBufferName, 0, GetElementBytes(elementCount)) },
+            workgroupSize, elementCount, constants, settings);
+    }
+
+    Vector<std::unique_ptr<RenderStage>> StageFactory::CreateReduceStages(
+        const String& stageName,
+        const String& inputBufferName,
+        const String& outputBufferName,
+        uint32_t elementCount,
+        ReduceOperation operation,
+        const ComputePrimitiveSettings& settings)
+    {
+        uint32_t workgroupSize = GetPrimitiveWorkgroupSize(settings);
+        elementCount = ClampElementCount(stageName, elementCount, workgroupSize);
+
+        ComputePrimitiveInfo primitive{ ComputePrimitive::REDUCE, stageName, elementCount };
+        primitive.bufferNames = { inputBufferName, outputBufferName };
+        primitive.parameter = static_cast<uint32_t>(operation);
+        uint32_t blockCount = (elementCount + workgroupSize - 1) / workgroupSize;
+        uint32_t partialCount = std::clamp(settings.maxStridedWorkgroups, 1u, blockCount);
+
+        PrimitiveConstants constants;
+        constants.elementCount = elementCount;
+        constants.parameter = static_cast<uint32_t>(operation);
+
+        Vector<std::unique_ptr<RenderStage>> stages;
+        if (partialCount == 1)
+        {
+            stages.push_back(CreatePrimitiveStage(stageName, "Reduce.comp.spv", primitive,
+                { MakePrimitiveBinding(inputBufferName, 0, GetElementBytes(elementCount)) },
+                { MakePrimitiveBinding(outputBufferName, 1, GetElementBytes(1)) },
+                workgroupSize, workgroupSize, constants, settings));
+            return stages;
+        }
+
+        // One value per workgroup, then one workgroup over those
+        String partialBufferName = stageName + "Partials";
+        stages.push_back(CreatePrimitiveStage(stageName + "Partial", "Reduce.comp.spv", primitive,
+            { MakePrimitiveBinding(inputBufferName, 0, GetElementBytes(elementCount)) },
+            { MakePrimitiveBinding(partialBufferName, 1, GetElementBytes(partialCount)) },
+            workgroupSize, partialCount * workgroupSize, constants, settings));
+
+        // Counts add up
+        PrimitiveConstants finalConstants;
+        finalConstants.elementCount = partialCount;
+        finalConstants.parameter = static_cast<uint32_t>(
+            operation == ReduceOperation::COUNT_NONZERO ? ReduceOperation::SUM : operation);
+
+        stages.push_back(CreatePrimitiveStage(stageName + "Final", "Reduce.comp.spv", primitive,
+            { MakePrimitiveBinding(partialBufferName, 0, GetElementBytes(partialCount)) },
+            { MakePrimitiveBinding(outputBufferName, 1, GetElementBytes(1)) },
+            workgroupSize, workgroupSize, finalConstants, settings));
+        return stages;
+    }
+
+    Vector<std::unique_ptr<RenderStage>> StageFactory::CreateExclusiveScanStages(
+        const String& stageName,
+        const String& inputBufferName,
+        const String& outputBufferName,
+        uint32_t elementCount,
+        const ComputePrimitiveSettings& settings)
+    {
+        uint32_t workgroupSize = GetPrimitiveWorkgroupSize(settings);
+        elementCount = ClampElementCount(stageName, elementCount, workgroupSize);
+
+        ComputePrimitiveInfo primitive{ ComputePrimitive::EXCLUSIVE_SCAN, stageName, elementCount };
+        primitive.bufferNames = { inputBufferName, outputBufferName };
+        uint32_t blockCount = (elementCount + workgroupSize - 1) / workgroupSize;
+        String blockBufferName = stageName + "Blocks";
+
+        // Reduce-then-scan: tile totals, their scan, then each tile scanned from its offset
+        PrimitiveConstants reduceConstants;
+        reduceConstants.elementCount = elementCount;
+        reduceConstants.parameter = static_cast<uint32_t>(ReduceOperation::SUM);
+
+        PrimitiveConstants blockConstants;
+        blockConstants.elementCount = blockCount;
+
+        PrimitiveConstants scanConstants;
+        scanConstants.elementCount = elementCount;
+        scanConstants.blockCount = blockCount;
+
+        Vector<std::unique_ptr<RenderStage>> stages;
+        stages.push_back(CreatePrimitiveStage(stageName + "Reduce", "Reduce.comp.spv", primitive,
+            { MakePrimitiveBinding(inputBufferName, 0, GetElementBytes(elementCount)) },
+            { MakePrimitiveBinding(blockBufferName, 1, GetElementBytes(blockCount)) },
+            workgroupSize, elementCount, reduceConstants, settings));
+        stages.push_back(CreatePrimitiveStage(stageName + "ScanBlocks", "ScanBlocks.comp.spv", primitive,
+            {},
+            {
+                MakePrimitiveBinding(blockBufferName, 0, GetElementBytes(blockCount)),
+                MakePrimitiveBinding(stageName + "Total", 1, k_ScanSummarySize)
+            },
+            workgroupSize, workgroupSize, blockConstants, settings));
+        stages.push_back(CreatePrimitiveStage(stageName + "Downsweep", "Scan.comp.spv", primitive,
+            {
+                MakePrimitiveBinding(inputBufferName, 0, GetElementBytes(elementCount)),
+                MakePrimitiveBinding(blockBufferName, 1, GetElementBytes(blockCount))
+            },
+            { MakePrimitiveBinding(outputBufferName, 2, GetElementBytes(elementCount)) },
+            workgroupSize, elementCount, scanConstants, settings));
+        return stages;
+    }
+
+    Vector<std::unique_ptr<RenderStage>> StageFactory::CreateCompactStages(
+        const String& stageName,
+        const String& inputBufferName,
+        const String& flagBufferName,
+        const String& outputBufferName,
+        const String& countBufferName,
+        uint32_t elementCount,
+        const ComputePrimitiveSettings& settings)
+    {
+        uint32_t workgroupSize = GetPrimitiveWorkgroupSize(settings);
+        elementCount = ClampElementCount(stageName, elementCount, workgroupSize);
+
+        ComputePrimitiveInfo primitive{ ComputePrimitive::COMPACT, stageName, elementCount };
+        primitive.bufferNames = { inputBufferName, flagBufferName, outputBufferName, countBufferName };
+        uint32_t blockCount = (elementCount + workgroupSize - 1) / workgroupSize;
+        String blockBufferName = stageName + "Blocks";
+
+        // The kept values per tile, scanned into each tile's first output slot
+        PrimitiveConstants countConstants;
+        countConstants.elementCount = elementCount;
+        countConstants.parameter = static_cast<uint32_t>(ReduceOperation::COUNT_NONZERO);
+
+        PrimitiveConstants blockConstants;
+        blockConstants.elementCount = blockCount;
+        blockConstants.parameter = std::max(settings.indirectWorkgroupSize, 1u);
+
+        PrimitiveConstants scatterConstants;
+        scatterConstants.elementCount = elementCount;
+        scatterConstants.blockCount = blockCount;
+
+        Vector<std::unique_ptr<RenderStage>> stages;
+        stages.push_back(CreatePrimitiveStage(stageName + "Count", "Reduce.comp.spv", primitive,
+            { MakePrimitiveBinding(flagBufferName, 0, GetElementBytes(elementCount)) },
+            { MakePrimitiveBinding(blockBufferName, 1, GetElementBytes(blockCount)) },
+            workgroupSize, elementCount, countConstants, settings));
+        stages.push_back(CreatePrimitiveStage(stageName + "ScanBlocks", "ScanBlocks.comp.spv", primitive,
+            {},
+            {
+                MakePrimitiveBinding(blockBufferName, 0, GetElementBytes(blockCount)),
+                MakePrimitiveBinding(countBufferName, 1, k_ScanSummarySize)
+            },
+            workgroupSize, workgroupSize, blockConstants, settings));
+        stages.push_back(CreatePrimitiveStage(stageName + "Scatter", "Compact.comp.spv", primitive,
+            {
+                MakePrimitiveBinding(inputBufferName, 0, GetElementBytes(elementCount)),
+                MakePrimitiveBinding(flagBufferName, 1, GetElementBytes(elementCount)),
+                MakePrimitiveBinding(blockBufferName, 2, GetElementBytes(blockCount))
+            },
+            { MakePrimitiveBinding(outputBufferName, 3, GetElementBytes(elementCount)) },
+            workgroupSize, elementCount, scatterConstants, settings));
+        return stages;
+    }
+
+    std::unique_ptr<RenderStage> StageFactory::CreateHistogramStage(
+        const String& stageName,
+        const String& inputBufferName,
+        const String& outputBufferName,
+        uint32_t elementCount,
+        uint32_t binCount,
+        uint32_t binShift,
+        const ComputePrimitiveSettings& settings)
+    {
+        uint32_t workgroupSize = GetPrimitiveWorkgroupSize(settings);
+        elementCount = ClampElementCount(stageName, elementCount, workgroupSize);
+
+        if (binCount == 0 || binCount > k_MaxHistogramBins || binShift > 31)
+        {
+            MAGMA_LOG_ERROR("[StageFactory] Histogram '{}' takes 1 to {} bins and shifts below 32, not {} and {}",
+                stageName, k_MaxHistogramBins, binCount, binShift);
+        }
+
+        PrimitiveConstants constants;
+        constants.elementCount = elementCount;
+        constants.shift = std::min(binShift, 31u);
+        constants.parameter = std::clamp(binCount, 1u, k_MaxHistogramBins);
+
+        uint32_t blockCount = (elementCount + workgroupSize - 1) / workgroupSize;
+        uint32_t workgroupCount = std::clamp(settings.maxStridedWorkgroups, 1u, blockCount);
+
+        ComputePrimitiveInfo primitive{ ComputePrimitive::HISTOGRAM, stageName, elementCount };
+        primitive.bufferNames = { inputBufferName, outputBufferName };
+        primitive.parameter = constants.parameter;
+        primitive.shift = constants.shift;
+
+        // Workgroups add their counts to the bins, which start every frame at zero
+        return CreatePrimitiveStage(stageName, "Histogram.comp.spv", primitive,
+            { MakePrimitiveBinding(inputBufferName, 0, GetElementBytes(elementCount)) },
+            { MakePrimitiveBinding(outputBufferName, 1, GetElementBytes(constants.parameter), true) },
+            workgroupSize, workgroupCount * workgroupSize, constants, settings);
+    }
+
+    Vector<std::unique_ptr<RenderStage>> StageFactory::CreateRadixSortStages(
+        const String& stageName,
+        const String& keyBufferName,
+        const String& valueBufferName,
+        uint32_t elementCount,
+        uint32_t keyBits,
+        const ComputePrimitiveSettings& settings)
+    {
+        uint32_t workgroupSize = GetPrimitiveWorkgroupSize(settings);
+        elementCount = ClampElementCount(stageName, elementCount, workgroupSize);
+
+        ComputePrimitiveInfo primitive{ ComputePrimitive::RADIX_SORT, stageName, elementCount };
+        primitive.bufferNames = { keyBufferName, valueBufferName };
+        primitive.parameter = std::clamp(keyBits, 1u, 32u);
+        uint32_t blockCount = (elementCount + workgroupSize - 1) / workgroupSize;
+        uint32_t countCount = k_RadixDigits * blockCount;
+
+        // Passes alternate between the buffers and the scratch copies, an even count ends in the buffers
+        uint32_t passCount = (std::clamp(keyBits, 1u, 32u) + k_RadixBits - 1) / k_RadixBits;
+        passCount += passCount % 2;
+
+        const String buffers[2][2] = {
+            { keyBufferName, valueBufferName },
+            { stageName + "ScratchKeys", stageName + "ScratchValues" }
+        };
+        String countBufferName = stageName + "Counts";
+        VkDeviceSize elementBytes = GetElementBytes(elementCount);
+
+        Vector<std::unique_ptr<RenderStage>> stages;
+        for (uint32_t pass = 0; pass < passCount; pass++)
+        {
+            const String* source = buffers[pass % 2];
+            const String* destination = buffers[(pass + 1) % 2];
+            String passName = std::to_string(pass);
+
+            PrimitiveConstants constants;
+            constants.elementCount = elementCount;
+            constants.blockCount = blockCount;
+            constants.shift = pass * k_RadixBits;
+
+            PrimitiveConstants countConstants;
+            countConstants.elementCount = countCount;
+
+            stages.push_back(CreatePrimitiveStage(stageName + "Count" + passName, "RadixCount.comp.spv", primitive,
+                { MakePrimitiveBinding(source[0], 0, elementBytes) },
+                { MakePrimitiveBinding(countBufferName, 1, GetElementBytes(countCount)) },
+                workgroupSize, elementCount, constants, settings));
+            stages.push_back(CreatePrimitiveStage(stageName + "ScanCounts" + passName, "ScanBlocks.comp.spv", primitive,
+                {},
+                {
+                    MakePrimitiveBinding(countBufferName, 0, GetElementBytes(countCount)),
+                    MakePrimitiveBinding(stageName + "Total", 1, k_ScanSummarySize)
+                },
+                workgroupSize, workgroupSize, countConstants, settings));
+            stages.push_back(CreatePrimitiveStage(stageName + "Scatter" + passName, "RadixScatter.comp.spv", primitive,
+                {
+                    MakePrimitiveBinding(source[0], 0, elementBytes),
+                    MakePrimitiveBinding(source[1], 1, elementBytes),
+                    MakePrimitiveBinding(countBufferName, 2, GetElementBytes(countCount))
+                },
+                {
+                    MakePrimitiveBinding(destination[0], 3, elementBytes),
+                    MakePrimitiveBinding(destination[1], 4, elementBytes)
+                },
+                workgroupSize, elementCount, constants, settings));
+        }
+
+        return stages;
+    }
+
     std::unique_ptr<RenderStage> StageFactory::CreateFromConfiguration(
         const StageConfiguration& config)
     {
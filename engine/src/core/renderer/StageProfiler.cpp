@@ -0,0 +1,216 @@
+#include <magma_engine/core/renderer/StageProfiler.h>
+#include <logging/Logger.h>
+#include <algorithm>
+
+namespace Magma
+{
+    namespace
+    {
+        // Results are written in bit order of the enabled flags
+        constexpr VkQueryPipelineStatisticFlags k_statisticFlags =
+            VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+        constexpr uint32_t k_statisticCount = 4;
+    }
+
+    void StageProfiler::Initialize(VkDevice device, uint32_t framesInFlight, uint32_t maxStages, const StageProfilerSettings& settings)
+    {
+        m_device = device;
+        m_settings = settings;
+        m_framesInFlight = framesInFlight;
+        m_maxStages = maxStages;
+
+        m_recordedStages.assign(framesInFlight, 0);
+        m_stageStats.assign(maxStages, StageGpuStats{});
+
+        if (maxStages == 0 || !IsEnabled())
+        {
+            return;
+        }
+
+        if (m_settings.enableTimestamps)
+        {
+            VkQueryPoolCreateInfo poolInfo{};
+            poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            poolInfo.queryCount = framesInFlight * maxStages * 2;
+
+            VK_CHECK(vkCreateQueryPool(m_device, &poolInfo, nullptr, &m_timestampPool));
+        }
+
+        if (m_settings.enablePipelineStatistics)
+        {
+            VkQueryPoolCreateInfo poolInfo{};
+            poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+            poolInfo.queryCount = framesInFlight * maxStages;
+            poolInfo.pipelineStatistics = k_statisticFlags;
+
+            VK_CHECK(vkCreateQueryPool(m_device, &poolInfo, nullptr, &m_statisticsPool));
+        }
+
+        MAGMA_LOG_INFO("[StageProfiler] Initialized for {} stage(s) (timestamps: {}, pipeline statistics: {})",
+            maxStages, m_settings.enableTimestamps, m_settings.enablePipelineStatistics);
+    }
+
+    void StageProfiler::Cleanup()
+    {
+        if (m_timestampPool != VK_NULL_HANDLE)
+        {
+            vkDestroyQueryPool(m_device, m_timestampPool, nullptr);
+            m_timestampPool = VK_NULL_HANDLE;
+        }
+
+        if (m_statisticsPool != VK_NULL_HANDLE)
+        {
+            vkDestroyQueryPool(m_device, m_statisticsPool, nullptr);
+            m_statisticsPool = VK_NULL_HANDLE;
+        }
+
+        m_recordedStages.clear();
+        m_stageStats.clear();
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool StageProfiler::BeginFrame(VkCommandBuffer cmd, uint32_t frameIndex)
+    {
+        m_currentFrameIndex = frameIndex % std::max(m_framesInFlight, 1u);
+
+        if (!IsEnabled() || m_maxStages == 0)
+        {
+            return false;
+        }
+
+        bool hasResults = m_recordedStages[m_currentFrameIndex] > 0;
+        if (hasResults)
+        {
+            CollectResults(m_currentFrameIndex);
+        }
+
+        if (m_timestampPool != VK_NULL_HANDLE)
+        {
+            vkCmdResetQueryPool(cmd, m_timestampPool, m_currentFrameIndex * m_maxStages * 2, m_maxStages * 2);
+        }
+
+        if (m_statisticsPool != VK_NULL_HANDLE)
+        {
+            vkCmdResetQueryPool(cmd, m_statisticsPool, m_currentFrameIndex * m_maxStages, m_maxStages);
+        }
+
+        m_recordedStages[m_currentFrameIndex] = 0;
+        return hasResults;
+    }
+
+    void StageProfiler::BeginStage(VkCommandBuffer cmd, uint32_t stageIndex)
+    {
+        if (stageIndex >= m_maxStages)
+        {
+            return;
+        }
+
+        if (m_timestampPool != VK_NULL_HANDLE)
+        {
+            uint32_t query = (m_currentFrameIndex * m_maxStages + stageIndex) * 2;
+            vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_timestampPool, query);
+        }
+
+        if (m_statisticsPool != VK_NULL_HANDLE)
+        {
+            vkCmdBeginQuery(cmd, m_statisticsPool, m_currentFrameIndex * m_maxStages + stageIndex, 0);
+        }
+    }
+
+    void StageProfiler::EndStage(VkCommandBuffer cmd, uint32_t stageIndex)
+    {
+        if (stageIndex >= m_maxStages)
+        {
+            return;
+        }
+
+        if (m_statisticsPool != VK_NULL_HANDLE)
+        {
+            vkCmdEndQuery(cmd, m_statisticsPool, m_currentFrameIndex * m_maxStages + stageIndex);
+        }
+
+        if (m_timestampPool != VK_NULL_HANDLE)
+        {
+            uint32_t query = (m_currentFrameIndex * m_maxStages + stageIndex) * 2 + 1;
+            vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampPool, query);
+        }
+
+        m_recordedStages[m_currentFrameIndex] = std::max(m_recordedStages[m_currentFrameIndex], stageIndex + 1);
+    }
+
+    void StageProfiler::CollectResults(uint32_t frameIndex)
+    {
+        uint32_t stageCount = m_recordedStages[frameIndex];
+
+        Vector<uint64_t> timestamps(stageCount * 2, 0);
+        Vector<uint64_t> statistics(stageCount * k_statisticCount, 0);
+
+        bool timestampsReady = false;
+        bool statisticsReady = false;
+
+        // The frame fence has already been waited on, so no WAIT flag is needed
+        if (m_timestampPool != VK_NULL_HANDLE)
+        {
+            VkResult result = vkGetQueryPoolResults(m_device, m_timestampPool,
+                frameIndex * m_maxStages * 2, stageCount * 2,
+                timestamps.size() * sizeof(uint64_t), timestamps.data(),
+                sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+            timestampsReady = result == VK_SUCCESS;
+        }
+
+        if (m_statisticsPool != VK_NULL_HANDLE)
+        {
+            VkResult result = vkGetQueryPoolResults(m_device, m_statisticsPool,
+                frameIndex * m_maxStages, stageCount,
+                statistics.size() * sizeof(uint64_t), statistics.data(),
+                k_statisticCount * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+            statisticsReady = result == VK_SUCCESS;
+        }
+
+        m_totalGpuTimeMs = 0.0;
+        m_frameGpuTimeMs = 0.0;
+        uint64_t frameBegin = timestampsReady && stageCount > 0 ? timestamps[0] : 0;
+        uint64_t latestEnd = frameBegin;
+
+        for (uint32_t i = 0; i < stageCount; i++)
+        {
+            StageGpuStats& stats = m_stageStats[i];
+            stats.valid = timestampsReady || statisticsReady;
+
+            if (timestampsReady)
+            {
+                uint64_t begin = timestamps[i * 2];
+                uint64_t end = timestamps[i * 2 + 1];
+                double ticks = end > begin ? static_cast<double>(end - begin) : 0.0;
+                stats.gpuTimeMs = ticks * m_settings.timestampPeriod / 1000000.0;
+                stats.gpuStartOffsetMs = begin > frameBegin
+                    ? static_cast<double>(begin - frameBegin) * m_settings.timestampPeriod / 1000000.0
+                    : 0.0;
+
+                uint64_t overlapEnd = std::min(end, latestEnd);
+                stats.gpuOverlapMs = overlapEnd > begin
+                    ? static_cast<double>(overlapEnd - begin) * m_settings.timestampPeriod / 1000000.0
+                    : 0.0;
+                latestEnd = std::max(latestEnd, end);
+
+                m_totalGpuTimeMs += stats.gpuTimeMs;
+                m_frameGpuTimeMs = static_cast<double>(latestEnd - frameBegin) * m_settings.timestampPeriod / 1000000.0;
+            }
+
+            if (statisticsReady)
+            {
+                const uint64_t* counters = &statistics[i * k_statisticCount];
+                stats.inputAssemblyPrimitives = counters[0];
+                stats.clippingPrimitives = counters[1];
+                stats.fragmentShaderInvocations = counters[2];
+                stats.computeShaderInvocations = counters[3];
+            }
+        }
+    }
+}
@@ -0,0 +1,227 @@
+#include <magma_engine/core/renderer/StageSynchronizer.h>
+#include <magma_engine/core/renderer/VkUtils.h>
+#include <logging/Logger.h>
+#include <algorithm>
+
+namespace Magma
+{
+    void StageSynchronizer::Initialize(VkDevice device, uint32_t framesInFlight, const Vector<StageAccess>& stages,
+        bool barrierBeforeFirstStage, const StageSynchronizerSettings& settings)
+    {
+        m_device = device;
+        m_settings = settings;
+
+        // Same scopes as vkutil::shader_write_barrier()
+        VkPipelineStageFlags2 shaderStages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT |
+            VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT |
+            VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+
+        m_eventBarrier = {};
+        m_eventBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+        m_eventBarrier.srcStageMask = shaderStages;
+        m_eventBarrier.srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+        m_eventBarrier.dstStageMask = shaderStages;
+        m_eventBarrier.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT |
+            VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+
+        // Set and wait have to pass the same dependency, so every event covers indirect arguments
+        // as soon as one stage dispatches indirectly
+        bool indirectArgs = std::any_of(stages.begin(), stages.end(), [](const StageAccess& stage) { return stage.readsIndirectArgs; });
+        if (indirectArgs)
+        {
+            m_eventBarrier.dstStageMask |= VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT;
+            m_eventBarrier.dstAccessMask |= VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT;
+        }
+
+        bool useEvents = m_settings.enableSplitBarriers && m_settings.cmdSetEvent2 && m_settings.cmdWaitEvents2;
+        CompileStages(stages, barrierBeforeFirstStage, useEvents);
+
+        m_events.assign(framesInFlight, {});
+        for (Vector<VkEvent>& events : m_events)
+        {
+            events.resize(m_eventCount, VK_NULL_HANDLE);
+            for (VkEvent& event : events)
+            {
+                VkEventCreateInfo eventInfo{};
+                eventInfo.sType = VK_STRUCTURE_TYPE_EVENT_CREATE_INFO;
+
+                VK_CHECK(vkCreateEvent(m_device, &eventInfo, nullptr, &event));
+            }
+        }
+
+        MAGMA_LOG_INFO("[StageSynchronizer] {} stage(s): {} pipeline barrier(s), {} split barrier(s){}",
+            stages.size(), m_pipelineBarrierCount, m_splitBarrierCount, useEvents ? "" : " (split barriers unavailable)");
+    }
+
+    void StageSynchronizer::Cleanup()
+    {
+        for (Vector<VkEvent>& events : m_events)
+        {
+            for (VkEvent event : events)
+            {
+                vkDestroyEvent(m_device, event, nullptr);
+            }
+        }
+
+        m_events.clear();
+        m_stages.clear();
+        m_eventCount = 0;
+        m_pipelineBarrierCount = 0;
+        m_splitBarrierCount = 0;
+        m_device = VK_NULL_HANDLE;
+    }
+
+    void StageSynchronizer::BeginFrame(uint32_t frameIndex)
+    {
+        m_currentFrameIndex = frameIndex % std::max(static_cast<uint32_t>(m_events.size()), 1u);
+
+        if (m_events.empty())
+        {
+            return;
+        }
+
+        // Events are set once per frame, the slot's last frame has completed
+        for (VkEvent event : m_events[m_currentFrameIndex])
+        {
+            VK_CHECK(vkResetEvent(m_device, event));
+        }
+    }
+
+    void StageSynchronizer::BeforeStage(VkCommandBuffer cmd, uint32_t stageIndex)
+    {
+        if (stageIndex >= m_stages.size())
+        {
+            return;
+        }
+
+        const StageSync& sync = m_stages[stageIndex];
+        if (sync.pipelineBarrier)
+        {
+            vkutil::shader_write_barrier(cmd, sync.indirectArgs);
+        }
+
+        if (sync.waitEvent)
+        {
+            VkEvent event = m_events[m_currentFrameIndex][*sync.waitEvent];
+            VkDependencyInfo dependency = GetEventDependency();
+            m_settings.cmdWaitEvents2(cmd, 1, &event, &dependency);
+        }
+    }
+
+    void StageSynchronizer::AfterStage(VkCommandBuffer cmd, uint32_t stageIndex)
+    {
+        if (stageIndex >= m_stages.size() || !m_stages[stageIndex].signalEvent)
+        {
+            return;
+        }
+
+        // The wait must pass the same dependency the event was set with
+        VkDependencyInfo dependency = GetEventDependency();
+        m_settings.cmdSetEvent2(cmd, m_events[m_currentFrameIndex][*m_stages[stageIndex].signalEvent], &dependency);
+    }
+
+    void StageSynchronizer::CompileStages(const Vector<StageAccess>& stages, bool barrierBeforeFirstStage, bool useEvents)
+    {
+        m_stages.assign(stages.size(), StageSync{});
+        m_eventCount = 0;
+        m_pipelineBarrierCount = 0;
+        m_splitBarrierCount = 0;
+
+        Map<String, uint32_t> lastWriter;
+        Map<String, Vector<uint32_t>> readersSinceWrite;
+
+        // Stages below this index are already ordered before the stage being compiled
+        uint32_t orderedBefore = 0;
+
+        for (uint32_t i = 0; i < stages.size(); i++)
+        {
+            StageSync& sync = m_stages[i];
+            sync.indirectArgs = stages[i].readsIndirectArgs;
+
+            if (i == 0 && barrierBeforeFirstStage)
+            {
+                sync.pipelineBarrier = true;
+                m_pipelineBarrierCount++;
+            }
+
+            // Read after write, write after write and write after read
+            std::optional<uint32_t> latestDependency;
+            auto depend = [&](uint32_t producer) {
+                if (producer != i && producer >= orderedBefore)
+                {
+                    latestDependency = std::max(latestDependency.value_or(producer), producer);
+                }
+            };
+
+            for (const String& buffer : stages[i].reads)
+            {
+                auto writer = lastWriter.find(buffer);
+                if (writer != lastWriter.end())
+                {
+                    depend(writer->second);
+                }
+            }
+
+            for (const String& buffer : stages[i].writes)
+            {
+                auto writer = lastWriter.find(buffer);
+                if (writer != lastWriter.end())
+                {
+                    depend(writer->second);
+                }
+
+                for (uint32_t reader : readersSinceWrite[buffer])
+                {
+                    depend(reader);
+                }
+            }
+
+            if (latestDependency)
+            {
+                uint32_t producer = *latestDependency;
+                if (!useEvents || producer + 1 == i)
+                {
+                    // Nothing to overlap with
+                    if (!sync.pipelineBarrier)
+                    {
+                        sync.pipelineBarrier = true;
+                        m_pipelineBarrierCount++;
+                    }
+                    orderedBefore = i;
+                }
+                else
+                {
+                    StageSync& producerSync = m_stages[producer];
+                    if (!producerSync.signalEvent)
+                    {
+                        producerSync.signalEvent = m_eventCount++;
+                    }
+
+                    sync.waitEvent = producerSync.signalEvent;
+                    orderedBefore = producer + 1;
+                    m_splitBarrierCount++;
+                }
+            }
+
+            for (const String& buffer : stages[i].reads)
+            {
+                readersSinceWrite[buffer].push_back(i);
+            }
+
+            for (const String& buffer : stages[i].writes)
+            {
+                lastWriter[buffer] = i;
+                readersSinceWrite[buffer].clear();
+            }
+        }
+    }
+
+    VkDependencyInfo StageSynchronizer::GetEventDependency() const
+    {
+        VkDependencyInfo dependency{};
+        dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependency.memoryBarrierCount = 1;
+        dependency.pMemoryBarriers = &m_eventBarrier;
+        return dependency;
+    }
+}
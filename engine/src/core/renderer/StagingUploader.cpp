@@ -0,0 +1,473 @@
+#include <magma_engine/core/renderer/StagingUploader.h>
+#include <magma_engine/core/renderer/VkInitializers.h>
+#include <magma_engine/core/renderer/VkUtils.h>
+#include <logging/Logger.h>
+#include <profiling/Profiler.h>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <numeric>
+
+namespace Magma
+{
+    namespace
+    {
+        // Satisfies optimalBufferCopyOffsetAlignment on every common implementation
+        constexpr VkDeviceSize k_copyAlignment = 16;
+
+        uint64_t AlignUp(uint64_t value, uint64_t alignment)
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+    }
+
+    void StagingUploader::Initialize(VkDevice device, VmaAllocator allocator, const StagingUploaderSettings& settings)
+    {
+        assert(device != VK_NULL_HANDLE && "StagingUploader::Initialize() - VkDevice is null!");
+        assert(settings.transferQueueMutex && "StagingUploader::Initialize() - A queue mutex is required!");
+
+        m_device = device;
+        m_allocator = allocator;
+        m_settings = settings;
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = m_settings.ringSize;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VmaAllocationCreateInfo allocInfo{};
+        allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+        allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+        VmaAllocationInfo allocationResult{};
+        VK_CHECK(vmaCreateBuffer(m_allocator, &bufferInfo, &allocInfo, &m_ring.buffer, &m_ring.allocation, &allocationResult));
+
+        m_ring.size = m_settings.ringSize;
+        m_ring.mappedData = allocationResult.pMappedData;
+        m_ringData = static_cast<uint8_t*>(m_ring.mappedData);
+
+        VkSemaphoreTypeCreateInfo typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo = vkinit::semaphore_create_info();
+        semaphoreInfo.pNext = &typeInfo;
+        VK_CHECK(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_timeline));
+
+        m_head = 0;
+        m_tail = 0;
+        m_nextValue = 0;
+        m_lastReturnedValue = 0;
+        m_stats = StagingStats{};
+        m_windowStart = std::chrono::steady_clock::now();
+
+        MAGMA_LOG_INFO("[StagingUploader] {} MB ring, {} transfer queue",
+            m_settings.ringSize / (1024 * 1024), HasDedicatedTransferQueue() ? "dedicated" : "shared graphics");
+    }
+
+    void StagingUploader::Cleanup()
+    {
+        if (m_device == VK_NULL_HANDLE)
+        {
+            return;
+        }
+
+        std::lock_guard lock(m_mutex);
+
+        for (Batch& batch : m_batches)
+        {
+            vkDestroyCommandPool(m_device, batch.pool, nullptr);
+        }
+        m_batches.clear();
+
+        m_pendingBuffers.clear();
+        m_pendingImages.clear();
+        m_bufferAcquires.clear();
+        m_imageAcquires.clear();
+        m_layoutUpdates.clear();
+
+        vkDestroySemaphore(m_device, m_timeline, nullptr);
+        vmaDestroyBuffer(m_allocator, m_ring.buffer, m_ring.allocation);
+
+        m_timeline = VK_NULL_HANDLE;
+        m_ring = AllocatedBuffer{};
+        m_ringData = nullptr;
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool StagingUploader::UploadBuffer(const AllocatedBuffer& destination, VkDeviceSize destinationOffset, const void* data, VkDeviceSize size)
+    {
+        std::lock_guard lock(m_mutex);
+
+        uint64_t position = 0;
+        if (!Allocate(size, k_copyAlignment, position))
+        {
+            return false;
+        }
+
+        VkDeviceSize ringOffset = position % m_settings.ringSize;
+        std::memcpy(m_ringData + ringOffset, data, size);
+
+        VkBufferCopy region{};
+        region.srcOffset = ringOffset;
+        region.dstOffset = destinationOffset;
+        region.size = size;
+
+        m_pendingBuffers.push_back({ destination.buffer, region });
+        m_pendingBytes += size;
+        m_stats.pendingUploads = m_pendingBuffers.size() + m_pendingImages.size();
+        return true;
+    }
+
+    bool StagingUploader::UploadImage(std::shared_ptr<AllocatedImage> destination, const void* data, VkDeviceSize size, VkImageLayout finalLayout)
+    {
+        std::lock_guard lock(m_mutex);
+
+        // Buffer offsets of image copies must also be a multiple of the texel size
+        VkDeviceSize texelSize = std::max<VkDeviceSize>(vkutil::format_texel_size(destination->imageFormat), 1);
+        VkDeviceSize alignment = std::lcm(k_copyAlignment, texelSize);
+
+        uint64_t position = 0;
+        if (!Allocate(size, alignment, position))
+        {
+            return false;
+        }
+
+        VkDeviceSize ringOffset = position % m_settings.ringSize;
+        std::memcpy(m_ringData + ringOffset, data, size);
+
+        VkBufferImageCopy region{};
+        region.bufferOffset = ringOffset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = destination->imageExtent;
+
+        m_pendingImages.push_back({ std::move(destination), region, finalLayout });
+        m_pendingBytes += size;
+        m_stats.pendingUploads = m_pendingBuffers.size() + m_pendingImages.size();
+        return true;
+    }
+
+    uint64_t StagingUploader::Flush(VkCommandBuffer cmd)
+    {
+        std::lock_guard lock(m_mutex);
+
+        FlushLocked();
+        RecordAcquireBarriersLocked(cmd);
+
+        // Uploads may also have been flushed early by a stall, report those too
+        if (m_nextValue > m_lastReturnedValue)
+        {
+            m_lastReturnedValue = m_nextValue;
+            return m_nextValue;
+        }
+
+        return 0;
+    }
+
+    void StagingUploader::RecordAcquireBarriersLocked(VkCommandBuffer cmd)
+    {
+        if (!m_bufferAcquires.empty() || !m_imageAcquires.empty())
+        {
+            vkCmdPipelineBarrier(cmd,
+                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                0,
+                0, nullptr,
+                static_cast<uint32_t>(m_bufferAcquires.size()), m_bufferAcquires.data(),
+                static_cast<uint32_t>(m_imageAcquires.size()), m_imageAcquires.data());
+
+            m_bufferAcquires.clear();
+            m_imageAcquires.clear();
+        }
+
+        for (auto& [image, layout] : m_layoutUpdates)
+        {
+            image->currentLayout = layout;
+        }
+        m_layoutUpdates.clear();
+    }
+
+    uint64_t StagingUploader::FlushLocked()
+    {
+        if (m_pendingBuffers.empty() && m_pendingImages.empty())
+        {
+            return 0;
+        }
+
+        MAGMA_PROFILE_ZONE("StagingUploader::Flush");
+
+        Reclaim(GetCompletedValue());
+
+        Batch& batch = AcquireBatch();
+
+        VkCommandBufferBeginInfo cmdBeginInfo = vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+        VK_CHECK(vkBeginCommandBuffer(batch.commandBuffer, &cmdBeginInfo));
+        RecordCopies(batch.commandBuffer);
+        VK_CHECK(vkEndCommandBuffer(batch.commandBuffer));
+
+        batch.timelineValue = ++m_nextValue;
+        batch.ringEnd = m_head;
+
+        // synchronization2 is optional, so the timeline value is chained to a core submit
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &batch.timelineValue;
+
+        VkSubmitInfo submit{};
+        submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit.pNext = &timelineInfo;
+        submit.commandBufferCount = 1;
+        submit.pCommandBuffers = &batch.commandBuffer;
+        submit.signalSemaphoreCount = 1;
+        submit.pSignalSemaphores = &m_timeline;
+
+        {
+            std::lock_guard queueLock(*m_settings.transferQueueMutex);
+            VK_CHECK(vkQueueSubmit(m_settings.transferQueue, 1, &submit, VK_NULL_HANDLE));
+        }
+
+        m_stats.batchesSubmitted++;
+        m_stats.totalBytes += m_pendingBytes;
+        UpdateThroughput(m_pendingBytes);
+
+        m_pendingBuffers.clear();
+        m_pendingImages.clear();
+        m_pendingBytes = 0;
+        m_stats.pendingUploads = 0;
+
+        return batch.timelineValue;
+    }
+
+    void StagingUploader::RecordCopies(VkCommandBuffer cmd)
+    {
+        bool dedicated = HasDedicatedTransferQueue();
+
+        // Contents are discarded on first use, so no acquire from the graphics family is needed here
+        Vector<VkImageMemoryBarrier> toTransfer;
+        toTransfer.reserve(m_pendingImages.size());
+        for (const PendingImageCopy& copy : m_pendingImages)
+        {
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = copy.destination->image;
+            barrier.subresourceRange = vkinit::image_subresource_range(VK_IMAGE_ASPECT_COLOR_BIT);
+            toTransfer.push_back(barrier);
+        }
+
+        if (!toTransfer.empty())
+        {
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                0, nullptr, 0, nullptr, static_cast<uint32_t>(toTransfer.size()), toTransfer.data());
+        }
+
+        for (const PendingBufferCopy& copy : m_pendingBuffers)
+        {
+            vkCmdCopyBuffer(cmd, m_ring.buffer, copy.destination, 1, &copy.region);
+        }
+
+        for (const PendingImageCopy& copy : m_pendingImages)
+        {
+            vkCmdCopyBufferToImage(cmd, m_ring.buffer, copy.destination->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy.region);
+        }
+
+        // Release side of the ownership transfer, or the final transition on a shared queue
+        Vector<VkBufferMemoryBarrier> bufferReleases;
+        Vector<VkImageMemoryBarrier> imageReleases;
+
+        if (dedicated)
+        {
+            for (const PendingBufferCopy& copy : m_pendingBuffers)
+            {
+                VkBufferMemoryBarrier barrier{};
+                barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+                barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                barrier.dstAccessMask = 0;
+                barrier.srcQueueFamilyIndex = m_settings.transferQueueFamily;
+                barrier.dstQueueFamilyIndex = m_settings.graphicsQueueFamily;
+                barrier.buffer = copy.destination;
+                barrier.offset = copy.region.dstOffset;
+                barrier.size = copy.region.size;
+                bufferReleases.push_back(barrier);
+
+                barrier.srcAccessMask = 0;
+                barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+                m_bufferAcquires.push_back(barrier);
+            }
+        }
+
+        for (const PendingImageCopy& copy : m_pendingImages)
+        {
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = dedicated ? 0 : VK_ACCESS_MEMORY_READ_BIT;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout = copy.finalLayout;
+            barrier.srcQueueFamilyIndex = dedicated ? m_settings.transferQueueFamily : VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = dedicated ? m_settings.graphicsQueueFamily : VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = copy.destination->image;
+            barrier.subresourceRange = vkinit::image_subresource_range(VK_IMAGE_ASPECT_COLOR_BIT);
+            imageReleases.push_back(barrier);
+
+            if (dedicated)
+            {
+                barrier.srcAccessMask = 0;
+                barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+                m_imageAcquires.push_back(barrier);
+            }
+
+            m_layoutUpdates.emplace_back(copy.destination, copy.finalLayout);
+        }
+
+        if (!bufferReleases.empty() || !imageReleases.empty())
+        {
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                dedicated ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+                0, nullptr,
+                static_cast<uint32_t>(bufferReleases.size()), bufferReleases.data(),
+                static_cast<uint32_t>(imageReleases.size()), imageReleases.data());
+        }
+    }
+
+    bool StagingUploader::Allocate(VkDeviceSize size, VkDeviceSize alignment, uint64_t& outOffset)
+    {
+        if (size > m_settings.ringSize)
+        {
+            MAGMA_LOG_ERROR("[StagingUploader] Upload of {} bytes exceeds the {} byte ring", size, m_settings.ringSize);
+            return false;
+        }
+
+        bool stalled = false;
+
+        while (true)
+        {
+            uint64_t position = AlignUp(m_head, alignment);
+
+            // Allocations never straddle the end of the ring
+            uint64_t ringOffset = position % m_settings.ringSize;
+            if (ringOffset + size > m_settings.ringSize)
+            {
+                position += m_settings.ringSize - ringOffset;
+            }
+
+            if (position + size - m_tail <= m_settings.ringSize)
+            {
+                m_head = position + size;
+                outOffset = position;
+                return true;
+            }
+
+            Reclaim(GetCompletedValue());
+            if (position + size - m_tail <= m_settings.ringSize)
+            {
+                continue;
+            }
+
+            // The ring is full of data the GPU has not consumed yet, wait for the oldest batch
+            if (!stalled)
+            {
+                m_stats.stallCount++;
+                stalled = true;
+            }
+
+            FlushLocked();
+
+            uint64_t waitValue = 0;
+            for (const Batch& batch : m_batches)
+            {
+                if (batch.timelineValue > GetCompletedValue() && (waitValue == 0 || batch.timelineValue < waitValue))
+                {
+                    waitValue = batch.timelineValue;
+                }
+            }
+
+            if (waitValue == 0)
+            {
+                // Nothing in flight, so everything between tail and head is reclaimable
+                m_tail = m_head;
+                continue;
+            }
+
+            MAGMA_PROFILE_ZONE("StagingUploader stall");
+
+            VkSemaphoreWaitInfo waitInfo{};
+            waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+            waitInfo.semaphoreCount = 1;
+            waitInfo.pSemaphores = &m_timeline;
+            waitInfo.pValues = &waitValue;
+            VK_CHECK(vkWaitSemaphores(m_device, &waitInfo, UINT64_MAX));
+        }
+    }
+
+    void StagingUploader::Reclaim(uint64_t completedValue)
+    {
+        for (const Batch& batch : m_batches)
+        {
+            if (batch.timelineValue != 0 && batch.timelineValue <= completedValue)
+            {
+                m_tail = std::max(m_tail, batch.ringEnd);
+            }
+        }
+    }
+
+    uint64_t StagingUploader::GetCompletedValue() const
+    {
+        uint64_t value = 0;
+        VK_CHECK(vkGetSemaphoreCounterValue(m_device, m_timeline, &value));
+        return value;
+    }
+
+    StagingUploader::Batch& StagingUploader::AcquireBatch()
+    {
+        uint64_t completedValue = GetCompletedValue();
+
+        for (Batch& batch : m_batches)
+        {
+            if (batch.timelineValue <= completedValue)
+            {
+                VK_CHECK(vkResetCommandPool(m_device, batch.pool, 0));
+                return batch;
+            }
+        }
+
+        Batch batch;
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = m_settings.transferQueueFamily;
+        VK_CHECK(vkCreateCommandPool(m_device, &poolInfo, nullptr, &batch.pool));
+
+        VkCommandBufferAllocateInfo allocInfo = vkinit::command_buffer_allocate_info(batch.pool, 1);
+        VK_CHECK(vkAllocateCommandBuffers(m_device, &allocInfo, &batch.commandBuffer));
+
+        m_batches.push_back(batch);
+        return m_batches.back();
+    }
+
+    void StagingUploader::UpdateThroughput(VkDeviceSize bytes)
+    {
+        m_windowBytes += bytes;
+
+        auto now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - m_windowStart).count();
+        if (seconds >= 1.0)
+        {
+            m_stats.throughputMBps = static_cast<double>(m_windowBytes) / (1024.0 * 1024.0) / seconds;
+            m_windowBytes = 0;
+            m_windowStart = now;
+        }
+    }
+}
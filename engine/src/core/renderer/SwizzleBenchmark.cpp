@@ -0,0 +1,123 @@
+#include <magma_engine/core/renderer/SwizzleBenchmark.h>
+#include <logging/Logger.h>
+#include <algorithm>
+
+namespace Magma
+{
+    namespace
+    {
+        const char* DispatchSwizzleToString(DispatchSwizzle swizzle)
+        {
+            switch (swizzle)
+            {
+                case DispatchSwizzle::NONE: return "row-major";
+                case DispatchSwizzle::TILE_STRIPS: return "tile strips";
+                case DispatchSwizzle::MORTON: return "Morton";
+                default: return "unknown";
+            }
+        }
+    }
+
+    void SwizzleBenchmark::Start(RenderGraph& graph, uint32_t framesInFlight, uint32_t framesPerMode, uint32_t samplesPerMode)
+    {
+        m_stageIndices.clear();
+        m_results.clear();
+
+        uint32_t stageIndex = 0;
+        for (auto* stage : graph)
+        {
+            if (stage->HasDispatchSwizzle())
+            {
+                m_stageIndices.push_back(stageIndex);
+                m_results.push_back({ stage->GetStageName(), stage->GetConfiguration().GetComputeConfig().swizzle });
+            }
+            stageIndex++;
+        }
+
+        if (m_stageIndices.empty())
+        {
+            MAGMA_LOG_WARNING("[SwizzleBenchmark] No stage has a dispatch swizzle, nothing to compare");
+            return;
+        }
+
+        m_framesPerMode = std::max(framesPerMode, 1u);
+        m_samplesPerMode = std::max(samplesPerMode, 1u);
+        m_frame = 0;
+        m_slotSwizzled.assign(framesInFlight, std::nullopt);
+        m_running = true;
+
+        MAGMA_LOG_INFO("[SwizzleBenchmark] Comparing {} stage(s), {} frame(s) per order", m_stageIndices.size(), m_framesPerMode);
+    }
+
+    void SwizzleBenchmark::Stop(RenderGraph& graph)
+    {
+        for (auto* stage : graph)
+        {
+            stage->SetDispatchSwizzleEnabled(true);
+        }
+
+        m_running = false;
+    }
+
+    void SwizzleBenchmark::Update(RenderGraph& graph, uint32_t frameIndex, const StageProfiler& profiler, bool hasStats)
+    {
+        if (!m_running || frameIndex >= m_slotSwizzled.size())
+        {
+            return;
+        }
+
+        if (hasStats && m_slotSwizzled[frameIndex].has_value())
+        {
+            bool swizzled = *m_slotSwizzled[frameIndex];
+            for (size_t i = 0; i < m_stageIndices.size(); i++)
+            {
+                const StageGpuStats& stats = profiler.GetStageStats(m_stageIndices[i]);
+                if (!stats.valid || stats.gpuTimeMs <= 0.0)
+                {
+                    continue;
+                }
+
+                SwizzleBenchmarkResult& result = m_results[i];
+                (swizzled ? result.swizzledMs : result.rowMajorMs) += stats.gpuTimeMs;
+                (swizzled ? result.swizzledSamples : result.rowMajorSamples)++;
+            }
+        }
+
+        bool done = std::all_of(m_results.begin(), m_results.end(), [this](const SwizzleBenchmarkResult& result) {
+            return result.rowMajorSamples >= m_samplesPerMode && result.swizzledSamples >= m_samplesPerMode;
+        });
+        if (done)
+        {
+            Finish(graph);
+            return;
+        }
+
+        // Blocks of frames rather than alternating every frame, so caches settle into each order
+        bool swizzled = (m_frame++ / m_framesPerMode) % 2 == 1;
+        m_slotSwizzled[frameIndex] = swizzled;
+
+        uint32_t stageIndex = 0;
+        for (auto* stage : graph)
+        {
+            if (std::find(m_stageIndices.begin(), m_stageIndices.end(), stageIndex) != m_stageIndices.end())
+            {
+                stage->SetDispatchSwizzleEnabled(swizzled);
+            }
+            stageIndex++;
+        }
+    }
+
+    void SwizzleBenchmark::Finish(RenderGraph& graph)
+    {
+        Stop(graph);
+
+        for (SwizzleBenchmarkResult& result : m_results)
+        {
+            result.rowMajorMs /= std::max(result.rowMajorSamples, 1u);
+            result.swizzledMs /= std::max(result.swizzledSamples, 1u);
+
+            MAGMA_LOG_INFO("[SwizzleBenchmark] {}: row-major {:.3f} ms, {} {:.3f} ms ({:.2f}x)",
+                result.stageName, result.rowMajorMs, DispatchSwizzleToString(result.swizzle), result.swizzledMs, result.GetSpeedup());
+        }
+    }
+}
@@ -3,11 +3,17 @@
 #include <magma_engine/core/renderer/VkInitializers.h>
 
 void Magma::vkutil::transition_image(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout)
+{
+	transition_image(cmd, image, currentLayout, newLayout, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+}
+
+void Magma::vkutil::transition_image(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout,
+	VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask)
 {
 	VkImageMemoryBarrier imageBarrier {.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
 	imageBarrier.pNext = nullptr;
 
-	imageBarrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+	imageBarrier.srcAccessMask = srcStageMask == VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT ? 0 : VK_ACCESS_MEMORY_WRITE_BIT;
 	imageBarrier.dstAccessMask = VK_ACCESS_MEMORY_WRITE_BIT | VK_ACCESS_MEMORY_READ_BIT;
 
 	imageBarrier.oldLayout = currentLayout;
@@ -20,14 +26,61 @@ void Magma::vkutil::transition_image(VkCommandBuffer cmd, VkImage image, VkImage
 	imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 
 	vkCmdPipelineBarrier(cmd,
-		VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,  // srcStageMask
-		VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,  // dstStageMask
+		srcStageMask,                         // srcStageMask
+		dstStageMask,                         // dstStageMask
 		0,                                    // dependencyFlags
 		0, nullptr,                          // memory barriers
 		0, nullptr,                          // buffer barriers
 		1, &imageBarrier);                   // image barriers
 }
 
+void Magma::vkutil::shader_write_barrier(VkCommandBuffer cmd, bool indirectCommandRead)
+{
+	VkMemoryBarrier memoryBarrier {.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+	memoryBarrier.pNext = nullptr;
+
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT |
+		VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+	VkPipelineStageFlags shaderStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+
+	VkPipelineStageFlags dstStages = shaderStages;
+	if (indirectCommandRead)
+	{
+		memoryBarrier.dstAccessMask |= VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		dstStages |= VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+	}
+
+	vkCmdPipelineBarrier(cmd,
+		shaderStages,                         // srcStageMask
+		dstStages,                            // dstStageMask
+		0,                                    // dependencyFlags
+		1, &memoryBarrier,                   // memory barriers
+		0, nullptr,                          // buffer barriers
+		0, nullptr);                         // image barriers
+}
+
+void Magma::vkutil::transfer_write_barrier(VkCommandBuffer cmd)
+{
+	VkMemoryBarrier memoryBarrier {.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+	memoryBarrier.pNext = nullptr;
+
+	memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+	vkCmdPipelineBarrier(cmd,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,       // srcStageMask
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, // dstStageMask
+		0,                                    // dependencyFlags
+		1, &memoryBarrier,                   // memory barriers
+		0, nullptr,                          // buffer barriers
+		0, nullptr);                         // image barriers
+}
+
 void Magma::vkutil::copy_image_to_image(VkCommandBuffer cmd, VkImage source, VkImage destination, VkExtent2D srcSize, VkExtent2D dstSize, PFN_vkCmdBlitImage2KHR vkCmdBlitImage2Func)
 {
 	VkImageBlit2 blitRegion{ .sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2, .pNext = nullptr };
@@ -63,3 +116,40 @@ void Magma::vkutil::copy_image_to_image(VkCommandBuffer cmd, VkImage source, VkI
 
 	vkCmdBlitImage2Func(cmd, &blitInfo);
 }
+
+
+uint32_t Magma::vkutil::format_texel_size(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_R8_UNORM:
+	case VK_FORMAT_R8_UINT:
+		return 1;
+	case VK_FORMAT_R8G8_UNORM:
+	case VK_FORMAT_R16_SFLOAT:
+	case VK_FORMAT_R16_UINT:
+	case VK_FORMAT_D16_UNORM:
+		return 2;
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:
+	case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+	case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+	case VK_FORMAT_R16G16_SFLOAT:
+	case VK_FORMAT_R32_SFLOAT:
+	case VK_FORMAT_R32_UINT:
+	case VK_FORMAT_D32_SFLOAT:
+	case VK_FORMAT_D24_UNORM_S8_UINT:
+		return 4;
+	case VK_FORMAT_R16G16B16A16_SFLOAT:
+	case VK_FORMAT_R16G16B16A16_UNORM:
+	case VK_FORMAT_R32G32_SFLOAT:
+		return 8;
+	case VK_FORMAT_R32G32B32A32_SFLOAT:
+	case VK_FORMAT_R32G32B32A32_UINT:
+		return 16;
+	default:
+		return 0;
+	}
+}
@@ -0,0 +1,370 @@
+#include <magma_engine/core/renderer/WorkgroupTuner.h>
+#include <logging/Logger.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace Magma
+{
+    namespace
+    {
+        constexpr const char* k_CacheHeader = "# Magma workgroup tuning cache v1";
+
+        // Shapes tried for 2D image stages, filtered by the device limits
+        constexpr uint32_t k_CandidateSizes[][2] = {
+            { 8, 8 }, { 16, 8 }, { 8, 16 }, { 16, 16 }, { 32, 8 }, { 32, 16 }, { 32, 32 }
+        };
+    }
+
+    void WorkgroupTuner::Initialize(const ComputeDeviceInfo& computeInfo, const WorkgroupTunerSettings& settings)
+    {
+        m_computeInfo = computeInfo;
+        m_settings = settings;
+        m_cache.clear();
+
+        LoadCache();
+    }
+
+    void WorkgroupTuner::ApplyCachedSizes(RenderGraph& graph) const
+    {
+        for (auto* stage : graph)
+        {
+            if (!IsTunable(*stage))
+            {
+                continue;
+            }
+
+            auto entry = m_cache.find(GetCacheKey(*stage));
+            if (entry == m_cache.end())
+            {
+                continue;
+            }
+
+            StageConfiguration config = stage->GetConfiguration();
+            ComputeConfig computeConfig = config.GetComputeConfig();
+            computeConfig.workgroupSizeX = entry->second.workgroupSizeX;
+            computeConfig.workgroupSizeY = entry->second.workgroupSizeY;
+            computeConfig.workgroupSizeZ = entry->second.workgroupSizeZ;
+            computeConfig.requiredSubgroupSize = entry->second.requiredSubgroupSize;
+            config.pipelineConfig = computeConfig;
+            stage->UpdateConfiguration(config);
+        }
+    }
+
+    void WorkgroupTuner::Start(RenderGraph& graph, uint32_t framesInFlight)
+    {
+        if (!m_settings.enableTuning)
+        {
+            return;
+        }
+
+        m_stages.clear();
+        m_candidateCount = 0;
+
+        uint32_t stageIndex = 0;
+        for (auto* stage : graph)
+        {
+            String cacheKey = GetCacheKey(*stage);
+            if (!IsTunable(*stage) || m_cache.count(cacheKey) > 0)
+            {
+                stageIndex++;
+                continue;
+            }
+
+            Vector<ComputeConfig> candidates = GetCandidates(stage->GetConfiguration().GetComputeConfig());
+
+            bool created = stage->GetWorkgroupVariantCount() == 0;
+            for (const ComputeConfig& candidate : candidates)
+            {
+                created = created && stage->AddWorkgroupVariant(candidate);
+            }
+
+            // Candidates line up with the variants, a stage missing one is left as configured
+            if (!created)
+            {
+                MAGMA_LOG_WARNING("[WorkgroupTuner] Skipping stage '{}'", stage->GetStageName());
+                stageIndex++;
+                continue;
+            }
+
+            TuningStage& tuningStage = m_stages.emplace_back();
+            tuningStage.stageIndex = stageIndex;
+            tuningStage.cacheKey = cacheKey;
+            tuningStage.gpuTimeMs.assign(candidates.size(), 0.0);
+            tuningStage.samples.assign(candidates.size(), 0);
+
+            m_candidateCount = static_cast<uint32_t>(candidates.size());
+            stageIndex++;
+        }
+
+        if (m_stages.empty())
+        {
+            return;
+        }
+
+        m_frame = 0;
+        m_slotCandidate.assign(framesInFlight, std::nullopt);
+        m_running = true;
+
+        MAGMA_LOG_INFO("[WorkgroupTuner] Tuning {} stage(s) over {} candidate(s)", m_stages.size(), m_candidateCount);
+    }
+
+    void WorkgroupTuner::Update(RenderGraph& graph, uint32_t frameIndex, const StageProfiler& profiler, bool hasStats)
+    {
+        if (!m_running || frameIndex >= m_slotCandidate.size())
+        {
+            return;
+        }
+
+        if (hasStats && m_slotCandidate[frameIndex].has_value())
+        {
+            uint32_t candidate = *m_slotCandidate[frameIndex];
+            for (TuningStage& tuningStage : m_stages)
+            {
+                const StageGpuStats& stats = profiler.GetStageStats(tuningStage.stageIndex);
+                if (stats.valid && stats.gpuTimeMs > 0.0)
+                {
+                    tuningStage.gpuTimeMs[candidate] += stats.gpuTimeMs;
+                    tuningStage.samples[candidate]++;
+                }
+            }
+        }
+
+        uint32_t framesPerCandidate = m_settings.warmupFrames + std::max(m_settings.samplesPerCandidate, 1u);
+        uint32_t candidate = m_frame / framesPerCandidate;
+        bool warmingUp = m_frame % framesPerCandidate < m_settings.warmupFrames;
+        m_frame++;
+
+        // Back to the configured pipelines until the slots recorded with the last candidate reported back
+        if (candidate >= m_candidateCount)
+        {
+            SelectCandidate(graph, std::nullopt);
+            m_slotCandidate[frameIndex] = std::nullopt;
+
+            bool pending = std::any_of(m_slotCandidate.begin(), m_slotCandidate.end(),
+                [](const std::optional<uint32_t>& slotCandidate) { return slotCandidate.has_value(); });
+            if (!pending)
+            {
+                Finish(graph);
+            }
+            return;
+        }
+
+        SelectCandidate(graph, candidate);
+        m_slotCandidate[frameIndex] = warmingUp ? std::nullopt : std::optional<uint32_t>(candidate);
+    }
+
+    bool WorkgroupTuner::SaveCache() const
+    {
+        if (m_settings.cachePath.empty())
+        {
+            return false;
+        }
+
+        std::ofstream file(m_settings.cachePath, std::ios::trunc);
+        if (!file.is_open())
+        {
+            MAGMA_LOG_ERROR("[WorkgroupTuner] Failed to write tuning cache: {}", m_settings.cachePath);
+            return false;
+        }
+
+        file << k_CacheHeader << "\n";
+        for (const auto& [key, entry] : m_cache)
+        {
+            file << key << "\t" << entry.workgroupSizeX << "\t" << entry.workgroupSizeY << "\t" << entry.workgroupSizeZ
+                << "\t" << entry.requiredSubgroupSize << "\t" << entry.gpuTimeMs << "\n";
+        }
+
+        return true;
+    }
+
+    Vector<ComputeConfig> WorkgroupTuner::GetCandidates(const ComputeConfig& baseConfig) const
+    {
+        Vector<uint32_t> subgroupSizes = { 0 };
+        if (m_computeInfo.subgroupSizeControl && m_computeInfo.minSubgroupSize < m_computeInfo.maxSubgroupSize)
+        {
+            subgroupSizes.push_back(m_computeInfo.minSubgroupSize);
+            subgroupSizes.push_back(m_computeInfo.maxSubgroupSize);
+        }
+
+        Vector<ComputeConfig> candidates;
+        for (const auto& size : k_CandidateSizes)
+        {
+            uint32_t invocations = size[0] * size[1];
+            if (invocations > m_computeInfo.maxWorkgroupInvocations ||
+                size[0] > m_computeInfo.maxWorkgroupSize[0] || size[1] > m_computeInfo.maxWorkgroupSize[1])
+            {
+                continue;
+            }
+
+            for (uint32_t subgroupSize : subgroupSizes)
+            {
+                // Partial subgroups would leave lanes idle in every workgroup
+                if (subgroupSize != 0 && invocations % subgroupSize != 0)
+                {
+                    continue;
+                }
+
+                ComputeConfig candidate = baseConfig;
+                candidate.workgroupSizeX = size[0];
+                candidate.workgroupSizeY = size[1];
+                candidate.workgroupSizeZ = 1;
+                candidate.requiredSubgroupSize = subgroupSize;
+                candidates.push_back(candidate);
+            }
+        }
+
+        return candidates;
+    }
+
+    String WorkgroupTuner::GetCacheKey(const RenderStage& stage) const
+    {
+        const StageConfiguration& config = stage.GetConfiguration();
+
+        std::ostringstream key;
+        key << std::hex << m_computeInfo.vendorID << ":" << m_computeInfo.deviceID << ":" << m_computeInfo.driverVersion
+            << std::dec << "\t" << config.name << "\t" << (config.shaders.empty() ? String() : config.shaders[0].path);
+        return key.str();
+    }
+
+    bool WorkgroupTuner::IsTunable(const RenderStage& stage) const
+    {
+        // Producers of indirect arguments count groups of the size the stage was written for
+        const StageConfiguration& config = stage.GetConfiguration();
+        return config.IsCompute() && config.GetComputeConfig().tuneWorkgroupSize && !config.GetComputeConfig().IsIndirect();
+    }
+
+    void WorkgroupTuner::SelectCandidate(RenderGraph& graph, std::optional<uint32_t> candidate)
+    {
+        uint32_t stageIndex = 0;
+        auto tuningStage = m_stages.begin();
+        for (auto* stage : graph)
+        {
+            if (tuningStage != m_stages.end() && tuningStage->stageIndex == stageIndex)
+            {
+                stage->SelectWorkgroupVariant(candidate);
+                ++tuningStage;
+            }
+            stageIndex++;
+        }
+    }
+
+    void WorkgroupTuner::Finish(RenderGraph& graph)
+    {
+        m_running = false;
+
+        uint32_t stageIndex = 0;
+        auto tuningStage = m_stages.begin();
+        for (auto* stage : graph)
+        {
+            if (tuningStage == m_stages.end())
+            {
+                break;
+            }
+
+            if (tuningStage->stageIndex != stageIndex++)
+            {
+                continue;
+            }
+
+            std::optional<uint32_t> best;
+            double bestTimeMs = 0.0;
+            for (uint32_t i = 0; i < m_candidateCount; i++)
+            {
+                if (tuningStage->samples[i] == 0)
+                {
+                    continue;
+                }
+
+                double timeMs = tuningStage->gpuTimeMs[i] / tuningStage->samples[i];
+                if (!best || timeMs < bestTimeMs)
+                {
+                    best = i;
+                    bestTimeMs = timeMs;
+                }
+            }
+
+            if (best)
+            {
+                stage->CommitWorkgroupVariant(*best);
+
+                const ComputeConfig& computeConfig = stage->GetConfiguration().GetComputeConfig();
+                m_cache[tuningStage->cacheKey] = {
+                    computeConfig.workgroupSizeX,
+                    computeConfig.workgroupSizeY,
+                    computeConfig.workgroupSizeZ,
+                    computeConfig.requiredSubgroupSize,
+                    bestTimeMs
+                };
+
+                MAGMA_LOG_INFO("[WorkgroupTuner] {}: {}x{}, subgroup size {}, {:.3f} ms", stage->GetStageName(),
+                    computeConfig.workgroupSizeX, computeConfig.workgroupSizeY, computeConfig.requiredSubgroupSize, bestTimeMs);
+            }
+            else
+            {
+                MAGMA_LOG_WARNING("[WorkgroupTuner] No timings for stage '{}', keeping its size", stage->GetStageName());
+                stage->ReleaseWorkgroupVariants();
+            }
+
+            ++tuningStage;
+        }
+
+        SaveCache();
+    }
+
+    void WorkgroupTuner::LoadCache()
+    {
+        if (m_settings.cachePath.empty())
+        {
+            return;
+        }
+
+        std::ifstream file(m_settings.cachePath);
+        if (!file.is_open())
+        {
+            return;
+        }
+
+        String line;
+        std::getline(file, line);
+        if (line != k_CacheHeader)
+        {
+            MAGMA_LOG_WARNING("[WorkgroupTuner] Ignoring tuning cache in an unknown format: {}", m_settings.cachePath);
+            return;
+        }
+
+        while (std::getline(file, line))
+        {
+            // Device, stage name and shader make up the key
+            Vector<String> fields;
+            std::istringstream lineStream(line);
+            for (String field; std::getline(lineStream, field, '\t');)
+            {
+                fields.push_back(field);
+            }
+
+            if (fields.size() != 8)
+            {
+                continue;
+            }
+
+            try
+            {
+                WorkgroupTuningEntry entry;
+                entry.workgroupSizeX = static_cast<uint32_t>(std::stoul(fields[3]));
+                entry.workgroupSizeY = static_cast<uint32_t>(std::stoul(fields[4]));
+                entry.workgroupSizeZ = static_cast<uint32_t>(std::stoul(fields[5]));
+                entry.requiredSubgroupSize = static_cast<uint32_t>(std::stoul(fields[6]));
+                entry.gpuTimeMs = std::stod(fields[7]);
+
+                m_cache[fields[0] + "\t" + fields[1] + "\t" + fields[2]] = entry;
+            }
+            catch (const std::exception&)
+            {
+                MAGMA_LOG_WARNING("[WorkgroupTuner] Skipping malformed tuning cache line");
+            }
+        }
+
+        MAGMA_LOG_INFO("[WorkgroupTuner] Loaded {} tuned stage(s) from {}", m_cache.size(), m_settings.cachePath);
+    }
+}